@@ -0,0 +1,54 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <utility>
+#include <vector>
+
+// Keeps the capacity best values pushed into it. better(lhs, rhs) must be a strict
+// ordering where lhs ranks before rhs. The worst kept value sits at the top of the heap,
+// so a value that does not make it costs one comparison.
+template <typename T, typename Better>
+class BoundedHeap {
+public:
+    BoundedHeap(size_t capacity, Better better)
+        : capacity_(capacity)
+        , better_(better) {
+    }
+
+    void Push(T value) {
+        if (values_.size() < capacity_) {
+            values_.push_back(std::move(value));
+            std::push_heap(values_.begin(), values_.end(), better_);
+        }
+        else if (capacity_ > 0 && better_(value, values_.front())) {
+            std::pop_heap(values_.begin(), values_.end(), better_);
+            values_.back() = std::move(value);
+            std::push_heap(values_.begin(), values_.end(), better_);
+        }
+    }
+
+    size_t size() const {
+        return values_.size();
+    }
+
+    bool IsFull() const {
+        return values_.size() >= capacity_;
+    }
+
+    // the value a newcomer has to beat, the heap must not be empty
+    const T& GetWorst() const {
+        return values_.front();
+    }
+
+    // the kept values, best first
+    std::vector<T> TakeSorted() && {
+        std::sort_heap(values_.begin(), values_.end(), better_);
+        return std::move(values_);
+    }
+
+private:
+    size_t capacity_;
+    Better better_;
+    std::vector<T> values_;
+};
@@ -1,58 +1,241 @@
-﻿#include <algorithm>
+﻿#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
 #include <cstdlib>
-#include <map>
-#include <vector>
 #include <mutex>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
 
 using namespace std::string_literals;
 
+// Test-and-test-and-set lock, cheaper than std::mutex for the short critical sections below
+class SpinLock {
+public:
+    void lock() {
+        for (int spins = 0; locked_.exchange(true, std::memory_order_acquire); ++spins) {
+            while (locked_.load(std::memory_order_relaxed)) {
+                if (++spins > 64) {
+                    std::this_thread::yield();
+                }
+            }
+        }
+    }
+
+    void unlock() {
+        locked_.store(false, std::memory_order_release);
+    }
+
+private:
+    std::atomic<bool> locked_ = false;
+};
+
+// Hash map striped into independently locked buckets. Every bucket is an open addressing
+// table with linear probing and sits on its own cache line, so threads working on
+// different buckets do not share lines.
 template <typename Key, typename Value>
 class ConcurrentMap {
 public:
     static_assert(std::is_integral_v<Key>, "ConcurrentMap supports only integer keys"s);
 
+    struct Slot {
+        Key key;
+        Value value;
+        bool used;
+    };
+
+    class Bucket {
+    public:
+        Value& operator[](const Key& key);
+
+        void Erase(const Key& key);
+
+        template <typename Func>
+        void ForEach(Func&& func);
+
+        void Clear();
+
+        size_t Size() const {
+            return size_;
+        }
+
+    private:
+        std::vector<Slot> slots_;
+        size_t size_ = 0;
+
+        size_t Home(const Key& key) const {
+            return static_cast<size_t>(ConcurrentMap::Hash(key) >> 32) & (slots_.size() - 1);
+        }
+
+        void Grow();
+    };
 
     struct Access {    
-        std::lock_guard<std::mutex> guard_;
+        std::lock_guard<SpinLock> guard_;
         Value& ref_to_value;
-        Access(std::pair<std::map<Key, Value>, std::mutex>& map, const Key& key) :
-            guard_(map.second), ref_to_value(map.first[key]) {}
+        Access(SpinLock& lock, Bucket& bucket, const Key& key) :
+            guard_(lock), ref_to_value(bucket[key]) {}
     };
 
-    explicit ConcurrentMap(size_t bucket_count) : buckets_(bucket_count), bucket_count_(bucket_count) {};
+    explicit ConcurrentMap(size_t bucket_count) : buckets_(std::max<size_t>(bucket_count, 1)), bucket_count_(buckets_.size()) {};
 
     Access operator[](const Key& key);
 
-    void Erase(const Key& key) {
-        uint64_t tmp_key = static_cast<uint64_t>(key) % bucket_count_;        
-        buckets_[tmp_key].first.erase(key);
-    }
+    void Erase(const Key& key);
+
+    // Calls func(key, value) for every entry without copying the map. Buckets are locked
+    // one at a time, so entries changed concurrently may or may not be seen.
+    template <typename Func>
+    void ForEach(Func func);
+
+    // Same as ForEach but passes the values as rvalues and leaves the map empty
+    template <typename Func>
+    void Drain(Func func);
 
-    std::map<Key, Value> BuildOrdinaryMap();
+    size_t Size();
 
 private:
-    std::vector<std::pair<std::map<Key, Value>, std::mutex>> buckets_;
+    struct alignas(64) PaddedBucket {
+        SpinLock lock;
+        Bucket bucket;
+    };
+
+    std::vector<PaddedBucket> buckets_;
     const size_t bucket_count_;
+
+    static uint64_t Hash(const Key& key) {
+        uint64_t x = static_cast<uint64_t>(key);
+        x ^= x >> 33;
+        x *= 0xff51afd7ed558ccdULL;
+        x ^= x >> 33;
+        return x;
+    }
+
+    PaddedBucket& GetBucket(const Key& key) {
+        return buckets_[Hash(key) % bucket_count_];
+    }
 };
 
+template<typename Key, typename Value>
+Value& ConcurrentMap<Key, Value>::Bucket::operator[](const Key& key) {
+    if ((size_ + 1) * 2 > slots_.size()) {
+        Grow();
+    }
+    const size_t mask = slots_.size() - 1;
+    for (size_t i = Home(key);; i = (i + 1) & mask) {
+        if (!slots_[i].used) {
+            slots_[i] = { key, Value(), true };
+            ++size_;
+            return slots_[i].value;
+        }
+        if (slots_[i].key == key) {
+            return slots_[i].value;
+        }
+    }
+}
+
+template<typename Key, typename Value>
+void ConcurrentMap<Key, Value>::Bucket::Erase(const Key& key) {
+    if (size_ == 0) {
+        return;
+    }
+    const size_t mask = slots_.size() - 1;
+    size_t hole = Home(key);
+    while (slots_[hole].used && slots_[hole].key != key) {
+        hole = (hole + 1) & mask;
+    }
+    if (!slots_[hole].used) {
+        return;
+    }
+    slots_[hole].used = false;
+    --size_;
+    // backward shift deletion: pull later entries of the probe chain into the hole
+    for (size_t next = (hole + 1) & mask; slots_[next].used; next = (next + 1) & mask) {
+        const size_t home = Home(slots_[next].key);
+        const bool reachable = hole <= next ? (home <= hole || home > next) : (home <= hole && home > next);
+        if (reachable) {
+            slots_[hole] = std::move(slots_[next]);
+            slots_[next].used = false;
+            hole = next;
+        }
+    }
+}
+
+template<typename Key, typename Value>
+template <typename Func>
+void ConcurrentMap<Key, Value>::Bucket::ForEach(Func&& func) {
+    for (Slot& slot : slots_) {
+        if (slot.used) {
+            func(slot.key, slot.value);
+        }
+    }
+}
+
+template<typename Key, typename Value>
+void ConcurrentMap<Key, Value>::Bucket::Clear() {
+    slots_.clear();
+    size_ = 0;
+}
+
+template<typename Key, typename Value>
+void ConcurrentMap<Key, Value>::Bucket::Grow() {
+    std::vector<Slot> old_slots(std::max<size_t>(slots_.size() * 2, 8), Slot{ Key(), Value(), false });
+    old_slots.swap(slots_);
+    size_ = 0;
+    for (Slot& slot : old_slots) {
+        if (slot.used) {
+            (*this)[slot.key] = std::move(slot.value);
+        }
+    }
+}
+
 template<typename Key, typename Value>
 typename ConcurrentMap<Key, Value>::Access
 ConcurrentMap<Key, Value>::operator[](const Key& key) {
-    auto bucket = static_cast<uint64_t>(key) % bucket_count_;
-    return Access(buckets_[bucket], key);
+    PaddedBucket& padded = GetBucket(key);
+    return Access(padded.lock, padded.bucket, key);
 }
 
 template<typename Key, typename Value>
-std::map<Key, Value> ConcurrentMap<Key, Value>::BuildOrdinaryMap() {
-    std::map<Key, Value> result;
-    for (auto bucket = 0; bucket < bucket_count_; ++bucket) {
-        buckets_[bucket].second.lock();
+void ConcurrentMap<Key, Value>::Erase(const Key& key) {
+    PaddedBucket& padded = GetBucket(key);
+    std::lock_guard guard(padded.lock);
+    padded.bucket.Erase(key);
+}
+
+template<typename Key, typename Value>
+template <typename Func>
+void ConcurrentMap<Key, Value>::ForEach(Func func) {
+    for (PaddedBucket& padded : buckets_) {
+        std::lock_guard guard(padded.lock);
+        padded.bucket.ForEach([&func](const Key& key, Value& value) {
+            func(key, value);
+            });
     }
-    for (auto bucket = 0; bucket < bucket_count_; ++bucket) {
-        result.insert(buckets_[bucket].first.begin(), buckets_[bucket].first.end());
+}
+
+template<typename Key, typename Value>
+template <typename Func>
+void ConcurrentMap<Key, Value>::Drain(Func func) {
+    for (PaddedBucket& padded : buckets_) {
+        std::lock_guard guard(padded.lock);
+        padded.bucket.ForEach([&func](const Key& key, Value& value) {
+            func(key, std::move(value));
+            });
+        padded.bucket.Clear();
     }
-    for (auto bucket = 0; bucket < bucket_count_; ++bucket) {
-        buckets_[bucket].second.unlock();
+}
+
+template<typename Key, typename Value>
+size_t ConcurrentMap<Key, Value>::Size() {
+    size_t size = 0;
+    for (PaddedBucket& padded : buckets_) {
+        std::lock_guard guard(padded.lock);
+        size += padded.bucket.Size();
     }
-    return result;
+    return size;
 }
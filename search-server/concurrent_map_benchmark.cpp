@@ -0,0 +1,54 @@
+#include "concurrent_map_benchmark.h"
+#include "concurrent_map.h"
+#include <chrono>
+#include <random>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+namespace {
+
+const int OPERATION_COUNT = 1 << 22;
+
+double MeasureScatterAdd(int thread_count, int key_count) {
+    ConcurrentMap<int, double> map(thread::hardware_concurrency());
+    const int operations_per_thread = OPERATION_COUNT / thread_count;
+
+    const auto start = chrono::steady_clock::now();
+    vector<thread> threads;
+    threads.reserve(thread_count);
+    for (int t = 0; t < thread_count; ++t) {
+        threads.emplace_back([&map, operations_per_thread, key_count, t]() {
+            mt19937 generator(t);
+            uniform_int_distribution<int> key_distribution(0, key_count - 1);
+            for (int i = 0; i < operations_per_thread; ++i) {
+                map[key_distribution(generator)].ref_to_value += 1.0;
+                if (i % 16 == 0) {
+                    map.Erase(key_distribution(generator));
+                }
+            }
+            });
+    }
+    for (thread& worker : threads) {
+        worker.join();
+    }
+    double total = 0;
+    map.ForEach([&total](int, double value) {
+        total += value;
+        });
+    const auto duration = chrono::steady_clock::now() - start;
+    return chrono::duration<double, nano>(duration).count() / (operations_per_thread * thread_count);
+}
+
+}
+
+void BenchmarkConcurrentMap(ostream& out) {
+    for (const int key_count : { 1'000, 1'000'000 }) {
+        for (const int thread_count : { 1, 4, 16, 64 }) {
+            out << "ConcurrentMap keys="sv << key_count << " threads="sv << thread_count << ": "sv
+                << MeasureScatterAdd(thread_count, key_count) << " ns/op"sv << endl;
+        }
+    }
+}
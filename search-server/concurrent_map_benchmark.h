@@ -0,0 +1,7 @@
+#pragma once
+
+#include <iostream>
+
+// Scatter-add contention benchmark of ConcurrentMap at 1, 4, 16 and 64 threads
+// over a hot (few keys) and a cold (many keys) key range.
+void BenchmarkConcurrentMap(std::ostream& out = std::cerr);
@@ -0,0 +1,48 @@
+#include "corpus_statistics.h"
+#include <algorithm>
+#include <stdexcept>
+#include <tuple>
+
+using namespace std;
+
+QueryExpansion& QueryExpansion::operator+=(const QueryExpansion& other) {
+    words.insert(words.end(), other.words.begin(), other.words.end());
+    // a word found in several parts has the same distance in all of them
+    sort(words.begin(), words.end(), [this](const pair<string, int>& lhs, const pair<string, int>& rhs) {
+        return is_fuzzy ? tie(lhs.second, lhs.first) < tie(rhs.second, rhs.first) : lhs.first < rhs.first;
+        });
+    words.erase(unique(words.begin(), words.end()), words.end());
+    if (words.size() > max_word_count) {
+        words.resize(max_word_count);
+    }
+    return *this;
+}
+
+CorpusStatistics& CorpusStatistics::operator+=(const CorpusStatistics& other) {
+    if (expansions.empty()) {
+        expansions = other.expansions;
+    }
+    else if (!other.expansions.empty()) {
+        if (expansions.size() != other.expansions.size()) {
+            throw invalid_argument("Статистика собрана для другого запроса"s);
+        }
+        for (size_t i = 0; i < expansions.size(); ++i) {
+            expansions[i] += other.expansions[i];
+        }
+    }
+    document_count += other.document_count;
+    total_document_length += other.total_document_length;
+    for (const auto& [word, document_freq] : other.document_freqs) {
+        document_freqs[word] += document_freq;
+    }
+    return *this;
+}
+
+RankingStats CorpusStatistics::GetRankingStats() const {
+    return { document_count, document_count > 0 ? static_cast<double>(total_document_length) / document_count : 0.0 };
+}
+
+int CorpusStatistics::GetDocumentFreq(string_view word) const {
+    const auto it = document_freqs.find(word);
+    return it == document_freqs.end() ? 0 : it->second;
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include "ranking.h"
+#include <cstddef>
+#include <map>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Words a plus "word*" or "word~" of a query expands to in a corpus, the first max_word_count
+// of them. Every part of a corpus keeps its own first words, merged they are the first words
+// of the whole corpus.
+struct QueryExpansion {
+    // fuzzy words come by (edit distance, word), prefix words by word
+    bool is_fuzzy = false;
+    size_t max_word_count = 0;
+    // (word, edit distance), 0 for a prefix word
+    std::vector<std::pair<std::string, int>> words;
+
+    QueryExpansion& operator+=(const QueryExpansion& other);
+};
+
+// Statistics of the words of one query over a corpus. Statistics of the parts of a corpus
+// add up to those of the whole, so every part can rank its documents as the whole would.
+struct CorpusStatistics {
+    int document_count = 0;
+    long long total_document_length = 0;
+    // number of documents with the word, for the query words found in the corpus
+    std::map<std::string, int, std::less<>> document_freqs;
+    // the plus "word*" and "word~" of the query in query order. A search given the statistics
+    // takes these words instead of expanding the query in its own part of the corpus
+    std::vector<QueryExpansion> expansions;
+
+    // throws invalid_argument for the statistics of another query
+    CorpusStatistics& operator+=(const CorpusStatistics& other);
+
+    RankingStats GetRankingStats() const;
+
+    // 0 for a word missing from the corpus
+    int GetDocumentFreq(std::string_view word) const;
+};
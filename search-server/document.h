@@ -1,6 +1,7 @@
 #pragma once
 
 #include <iostream>
+#include <string_view>
 #include <vector>
 
 struct Document {
@@ -24,6 +25,14 @@ enum class DocumentStatus {
     REMOVED,
 };
 
+// A document to be indexed, the text is not owned and must outlive the indexing
+struct DocumentRecord {
+    int id = 0;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::vector<int> ratings;
+    std::string_view text;
+};
+
 std::ostream& operator<<(std::ostream& out, const Document& document);
 
 void PrintMatchDocumentResult(int document_id, const std::vector<std::string>& words, DocumentStatus status);
\ No newline at end of file
@@ -0,0 +1,241 @@
+#include "document_loader.h"
+#include "string_processing.h"
+#include <algorithm>
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+#include <execution>
+#include <fstream>
+#include <iterator>
+#include <numeric>
+#include <optional>
+#include <stdexcept>
+#include <thread>
+#include <utility>
+#if __has_include(<sys/mman.h>)
+#define DOCUMENT_LOADER_HAS_MMAP
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+// smaller inputs are parsed by one thread
+const size_t MIN_CHUNK_SIZE = 64 * 1024;
+const size_t CHUNKS_PER_THREAD = 4;
+// LoadDocuments parses and adds the file this many bytes at a time
+const size_t LOAD_WINDOW_SIZE = 64 * 1024 * 1024;
+
+struct ParsedChunk {
+    vector<DocumentRecord> records;
+    size_t line_count = 0;
+    // line within the chunk from 0 and the reason of the first malformed line
+    optional<pair<size_t, string>> error;
+};
+
+string_view TakeField(string_view& line) {
+    const size_t end = min(line.find('\t'), line.size());
+    const string_view field = line.substr(0, end);
+    line.remove_prefix(min(end + 1, line.size()));
+    return field;
+}
+
+bool ParseInt(string_view text, int& value) {
+    const auto [end, error] = from_chars(text.data(), text.data() + text.size(), value);
+    return error == errc() && end == text.data() + text.size();
+}
+
+optional<DocumentStatus> ParseStatus(string_view text) {
+    if (text == "ACTUAL"sv) {
+        return DocumentStatus::ACTUAL;
+    }
+    if (text == "IRRELEVANT"sv) {
+        return DocumentStatus::IRRELEVANT;
+    }
+    if (text == "BANNED"sv) {
+        return DocumentStatus::BANNED;
+    }
+    if (text == "REMOVED"sv) {
+        return DocumentStatus::REMOVED;
+    }
+    return nullopt;
+}
+
+// the reason when the line is malformed
+optional<string> ParseTsvLine(string_view line, DocumentRecord& record) {
+    if (count(line.begin(), line.end(), '\t') < 3) {
+        return "ожидается 4 поля через табуляцию"s;
+    }
+    if (!ParseInt(TakeField(line), record.id)) {
+        return "недопустимый номер документа"s;
+    }
+    const optional<DocumentStatus> status = ParseStatus(TakeField(line));
+    if (!status) {
+        return "недопустимый статус документа"s;
+    }
+    record.status = *status;
+    for (const string_view rating : SplitIntoWords(TakeField(line))) {
+        record.ratings.push_back(0);
+        if (!ParseInt(rating, record.ratings.back())) {
+            return "недопустимый рейтинг"s;
+        }
+    }
+    record.text = line;
+    return nullopt;
+}
+
+// with LINES the ids are line numbers within the chunk
+ParsedChunk ParseChunk(string_view chunk, DocumentFormat format) {
+    ParsedChunk result;
+    while (!chunk.empty()) {
+        const size_t line_end = min(chunk.find('\n'), chunk.size());
+        string_view line = chunk.substr(0, line_end);
+        chunk.remove_prefix(min(line_end + 1, chunk.size()));
+        const size_t line_index = result.line_count++;
+        if (!line.empty() && line.back() == '\r') {
+            line.remove_suffix(1);
+        }
+        if (line.empty()) {
+            continue;
+        }
+        DocumentRecord record;
+        if (format == DocumentFormat::LINES) {
+            record.id = static_cast<int>(line_index);
+            record.text = line;
+        }
+        else if (optional<string> error = ParseTsvLine(line, record)) {
+            result.error.emplace(line_index, move(*error));
+            break;
+        }
+        result.records.push_back(move(record));
+    }
+    return result;
+}
+
+// ParseDocuments of data that starts at line first_line of a file, line_count is set to its lines
+vector<DocumentRecord> ParseLines(string_view data, DocumentFormat format, size_t first_line, size_t& line_count) {
+    const size_t max_chunk_count = max<size_t>(thread::hardware_concurrency(), 1) * CHUNKS_PER_THREAD;
+    const size_t chunk_count = clamp<size_t>(data.size() / MIN_CHUNK_SIZE, 1, max_chunk_count);
+    // chunk i is data[bounds[i], bounds[i + 1]), every bound starts a line
+    vector<size_t> bounds(chunk_count + 1, data.size());
+    bounds[0] = 0;
+    for (size_t i = 1; i < chunk_count; ++i) {
+        const size_t line_end = data.find('\n', max(i * (data.size() / chunk_count), bounds[i - 1] + 1) - 1);
+        bounds[i] = line_end == string_view::npos ? data.size() : line_end + 1;
+    }
+    vector<size_t> chunk_indexes(chunk_count);
+    iota(chunk_indexes.begin(), chunk_indexes.end(), 0);
+    vector<ParsedChunk> chunks(chunk_count);
+    transform(execution::par, chunk_indexes.begin(), chunk_indexes.end(), chunks.begin(), [&](size_t i) {
+        return ParseChunk(data.substr(bounds[i], bounds[i + 1] - bounds[i]), format);
+        });
+
+    size_t record_count = 0;
+    for (const ParsedChunk& chunk : chunks) {
+        record_count += chunk.records.size();
+    }
+    vector<DocumentRecord> records;
+    records.reserve(record_count);
+    size_t chunk_first_line = first_line;
+    for (ParsedChunk& chunk : chunks) {
+        if (chunk.error) {
+            throw invalid_argument("Ошибка в строке "s + to_string(chunk_first_line + chunk.error->first + 1) + ": "s
+                + chunk.error->second);
+        }
+        for (DocumentRecord& record : chunk.records) {
+            if (format == DocumentFormat::LINES) {
+                record.id += static_cast<int>(chunk_first_line);
+            }
+            records.push_back(move(record));
+        }
+        chunk_first_line += chunk.line_count;
+    }
+    line_count = chunk_first_line - first_line;
+    return records;
+}
+
+// calls action with the records of every window of about LOAD_WINDOW_SIZE bytes, windows end at line ends
+template <typename Action>
+void ForEachWindow(string_view data, DocumentFormat format, Action action) {
+    size_t first_line = 0;
+    while (!data.empty()) {
+        const size_t line_end = data.size() > LOAD_WINDOW_SIZE ? data.find('\n', LOAD_WINDOW_SIZE - 1) : string_view::npos;
+        const size_t window_size = line_end == string_view::npos ? data.size() : line_end + 1;
+        size_t line_count = 0;
+        action(ParseLines(data.substr(0, window_size), format, first_line, line_count));
+        first_line += line_count;
+        data.remove_prefix(window_size);
+    }
+}
+
+}
+
+MappedFile::MappedFile(const string& path) {
+#ifdef DOCUMENT_LOADER_HAS_MMAP
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw runtime_error("Не удалось открыть файл "s + path + ": "s + strerror(errno));
+    }
+    struct stat file_stat {};
+    const bool is_regular = fstat(fd, &file_stat) == 0 && S_ISREG(file_stat.st_mode);
+    const size_t size = is_regular ? static_cast<size_t>(file_stat.st_size) : 0;
+    if (size > 0) {
+        void* const data = mmap(nullptr, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (data != MAP_FAILED) {
+            // every chunk is read front to back, so the kernel may read ahead aggressively
+            madvise(data, size, MADV_SEQUENTIAL);
+            data_ = string_view(static_cast<const char*>(data), size);
+            is_mapped_ = true;
+        }
+    }
+    close(fd);
+    if (is_mapped_ || (is_regular && size == 0)) {
+        return;
+    }
+#endif
+    // pipes and platforms without mmap
+    ifstream input(path, ios::binary);
+    if (!input) {
+        throw runtime_error("Не удалось открыть файл "s + path);
+    }
+    buffer_.assign(istreambuf_iterator<char>(input), istreambuf_iterator<char>());
+    data_ = buffer_;
+}
+
+MappedFile::~MappedFile() {
+#ifdef DOCUMENT_LOADER_HAS_MMAP
+    if (is_mapped_) {
+        munmap(const_cast<char*>(data_.data()), data_.size());
+    }
+#endif
+}
+
+vector<DocumentRecord> ParseDocuments(string_view data, DocumentFormat format) {
+    size_t line_count = 0;
+    return ParseLines(data, format, 0, line_count);
+}
+
+size_t LoadDocuments(SearchServer& search_server, const string& path, DocumentFormat format) {
+    const MappedFile file(path);
+    // the whole file is checked before the first document is added, the ids of earlier
+    // windows are kept to find an id repeated in a later one
+    vector<int> ids;
+    ForEachWindow(file.GetData(), format, [&search_server, &ids](const vector<DocumentRecord>& documents) {
+        search_server.CheckNewDocuments(execution::par, documents);
+        for (const DocumentRecord& document : documents) {
+            ids.push_back(document.id);
+        }
+        });
+    sort(ids.begin(), ids.end());
+    if (adjacent_find(ids.begin(), ids.end()) != ids.end()) {
+        throw invalid_argument("документ с таким номером уже существует"s);
+    }
+    ForEachWindow(file.GetData(), format, [&search_server](const vector<DocumentRecord>& documents) {
+        search_server.AddDocuments(execution::par, documents);
+        });
+    return ids.size();
+}
@@ -0,0 +1,49 @@
+#pragma once
+
+#include "document.h"
+#include "search_server.h"
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <vector>
+
+enum class DocumentFormat {
+    // one document per line, the id is the line number from 0, empty lines are skipped
+    LINES,
+    // id \t status \t ratings separated by spaces \t text, the status is its name (ACTUAL, BANNED, ...)
+    TSV,
+};
+
+// Read-only contents of a file, memory mapped where the platform has mmap and read
+// into memory otherwise. The views into it stay valid while the object lives.
+class MappedFile {
+public:
+    // throws runtime_error when the file cannot be opened
+    explicit MappedFile(const std::string& path);
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    ~MappedFile();
+
+    std::string_view GetData() const {
+        return data_;
+    }
+
+private:
+    std::string_view data_;
+    // used when the file is not mapped
+    std::string buffer_;
+    bool is_mapped_ = false;
+};
+
+// Splits data into chunks at line boundaries and parses them in parallel. The texts of the
+// records are views into data. A malformed line throws invalid_argument with its number
+std::vector<DocumentRecord> ParseDocuments(std::string_view data, DocumentFormat format);
+
+// Maps the file, parses it and adds the documents with SearchServer::AddDocuments, so the
+// document texts are never copied. The file goes in windows of 64 MB twice: the first pass
+// checks every document, so on invalid_argument the index is not changed, the second one
+// adds them. Only the records of one window and the ids are held at once. Returns the number
+// of added documents
+size_t LoadDocuments(SearchServer& search_server, const std::string& path, DocumentFormat format = DocumentFormat::TSV);
@@ -0,0 +1,54 @@
+#include "impact_index.h"
+
+using namespace std;
+
+ImpactIndex::ImpactIndex(shared_ptr<MemoryCounter> counter)
+    : lists_(MakeCounted<decltype(lists_)>(counter))
+    , empty_list_(MakeCounted<ImpactList>(counter)) {
+}
+
+ImpactIndex::ImpactIndex(const ImpactIndex& other, shared_ptr<MemoryCounter> counter)
+    : ImpactIndex(move(counter)) {
+    lists_.reserve(other.lists_.size());
+    for (const ImpactList& list : other.lists_) {
+        lists_.emplace_back(list, lists_.get_allocator());
+    }
+}
+
+void ImpactIndex::Add(int term_id, const Impact& impact) {
+    if (static_cast<size_t>(term_id) >= lists_.size()) {
+        lists_.resize(term_id + 1, ImpactList(lists_.get_allocator()));
+    }
+    lists_[term_id].insert(impact);
+}
+
+void ImpactIndex::Remove(int term_id, int document_id, double term_freq) {
+    if (static_cast<size_t>(term_id) < lists_.size()) {
+        lists_[term_id].erase({ term_freq, document_id });
+    }
+}
+
+const ImpactIndex::ImpactList& ImpactIndex::GetImpacts(int term_id) const {
+    return static_cast<size_t>(term_id) < lists_.size() ? lists_[term_id] : empty_list_;
+}
+
+ImpactAccumulator::ImpactAccumulator(size_t slot_count) {
+    thread_local Buffers thread_buffers;
+    buffers_ = thread_buffers.in_use ? &own_buffers_ : &thread_buffers;
+    buffers_->in_use = true;
+    if (buffers_->relevance.size() < slot_count) {
+        buffers_->relevance.resize(slot_count, 0.0);
+        buffers_->seen_terms.resize(slot_count, 0);
+        buffers_->touched.resize(slot_count, 0);
+    }
+}
+
+ImpactAccumulator::~ImpactAccumulator() {
+    for (const int slot : buffers_->touched_slots) {
+        buffers_->relevance[slot] = 0.0;
+        buffers_->seen_terms[slot] = 0;
+        buffers_->touched[slot] = 0;
+    }
+    buffers_->touched_slots.clear();
+    buffers_->in_use = false;
+}
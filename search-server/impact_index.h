@@ -0,0 +1,104 @@
+#pragma once
+
+#include "document.h"
+#include "memory_stats.h"
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+// Postings of every term ordered by descending term frequency. All the postings of a term
+// share one inverse document frequency, so this is also the order of their TF-IDF impacts,
+// and it stays valid while documents are added and removed.
+class ImpactIndex {
+public:
+    // everything a search needs to take the posting without looking the document up,
+    // rating and status never change after the document is added
+    struct Impact {
+        double term_freq;
+        int document_id;
+        int slot = 0;
+        int rating = 0;
+        DocumentStatus status = DocumentStatus::ACTUAL;
+    };
+
+    // higher term frequency first, equal frequencies by id
+    struct HigherImpact {
+        bool operator()(const Impact& lhs, const Impact& rhs) const {
+            return lhs.term_freq > rhs.term_freq || (lhs.term_freq == rhs.term_freq && lhs.document_id < rhs.document_id);
+        }
+    };
+
+    using ImpactList = CountedSet<Impact, HigherImpact>;
+
+    ImpactIndex() = default;
+
+    // the lists report their heap memory to counter
+    explicit ImpactIndex(std::shared_ptr<MemoryCounter> counter);
+
+    // copy of other reporting to counter instead of other's counter
+    ImpactIndex(const ImpactIndex& other, std::shared_ptr<MemoryCounter> counter);
+
+    void Add(int term_id, const Impact& impact);
+
+    // Lists of distinct terms may be changed from different threads at the same time,
+    // Remove never reallocates the list of lists.
+    void Remove(int term_id, int document_id, double term_freq);
+
+    // empty for a term without postings
+    const ImpactList& GetImpacts(int term_id) const;
+
+private:
+    CountedVector<ImpactList> lists_;
+    ImpactList empty_list_;
+};
+
+// Relevance sums of one score-at-a-time query together with the query terms already counted
+// for every document. Terms from the 64th on are never marked, so a bound built on the marks
+// stays an upper bound. Buffers are thread-local and reused like in SequentialAccumulator.
+class ImpactAccumulator {
+public:
+    static constexpr size_t MAX_TRACKED_TERMS = 64;
+
+    explicit ImpactAccumulator(size_t slot_count);
+
+    ImpactAccumulator(const ImpactAccumulator&) = delete;
+    ImpactAccumulator& operator=(const ImpactAccumulator&) = delete;
+
+    ~ImpactAccumulator();
+
+    void Add(int slot, size_t term_index, double value) {
+        if (!buffers_->touched[slot]) {
+            buffers_->touched[slot] = 1;
+            buffers_->touched_slots.push_back(slot);
+        }
+        buffers_->relevance[slot] += value;
+        if (term_index < MAX_TRACKED_TERMS) {
+            buffers_->seen_terms[slot] |= uint64_t{ 1 } << term_index;
+        }
+    }
+
+    size_t size() const {
+        return buffers_->touched_slots.size();
+    }
+
+    // func(slot, relevance, seen_terms) where bit i of seen_terms marks the i-th term
+    template <typename Func>
+    void ForEach(Func func) const {
+        for (const int slot : buffers_->touched_slots) {
+            func(slot, buffers_->relevance[slot], buffers_->seen_terms[slot]);
+        }
+    }
+
+private:
+    struct Buffers {
+        std::vector<double> relevance;
+        std::vector<uint64_t> seen_terms;
+        std::vector<char> touched;
+        std::vector<int> touched_slots;
+        bool in_use = false;
+    };
+
+    Buffers own_buffers_;
+    Buffers* buffers_;
+};
@@ -0,0 +1,44 @@
+#include "levenshtein_automaton.h"
+#include <algorithm>
+
+using namespace std;
+
+LevenshteinAutomaton::LevenshteinAutomaton(const string_view word, int max_distance)
+    : word_(word)
+    , max_distance_(max_distance) {
+    for (const char c : word_) {
+        uint16_t& byte_class = byte_classes_[static_cast<unsigned char>(c)];
+        if (byte_class == 0) {
+            byte_class = static_cast<uint16_t>(class_count_++);
+        }
+    }
+    string start(word_.size() + 1, '\0');
+    for (size_t i = 0; i < start.size(); ++i) {
+        start[i] = static_cast<char>(min(static_cast<int>(i), max_distance_ + 1));
+    }
+    AddState(move(start));
+}
+
+LevenshteinAutomaton::State LevenshteinAutomaton::AddTransition(State state, char c) {
+    const string& row = rows_[state];
+    string next(row.size(), '\0');
+    const int cap = max_distance_ + 1;
+    next[0] = static_cast<char>(min(row[0] + 1, cap));
+    for (size_t i = 1; i < row.size(); ++i) {
+        const int substitution = row[i - 1] + (word_[i - 1] == c ? 0 : 1);
+        const int distance = min({ substitution, row[i] + 1, next[i - 1] + 1 });
+        next[i] = static_cast<char>(min(distance, cap));
+    }
+    return AddState(move(next));
+}
+
+LevenshteinAutomaton::State LevenshteinAutomaton::AddState(string row) {
+    const auto [it, inserted] = row_states_.emplace(row, static_cast<State>(rows_.size()));
+    if (inserted) {
+        distances_.push_back(row.back());
+        can_match_.push_back(*min_element(row.begin(), row.end()) <= max_distance_);
+        rows_.push_back(move(row));
+        transitions_.resize(transitions_.size() + class_count_, -1);
+    }
+    return it->second;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Accepts the strings within max_distance edits (insert, delete, substitute a byte) of a word.
+// A state stands for a row of the edit distance table for the consumed input, capped at
+// max_distance + 1. The automaton is compiled into a DFA lazily: a transition is computed
+// from its row on first use and read from a table afterwards. Bytes absent from the word
+// share one column of the table.
+class LevenshteinAutomaton {
+public:
+    using State = int;
+
+    LevenshteinAutomaton(std::string_view word, int max_distance);
+
+    State Start() const {
+        return 0;
+    }
+
+    State Step(State state, char c) {
+        const size_t index = static_cast<size_t>(state) * class_count_ + byte_classes_[static_cast<unsigned char>(c)];
+        if (transitions_[index] < 0) {
+            const State next = AddTransition(state, c);
+            transitions_[index] = next;
+        }
+        return transitions_[index];
+    }
+
+    // the consumed input is within max_distance of the word
+    bool IsMatch(State state) const {
+        return distances_[state] <= max_distance_;
+    }
+
+    // some continuation of the consumed input may still match
+    bool CanMatch(State state) const {
+        return can_match_[state];
+    }
+
+    int GetDistance(State state) const {
+        return distances_[state];
+    }
+
+private:
+    std::string word_;
+    int max_distance_;
+    // the distinct bytes of the word are classes 1.., the other bytes are class 0
+    std::array<uint16_t, 256> byte_classes_{};
+    size_t class_count_ = 1;
+    // a cell per byte of the word plus one
+    std::vector<std::string> rows_;
+    std::unordered_map<std::string, State> row_states_;
+    // state * class_count_ + class, -1 until computed
+    std::vector<State> transitions_;
+    std::vector<int> distances_;
+    std::vector<char> can_match_;
+
+    State AddTransition(State state, char c);
+
+    State AddState(std::string row);
+};
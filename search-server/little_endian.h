@@ -0,0 +1,27 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+#include <string_view>
+#include <type_traits>
+
+// Fixed-size integers in little-endian byte order, the encoding of the frames of
+// search_protocol.h and of the records of write_ahead_log.h
+
+template <typename Integer>
+void AppendLittleEndian(std::string& out, Integer value) {
+    const auto bits = static_cast<std::make_unsigned_t<Integer>>(value);
+    for (size_t i = 0; i < sizeof(Integer); ++i) {
+        out.push_back(static_cast<char>((bits >> (8 * i)) & 0xFF));
+    }
+}
+
+// the integer at the front of bytes, which must hold at least sizeof(Integer) of them
+template <typename Integer>
+Integer ParseLittleEndian(std::string_view bytes) {
+    std::make_unsigned_t<Integer> bits = 0;
+    for (size_t i = 0; i < sizeof(Integer); ++i) {
+        bits |= static_cast<std::make_unsigned_t<Integer>>(static_cast<unsigned char>(bytes[i])) << (8 * i);
+    }
+    return static_cast<Integer>(bits);
+}
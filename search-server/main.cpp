@@ -1,7 +1,16 @@
 ﻿#include "search_server.h"
 #include "log_duration.h"
 #include "process_queries.h"
+#include "concurrent_map_benchmark.h"
+#include "search_server_benchmark.h"
+#include "search_client.h"
+#include "search_daemon.h"
+#include "document_loader.h"
+#include "write_ahead_log.h"
+#include <algorithm>
+#include <signal.h>
 #include <execution>
+#include <filesystem>
 #include <iostream>
 #include <random>
 #include <string>
@@ -58,7 +67,145 @@ void Test(string_view mark, const SearchServer& search_server, const vector<stri
     cout << total_relevance << endl;
 }
 #define TEST(policy) Test(#policy, search_server, queries, execution::policy)
-int main() {
+
+const BenchmarkScale* FindBenchmarkScale(const vector<BenchmarkScale>& scales, string_view name) {
+    const auto it = find_if(scales.begin(), scales.end(), [name](const BenchmarkScale& scale) {
+        return scale.name == name;
+        });
+    if (it == scales.end()) {
+        cerr << "Unknown benchmark scale "s << name << endl;
+        return nullptr;
+    }
+    return &*it;
+}
+
+// main --benchmark [small|medium|large|concurrent-map ...] prints the benchmark suite as JSON lines;
+// concurrent-map runs the ConcurrentMap contention benchmark instead
+int RunBenchmarks(int argc, char* argv[]) {
+    const auto scales = GetDefaultBenchmarkScales();
+    vector<string_view> names(argv + 2, argv + argc);
+    if (names.empty()) {
+        names.push_back(scales[0].name);
+    }
+    for (const string_view name : names) {
+        if (name == "concurrent-map"sv) {
+            BenchmarkConcurrentMap(cout);
+            continue;
+        }
+        const BenchmarkScale* scale = FindBenchmarkScale(scales, name);
+        if (!scale) {
+            return 1;
+        }
+        BenchmarkSearchServer(*scale, cout);
+    }
+    return 0;
+}
+
+// main --project-memory N [scale] measures the scale's index and projects it to N documents
+int RunMemoryProjection(int argc, char* argv[]) {
+    const auto scales = GetDefaultBenchmarkScales();
+    if (argc < 3) {
+        cerr << "Usage: --project-memory <documents> [scale]"s << endl;
+        return 1;
+    }
+    const BenchmarkScale* scale = FindBenchmarkScale(scales, argc > 3 ? string_view(argv[3]) : string_view(scales[0].name));
+    if (!scale) {
+        return 1;
+    }
+    ProjectSearchServerMemory(*scale, stoull(argv[2]), cout);
+    return 0;
+}
+
+// the documents of a TSV file with the changes of a write-ahead log replayed on top
+SearchServer LoadServedDocuments(const string& documents_path, const string& log_path) {
+    SearchServer search_server(""s);
+    LoadDocuments(search_server, documents_path);
+    if (!log_path.empty()) {
+        const WalReplayResult replay = ReplayWriteAheadLog(search_server, log_path);
+        cerr << "Replayed "s << replay.records << " logged changes"s << endl;
+    }
+    return search_server;
+}
+
+// main --serve <socket> [scale] serves the scale's corpus with a SearchDaemon until SIGINT or SIGTERM,
+// main --serve <socket> <documents.tsv> [log.wal] serves the documents of the file and the logged changes
+int RunDaemon(int argc, char* argv[]) {
+    const auto scales = GetDefaultBenchmarkScales();
+    if (argc < 3) {
+        cerr << "Usage: --serve <socket> [scale | documents.tsv [log.wal]]"s << endl;
+        return 1;
+    }
+    const bool is_file = argc > 3 && filesystem::is_regular_file(argv[3]);
+    const BenchmarkScale* scale = nullptr;
+    if (!is_file) {
+        scale = FindBenchmarkScale(scales, argc > 3 ? string_view(argv[3]) : string_view(scales[0].name));
+        if (!scale) {
+            return 1;
+        }
+    }
+    // blocked before the daemon starts its threads, so only sigwait receives them
+    sigset_t signals;
+    sigemptyset(&signals);
+    sigaddset(&signals, SIGINT);
+    sigaddset(&signals, SIGTERM);
+    pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+
+    try {
+        const SearchServer search_server = is_file ? LoadServedDocuments(argv[3], argc > 4 ? argv[4] : ""s)
+            : BuildBenchmarkSearchServer(*scale);
+        SearchDaemon daemon(search_server, argv[2]);
+        cerr << "Serving "s << search_server.GetDocumentCount() << " documents on "s << argv[2] << endl;
+        int signal = 0;
+        sigwait(&signals, &signal);
+        daemon.Stop();
+        const SearchDaemon::Stats stats = daemon.GetStats();
+        cerr << "Answered "s << stats.requests << " requests in "s << stats.batches << " batches"s << endl;
+    }
+    catch (const exception& error) {
+        cerr << error.what() << endl;
+        return 1;
+    }
+    return 0;
+}
+
+// main --load <socket> [scale] [connections] [pipeline depth] [requests per connection] measures a running daemon
+int RunLoadGenerator(int argc, char* argv[]) {
+    const auto scales = GetDefaultBenchmarkScales();
+    if (argc < 3) {
+        cerr << "Usage: --load <socket> [scale] [connections] [pipeline depth] [requests per connection]"s << endl;
+        return 1;
+    }
+    const BenchmarkScale* scale = FindBenchmarkScale(scales, argc > 3 ? string_view(argv[3]) : string_view(scales[0].name));
+    if (!scale) {
+        return 1;
+    }
+    LoadOptions options;
+    if (argc > 4) {
+        options.connections = stoul(argv[4]);
+    }
+    if (argc > 5) {
+        options.pipeline_depth = stoul(argv[5]);
+    }
+    if (argc > 6) {
+        options.requests_per_connection = stoul(argv[6]);
+    }
+    BenchmarkSearchDaemon(*scale, argv[2], options, cout);
+    return 0;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc > 1 && argv[1] == "--benchmark"s) {
+        return RunBenchmarks(argc, argv);
+    }
+    if (argc > 1 && argv[1] == "--project-memory"s) {
+        return RunMemoryProjection(argc, argv);
+    }
+    if (argc > 1 && argv[1] == "--serve"s) {
+        return RunDaemon(argc, argv);
+    }
+    if (argc > 1 && argv[1] == "--load"s) {
+        return RunLoadGenerator(argc, argv);
+    }
     mt19937 generator;
     const auto dictionary = GenerateDictionary(generator, 1000, 10);
     const auto documents = GenerateQueries(generator, dictionary, 10'000, 70);
@@ -0,0 +1,70 @@
+#include "memory_stats.h"
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+// exponent of Heaps' law for natural language text
+const double VOCABULARY_GROWTH_EXPONENT = 0.5;
+
+double GetGrowthFactor(MemoryGrowth growth, double scale) {
+    switch (growth) {
+    case MemoryGrowth::CONSTANT:
+        return 1.0;
+    case MemoryGrowth::VOCABULARY:
+        return pow(scale, VOCABULARY_GROWTH_EXPONENT);
+    case MemoryGrowth::LINEAR:
+        return scale;
+    }
+    return scale;
+}
+
+}
+
+size_t MemoryStats::GetTotalBytes() const {
+    size_t total = 0;
+    for (const ComponentMemory& component : components) {
+        total += component.bytes;
+    }
+    return total;
+}
+
+ComponentMemory MakeComponentMemory(string name, const MemoryCounter& counter, size_t elements, MemoryGrowth growth) {
+    ComponentMemory component;
+    component.name = move(name);
+    component.bytes = static_cast<size_t>(max<int64_t>(0, counter.bytes.load(memory_order_relaxed)));
+    component.allocations = static_cast<size_t>(max<int64_t>(0, counter.allocations.load(memory_order_relaxed)));
+    component.elements = elements;
+    component.growth = growth;
+    return component;
+}
+
+MemoryStats ProjectMemory(const MemoryStats& stats, size_t document_count) {
+    if (stats.document_count == 0) {
+        throw invalid_argument("Для прогноза памяти нужен хотя бы один документ");
+    }
+    const double scale = static_cast<double>(document_count) / stats.document_count;
+    MemoryStats projection;
+    projection.document_count = document_count;
+    for (const ComponentMemory& component : stats.components) {
+        const double factor = GetGrowthFactor(component.growth, scale);
+        ComponentMemory projected = component;
+        projected.bytes = static_cast<size_t>(llround(component.bytes * factor));
+        projected.allocations = static_cast<size_t>(llround(component.allocations * factor));
+        projected.elements = static_cast<size_t>(llround(component.elements * factor));
+        projection.components.push_back(move(projected));
+    }
+    return projection;
+}
+
+void PrintMemoryStats(ostream& out, const MemoryStats& stats) {
+    out << "documents: "sv << stats.document_count << '\n';
+    for (const ComponentMemory& component : stats.components) {
+        out << component.name << ": "sv << component.bytes << " bytes, "sv << component.allocations << " allocations, "sv
+            << component.elements << " elements"sv << '\n';
+    }
+    out << "total: "sv << stats.GetTotalBytes() << " bytes"sv << '\n';
+}
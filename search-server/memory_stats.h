@@ -0,0 +1,124 @@
+#pragma once
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <ostream>
+#include <set>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <vector>
+
+// Heap bytes and blocks currently held through the allocators attached to it
+struct MemoryCounter {
+    std::atomic<int64_t> bytes{ 0 };
+    std::atomic<int64_t> allocations{ 0 };
+};
+
+// std::allocator that reports every allocation to a shared counter. A default
+// constructed allocator counts nothing.
+template <typename T>
+class CountingAllocator {
+public:
+    using value_type = T;
+    using propagate_on_container_copy_assignment = std::true_type;
+    using propagate_on_container_move_assignment = std::true_type;
+    using propagate_on_container_swap = std::true_type;
+
+    CountingAllocator() noexcept = default;
+
+    explicit CountingAllocator(std::shared_ptr<MemoryCounter> counter) noexcept
+        : counter_(std::move(counter)) {
+    }
+
+    template <typename U>
+    CountingAllocator(const CountingAllocator<U>& other) noexcept
+        : counter_(other.counter_) {
+    }
+
+    T* allocate(size_t count) {
+        T* pointer = std::allocator<T>().allocate(count);
+        if (counter_) {
+            counter_->bytes.fetch_add(static_cast<int64_t>(count * sizeof(T)), std::memory_order_relaxed);
+            counter_->allocations.fetch_add(1, std::memory_order_relaxed);
+        }
+        return pointer;
+    }
+
+    void deallocate(T* pointer, size_t count) noexcept {
+        if (counter_) {
+            counter_->bytes.fetch_sub(static_cast<int64_t>(count * sizeof(T)), std::memory_order_relaxed);
+            counter_->allocations.fetch_sub(1, std::memory_order_relaxed);
+        }
+        std::allocator<T>().deallocate(pointer, count);
+    }
+
+    template <typename U>
+    bool operator==(const CountingAllocator<U>& other) const noexcept {
+        return counter_ == other.counter_;
+    }
+
+    template <typename U>
+    bool operator!=(const CountingAllocator<U>& other) const noexcept {
+        return !(*this == other);
+    }
+
+private:
+    std::shared_ptr<MemoryCounter> counter_;
+
+    template <typename U>
+    friend class CountingAllocator;
+};
+
+template <typename T>
+using CountedVector = std::vector<T, CountingAllocator<T>>;
+
+template <typename Key, typename Value, typename Compare = std::less<Key>>
+using CountedMap = std::map<Key, Value, Compare, CountingAllocator<std::pair<const Key, Value>>>;
+
+template <typename Key, typename Compare = std::less<Key>>
+using CountedSet = std::set<Key, Compare, CountingAllocator<Key>>;
+
+using CountedString = std::basic_string<char, std::char_traits<char>, CountingAllocator<char>>;
+
+// empty container reporting to counter
+template <typename Container>
+Container MakeCounted(const std::shared_ptr<MemoryCounter>& counter) {
+    return Container(typename Container::allocator_type(counter));
+}
+
+// how a component grows with the number of documents
+enum class MemoryGrowth {
+    // does not depend on the documents
+    CONSTANT,
+    // follows the vocabulary, which grows as the square root of the corpus (Heaps' law)
+    VOCABULARY,
+    // proportional to the documents
+    LINEAR,
+};
+
+struct ComponentMemory {
+    std::string name;
+    size_t bytes = 0;
+    size_t allocations = 0;
+    size_t elements = 0;
+    MemoryGrowth growth = MemoryGrowth::LINEAR;
+};
+
+struct MemoryStats {
+    size_t document_count = 0;
+    std::vector<ComponentMemory> components;
+
+    size_t GetTotalBytes() const;
+};
+
+ComponentMemory MakeComponentMemory(std::string name, const MemoryCounter& counter, size_t elements, MemoryGrowth growth);
+
+// Scales every component of stats, measured on at least one document, to document_count documents.
+// The heap bytes are those requested from the allocator, malloc overhead is not included.
+MemoryStats ProjectMemory(const MemoryStats& stats, size_t document_count);
+
+void PrintMemoryStats(std::ostream& out, const MemoryStats& stats);
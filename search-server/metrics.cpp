@@ -0,0 +1,233 @@
+#include "metrics.h"
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <mutex>
+#include <numeric>
+
+using namespace std;
+
+string_view GetMetricName(MetricStage stage) {
+    switch (stage) {
+    case MetricStage::PARSE:
+        return "parse"sv;
+    case MetricStage::POSTING_FETCH:
+        return "posting_fetch"sv;
+    case MetricStage::SCORING:
+        return "scoring"sv;
+    case MetricStage::TOP_K:
+        return "top_k"sv;
+    case MetricStage::MATCH:
+        return "match"sv;
+    }
+    return "unknown"sv;
+}
+
+string_view GetMetricName(MetricCounter counter) {
+    switch (counter) {
+    case MetricCounter::POSTINGS_SCANNED:
+        return "postings_scanned"sv;
+    case MetricCounter::DOCUMENTS_SCORED:
+        return "documents_scored"sv;
+    }
+    return "unknown"sv;
+}
+
+uint64_t LatencyHistogram::GetBucketLowerBound(size_t index) {
+    if (index < SUB_BUCKET_COUNT) {
+        return index;
+    }
+    const size_t shift = index / SUB_BUCKET_COUNT - 1;
+    return (SUB_BUCKET_COUNT + index % SUB_BUCKET_COUNT) << shift;
+}
+
+uint64_t LatencyHistogram::GetBucketUpperBound(size_t index) {
+    if (index + 1 == BUCKET_COUNT) {
+        return numeric_limits<uint64_t>::max();
+    }
+    return GetBucketLowerBound(index + 1) - 1;
+}
+
+LatencyHistogram::LatencyHistogram()
+    : buckets_(BUCKET_COUNT) {
+}
+
+LatencyHistogram::LatencyHistogram(vector<uint64_t> buckets, uint64_t sum, uint64_t max)
+    : buckets_(move(buckets))
+    , count_(accumulate(buckets_.begin(), buckets_.end(), uint64_t(0)))
+    , sum_(sum)
+    , max_(max) {
+}
+
+void LatencyHistogram::Record(uint64_t value, uint64_t count) {
+    buckets_[GetBucketIndex(value)] += count;
+    count_ += count;
+    sum_ += value * count;
+    max_ = std::max(max_, value);
+}
+
+double LatencyHistogram::GetMean() const {
+    return count_ == 0 ? 0.0 : static_cast<double>(sum_) / count_;
+}
+
+uint64_t LatencyHistogram::GetPercentile(double percentile) const {
+    if (count_ == 0) {
+        return 0;
+    }
+    const double share = clamp(percentile, 0.0, 100.0) / 100.0;
+    const uint64_t rank = max<uint64_t>(1, static_cast<uint64_t>(ceil(share * count_)));
+    uint64_t seen = 0;
+    for (size_t index = 0; index < BUCKET_COUNT; ++index) {
+        seen += buckets_[index];
+        if (seen >= rank) {
+            return min(GetBucketUpperBound(index), max_);
+        }
+    }
+    return max_;
+}
+
+LatencyHistogram& LatencyHistogram::operator+=(const LatencyHistogram& other) {
+    for (size_t index = 0; index < BUCKET_COUNT; ++index) {
+        buckets_[index] += other.buckets_[index];
+    }
+    count_ += other.count_;
+    sum_ += other.sum_;
+    max_ = std::max(max_, other.max_);
+    return *this;
+}
+
+LatencyHistogram& LatencyHistogram::operator-=(const LatencyHistogram& earlier) {
+    uint64_t max_bound = 0;
+    for (size_t index = 0; index < BUCKET_COUNT; ++index) {
+        buckets_[index] -= earlier.buckets_[index];
+        if (buckets_[index] > 0) {
+            max_bound = GetBucketUpperBound(index);
+        }
+    }
+    count_ -= earlier.count_;
+    sum_ -= earlier.sum_;
+    max_ = count_ == 0 ? 0 : std::min(max_, max_bound);
+    return *this;
+}
+
+MetricsSnapshot& MetricsSnapshot::operator-=(const MetricsSnapshot& earlier) {
+    for (size_t stage = 0; stage < METRIC_STAGE_COUNT; ++stage) {
+        stages[stage] -= earlier.stages[stage];
+    }
+    for (size_t counter = 0; counter < METRIC_COUNTER_COUNT; ++counter) {
+        counters[counter] -= earlier.counters[counter];
+    }
+    return *this;
+}
+
+namespace {
+
+struct MetricsRegistry {
+    mutex lock;
+    vector<const metrics_detail::ThreadMetrics*> threads;
+    // totals of the threads that have finished
+    MetricsSnapshot finished;
+};
+
+MetricsRegistry& GetRegistry() {
+    // never destroyed, threads may finish after static destructors have run
+    static MetricsRegistry* registry = new MetricsRegistry;
+    return *registry;
+}
+
+void AddThreadMetrics(MetricsSnapshot& snapshot, const metrics_detail::ThreadMetrics& metrics) {
+    for (size_t stage = 0; stage < METRIC_STAGE_COUNT; ++stage) {
+        vector<uint64_t> buckets(LatencyHistogram::BUCKET_COUNT);
+        for (size_t index = 0; index < buckets.size(); ++index) {
+            buckets[index] = metrics.buckets[stage][index].load(memory_order_relaxed);
+        }
+        snapshot.stages[stage] += LatencyHistogram(move(buckets), metrics.sums[stage].load(memory_order_relaxed),
+            metrics.maxima[stage].load(memory_order_relaxed));
+    }
+    for (size_t counter = 0; counter < METRIC_COUNTER_COUNT; ++counter) {
+        snapshot.counters[counter] += metrics.counters[counter].load(memory_order_relaxed);
+    }
+}
+
+}
+
+namespace metrics_detail {
+
+ThreadMetrics::ThreadMetrics() {
+    for (auto& stage_buckets : buckets) {
+        for (auto& bucket : stage_buckets) {
+            bucket.store(0, memory_order_relaxed);
+        }
+    }
+    for (size_t stage = 0; stage < METRIC_STAGE_COUNT; ++stage) {
+        sums[stage].store(0, memory_order_relaxed);
+        maxima[stage].store(0, memory_order_relaxed);
+    }
+    for (auto& counter : counters) {
+        counter.store(0, memory_order_relaxed);
+    }
+    MetricsRegistry& registry = GetRegistry();
+    lock_guard guard(registry.lock);
+    registry.threads.push_back(this);
+}
+
+ThreadMetrics::~ThreadMetrics() {
+    MetricsRegistry& registry = GetRegistry();
+    lock_guard guard(registry.lock);
+    AddThreadMetrics(registry.finished, *this);
+    registry.threads.erase(find(registry.threads.begin(), registry.threads.end(), this));
+}
+
+}
+
+MetricsSnapshot GetMetricsSnapshot() {
+    MetricsRegistry& registry = GetRegistry();
+    lock_guard guard(registry.lock);
+    MetricsSnapshot snapshot = registry.finished;
+    for (const metrics_detail::ThreadMetrics* metrics : registry.threads) {
+        AddThreadMetrics(snapshot, *metrics);
+    }
+    return snapshot;
+}
+
+void PrintMetrics(ostream& out, const MetricsSnapshot& snapshot) {
+    for (size_t stage = 0; stage < METRIC_STAGE_COUNT; ++stage) {
+        const LatencyHistogram& histogram = snapshot.stages[stage];
+        out << GetMetricName(static_cast<MetricStage>(stage)) << ": count="sv << histogram.GetCount()
+            << " mean="sv << static_cast<uint64_t>(histogram.GetMean()) << " ns"sv
+            << " p50="sv << histogram.GetPercentile(50) << " ns"sv
+            << " p90="sv << histogram.GetPercentile(90) << " ns"sv
+            << " p99="sv << histogram.GetPercentile(99) << " ns"sv
+            << " max="sv << histogram.GetMax() << " ns"sv << '\n';
+    }
+    for (size_t counter = 0; counter < METRIC_COUNTER_COUNT; ++counter) {
+        out << GetMetricName(static_cast<MetricCounter>(counter)) << ": "sv << snapshot.counters[counter] << '\n';
+    }
+}
+
+void PrintMetricsJson(ostream& out, const MetricsSnapshot& snapshot) {
+    out << "{\"stages\":{"sv;
+    for (size_t stage = 0; stage < METRIC_STAGE_COUNT; ++stage) {
+        const LatencyHistogram& histogram = snapshot.stages[stage];
+        if (stage > 0) {
+            out << ',';
+        }
+        out << '"' << GetMetricName(static_cast<MetricStage>(stage)) << "\":{"sv
+            << "\"count\":"sv << histogram.GetCount()
+            << ",\"sum_ns\":"sv << histogram.GetSum()
+            << ",\"mean_ns\":"sv << histogram.GetMean()
+            << ",\"p50_ns\":"sv << histogram.GetPercentile(50)
+            << ",\"p90_ns\":"sv << histogram.GetPercentile(90)
+            << ",\"p99_ns\":"sv << histogram.GetPercentile(99)
+            << ",\"p999_ns\":"sv << histogram.GetPercentile(99.9)
+            << ",\"max_ns\":"sv << histogram.GetMax() << '}';
+    }
+    out << "},\"counters\":{"sv;
+    for (size_t counter = 0; counter < METRIC_COUNTER_COUNT; ++counter) {
+        if (counter > 0) {
+            out << ',';
+        }
+        out << '"' << GetMetricName(static_cast<MetricCounter>(counter)) << "\":"sv << snapshot.counters[counter];
+    }
+    out << "}}"sv;
+}
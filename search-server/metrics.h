@@ -0,0 +1,220 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string_view>
+#include <vector>
+
+/**
+ * Метрики поискового сервера: гистограммы времени этапов обработки запроса
+ * и счётчики работы. Запись идёт в буферы потока без блокировок и атомарных
+ * read-modify-write операций, снимок собирает данные всех потоков.
+ *
+ * Сборка с -DSEARCH_SERVER_DISABLE_METRICS убирает запись полностью,
+ * снимки при этом остаются пустыми.
+ *
+ * Пример использования:
+ *
+ *  void Parse() {
+ *      METRICS_SCOPE(MetricStage::PARSE); // время до конца блока попадёт в гистограмму PARSE
+ *      METRICS_COUNT(MetricCounter::POSTINGS_SCANNED, 10);
+ *  }
+ *
+ *  PrintMetricsJson(std::cout, GetMetricsSnapshot());
+ */
+
+enum class MetricStage {
+    PARSE,
+    POSTING_FETCH,
+    SCORING,
+    TOP_K,
+    MATCH,
+};
+
+enum class MetricCounter {
+    POSTINGS_SCANNED,
+    DOCUMENTS_SCORED,
+};
+
+inline constexpr size_t METRIC_STAGE_COUNT = 5;
+inline constexpr size_t METRIC_COUNTER_COUNT = 2;
+
+#ifdef SEARCH_SERVER_DISABLE_METRICS
+inline constexpr bool METRICS_ENABLED = false;
+#else
+inline constexpr bool METRICS_ENABLED = true;
+#endif
+
+std::string_view GetMetricName(MetricStage stage);
+std::string_view GetMetricName(MetricCounter counter);
+
+// Log-linear buckets in the spirit of HdrHistogram: every power of two is split into
+// 16 equal sub-buckets, so a value is known within 1/16 of itself. Values are nanoseconds.
+class LatencyHistogram {
+public:
+    static constexpr int SUB_BUCKET_BITS = 4;
+    static constexpr size_t SUB_BUCKET_COUNT = size_t(1) << SUB_BUCKET_BITS;
+    // values from 2^41 ns (about 36 minutes) on share the last bucket
+    static constexpr int MAX_VALUE_BITS = 41;
+    static constexpr size_t BUCKET_COUNT = (MAX_VALUE_BITS - SUB_BUCKET_BITS + 1) * SUB_BUCKET_COUNT;
+
+    static size_t GetBucketIndex(uint64_t value) {
+        if (value < SUB_BUCKET_COUNT) {
+            return static_cast<size_t>(value);
+        }
+#if defined(__GNUC__) || defined(__clang__)
+        const int exponent = 63 - __builtin_clzll(value);
+#else
+        int exponent = SUB_BUCKET_BITS;
+        while (exponent < 63 && (value >> (exponent + 1)) != 0) {
+            ++exponent;
+        }
+#endif
+        if (exponent >= MAX_VALUE_BITS) {
+            return BUCKET_COUNT - 1;
+        }
+        const int shift = exponent - SUB_BUCKET_BITS;
+        return (shift + 1) * SUB_BUCKET_COUNT + ((value >> shift) & (SUB_BUCKET_COUNT - 1));
+    }
+
+    // smallest value falling into the bucket
+    static uint64_t GetBucketLowerBound(size_t index);
+
+    // largest value falling into the bucket
+    static uint64_t GetBucketUpperBound(size_t index);
+
+    LatencyHistogram();
+
+    // buckets must hold BUCKET_COUNT counts
+    LatencyHistogram(std::vector<uint64_t> buckets, uint64_t sum, uint64_t max);
+
+    void Record(uint64_t value, uint64_t count = 1);
+
+    uint64_t GetCount() const {
+        return count_;
+    }
+
+    uint64_t GetSum() const {
+        return sum_;
+    }
+
+    uint64_t GetMax() const {
+        return max_;
+    }
+
+    double GetMean() const;
+
+    // value not exceeded by the given share of records, percentile in [0, 100]
+    uint64_t GetPercentile(double percentile) const;
+
+    uint64_t GetBucketCount(size_t index) const {
+        return buckets_[index];
+    }
+
+    LatencyHistogram& operator+=(const LatencyHistogram& other);
+
+    // records made after earlier was taken, the maximum is estimated from the buckets
+    LatencyHistogram& operator-=(const LatencyHistogram& earlier);
+
+private:
+    std::vector<uint64_t> buckets_;
+    uint64_t count_ = 0;
+    uint64_t sum_ = 0;
+    uint64_t max_ = 0;
+};
+
+struct MetricsSnapshot {
+    std::array<LatencyHistogram, METRIC_STAGE_COUNT> stages;
+    std::array<uint64_t, METRIC_COUNTER_COUNT> counters = {};
+
+    const LatencyHistogram& GetStage(MetricStage stage) const {
+        return stages[static_cast<size_t>(stage)];
+    }
+
+    uint64_t GetCounter(MetricCounter counter) const {
+        return counters[static_cast<size_t>(counter)];
+    }
+
+    // metrics recorded after earlier was taken
+    MetricsSnapshot& operator-=(const MetricsSnapshot& earlier);
+};
+
+// sums the buffers of all live threads and of the threads that have finished
+MetricsSnapshot GetMetricsSnapshot();
+
+void PrintMetrics(std::ostream& out, const MetricsSnapshot& snapshot);
+
+void PrintMetricsJson(std::ostream& out, const MetricsSnapshot& snapshot);
+
+namespace metrics_detail {
+
+// Written by its own thread only, so plain loads and stores of relaxed atomics suffice:
+// they compile to ordinary moves but keep concurrent snapshots well defined.
+struct ThreadMetrics {
+    std::array<std::array<std::atomic<uint64_t>, LatencyHistogram::BUCKET_COUNT>, METRIC_STAGE_COUNT> buckets;
+    std::array<std::atomic<uint64_t>, METRIC_STAGE_COUNT> sums;
+    std::array<std::atomic<uint64_t>, METRIC_STAGE_COUNT> maxima;
+    std::array<std::atomic<uint64_t>, METRIC_COUNTER_COUNT> counters;
+
+    ThreadMetrics();
+    ~ThreadMetrics();
+
+    static void Add(std::atomic<uint64_t>& cell, uint64_t value) {
+        cell.store(cell.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+    }
+
+    void Record(MetricStage stage, uint64_t value) {
+        const size_t index = static_cast<size_t>(stage);
+        Add(buckets[index][LatencyHistogram::GetBucketIndex(value)], 1);
+        Add(sums[index], value);
+        if (value > maxima[index].load(std::memory_order_relaxed)) {
+            maxima[index].store(value, std::memory_order_relaxed);
+        }
+    }
+
+    void Count(MetricCounter counter, uint64_t value) {
+        Add(counters[static_cast<size_t>(counter)], value);
+    }
+};
+
+inline thread_local ThreadMetrics thread_metrics;
+
+class StageTimer {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    explicit StageTimer(MetricStage stage)
+        : stage_(stage) {
+    }
+
+    StageTimer(const StageTimer&) = delete;
+    StageTimer& operator=(const StageTimer&) = delete;
+
+    ~StageTimer() {
+        const auto duration = Clock::now() - start_time_;
+        thread_metrics.Record(stage_, static_cast<uint64_t>(
+            std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count()));
+    }
+
+private:
+    const MetricStage stage_;
+    const Clock::time_point start_time_ = Clock::now();
+};
+
+}
+
+#define METRICS_CONCAT_INTERNAL(X, Y) X##Y
+#define METRICS_CONCAT(X, Y) METRICS_CONCAT_INTERNAL(X, Y)
+
+#ifdef SEARCH_SERVER_DISABLE_METRICS
+#define METRICS_SCOPE(stage) ((void)0)
+#define METRICS_COUNT(counter, value) ((void)0)
+#else
+// measures the time from this point to the end of the enclosing block
+#define METRICS_SCOPE(stage) metrics_detail::StageTimer METRICS_CONCAT(metricsTimer, __LINE__)(stage)
+#define METRICS_COUNT(counter, value) metrics_detail::thread_metrics.Count((counter), (value))
+#endif
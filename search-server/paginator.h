@@ -1,6 +1,9 @@
 #pragma once
 
 #include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
 #include <vector>
 #include <ostream>
 
@@ -30,34 +33,108 @@ private:
     std::size_t size_;
 };
 
+// Splits a range into pages of page_size elements. Page boundaries are found only
+// when a page is visited, so over random access iterators every operation is O(1).
 template <typename Iterator>
 class Paginator {
 public:
-    Paginator(Iterator begin, Iterator end, std::size_t page_size) {
-        for (std::size_t left = std::distance(begin, end); left > 0;) {
-            const std::size_t current_page_size = std::min(page_size, left);
-            const Iterator current_page_end = std::next(begin, current_page_size);
-            pages_.push_back({ begin, current_page_end });
-
-            left -= current_page_size;
-            begin = current_page_end;
+    class PageIterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = IteratorRange<Iterator>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = IteratorRange<Iterator>;
+
+        PageIterator(Iterator first, Iterator last, std::size_t page_size)
+            : first_(first)
+            , last_(last)
+            , page_size_(page_size) {
+        }
+
+        IteratorRange<Iterator> operator*() const {
+            return { first_, Advance(first_, last_, page_size_) };
+        }
+
+        PageIterator& operator++() {
+            first_ = Advance(first_, last_, page_size_);
+            return *this;
+        }
+
+        PageIterator operator++(int) {
+            PageIterator previous = *this;
+            ++*this;
+            return previous;
+        }
+
+        bool operator==(const PageIterator& other) const {
+            return first_ == other.first_;
+        }
+
+        bool operator!=(const PageIterator& other) const {
+            return !(*this == other);
+        }
+
+    private:
+        Iterator first_, last_;
+        std::size_t page_size_;
+    };
+
+    Paginator(Iterator begin, Iterator end, std::size_t page_size)
+        : first_(begin)
+        , last_(end)
+        , page_size_(page_size) {
+        if (page_size == 0) {
+            throw std::invalid_argument("Размер страницы должен быть положительным");
         }
     }
 
-    auto begin() const {
-        return pages_.begin();
+    PageIterator begin() const {
+        return { first_, last_, page_size_ };
     }
 
-    auto end() const {
-        return pages_.end();
+    PageIterator end() const {
+        return { last_, last_, page_size_ };
     }
 
     std::size_t size() const {
-        return pages_.size();
+        return (static_cast<std::size_t>(std::distance(first_, last_)) + page_size_ - 1) / page_size_;
+    }
+
+    // the page with the given index counting from 0, empty past the last page
+    IteratorRange<Iterator> operator[](std::size_t index) const {
+        Iterator page_begin = first_;
+        if constexpr (IS_RANDOM_ACCESS) {
+            const std::size_t total = static_cast<std::size_t>(last_ - first_);
+            page_begin = first_ + std::min(total, index <= total / page_size_ ? index * page_size_ : total);
+        }
+        else {
+            for (std::size_t i = 0; i < index && page_begin != last_; ++i) {
+                page_begin = Advance(page_begin, last_, page_size_);
+            }
+        }
+        return { page_begin, Advance(page_begin, last_, page_size_) };
     }
 
 private:
-    std::vector<IteratorRange<Iterator>> pages_;
+    static constexpr bool IS_RANDOM_ACCESS = std::is_base_of_v<std::random_access_iterator_tag,
+        typename std::iterator_traits<Iterator>::iterator_category>;
+
+    Iterator first_, last_;
+    std::size_t page_size_;
+
+    // first + count, but not past last
+    static Iterator Advance(Iterator first, Iterator last, std::size_t count) {
+        if constexpr (IS_RANDOM_ACCESS) {
+            return first + std::min(count, static_cast<std::size_t>(last - first));
+        }
+        else {
+            for (; count > 0 && first != last; --count) {
+                ++first;
+            }
+            return first;
+        }
+    }
 };
 
 template <typename Container>
@@ -71,4 +148,4 @@ std::ostream& operator<<(std::ostream& out, const IteratorRange<Iterator>& range
         out << *it;
     }
     return out;
-}
\ No newline at end of file
+}
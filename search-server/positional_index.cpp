@@ -0,0 +1,124 @@
+#include "positional_index.h"
+#include <algorithm>
+#include <limits>
+
+using namespace std;
+
+namespace {
+
+void AppendVarint(CountedVector<uint8_t>& out, uint32_t value) {
+    while (value >= 0x80) {
+        out.push_back(static_cast<uint8_t>(value | 0x80));
+        value >>= 7;
+    }
+    out.push_back(static_cast<uint8_t>(value));
+}
+
+}
+
+PositionalIndex::PositionalIndex(shared_ptr<MemoryCounter> counter)
+    : documents_(MakeCounted<decltype(documents_)>(counter)) {
+}
+
+PositionalIndex::PositionalIndex(const PositionalIndex& other, shared_ptr<MemoryCounter> counter)
+    : PositionalIndex(move(counter)) {
+    for (const auto& [document_id, document] : other.documents_) {
+        documents_.emplace_hint(documents_.end(), document_id, DocumentPositions{
+            CountedVector<uint32_t>(document.offsets, documents_.get_allocator()),
+            CountedVector<uint8_t>(document.data, documents_.get_allocator()) });
+    }
+}
+
+void PositionalIndex::AddDocument(int document_id, const vector<pair<int, int>>& term_positions) {
+    DocumentPositions document{ CountedVector<uint32_t>(documents_.get_allocator()),
+        CountedVector<uint8_t>(documents_.get_allocator()) };
+    document.offsets.push_back(0);
+    for (size_t i = 0; i < term_positions.size(); ++i) {
+        const bool new_term = i == 0 || term_positions[i].first != term_positions[i - 1].first;
+        if (new_term && i != 0) {
+            document.offsets.push_back(static_cast<uint32_t>(document.data.size()));
+        }
+        const int previous = new_term ? 0 : term_positions[i - 1].second;
+        AppendVarint(document.data, static_cast<uint32_t>(term_positions[i].second - previous));
+    }
+    if (!term_positions.empty()) {
+        document.offsets.push_back(static_cast<uint32_t>(document.data.size()));
+    }
+    document.data.shrink_to_fit();
+    document.offsets.shrink_to_fit();
+    documents_[document_id] = move(document);
+}
+
+void PositionalIndex::RemoveDocument(int document_id) {
+    documents_.erase(document_id);
+}
+
+vector<int> PositionalIndex::GetPositions(int document_id, size_t entry_index) const {
+    vector<int> positions;
+    const auto it = documents_.find(document_id);
+    if (it == documents_.end() || entry_index + 1 >= it->second.offsets.size()) {
+        return positions;
+    }
+    const DocumentPositions& document = it->second;
+    int position = 0;
+    uint32_t value = 0;
+    int shift = 0;
+    for (uint32_t i = document.offsets[entry_index]; i < document.offsets[entry_index + 1]; ++i) {
+        value |= static_cast<uint32_t>(document.data[i] & 0x7F) << shift;
+        if (document.data[i] & 0x80) {
+            shift += 7;
+            continue;
+        }
+        position += static_cast<int>(value);
+        positions.push_back(position);
+        value = 0;
+        shift = 0;
+    }
+    return positions;
+}
+
+bool ContainsPhrase(const vector<vector<int>>& positions, const vector<int>& offsets) {
+    if (positions.empty()) {
+        return false;
+    }
+    for (const int first_position : positions[0]) {
+        const int start = first_position - offsets[0];
+        bool found = true;
+        for (size_t i = 1; i < positions.size() && found; ++i) {
+            found = binary_search(positions[i].begin(), positions[i].end(), start + offsets[i]);
+        }
+        if (found) {
+            return true;
+        }
+    }
+    return false;
+}
+
+int ComputeMinimalSpan(const vector<vector<int>>& positions) {
+    // merge all occurrences and slide a window that covers every list
+    vector<pair<int, size_t>> occurrences;
+    for (size_t list = 0; list < positions.size(); ++list) {
+        for (const int position : positions[list]) {
+            occurrences.push_back({ position, list });
+        }
+    }
+    sort(occurrences.begin(), occurrences.end());
+
+    vector<int> in_window(positions.size(), 0);
+    size_t covered = 0;
+    int best = numeric_limits<int>::max();
+    size_t left = 0;
+    for (size_t right = 0; right < occurrences.size(); ++right) {
+        if (in_window[occurrences[right].second]++ == 0) {
+            ++covered;
+        }
+        while (covered == positions.size()) {
+            best = min(best, occurrences[right].first - occurrences[left].first + 1);
+            if (--in_window[occurrences[left].second] == 0) {
+                --covered;
+            }
+            ++left;
+        }
+    }
+    return best;
+}
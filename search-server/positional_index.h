@@ -0,0 +1,45 @@
+#pragma once
+
+#include "memory_stats.h"
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <utility>
+#include <vector>
+
+// Word positions of every indexed document. For each document the positions of
+// every term are kept as a separate delta + varint encoded list, in the same
+// (term id) order as the document's forward index entries.
+class PositionalIndex {
+public:
+    PositionalIndex() = default;
+
+    // the encoded lists report their heap memory to counter
+    explicit PositionalIndex(std::shared_ptr<MemoryCounter> counter);
+
+    // copy of other reporting to counter instead of other's counter
+    PositionalIndex(const PositionalIndex& other, std::shared_ptr<MemoryCounter> counter);
+
+    // term_positions are (term id, position) pairs sorted by term id and then by position
+    void AddDocument(int document_id, const std::vector<std::pair<int, int>>& term_positions);
+
+    void RemoveDocument(int document_id);
+
+    // entry_index is the index of the term among the document's forward index entries
+    std::vector<int> GetPositions(int document_id, size_t entry_index) const;
+
+private:
+    struct DocumentPositions {
+        // offsets_[i] .. offsets_[i + 1] is the encoded list of the i-th term
+        CountedVector<uint32_t> offsets;
+        CountedVector<uint8_t> data;
+    };
+
+    CountedMap<int, DocumentPositions> documents_;
+};
+
+// Checks that the words occur at positions start + offsets[i] for some start
+bool ContainsPhrase(const std::vector<std::vector<int>>& positions, const std::vector<int>& offsets);
+
+// Length of the shortest window of positions which contains every list at least once
+int ComputeMinimalSpan(const std::vector<std::vector<int>>& positions);
@@ -0,0 +1,40 @@
+#include "query_executor.h"
+
+#ifdef SEARCH_SERVER_HAS_COROUTINES
+
+using namespace std;
+
+QueryExecutor::~QueryExecutor() {
+    // a spawned task owns the frames of the coroutines it awaits, so only the tasks are destroyed
+    ready_.clear();
+    for (void* const task : tasks_) {
+        coroutine_handle<>::from_address(task).destroy();
+    }
+}
+
+void QueryExecutor::Spawn(QueryTask<void> task) {
+    const DetachedTask detached = RunDetached(move(task));
+    detached.handle.promise().executor = this;
+    tasks_.insert(detached.handle.address());
+    ready_.push_back(detached.handle);
+}
+
+size_t QueryExecutor::Run() {
+    size_t step_count = 0;
+    while (!ready_.empty()) {
+        const coroutine_handle<> handle = ready_.front();
+        ready_.pop_front();
+        handle.resume();
+        ++step_count;
+        if (error_) {
+            rethrow_exception(exchange(error_, nullptr));
+        }
+    }
+    return step_count;
+}
+
+QueryExecutor::DetachedTask QueryExecutor::RunDetached(QueryTask<void> task) {
+    co_await move(task);
+}
+
+#endif
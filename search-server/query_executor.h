@@ -0,0 +1,244 @@
+#pragma once
+
+// Coroutines need C++20, in a C++17 build this header declares nothing and
+// SEARCH_SERVER_HAS_COROUTINES stays undefined.
+#if defined(__cpp_impl_coroutine) && __has_include(<coroutine>)
+#define SEARCH_SERVER_HAS_COROUTINES
+
+#include <coroutine>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <optional>
+#include <unordered_set>
+#include <utility>
+
+namespace query_task_detail {
+
+template <typename T>
+struct PromiseResult {
+    std::optional<T> value;
+
+    void return_value(T result) {
+        value.emplace(std::move(result));
+    }
+
+    T TakeValue() {
+        return std::move(*value);
+    }
+};
+
+template <>
+struct PromiseResult<void> {
+    void return_void() {
+    }
+
+    void TakeValue() {
+    }
+};
+
+}
+
+/**
+ * Result of a coroutine. The coroutine starts when the task is awaited, the awaiting
+ * coroutine continues with its result once it finishes. An exception of the coroutine
+ * is rethrown by co_await.
+ *
+ * Пример использования:
+ *
+ *  QueryTask<void> Serve(const SearchServer& server, QueryExecutor& executor) {
+ *      const auto documents = co_await server.FindTopDocumentsAsync(executor, "пушистый кот"s);
+ *      // ...
+ *  }
+ *
+ *  executor.Spawn(Serve(server, executor));
+ *  executor.Run();
+ */
+template <typename T>
+class [[nodiscard]] QueryTask {
+public:
+    struct promise_type : query_task_detail::PromiseResult<T> {
+        std::exception_ptr error;
+        std::coroutine_handle<> continuation;
+
+        QueryTask get_return_object() {
+            return QueryTask(std::coroutine_handle<promise_type>::from_promise(*this));
+        }
+
+        std::suspend_always initial_suspend() noexcept {
+            return {};
+        }
+
+        // hands the thread straight to the awaiting coroutine, so deep chains do not grow the stack
+        struct FinalAwaiter {
+            bool await_ready() noexcept {
+                return false;
+            }
+
+            std::coroutine_handle<> await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+                const std::coroutine_handle<> continuation = handle.promise().continuation;
+                return continuation ? continuation : std::noop_coroutine();
+            }
+
+            void await_resume() noexcept {
+            }
+        };
+
+        FinalAwaiter final_suspend() noexcept {
+            return {};
+        }
+
+        void unhandled_exception() {
+            error = std::current_exception();
+        }
+    };
+
+    QueryTask(QueryTask&& other) noexcept
+        : handle_(std::exchange(other.handle_, nullptr)) {
+    }
+
+    QueryTask& operator=(QueryTask&& other) noexcept {
+        if (this != &other) {
+            Destroy();
+            handle_ = std::exchange(other.handle_, nullptr);
+        }
+        return *this;
+    }
+
+    ~QueryTask() {
+        Destroy();
+    }
+
+    bool await_ready() const noexcept {
+        return false;
+    }
+
+    std::coroutine_handle<> await_suspend(std::coroutine_handle<> awaiting) noexcept {
+        handle_.promise().continuation = awaiting;
+        return handle_;
+    }
+
+    T await_resume() {
+        if (handle_.promise().error) {
+            std::rethrow_exception(handle_.promise().error);
+        }
+        return handle_.promise().TakeValue();
+    }
+
+private:
+    std::coroutine_handle<promise_type> handle_;
+
+    explicit QueryTask(std::coroutine_handle<promise_type> handle)
+        : handle_(handle) {
+    }
+
+    void Destroy() {
+        if (handle_) {
+            handle_.destroy();
+        }
+    }
+};
+
+// Runs coroutines on the thread calling Run, one step at a time in the order they became
+// ready. A coroutine gives the thread to the others with co_await executor.Yield(), so
+// thousands of queries can be in flight on one thread. Not thread safe.
+class QueryExecutor {
+public:
+    class YieldAwaiter {
+    public:
+        explicit YieldAwaiter(QueryExecutor& executor)
+            : executor_(executor) {
+        }
+
+        bool await_ready() const noexcept {
+            return false;
+        }
+
+        void await_suspend(std::coroutine_handle<> handle) {
+            executor_.ready_.push_back(handle);
+        }
+
+        void await_resume() const noexcept {
+        }
+
+    private:
+        QueryExecutor& executor_;
+    };
+
+    QueryExecutor() = default;
+
+    QueryExecutor(const QueryExecutor&) = delete;
+    QueryExecutor& operator=(const QueryExecutor&) = delete;
+
+    // destroys the tasks that have not finished
+    ~QueryExecutor();
+
+    // queues the calling coroutine behind the ready ones
+    YieldAwaiter Yield() {
+        return YieldAwaiter(*this);
+    }
+
+    // the task starts on the next Run
+    void Spawn(QueryTask<void> task);
+
+    // Resumes ready coroutines until none is left and returns the number of steps.
+    // An exception escaping a spawned task is rethrown here, the other tasks stay queued
+    size_t Run();
+
+    // spawned tasks that have not finished yet
+    size_t GetTaskCount() const {
+        return tasks_.size();
+    }
+
+private:
+    // owns a spawned task and removes itself from tasks_ when the task finishes
+    struct DetachedTask {
+        struct promise_type {
+            QueryExecutor* executor = nullptr;
+
+            DetachedTask get_return_object() {
+                return { std::coroutine_handle<promise_type>::from_promise(*this) };
+            }
+
+            std::suspend_always initial_suspend() noexcept {
+                return {};
+            }
+
+            struct FinalAwaiter {
+                bool await_ready() noexcept {
+                    return false;
+                }
+
+                void await_suspend(std::coroutine_handle<promise_type> handle) noexcept {
+                    handle.promise().executor->tasks_.erase(handle.address());
+                    handle.destroy();
+                }
+
+                void await_resume() noexcept {
+                }
+            };
+
+            FinalAwaiter final_suspend() noexcept {
+                return {};
+            }
+
+            void return_void() {
+            }
+
+            void unhandled_exception() {
+                executor->error_ = std::current_exception();
+            }
+        };
+
+        std::coroutine_handle<promise_type> handle;
+    };
+
+    std::deque<std::coroutine_handle<>> ready_;
+    // frame addresses of the spawned tasks
+    std::unordered_set<void*> tasks_;
+    std::exception_ptr error_;
+
+    static DetachedTask RunDetached(QueryTask<void> task);
+};
+
+#endif
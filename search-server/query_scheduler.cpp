@@ -0,0 +1,192 @@
+#include "query_scheduler.h"
+#include <iterator>
+#include <tuple>
+
+using namespace std;
+
+namespace {
+
+string GetRejectionMessage(RejectionReason reason) {
+    switch (reason) {
+    case RejectionReason::QUEUE_FULL:
+        return "Очередь запросов переполнена"s;
+    case RejectionReason::SHED:
+        return "Запрос вытеснен из очереди более важным"s;
+    case RejectionReason::DEADLINE_EXPIRED:
+        return "Срок выполнения запроса истёк в очереди"s;
+    }
+    return {};
+}
+
+}
+
+QueryRejectedError::QueryRejectedError(RejectionReason reason)
+    : runtime_error(GetRejectionMessage(reason))
+    , reason_(reason) {
+}
+
+bool QueryScheduler::QueueKey::operator<(const QueueKey& other) const {
+    return tie(priority, deadline, sequence) < tie(other.priority, other.deadline, other.sequence);
+}
+
+QueryScheduler::QueryScheduler(const SearchServer& server, QuerySchedulerOptions options)
+    : server_(server)
+    , options_(options) {
+    for (size_t i = 0; i < options_.worker_count; ++i) {
+        workers_.emplace_back([this] { Work(); });
+    }
+}
+
+QueryScheduler::~QueryScheduler() {
+    {
+        lock_guard guard(mutex_);
+        stopping_ = true;
+        while (!queue_.empty()) {
+            Reject(queue_.begin(), RejectionReason::SHED);
+        }
+    }
+    query_added_.notify_all();
+    for (thread& worker : workers_) {
+        worker.join();
+    }
+}
+
+future<vector<Document>> QueryScheduler::Submit(string raw_query, DocumentStatus status) {
+    const size_t cost = server_.EstimateQueryCost(raw_query);
+    const QueryPriority priority = cost <= options_.interactive_cost_limit ? QueryPriority::INTERACTIVE : QueryPriority::BATCH;
+    const auto deadline = Clock::now()
+        + (priority == QueryPriority::INTERACTIVE ? options_.interactive_deadline : options_.batch_deadline);
+    return Admit(move(raw_query), status, cost, priority, deadline);
+}
+
+future<vector<Document>> QueryScheduler::Submit(string raw_query, DocumentStatus status, QueryPriority priority,
+    Clock::time_point deadline) {
+    const size_t cost = server_.EstimateQueryCost(raw_query);
+    return Admit(move(raw_query), status, cost, priority, deadline);
+}
+
+future<vector<Document>> QueryScheduler::Admit(string raw_query, DocumentStatus status, size_t cost,
+    QueryPriority priority, Clock::time_point deadline) {
+    promise<vector<Document>> result;
+    auto future = result.get_future();
+    const auto now = Clock::now();
+
+    lock_guard guard(mutex_);
+    ++stats_.submitted;
+    const QueueKey key{ priority, deadline, next_sequence_++ };
+    const auto fits = [this, cost](size_t depth, size_t queued_cost) {
+        return depth < options_.max_queue_depth && queued_cost + cost <= options_.max_queued_cost;
+    };
+    if (!fits(queue_.size(), queued_cost_)) {
+        // expired queries would be rejected anyway, they make room first
+        for (auto it = queue_.begin(); it != queue_.end();) {
+            const auto current = it++;
+            if (current->first.deadline < now) {
+                Reject(current, RejectionReason::DEADLINE_EXPIRED);
+            }
+        }
+    }
+    // then the queries ranked after the new one, from the last, if that is enough
+    size_t depth = queue_.size();
+    size_t queued_cost = queued_cost_;
+    for (auto it = queue_.end(); !fits(depth, queued_cost) && it != queue_.begin() && key < prev(it)->first;) {
+        --it;
+        --depth;
+        queued_cost -= it->second.cost;
+    }
+    if (!fits(depth, queued_cost)) {
+        ++stats_.rejected;
+        result.set_exception(make_exception_ptr(QueryRejectedError(RejectionReason::QUEUE_FULL)));
+        return future;
+    }
+    while (queue_.size() > depth) {
+        Reject(prev(queue_.end()), RejectionReason::SHED);
+    }
+
+    queue_.emplace(key, QueuedQuery{ move(raw_query), status, cost, now, move(result) });
+    queued_cost_ += cost;
+    stats_.peak_queue_depth = max(stats_.peak_queue_depth, queue_.size());
+    query_added_.notify_one();
+    return future;
+}
+
+bool QueryScheduler::RunNext() {
+    optional<QueuedQuery> query;
+    {
+        lock_guard guard(mutex_);
+        query = TakeNext();
+    }
+    if (!query) {
+        return false;
+    }
+    Run(*query);
+    return true;
+}
+
+QueryScheduler::Stats QueryScheduler::GetStats() const {
+    lock_guard guard(mutex_);
+    Stats stats = stats_;
+    stats.queue_depth = queue_.size();
+    stats.queued_cost = queued_cost_;
+    return stats;
+}
+
+optional<QueryScheduler::QueuedQuery> QueryScheduler::TakeNext() {
+    const auto now = Clock::now();
+    while (!queue_.empty()) {
+        const auto it = queue_.begin();
+        if (it->first.deadline < now) {
+            Reject(it, RejectionReason::DEADLINE_EXPIRED);
+            continue;
+        }
+        const auto wait = chrono::duration_cast<chrono::nanoseconds>(now - it->second.submitted);
+        stats_.queue_wait[static_cast<size_t>(it->first.priority)].Record(static_cast<uint64_t>(wait.count()));
+        queued_cost_ -= it->second.cost;
+        optional<QueuedQuery> query(move(it->second));
+        queue_.erase(it);
+        return query;
+    }
+    return nullopt;
+}
+
+void QueryScheduler::Run(QueuedQuery& query) {
+    try {
+        query.result.set_value(server_.FindTopDocuments(query.raw_query, query.status));
+        lock_guard guard(mutex_);
+        ++stats_.completed;
+    }
+    catch (...) {
+        query.result.set_exception(current_exception());
+        lock_guard guard(mutex_);
+        ++stats_.failed;
+    }
+}
+
+void QueryScheduler::Reject(map<QueueKey, QueuedQuery>::iterator it, RejectionReason reason) {
+    it->second.result.set_exception(make_exception_ptr(QueryRejectedError(reason)));
+    queued_cost_ -= it->second.cost;
+    if (reason == RejectionReason::DEADLINE_EXPIRED) {
+        ++stats_.expired;
+    }
+    else {
+        ++stats_.shed;
+    }
+    queue_.erase(it);
+}
+
+void QueryScheduler::Work() {
+    while (true) {
+        optional<QueuedQuery> query;
+        {
+            unique_lock lock(mutex_);
+            query_added_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+            if (stopping_) {
+                return;
+            }
+            query = TakeNext();
+        }
+        if (query) {
+            Run(*query);
+        }
+    }
+}
@@ -0,0 +1,169 @@
+#pragma once
+
+#include "document.h"
+#include "metrics.h"
+#include "search_server.h"
+#include <array>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <future>
+#include <map>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+
+enum class QueryPriority {
+    // short queries of a user waiting for the answer
+    INTERACTIVE,
+    // long queries, run while no interactive query waits
+    BATCH,
+};
+
+inline constexpr size_t QUERY_PRIORITY_COUNT = 2;
+
+enum class RejectionReason {
+    // the queue was full and the query ranked after every queued one
+    QUEUE_FULL,
+    // a query ranked before it came to the full queue and took its place
+    SHED,
+    // the deadline passed before the query was started
+    DEADLINE_EXPIRED,
+};
+
+class QueryRejectedError : public std::runtime_error {
+public:
+    explicit QueryRejectedError(RejectionReason reason);
+
+    RejectionReason GetReason() const {
+        return reason_;
+    }
+
+private:
+    RejectionReason reason_;
+};
+
+struct QuerySchedulerOptions {
+    // with 0 workers queries run only in RunNext
+    size_t worker_count = 1;
+    // queued queries, the running ones are not counted
+    size_t max_queue_depth = 1000;
+    // sum of SearchServer::EstimateQueryCost of the queued queries
+    size_t max_queued_cost = 10'000'000;
+    // a query reading at most this many postings is INTERACTIVE unless its priority is given
+    size_t interactive_cost_limit = 10'000;
+    std::chrono::milliseconds interactive_deadline{ 100 };
+    std::chrono::milliseconds batch_deadline{ 5000 };
+};
+
+/**
+ * Admission control and priority scheduling in front of a SearchServer.
+ *
+ * The cost of a query is estimated from the lengths of its posting lists before it is
+ * queued. Cheap queries become INTERACTIVE and expensive ones BATCH, every query gets
+ * the deadline of its priority. Workers take the queries by priority and then by deadline,
+ * a query whose deadline has passed is rejected instead of being run.
+ *
+ * When the queue is full by depth or by cost, the expired queries are dropped first.
+ * If that is not enough, a new query takes the place of the last queued ones if it ranks
+ * before them, otherwise it is rejected. Rejections are delivered as QueryRejectedError
+ * through the future, so a caller may answer from a cache or with an error right away.
+ *
+ * Пример использования:
+ *
+ *  QueryScheduler scheduler(search_server, { 4 });
+ *  auto documents = scheduler.Submit("пушистый кот"s);
+ *  try {
+ *      Print(documents.get());
+ *  }
+ *  catch (const QueryRejectedError&) {
+ *      // перегрузка
+ *  }
+ */
+class QueryScheduler {
+public:
+    using Clock = std::chrono::steady_clock;
+
+    struct Stats {
+        uint64_t submitted = 0;
+        uint64_t completed = 0;
+        // queries the server threw on
+        uint64_t failed = 0;
+        uint64_t rejected = 0;
+        uint64_t shed = 0;
+        uint64_t expired = 0;
+        size_t queue_depth = 0;
+        size_t peak_queue_depth = 0;
+        size_t queued_cost = 0;
+        // nanoseconds from Submit to the start of the query, by priority
+        std::array<LatencyHistogram, QUERY_PRIORITY_COUNT> queue_wait;
+    };
+
+    // the server must outlive the scheduler and must not change while queries run
+    explicit QueryScheduler(const SearchServer& server, QuerySchedulerOptions options = {});
+
+    QueryScheduler(const QueryScheduler&) = delete;
+    QueryScheduler& operator=(const QueryScheduler&) = delete;
+
+    // waits for the running queries, the queued ones are shed
+    ~QueryScheduler();
+
+    // Priority and deadline follow from the estimated cost. An invalid query throws
+    // invalid_argument here, a rejection comes through the future
+    std::future<std::vector<Document>> Submit(std::string raw_query, DocumentStatus status = DocumentStatus::ACTUAL);
+
+    std::future<std::vector<Document>> Submit(std::string raw_query, DocumentStatus status, QueryPriority priority,
+        Clock::time_point deadline);
+
+    // runs the first queued query on the calling thread, false when nothing was queued
+    bool RunNext();
+
+    Stats GetStats() const;
+
+private:
+    // the queue order: priority, then deadline, then arrival
+    struct QueueKey {
+        QueryPriority priority;
+        Clock::time_point deadline;
+        uint64_t sequence;
+
+        bool operator<(const QueueKey& other) const;
+    };
+
+    struct QueuedQuery {
+        std::string raw_query;
+        DocumentStatus status = DocumentStatus::ACTUAL;
+        size_t cost = 0;
+        Clock::time_point submitted;
+        std::promise<std::vector<Document>> result;
+    };
+
+    const SearchServer& server_;
+    const QuerySchedulerOptions options_;
+
+    mutable std::mutex mutex_;
+    std::condition_variable query_added_;
+    std::map<QueueKey, QueuedQuery> queue_;
+    uint64_t next_sequence_ = 0;
+    size_t queued_cost_ = 0;
+    bool stopping_ = false;
+    Stats stats_;
+
+    // started last, after everything they use
+    std::vector<std::thread> workers_;
+
+    std::future<std::vector<Document>> Admit(std::string raw_query, DocumentStatus status, size_t cost,
+        QueryPriority priority, Clock::time_point deadline);
+
+    // the first queued query that has not expired, called under the lock
+    std::optional<QueuedQuery> TakeNext();
+
+    void Run(QueuedQuery& query);
+
+    void Reject(std::map<QueueKey, QueuedQuery>::iterator it, RejectionReason reason);
+
+    void Work();
+};
@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cmath>
+#include <type_traits>
+#include <utility>
+
+// Corpus-wide statistics passed to a ranking function, computed once per query
+struct RankingStats {
+    int document_count = 0;
+    double average_document_length = 0.0;
+};
+
+/*
+ * A ranking is any type providing
+ *
+ *   double TermWeight(const RankingStats& stats, int document_freq) const;
+ *   double operator()(const RankingStats& stats, double term_weight, double term_freq, int document_length) const;
+ *
+ * TermWeight is called once per query word, operator() once per scored posting.
+ * The ranking is a template parameter of FindTopDocuments, so the scoring loop
+ * is instantiated and inlined separately for every ranking type.
+ */
+
+struct TfIdfRanking {
+    double TermWeight(const RankingStats& stats, int document_freq) const {
+        return std::log(stats.document_count * 1.0 / document_freq);
+    }
+
+    double operator()(const RankingStats&, double term_weight, double term_freq, int) const {
+        return term_freq * term_weight;
+    }
+};
+
+struct Bm25Ranking {
+    double k1 = 1.2;
+    double b = 0.75;
+
+    double TermWeight(const RankingStats& stats, int document_freq) const {
+        return std::log((stats.document_count - document_freq + 0.5) / (document_freq + 0.5) + 1.0);
+    }
+
+    double operator()(const RankingStats& stats, double term_weight, double term_freq, int document_length) const {
+        // the index keeps normalized tf, BM25 wants the raw occurrence count
+        const double occurrences = term_freq * document_length;
+        const double length_norm = stats.average_document_length > 0
+            ? 1.0 - b + b * document_length / stats.average_document_length
+            : 1.0;
+        return term_weight * occurrences * (k1 + 1.0) / (occurrences + k1 * length_norm);
+    }
+};
+
+// Adapts a user callable double(double term_freq, double inverse_document_freq, int document_length)
+template <typename ScoreFunc>
+struct CustomRanking {
+    ScoreFunc score;
+
+    double TermWeight(const RankingStats& stats, int document_freq) const {
+        return std::log(stats.document_count * 1.0 / document_freq);
+    }
+
+    double operator()(const RankingStats&, double term_weight, double term_freq, int document_length) const {
+        return score(term_freq, term_weight, document_length);
+    }
+};
+
+template <typename ScoreFunc>
+CustomRanking<ScoreFunc> MakeRanking(ScoreFunc score) {
+    return { std::move(score) };
+}
+
+// Boosts documents where the query words occur close to each other.
+// Needs the positional index, see SearchServer::EnablePositionalIndex.
+template <typename BaseRanking = TfIdfRanking>
+struct ProximityRanking : BaseRanking {
+    static constexpr bool uses_positions = true;
+
+    double proximity_weight = 1.0;
+
+    // span is the shortest window containing all matched_words distinct query words
+    double ProximityBoost(int span, int matched_words) const {
+        if (matched_words < 2) {
+            return 1.0;
+        }
+        return 1.0 + proximity_weight * (matched_words - 1) / (span - 1);
+    }
+};
+
+template <typename Ranking, typename = void>
+struct RankingUsesPositions : std::false_type {};
+
+template <typename Ranking>
+struct RankingUsesPositions<Ranking, std::void_t<decltype(Ranking::uses_positions)>>
+    : std::bool_constant<Ranking::uses_positions> {};
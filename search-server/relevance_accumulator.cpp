@@ -0,0 +1,46 @@
+#include "relevance_accumulator.h"
+
+using namespace std;
+
+namespace {
+
+// below this many postings thread start-up costs more than it saves
+const size_t MIN_PARALLEL_POSTING_COUNT = 1 << 14;
+
+}
+
+AccumulationMode ChooseAccumulationMode(bool parallel, size_t term_count, size_t posting_count, size_t slot_count,
+    size_t thread_count) {
+    if (!parallel || thread_count < 2 || term_count < 2 || posting_count < MIN_PARALLEL_POSTING_COUNT) {
+        return AccumulationMode::SEQUENTIAL;
+    }
+    // the dense arrays are cleared and scanned whole, that must pay off
+    if (posting_count * 4 < slot_count) {
+        return AccumulationMode::SEQUENTIAL;
+    }
+    // private arrays cost thread_count * slot_count to reduce, but never contend
+    if (posting_count >= slot_count * min(thread_count, term_count)) {
+        return AccumulationMode::PRIVATE;
+    }
+    return AccumulationMode::ATOMIC;
+}
+
+SequentialAccumulator::SequentialAccumulator(size_t slot_count) {
+    thread_local Buffers thread_buffers;
+    // a nested query on the same thread (e.g. stolen by a parallel algorithm) gets its own buffers
+    buffers_ = thread_buffers.in_use ? &own_buffers_ : &thread_buffers;
+    buffers_->in_use = true;
+    if (buffers_->relevance.size() < slot_count) {
+        buffers_->relevance.resize(slot_count, 0.0);
+        buffers_->touched.resize(slot_count, 0);
+    }
+}
+
+SequentialAccumulator::~SequentialAccumulator() {
+    for (const int slot : buffers_->touched_slots) {
+        buffers_->relevance[slot] = 0.0;
+        buffers_->touched[slot] = 0;
+    }
+    buffers_->touched_slots.clear();
+    buffers_->in_use = false;
+}
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <execution>
+#include <numeric>
+#include <vector>
+
+// Relevance sums of one query over dense document slots. Three strategies are available,
+// ChooseAccumulationMode picks one by the amount of work in the query.
+enum class AccumulationMode {
+    // one thread, reusable thread-local buffers, only touched slots are visited
+    SEQUENTIAL,
+    // shared dense array updated by lock-free compare-and-swap from all threads
+    ATOMIC,
+    // every thread sums into its own dense array, the arrays are reduced at the end
+    PRIVATE,
+};
+
+// posting_count is the number of postings the query will score
+AccumulationMode ChooseAccumulationMode(bool parallel, size_t term_count, size_t posting_count, size_t slot_count,
+    size_t thread_count);
+
+class SequentialAccumulator {
+public:
+    explicit SequentialAccumulator(size_t slot_count);
+
+    SequentialAccumulator(const SequentialAccumulator&) = delete;
+    SequentialAccumulator& operator=(const SequentialAccumulator&) = delete;
+
+    ~SequentialAccumulator();
+
+    void Add(int slot, double value) {
+        if (!buffers_->touched[slot]) {
+            buffers_->touched[slot] = 1;
+            buffers_->touched_slots.push_back(slot);
+        }
+        buffers_->relevance[slot] += value;
+    }
+
+    bool Contains(int slot) const {
+        return buffers_->touched[slot];
+    }
+
+    // number of slots added to
+    size_t GetCount() const {
+        return buffers_->touched_slots.size();
+    }
+
+    template <typename Func>
+    void ForEach(Func func) const {
+        for (const int slot : buffers_->touched_slots) {
+            func(slot, buffers_->relevance[slot]);
+        }
+    }
+
+private:
+    struct Buffers {
+        std::vector<double> relevance;
+        std::vector<char> touched;
+        std::vector<int> touched_slots;
+        bool in_use = false;
+    };
+
+    Buffers own_buffers_;
+    Buffers* buffers_;
+};
+
+class AtomicAccumulator {
+public:
+    explicit AtomicAccumulator(size_t slot_count)
+        : relevance_(slot_count)
+        , touched_(slot_count) {
+    }
+
+    void Add(int slot, double value) {
+        // only the first writer dirties the flag's cache line
+        if (!touched_[slot].load(std::memory_order_relaxed)) {
+            touched_[slot].store(true, std::memory_order_relaxed);
+        }
+        std::atomic<double>& target = relevance_[slot];
+        double current = target.load(std::memory_order_relaxed);
+        while (!target.compare_exchange_weak(current, current + value, std::memory_order_relaxed)) {
+        }
+    }
+
+    // must not run concurrently with Add
+    template <typename Func>
+    void ForEach(Func func) const {
+        for (size_t slot = 0; slot < relevance_.size(); ++slot) {
+            if (touched_[slot].load(std::memory_order_relaxed)) {
+                func(static_cast<int>(slot), relevance_[slot].load(std::memory_order_relaxed));
+            }
+        }
+    }
+
+private:
+    std::vector<std::atomic<double>> relevance_;
+    std::vector<std::atomic<bool>> touched_;
+};
+
+class PrivateAccumulators {
+public:
+    PrivateAccumulators(size_t slot_count, size_t part_count)
+        : parts_(part_count) {
+        for (Part& part : parts_) {
+            part.relevance.assign(slot_count, 0.0);
+            part.touched.assign(slot_count, 0);
+        }
+    }
+
+    size_t GetPartCount() const {
+        return parts_.size();
+    }
+
+    // a part must be used by a single thread at a time
+    void Add(size_t part, int slot, double value) {
+        parts_[part].relevance[slot] += value;
+        parts_[part].touched[slot] = 1;
+    }
+
+    // sums every part into the first one, slot ranges are reduced in parallel
+    template <typename Policy>
+    void Reduce(Policy& policy) {
+        const size_t slot_count = parts_[0].relevance.size();
+        const size_t block_size = 4096;
+        std::vector<size_t> blocks((slot_count + block_size - 1) / block_size);
+        std::iota(blocks.begin(), blocks.end(), 0);
+        std::for_each(policy, blocks.begin(), blocks.end(), [this, slot_count, block_size](size_t block) {
+            const size_t last = std::min(slot_count, (block + 1) * block_size);
+            for (size_t part = 1; part < parts_.size(); ++part) {
+                for (size_t slot = block * block_size; slot < last; ++slot) {
+                    parts_[0].relevance[slot] += parts_[part].relevance[slot];
+                    parts_[0].touched[slot] |= parts_[part].touched[slot];
+                }
+            }
+            });
+    }
+
+    // valid after Reduce
+    template <typename Func>
+    void ForEach(Func func) const {
+        for (size_t slot = 0; slot < parts_[0].relevance.size(); ++slot) {
+            if (parts_[0].touched[slot]) {
+                func(static_cast<int>(slot), parts_[0].relevance[slot]);
+            }
+        }
+    }
+
+private:
+    // parts live on separate cache lines and own separate arrays, so threads never share a line
+    struct alignas(64) Part {
+        std::vector<double> relevance;
+        std::vector<char> touched;
+    };
+
+    std::vector<Part> parts_;
+};
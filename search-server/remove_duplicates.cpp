@@ -3,13 +3,14 @@
 using namespace std;
 
 void RemoveDuplicates(SearchServer& search_server) {
-    map<set<string_view>, int> word_to_document_freqs;   
+    // words come in term id order, so equal word sets give equal sequences
+    map<vector<string_view>, int> word_to_document_freqs;   
     set<int> documents_to_delete;
     for (const int document_id : search_server) {    
-        set<string_view> words;
-        for (auto& wordsandfreqs : search_server.GetWordFrequencies(document_id)) 
+        vector<string_view> words;
+        for (const auto& [word, _] : search_server.GetWordFrequencies(document_id)) 
         {
-            words.insert(wordsandfreqs.first);
+            words.push_back(word);
         }
         if (word_to_document_freqs.find(words) == word_to_document_freqs.end()) 
         {
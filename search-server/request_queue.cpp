@@ -1,39 +1,126 @@
 #include "request_queue.h"
+#include <algorithm>
 
 using namespace std;
 
+RequestQueue::RequestQueue(const SearchServer& search_server)
+    : RequestQueue(search_server, Clock::now) {
+}
+
+RequestQueue::RequestQueue(const SearchServer& search_server, function<Clock::time_point()> now)
+    : member(search_server)
+    , now_(move(now))
+    , start_(now_())
+    , buckets_(make_unique<array<atomic<uint64_t>, seconds_in_day_>>())
+    , minute_totals_(minutes_in_day_) {
+    // day 0 is tagged as 1 below, so zeroed buckets never look current
+    for (auto& bucket : *buckets_) {
+        bucket.store(0, memory_order_relaxed);
+    }
+}
+
 vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query, DocumentStatus status) {
     auto request = member.FindTopDocuments(raw_query, status);
-    AddRequest(static_cast<int>(request.size()));
+    AddRequest(request.size());
     return request;
 }
 
 vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query) {
     auto request = member.FindTopDocuments(raw_query);
-    AddRequest(static_cast<int>(request.size()));
+    AddRequest(request.size());
     return request;
 }
 
+vector<vector<Document>> RequestQueue::AddProcessQueries(const vector<string>& queries) {
+    auto requests = ProcessQueries(member, queries);
+    for (const auto& request : requests) {
+        AddRequest(request.size());
+    }
+    return requests;
+}
+
+namespace {
+
+uint64_t GetDayTag(uint64_t second, uint32_t seconds_in_day, int day_bits) {
+    return (second / seconds_in_day + 1) & ((uint64_t(1) << day_bits) - 1);
+}
+
+void AddStats(RequestQueue::Stats& total, const RequestQueue::Stats& stats) {
+    total.requests += stats.requests;
+    total.no_result_requests += stats.no_result_requests;
+}
+
+}
+
+void RequestQueue::AddRequest(size_t result_count) {
+    const uint64_t second = GetCurrentSecond();
+    const uint64_t tag = GetDayTag(second, seconds_in_day_, day_bits_);
+    atomic<uint64_t>& bucket = (*buckets_)[second % seconds_in_day_];
+    const uint64_t no_result = result_count == 0 ? 1 : 0;
+
+    uint64_t old_value = bucket.load(memory_order_relaxed);
+    uint64_t new_value;
+    do {
+        uint64_t requests = 0;
+        uint64_t no_result_requests = 0;
+        if (old_value >> (2 * counter_bits_) == tag) {
+            requests = old_value & counter_mask_;
+            no_result_requests = (old_value >> counter_bits_) & counter_mask_;
+        }
+        // counters saturate instead of spilling into the neighbouring field
+        requests = min(requests + 1, counter_mask_);
+        no_result_requests = min(no_result_requests + no_result, counter_mask_);
+        new_value = (tag << (2 * counter_bits_)) | (no_result_requests << counter_bits_) | requests;
+    } while (!bucket.compare_exchange_weak(old_value, new_value, memory_order_relaxed));
+}
+
 int RequestQueue::GetNoResultRequests() const {
-    return empty_requests_count;
+    return static_cast<int>(GetStats(Window::DAY).no_result_requests);
+}
+
+RequestQueue::Stats RequestQueue::GetStats(Window window) const {
+    const uint64_t length = window_seconds_[static_cast<size_t>(window)];
+    const uint64_t now = GetCurrentSecond();
+    const uint64_t first = now + 1 - min(length, now + 1);
+    // the minutes that lie wholly in the window and are over, the current one is not
+    const uint64_t first_minute = (first + 59) / 60;
+    const uint64_t current_minute = now / 60;
+    if (first_minute >= current_minute) {
+        return SumSeconds(first, now + 1);
+    }
+    Stats stats = SumSeconds(first, first_minute * 60);
+    AddStats(stats, SumMinutes(first_minute, current_minute));
+    AddStats(stats, SumSeconds(current_minute * 60, now + 1));
+    return stats;
 }
 
-void RequestQueue::AddRequest(int request_size) {
-    ++counter_min_;
-    if (counter_min_ > min_in_day_)
-    {
-        auto& request = requests_.front();
-        if (request.requests == 0) {
-            --empty_requests_count;
+RequestQueue::Stats RequestQueue::SumSeconds(uint64_t first, uint64_t last) const {
+    Stats stats;
+    for (uint64_t second = first; second < last; ++second) {
+        const uint64_t value = (*buckets_)[second % seconds_in_day_].load(memory_order_relaxed);
+        if (value >> (2 * counter_bits_) == GetDayTag(second, seconds_in_day_, day_bits_)) {
+            stats.requests += value & counter_mask_;
+            stats.no_result_requests += (value >> counter_bits_) & counter_mask_;
         }
-        requests_.pop_front();
-    }    
-    if (request_size == 0) {
-        ++empty_requests_count;
-        RequestQueue::requests_.push_back({ {static_cast<int>(counter_min_)}, { 0 } });
     }
-    else
-    {
-        RequestQueue::requests_.push_back({ {static_cast<int>(counter_min_)},{ 1 } });
+    return stats;
+}
+
+RequestQueue::Stats RequestQueue::SumMinutes(uint64_t first, uint64_t last) const {
+    lock_guard lock(minutes_mutex_);
+    // every minute that is over is summed once, older than a day it is never read again
+    for (uint64_t minute = max(summed_minutes_, last - min<uint64_t>(last, minutes_in_day_)); minute < last; ++minute) {
+        minute_totals_[minute % minutes_in_day_] = SumSeconds(minute * 60, minute * 60 + 60);
+    }
+    summed_minutes_ = max(summed_minutes_, last);
+    Stats stats;
+    for (uint64_t minute = first; minute < last; ++minute) {
+        AddStats(stats, minute_totals_[minute % minutes_in_day_]);
     }
-}
\ No newline at end of file
+    return stats;
+}
+
+uint64_t RequestQueue::GetCurrentSecond() const {
+    const auto elapsed = now_() - start_;
+    return static_cast<uint64_t>(max<Clock::duration::rep>(0, chrono::duration_cast<chrono::seconds>(elapsed).count()));
+}
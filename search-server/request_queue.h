@@ -1,41 +1,99 @@
 #pragma once
 
 #include "search_server.h"
+#include "process_queries.h"
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <mutex>
 #include <vector>
 #include <string>
-#include <deque>
 
+// Counts requests and requests without results over the last minute, hour and day
+// of wall-clock time. Safe to share between all query threads.
 class RequestQueue {
     const SearchServer& member;
 public:
-    RequestQueue(const SearchServer& search_server)
-        : member(search_server)
-    {
-    }
+    using Clock = std::chrono::steady_clock;
+
+    enum class Window {
+        MINUTE,
+        HOUR,
+        DAY,
+    };
+
+    struct Stats {
+        uint64_t requests = 0;
+        uint64_t no_result_requests = 0;
+    };
+
+    RequestQueue(const SearchServer& search_server);
+
+    // now is called once per recorded request and per statistics read
+    RequestQueue(const SearchServer& search_server, std::function<Clock::time_point()> now);
+
     // сделаем "обёртки" для всех методов поиска, чтобы сохранять результаты для нашей статистики
     template <typename DocumentPredicate>
-    std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate);    
+    std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentPredicate document_predicate);
 
     std::vector<Document> AddFindRequest(const std::string& raw_query, DocumentStatus status);
 
     std::vector<Document> AddFindRequest(const std::string& raw_query);
 
+    template <typename Policy, typename DocumentPredicate>
+    std::vector<Document> AddFindRequest(Policy& policy, const std::string& raw_query, DocumentPredicate document_predicate);
+
+    template <typename Policy>
+    std::vector<Document> AddFindRequest(Policy& policy, const std::string& raw_query);
+
+    // runs the queries through ProcessQueries and records every one of them
+    std::vector<std::vector<Document>> AddProcessQueries(const std::vector<std::string>& queries);
+
+    // thread-safe without locks, one clock read and one compare-and-swap
+    void AddRequest(size_t result_count);
+
+    // requests without results during the last day
     int GetNoResultRequests() const;
 
+    // Reads pay for the lock-free recording: the seconds of the window are summed, except
+    // the minutes that are over, whose totals are summed once and kept. A request recorded
+    // after its minute was summed, because its thread stalled between reading the clock and
+    // recording, is missed by the longer windows
+    Stats GetStats(Window window) const;
+
 private:
-    struct QueryResult {   
-        int request_time = 0;
-        int requests = 0;
-    };
-    std::deque<QueryResult> requests_;
+    static constexpr uint32_t seconds_in_day_ = 24 * 60 * 60;
+    static constexpr uint32_t minutes_in_day_ = 24 * 60;
+    static constexpr std::array<uint64_t, 3> window_seconds_ = { 60, 60 * 60, seconds_in_day_ };
+
+    // A bucket packs the day the second belongs to with both counters into one word,
+    // so a stale bucket is reset and incremented by a single compare-and-swap.
+    static constexpr int day_bits_ = 20;
+    static constexpr int counter_bits_ = 22;
+    static constexpr uint64_t counter_mask_ = (uint64_t(1) << counter_bits_) - 1;
+
+    std::function<Clock::time_point()> now_;
+    Clock::time_point start_;
+    // one bucket per second of the last day, indexed by the second modulo the day
+    std::unique_ptr<std::array<std::atomic<uint64_t>, seconds_in_day_>> buckets_;
 
-    int empty_requests_count = 0;
+    // readers only, guards the two members below
+    mutable std::mutex minutes_mutex_;
+    // totals of the minutes of the last day that are over, indexed by the minute modulo the day
+    mutable std::vector<Stats> minute_totals_;
+    // the minutes before this one are summed into minute_totals_
+    mutable uint64_t summed_minutes_ = 0;
 
-    const static uint64_t min_in_day_ = 1440;
+    uint64_t GetCurrentSecond() const;
 
-    uint64_t counter_min_ = 0;
+    // the seconds [first, last)
+    Stats SumSeconds(uint64_t first, uint64_t last) const;
 
-    void AddRequest(int request_size);
+    // the minutes [first, last), all of them over
+    Stats SumMinutes(uint64_t first, uint64_t last) const;
 };
 
 template <typename DocumentPredicate>
@@ -43,4 +101,19 @@ std::vector<Document> RequestQueue::AddFindRequest(const std::string& raw_query,
     auto request = member.FindTopDocuments(raw_query, document_predicate);
     RequestQueue::AddRequest(request.size());
     return request;
-}
\ No newline at end of file
+}
+
+template <typename Policy, typename DocumentPredicate>
+std::vector<Document> RequestQueue::AddFindRequest(Policy& policy, const std::string& raw_query,
+    DocumentPredicate document_predicate) {
+    auto request = member.FindTopDocuments(policy, raw_query, document_predicate);
+    AddRequest(request.size());
+    return request;
+}
+
+template <typename Policy>
+std::vector<Document> RequestQueue::AddFindRequest(Policy& policy, const std::string& raw_query) {
+    auto request = member.FindTopDocuments(policy, raw_query);
+    AddRequest(request.size());
+    return request;
+}
@@ -0,0 +1,160 @@
+#include "search_client.h"
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <future>
+#include <memory>
+#include <stdexcept>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+const size_t READ_BUFFER_SIZE = 64 * 1024;
+
+using Clock = chrono::steady_clock;
+
+struct ConnectionLoad {
+    uint64_t invalid_queries = 0;
+    LatencyHistogram latencies;
+};
+
+ConnectionLoad RunConnectionLoad(SearchClient& client, const vector<string>& queries, size_t first_query,
+    const LoadOptions& options) {
+    ConnectionLoad load;
+    const size_t total = options.requests_per_connection;
+    vector<Clock::time_point> sent_at(total);
+    size_t sent = 0;
+    const auto send_next = [&] {
+        sent_at[sent] = Clock::now();
+        client.Send({ static_cast<uint32_t>(sent), DocumentStatus::ACTUAL, queries[(first_query + sent) % queries.size()] });
+        ++sent;
+    };
+    while (sent < min(total, options.pipeline_depth)) {
+        send_next();
+    }
+    for (size_t received = 0; received < total; ++received) {
+        const SearchReply reply = client.Receive();
+        const auto latency = Clock::now() - sent_at.at(reply.request_id);
+        load.latencies.Record(static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(latency).count()));
+        if (reply.code != ReplyCode::OK) {
+            ++load.invalid_queries;
+        }
+        if (sent < total) {
+            send_next();
+        }
+    }
+    return load;
+}
+
+}
+
+SearchClient::SearchClient(const string& socket_path) {
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path.empty() || socket_path.size() >= sizeof(address.sun_path)) {
+        throw invalid_argument("Недопустимый путь к сокету "s + socket_path);
+    }
+    copy(socket_path.begin(), socket_path.end(), address.sun_path);
+    fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (fd_ < 0 || connect(fd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0) {
+        const string reason = strerror(errno);
+        if (fd_ >= 0) {
+            close(fd_);
+        }
+        throw runtime_error("Не удалось подключиться к "s + socket_path + ": "s + reason);
+    }
+}
+
+SearchClient::~SearchClient() {
+    close(fd_);
+}
+
+void SearchClient::Send(const SearchRequest& request) {
+    string frame;
+    AppendFrame(frame, request);
+    string_view data = frame;
+    while (!data.empty()) {
+        const ssize_t sent = send(fd_, data.data(), data.size(), MSG_NOSIGNAL);
+        if (sent < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw runtime_error("Соединение с сервером закрыто: "s + strerror(errno));
+        }
+        data.remove_prefix(static_cast<size_t>(sent));
+    }
+}
+
+SearchReply SearchClient::Receive() {
+    char buffer[READ_BUFFER_SIZE];
+    while (true) {
+        if (const size_t frame_size = GetFrameSize(input_)) {
+            SearchReply reply = ParseReply(string_view(input_).substr(FRAME_HEADER_SIZE, frame_size - FRAME_HEADER_SIZE));
+            input_.erase(0, frame_size);
+            return reply;
+        }
+        const ssize_t size = recv(fd_, buffer, sizeof(buffer), 0);
+        if (size < 0 && errno == EINTR) {
+            continue;
+        }
+        if (size <= 0) {
+            throw runtime_error("Соединение с сервером закрыто"s);
+        }
+        input_.append(buffer, static_cast<size_t>(size));
+    }
+}
+
+vector<Document> SearchClient::FindTopDocuments(string_view raw_query, DocumentStatus status) {
+    const uint32_t request_id = next_request_id_++;
+    Send({ request_id, status, string(raw_query) });
+    SearchReply reply = Receive();
+    if (reply.request_id != request_id) {
+        throw logic_error("Получен ответ на другой запрос"s);
+    }
+    if (reply.code == ReplyCode::INVALID_QUERY) {
+        throw invalid_argument(reply.error);
+    }
+    if (reply.code != ReplyCode::OK) {
+        throw runtime_error(reply.error);
+    }
+    return move(reply.documents);
+}
+
+double LoadReport::GetThroughput() const {
+    const double seconds = chrono::duration<double>(duration).count();
+    return seconds > 0 ? requests / seconds : 0.0;
+}
+
+LoadReport RunLoad(const string& socket_path, const vector<string>& queries, const LoadOptions& options) {
+    if (queries.empty() || options.pipeline_depth == 0) {
+        throw invalid_argument("Нужны запросы и хотя бы один запрос в полёте"s);
+    }
+    // connected before the clock starts, an unreachable daemon throws here
+    vector<unique_ptr<SearchClient>> clients;
+    for (size_t i = 0; i < options.connections; ++i) {
+        clients.push_back(make_unique<SearchClient>(socket_path));
+    }
+
+    const auto start = Clock::now();
+    vector<future<ConnectionLoad>> loads;
+    for (size_t i = 0; i < clients.size(); ++i) {
+        // connections start at different queries, so a batch is not one query repeated
+        const size_t first_query = i * queries.size() / clients.size();
+        loads.push_back(async(launch::async, [&client = *clients[i], &queries, first_query, &options] {
+            return RunConnectionLoad(client, queries, first_query, options);
+            }));
+    }
+    LoadReport report;
+    for (auto& load : loads) {
+        const ConnectionLoad connection_load = load.get();
+        report.invalid_queries += connection_load.invalid_queries;
+        report.latencies += connection_load.latencies;
+    }
+    report.duration = chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start);
+    report.requests = report.latencies.GetCount();
+    return report;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include "metrics.h"
+#include "search_protocol.h"
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A connection to a SearchDaemon. Several requests may be sent before their replies are
+// read. A client is used by one thread at a time.
+class SearchClient {
+public:
+    // throws runtime_error when nobody listens on socket_path
+    explicit SearchClient(const std::string& socket_path);
+
+    SearchClient(const SearchClient&) = delete;
+    SearchClient& operator=(const SearchClient&) = delete;
+
+    ~SearchClient();
+
+    // sends the request without waiting for its reply
+    void Send(const SearchRequest& request);
+
+    // the next reply the daemon has sent, not necessarily to the oldest request.
+    // Throws runtime_error when the connection is closed
+    SearchReply Receive();
+
+    // sends one request and waits for its reply, an invalid query throws invalid_argument,
+    // a query the server failed to evaluate throws runtime_error.
+    // Must not be mixed with unanswered requests of Send
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL);
+
+private:
+    int fd_ = -1;
+    std::string input_;
+    uint32_t next_request_id_ = 0;
+};
+
+struct LoadOptions {
+    size_t connections = 4;
+    size_t requests_per_connection = 1000;
+    // requests every connection keeps in flight
+    size_t pipeline_depth = 8;
+};
+
+struct LoadReport {
+    uint64_t requests = 0;
+    uint64_t invalid_queries = 0;
+    std::chrono::nanoseconds duration{ 0 };
+    // nanoseconds from sending a request to receiving its reply
+    LatencyHistogram latencies;
+
+    // answered requests per second
+    double GetThroughput() const;
+};
+
+// Closed-loop load: every connection in its own thread sends the queries round robin
+// and sends the next one as soon as a reply comes. Throws runtime_error when the
+// daemon is not reachable
+LoadReport RunLoad(const std::string& socket_path, const std::vector<std::string>& queries,
+    const LoadOptions& options = {});
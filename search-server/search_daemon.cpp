@@ -0,0 +1,400 @@
+#include "search_daemon.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <execution>
+#include <iterator>
+#include <stdexcept>
+#include <utility>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+using namespace std;
+
+namespace {
+
+const size_t READ_BUFFER_SIZE = 64 * 1024;
+
+// a connection that has not read this much of its replies is dropped
+const size_t MAX_OUTPUT_SIZE = 64 * 1024 * 1024;
+
+// how long Stop waits for the clients to read the last replies
+const chrono::milliseconds STOP_FLUSH_TIMEOUT{ 1000 };
+
+void CloseDescriptor(int& fd) {
+    if (fd >= 0) {
+        close(fd);
+        fd = -1;
+    }
+}
+
+bool SetNonBlocking(int fd) {
+    const int flags = fcntl(fd, F_GETFL);
+    return flags >= 0 && fcntl(fd, F_SETFL, flags | O_NONBLOCK) == 0;
+}
+
+}
+
+struct SearchDaemon::Connection {
+    explicit Connection(int fd)
+        : fd(fd) {
+    }
+
+    Connection(const Connection&) = delete;
+    Connection& operator=(const Connection&) = delete;
+
+    // the descriptor stays open while replies to the connection are pending
+    ~Connection() {
+        close(fd);
+    }
+
+    const int fd;
+    // bytes of frames not parsed yet, used by the I/O thread only
+    string input;
+    // input holds complete frames held back until requests are answered, used by the I/O thread only
+    bool input_waiting = false;
+    // the peer sends no more requests, used by the I/O thread only
+    bool input_closed = false;
+    // requests queued and not answered yet
+    atomic<size_t> pending_requests = 0;
+
+    // guards output and broken
+    mutex output_mutex;
+    // replies the socket has not taken yet
+    string output;
+    // the peer is gone or reads too slowly, its replies are dropped
+    bool broken = false;
+
+    // sends as much of the output as the socket takes without blocking, output_mutex must be held
+    void SendOutput() {
+        size_t offset = 0;
+        while (offset < output.size()) {
+            const ssize_t sent = send(fd, output.data() + offset, output.size() - offset, MSG_NOSIGNAL | MSG_DONTWAIT);
+            if (sent < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                    broken = true;
+                    output.clear();
+                    return;
+                }
+                break;
+            }
+            offset += static_cast<size_t>(sent);
+        }
+        output.erase(0, offset);
+    }
+
+    bool HasOutput() {
+        lock_guard guard(output_mutex);
+        return !output.empty();
+    }
+};
+
+SearchDaemon::SearchDaemon(const SearchServer& server, string socket_path, SearchDaemonOptions options)
+    : server_(server)
+    , socket_path_(move(socket_path))
+    , options_(options) {
+    if (options_.max_batch_size == 0) {
+        throw invalid_argument("Размер пакета запросов должен быть положительным"s);
+    }
+    if (options_.max_pending_requests == 0) {
+        throw invalid_argument("Число запросов соединения без ответа должно быть положительным"s);
+    }
+    sockaddr_un address{};
+    address.sun_family = AF_UNIX;
+    if (socket_path_.empty() || socket_path_.size() >= sizeof(address.sun_path)) {
+        throw invalid_argument("Недопустимый путь к сокету "s + socket_path_);
+    }
+    copy(socket_path_.begin(), socket_path_.end(), address.sun_path);
+
+    // a socket file left by a daemon that has not stopped cleanly is replaced, one that a
+    // daemon still accepts connections on is not, and other files are kept
+    struct stat file_status {};
+    if (stat(socket_path_.c_str(), &file_status) == 0 && S_ISSOCK(file_status.st_mode)) {
+        int probe = socket(AF_UNIX, SOCK_STREAM, 0);
+        const bool in_use = probe >= 0 && connect(probe, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) == 0;
+        CloseDescriptor(probe);
+        if (in_use) {
+            throw runtime_error("Сокет "s + socket_path_ + " уже используется"s);
+        }
+        unlink(socket_path_.c_str());
+    }
+    listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd_ < 0 || bind(listen_fd_, reinterpret_cast<const sockaddr*>(&address), sizeof(address)) != 0
+        || listen(listen_fd_, SOMAXCONN) != 0 || pipe(wake_pipe_) != 0
+        || !SetNonBlocking(wake_pipe_[0]) || !SetNonBlocking(wake_pipe_[1])) {
+        const string reason = strerror(errno);
+        CloseDescriptor(listen_fd_);
+        CloseDescriptor(wake_pipe_[0]);
+        CloseDescriptor(wake_pipe_[1]);
+        throw runtime_error("Не удалось открыть сокет "s + socket_path_ + ": "s + reason);
+    }
+    io_thread_ = thread([this] { ServeConnections(); });
+    batch_thread_ = thread([this] { ServeBatches(); });
+}
+
+SearchDaemon::~SearchDaemon() {
+    Stop();
+}
+
+void SearchDaemon::Stop() {
+    if (!io_thread_.joinable()) {
+        return;
+    }
+    // the I/O thread leaves first, so nothing is queued after the batch thread has drained the queue
+    io_stopping_ = true;
+    Wake();
+    io_thread_.join();
+    {
+        lock_guard guard(mutex_);
+        stopping_ = true;
+    }
+    request_added_.notify_all();
+    batch_thread_.join();
+    FlushAfterStop();
+    connections_.clear();
+
+    CloseDescriptor(listen_fd_);
+    CloseDescriptor(wake_pipe_[0]);
+    CloseDescriptor(wake_pipe_[1]);
+    unlink(socket_path_.c_str());
+}
+
+SearchDaemon::Stats SearchDaemon::GetStats() const {
+    return { connection_count_.load(), request_count_.load(), batch_count_.load(), protocol_error_count_.load() };
+}
+
+void SearchDaemon::Wake() {
+    // the pipe is non-blocking, when it is full the I/O thread is woken anyway
+    const char wake = 0;
+    [[maybe_unused]] const ssize_t written = write(wake_pipe_[1], &wake, 1);
+}
+
+void SearchDaemon::ServeConnections() {
+    vector<pollfd> descriptors;
+    vector<PendingRequest> received;
+    vector<char> buffer(READ_BUFFER_SIZE);
+    while (true) {
+        descriptors.clear();
+        descriptors.push_back({ wake_pipe_[0], POLLIN, 0 });
+        descriptors.push_back({ listen_fd_, POLLIN, 0 });
+        for (const auto& connection : connections_) {
+            // a connection at its limit of unanswered requests is read again once the batch thread wakes us
+            const bool readable = !connection->input_closed && !connection->input_waiting
+                && connection->pending_requests < options_.max_pending_requests;
+            const short events = (readable ? POLLIN : 0) | (connection->HasOutput() ? POLLOUT : 0);
+            // a connection waiting only for its replies is left out, a closed peer would report POLLHUP forever
+            descriptors.push_back({ events != 0 ? connection->fd : -1, events, 0 });
+        }
+        if (poll(descriptors.data(), descriptors.size(), -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return;
+        }
+        if (descriptors[0].revents != 0) {
+            while (read(wake_pipe_[0], buffer.data(), buffer.size()) > 0) {
+            }
+            if (io_stopping_) {
+                return;
+            }
+        }
+
+        const auto now = Clock::now();
+        for (size_t i = 2; i < descriptors.size(); ++i) {
+            const short revents = descriptors[i].revents;
+            if (revents == 0) {
+                continue;
+            }
+            Connection& connection = *connections_[i - 2];
+            if (revents & (POLLOUT | POLLERR | POLLHUP)) {
+                lock_guard guard(connection.output_mutex);
+                connection.SendOutput();
+            }
+            if (connection.input_closed || connection.input_waiting || (revents & (POLLIN | POLLERR | POLLHUP)) == 0) {
+                continue;
+            }
+            const ssize_t size = recv(connection.fd, buffer.data(), buffer.size(), 0);
+            if (size < 0 && errno == EINTR) {
+                continue;
+            }
+            if (size <= 0) {
+                connection.input_closed = true;
+                continue;
+            }
+            connection.input.append(buffer.data(), static_cast<size_t>(size));
+        }
+        // also the frames held back earlier, whose connections may have got replies meanwhile
+        for (const auto& connection : connections_) {
+            ParseRequests(connection, now, received);
+        }
+        // a connection lives on while its requests are answered and the replies sent
+        connections_.erase(remove_if(connections_.begin(), connections_.end(), [](const shared_ptr<Connection>& connection) {
+            if (!connection->input_closed || connection->input_waiting || connection->pending_requests > 0) {
+                return false;
+            }
+            lock_guard guard(connection->output_mutex);
+            return connection->output.empty();
+            }), connections_.end());
+
+        if (descriptors[1].revents & POLLIN) {
+            const int fd = accept(listen_fd_, nullptr, nullptr);
+            if (fd >= 0) {
+                connections_.push_back(make_shared<Connection>(fd));
+                ++connection_count_;
+            }
+        }
+
+        if (!received.empty()) {
+            {
+                lock_guard guard(mutex_);
+                move(received.begin(), received.end(), back_inserter(queue_));
+            }
+            received.clear();
+            request_added_.notify_one();
+        }
+    }
+}
+
+void SearchDaemon::ParseRequests(const shared_ptr<Connection>& connection, Clock::time_point now,
+    vector<PendingRequest>& received) {
+    string& input = connection->input;
+    try {
+        size_t offset = 0;
+        while (connection->pending_requests < options_.max_pending_requests) {
+            const size_t frame_size = GetFrameSize(string_view(input).substr(offset));
+            if (frame_size == 0) {
+                break;
+            }
+            const string_view payload = string_view(input).substr(offset + FRAME_HEADER_SIZE,
+                frame_size - FRAME_HEADER_SIZE);
+            received.push_back({ connection, ParseRequest(payload), now });
+            ++connection->pending_requests;
+            offset += frame_size;
+        }
+        input.erase(0, offset);
+        connection->input_waiting = GetFrameSize(input) != 0;
+    }
+    catch (const invalid_argument&) {
+        // the requests parsed so far are still answered
+        ++protocol_error_count_;
+        connection->input_closed = true;
+        connection->input_waiting = false;
+        input.clear();
+    }
+}
+
+void SearchDaemon::ServeBatches() {
+    vector<PendingRequest> batch;
+    while (true) {
+        {
+            unique_lock lock(mutex_);
+            request_added_.wait(lock, [this] { return stopping_ || !queue_.empty(); });
+            if (queue_.empty()) {
+                return;
+            }
+            // waits for the batch to fill up, but not longer than its oldest request may wait
+            const auto deadline = queue_.front().received + options_.batch_window;
+            request_added_.wait_until(lock, deadline, [this] {
+                return stopping_ || queue_.size() >= options_.max_batch_size;
+                });
+            const auto batch_end = queue_.begin() + min(queue_.size(), options_.max_batch_size);
+            batch.assign(make_move_iterator(queue_.begin()), make_move_iterator(batch_end));
+            queue_.erase(queue_.begin(), batch_end);
+        }
+        EvaluateBatch(batch);
+        batch.clear();
+    }
+}
+
+void SearchDaemon::EvaluateBatch(const vector<PendingRequest>& batch) {
+    vector<SearchReply> replies(batch.size());
+    transform(execution::par, batch.begin(), batch.end(), replies.begin(), [this](const PendingRequest& pending) {
+        SearchReply reply;
+        reply.request_id = pending.request.request_id;
+        try {
+            reply.documents = server_.FindTopDocuments(pending.request.raw_query, pending.request.status);
+        }
+        catch (const invalid_argument& error) {
+            reply.code = ReplyCode::INVALID_QUERY;
+            reply.error = error.what();
+        }
+        catch (const exception& error) {
+            // an exception must not leave the parallel algorithm, it would terminate the daemon
+            reply.code = ReplyCode::QUERY_FAILED;
+            reply.error = error.what();
+        }
+        return reply;
+        });
+
+    // a batch has a few connections, so a linear search groups the replies well enough
+    vector<pair<Connection*, string>> outputs;
+    for (size_t i = 0; i < batch.size(); ++i) {
+        Connection* connection = batch[i].connection.get();
+        auto output = find_if(outputs.begin(), outputs.end(), [connection](const auto& item) {
+            return item.first == connection;
+            });
+        if (output == outputs.end()) {
+            output = outputs.insert(outputs.end(), { connection, string() });
+        }
+        AppendFrame(output->second, replies[i]);
+    }
+    // counted before sending, so a client that has its replies sees them in the stats
+    request_count_ += batch.size();
+    ++batch_count_;
+    for (auto& [connection, data] : outputs) {
+        lock_guard guard(connection->output_mutex);
+        if (connection->broken) {
+            continue;
+        }
+        connection->output += data;
+        connection->SendOutput();
+        if (connection->output.size() > MAX_OUTPUT_SIZE) {
+            connection->broken = true;
+            connection->output.clear();
+            shutdown(connection->fd, SHUT_RDWR);
+        }
+    }
+    // answered only now, so the I/O thread does not drop a connection before its replies are queued
+    for (const PendingRequest& pending : batch) {
+        --pending.connection->pending_requests;
+    }
+    // the I/O thread writes what the sockets have not taken and drops the finished connections
+    Wake();
+}
+
+void SearchDaemon::FlushAfterStop() {
+    const auto deadline = Clock::now() + STOP_FLUSH_TIMEOUT;
+    vector<pollfd> descriptors;
+    vector<Connection*> waiting;
+    while (true) {
+        descriptors.clear();
+        waiting.clear();
+        for (const auto& connection : connections_) {
+            if (connection->HasOutput()) {
+                descriptors.push_back({ connection->fd, POLLOUT, 0 });
+                waiting.push_back(connection.get());
+            }
+        }
+        const auto timeout = chrono::duration_cast<chrono::milliseconds>(deadline - Clock::now());
+        if (waiting.empty() || timeout.count() <= 0) {
+            return;
+        }
+        if (poll(descriptors.data(), descriptors.size(), static_cast<int>(timeout.count())) < 0 && errno != EINTR) {
+            return;
+        }
+        for (size_t i = 0; i < descriptors.size(); ++i) {
+            if (descriptors[i].revents != 0) {
+                lock_guard guard(waiting[i]->output_mutex);
+                waiting[i]->SendOutput();
+            }
+        }
+    }
+}
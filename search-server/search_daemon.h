@@ -0,0 +1,120 @@
+#pragma once
+
+#include "search_protocol.h"
+#include "search_server.h"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+struct SearchDaemonOptions {
+    // a batch is evaluated once it has this many requests
+    size_t max_batch_size = 64;
+    // or when its first request has waited this long
+    std::chrono::microseconds batch_window{ 200 };
+    // a connection is not read while it has this many requests unanswered
+    size_t max_pending_requests = 1024;
+};
+
+/**
+ * Serves a SearchServer over a Unix domain socket with the protocol of search_protocol.h.
+ *
+ * One thread polls the listening socket and the connections and parses the frames. Requests
+ * of all the connections go to one queue, a second thread takes them in micro-batches and
+ * evaluates a batch in parallel like ProcessQueries. Replies of a batch are appended to the
+ * output buffer of every connection and sent without blocking: the batch thread sends what the
+ * socket takes at once, the I/O thread writes the rest when the socket becomes writable. So a
+ * client may keep many requests in flight on one connection, and a client that does not read
+ * its replies delays only itself. Its connection is dropped once 64 MB of them pile up.
+ * A connection with max_pending_requests unanswered requests is not read until replies to
+ * some of them are queued, so the requests held for a client stay bounded too.
+ *
+ * The server must not change while the daemon runs.
+ *
+ * Пример использования:
+ *
+ *  SearchDaemon daemon(server, "/tmp/search.sock"s);
+ *  SearchClient client("/tmp/search.sock"s);
+ *  const auto documents = client.FindTopDocuments("пушистый кот"s);
+ */
+class SearchDaemon {
+public:
+    struct Stats {
+        uint64_t connections = 0;
+        uint64_t requests = 0;
+        uint64_t batches = 0;
+        uint64_t protocol_errors = 0;
+    };
+
+    // binds the socket, a stale socket file at socket_path is replaced. Throws runtime_error when
+    // the socket cannot be opened or another daemon still accepts connections on it
+    SearchDaemon(const SearchServer& server, std::string socket_path, SearchDaemonOptions options = {});
+
+    SearchDaemon(const SearchDaemon&) = delete;
+    SearchDaemon& operator=(const SearchDaemon&) = delete;
+
+    ~SearchDaemon();
+
+    // answers the queued requests, waits up to a second for the clients to read the replies,
+    // closes the connections and removes the socket file
+    void Stop();
+
+    Stats GetStats() const;
+
+private:
+    using Clock = std::chrono::steady_clock;
+
+    struct Connection;
+
+    struct PendingRequest {
+        std::shared_ptr<Connection> connection;
+        SearchRequest request;
+        Clock::time_point received;
+    };
+
+    const SearchServer& server_;
+    const std::string socket_path_;
+    const SearchDaemonOptions options_;
+    int listen_fd_ = -1;
+    // writing to wake_pipe_[1] interrupts the poll of the I/O thread
+    int wake_pipe_[2] = { -1, -1 };
+    std::atomic<bool> io_stopping_ = false;
+    // used by the I/O thread, and by Stop once the thread has left
+    std::vector<std::shared_ptr<Connection>> connections_;
+
+    std::mutex mutex_;
+    std::condition_variable request_added_;
+    std::deque<PendingRequest> queue_;
+    bool stopping_ = false;
+
+    std::atomic<uint64_t> connection_count_ = 0;
+    std::atomic<uint64_t> request_count_ = 0;
+    std::atomic<uint64_t> batch_count_ = 0;
+    std::atomic<uint64_t> protocol_error_count_ = 0;
+
+    // started last, after everything they use
+    std::thread io_thread_;
+    std::thread batch_thread_;
+
+    void Wake();
+
+    void ServeConnections();
+
+    // moves the complete frames of the connection input to received while the connection
+    // has fewer than max_pending_requests unanswered requests
+    void ParseRequests(const std::shared_ptr<Connection>& connection, Clock::time_point now,
+        std::vector<PendingRequest>& received);
+
+    void ServeBatches();
+
+    void EvaluateBatch(const std::vector<PendingRequest>& batch);
+
+    // sends the replies left after the threads have stopped, for up to a second
+    void FlushAfterStop();
+};
@@ -0,0 +1,155 @@
+#include "search_protocol.h"
+#include "little_endian.h"
+#include <cstring>
+#include <limits>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+void AppendDouble(string& out, double value) {
+    uint64_t bits = 0;
+    memcpy(&bits, &value, sizeof(bits));
+    AppendLittleEndian(out, bits);
+}
+
+// writes a zero length first and patches it once the payload is known
+size_t BeginFrame(string& out) {
+    const size_t header_pos = out.size();
+    AppendLittleEndian(out, uint32_t{ 0 });
+    return header_pos;
+}
+
+void EndFrame(string& out, size_t header_pos) {
+    const size_t payload_size = out.size() - header_pos - FRAME_HEADER_SIZE;
+    if (payload_size > MAX_FRAME_PAYLOAD_SIZE) {
+        out.resize(header_pos);
+        throw invalid_argument("Сообщение превышает максимальный размер кадра"s);
+    }
+    for (size_t i = 0; i < FRAME_HEADER_SIZE; ++i) {
+        out[header_pos + i] = static_cast<char>((payload_size >> (8 * i)) & 0xFF);
+    }
+}
+
+class PayloadReader {
+public:
+    explicit PayloadReader(string_view payload)
+        : payload_(payload) {
+    }
+
+    template <typename Integer>
+    Integer ReadInteger() {
+        return ParseLittleEndian<Integer>(Take(sizeof(Integer)));
+    }
+
+    double ReadDouble() {
+        const uint64_t bits = ReadInteger<uint64_t>();
+        double value = 0.0;
+        memcpy(&value, &bits, sizeof(value));
+        return value;
+    }
+
+    string_view ReadRest() {
+        return Take(payload_.size());
+    }
+
+    bool IsEmpty() const {
+        return payload_.empty();
+    }
+
+private:
+    string_view payload_;
+
+    string_view Take(size_t size) {
+        if (payload_.size() < size) {
+            throw invalid_argument("Сообщение обрывается раньше времени"s);
+        }
+        const string_view bytes = payload_.substr(0, size);
+        payload_.remove_prefix(size);
+        return bytes;
+    }
+};
+
+}
+
+void AppendFrame(string& out, const SearchRequest& request) {
+    const size_t header_pos = BeginFrame(out);
+    AppendLittleEndian(out, request.request_id);
+    AppendLittleEndian(out, static_cast<uint8_t>(request.status));
+    out += request.raw_query;
+    EndFrame(out, header_pos);
+}
+
+void AppendFrame(string& out, const SearchReply& reply) {
+    if (reply.documents.size() > numeric_limits<uint16_t>::max()) {
+        throw invalid_argument("Слишком много документов в ответе"s);
+    }
+    const size_t header_pos = BeginFrame(out);
+    AppendLittleEndian(out, reply.request_id);
+    AppendLittleEndian(out, static_cast<uint8_t>(reply.code));
+    if (reply.code == ReplyCode::OK) {
+        AppendLittleEndian(out, static_cast<uint16_t>(reply.documents.size()));
+        for (const Document& document : reply.documents) {
+            AppendLittleEndian(out, static_cast<int32_t>(document.id));
+            AppendDouble(out, document.relevance);
+            AppendLittleEndian(out, static_cast<int32_t>(document.rating));
+        }
+    }
+    else {
+        out += reply.error;
+    }
+    EndFrame(out, header_pos);
+}
+
+size_t GetFrameSize(string_view buffer) {
+    if (buffer.size() < FRAME_HEADER_SIZE) {
+        return 0;
+    }
+    const auto payload_size = PayloadReader(buffer.substr(0, FRAME_HEADER_SIZE)).ReadInteger<uint32_t>();
+    if (payload_size > MAX_FRAME_PAYLOAD_SIZE) {
+        throw invalid_argument("Сообщение превышает максимальный размер кадра"s);
+    }
+    const size_t frame_size = FRAME_HEADER_SIZE + payload_size;
+    return buffer.size() < frame_size ? 0 : frame_size;
+}
+
+SearchRequest ParseRequest(string_view payload) {
+    PayloadReader reader(payload);
+    SearchRequest request;
+    request.request_id = reader.ReadInteger<uint32_t>();
+    const auto status = reader.ReadInteger<uint8_t>();
+    if (status > static_cast<uint8_t>(DocumentStatus::REMOVED)) {
+        throw invalid_argument("Неизвестный статус документа в запросе"s);
+    }
+    request.status = static_cast<DocumentStatus>(status);
+    request.raw_query = string(reader.ReadRest());
+    return request;
+}
+
+SearchReply ParseReply(string_view payload) {
+    PayloadReader reader(payload);
+    SearchReply reply;
+    reply.request_id = reader.ReadInteger<uint32_t>();
+    const auto code = reader.ReadInteger<uint8_t>();
+    if (code > static_cast<uint8_t>(ReplyCode::QUERY_FAILED)) {
+        throw invalid_argument("Неизвестный код ответа"s);
+    }
+    reply.code = static_cast<ReplyCode>(code);
+    if (reply.code != ReplyCode::OK) {
+        reply.error = string(reader.ReadRest());
+        return reply;
+    }
+    const auto count = reader.ReadInteger<uint16_t>();
+    reply.documents.reserve(count);
+    for (uint16_t i = 0; i < count; ++i) {
+        const auto id = reader.ReadInteger<int32_t>();
+        const double relevance = reader.ReadDouble();
+        const auto rating = reader.ReadInteger<int32_t>();
+        reply.documents.emplace_back(id, relevance, rating);
+    }
+    if (!reader.IsEmpty()) {
+        throw invalid_argument("Лишние байты в конце ответа"s);
+    }
+    return reply;
+}
@@ -0,0 +1,55 @@
+#pragma once
+
+#include "document.h"
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Binary protocol of SearchDaemon. Every message is a frame: the payload length as
+// a little-endian uint32 followed by the payload. All integers are little-endian.
+//
+// request payload: uint32 request_id, uint8 status, query bytes up to the end
+// reply payload:   uint32 request_id, uint8 code, then
+//                  for ReplyCode::OK    uint16 count and count * (int32 id, float64 relevance, int32 rating)
+//                  for any other code   error message bytes up to the end
+//
+// Replies on a connection may come in any order, request_id ties them to the requests.
+
+// a longer frame is a protocol error, the connection is closed
+inline constexpr size_t MAX_FRAME_PAYLOAD_SIZE = 1 << 20;
+inline constexpr size_t FRAME_HEADER_SIZE = 4;
+
+struct SearchRequest {
+    uint32_t request_id = 0;
+    DocumentStatus status = DocumentStatus::ACTUAL;
+    std::string raw_query;
+};
+
+enum class ReplyCode : uint8_t {
+    OK,
+    INVALID_QUERY,
+    // the query is well-formed, but the server failed to evaluate it
+    QUERY_FAILED,
+};
+
+struct SearchReply {
+    uint32_t request_id = 0;
+    ReplyCode code = ReplyCode::OK;
+    std::vector<Document> documents;
+    std::string error;
+};
+
+void AppendFrame(std::string& out, const SearchRequest& request);
+
+void AppendFrame(std::string& out, const SearchReply& reply);
+
+// size of the frame at the beginning of the buffer with its header, 0 while it is incomplete.
+// Throws invalid_argument when the announced payload is longer than MAX_FRAME_PAYLOAD_SIZE
+size_t GetFrameSize(std::string_view buffer);
+
+// payload is a frame without its header, malformed payloads throw invalid_argument
+SearchRequest ParseRequest(std::string_view payload);
+
+SearchReply ParseReply(std::string_view payload);
@@ -1,9 +1,20 @@
 #include "search_server.h"
 #include <numeric>
+#include <cctype>
 #include <cmath>
 
 using namespace std;
 
+namespace {
+
+// neighbouring postings are a few pointer hops away, farther ones are found from the root
+const int MAX_LINEAR_SKIP_STEPS = 8;
+
+// documents AddDocuments splits into words before adding them to the index
+const size_t TOKENIZE_BATCH_SIZE = 4096;
+
+}
+
 SearchServer::SearchServer(const string& stop_words_text)
     : SearchServer(SplitIntoWords(stop_words_text))  // Invoke delegating constructor from string container
 {
@@ -20,30 +31,289 @@ SearchServer::SearchServer(const string_view stop_words_text)
     }
 }
 
+SearchServer::SearchServer(const SearchServer& other)
+    : stop_words_(other.stop_words_, memory_.stop_words)
+    , dictionary_(other.dictionary_, memory_.dictionary)
+    , forward_index_(other.forward_index_, CountingAllocator<TermFrequency>(memory_.forward_index))
+    , forward_index_garbage_(other.forward_index_garbage_)
+    , documents_(other.documents_, CountingAllocator<pair<const int, DocumentData>>(memory_.documents))
+    , documents_order_(other.documents_order_, CountingAllocator<int>(memory_.documents_order))
+    , total_document_length_(other.total_document_length_)
+    , slot_to_document_id_(other.slot_to_document_id_, CountingAllocator<int>(memory_.slots))
+    , free_slots_(other.free_slots_, CountingAllocator<int>(memory_.slots))
+    , analyzer_(other.analyzer_) {
+    // the postings are copied one by one, a vector copy would keep their allocators
+    term_to_document_freqs_.reserve(other.term_to_document_freqs_.size());
+    for (const Postings& postings : other.term_to_document_freqs_) {
+        term_to_document_freqs_.emplace_back(postings, term_to_document_freqs_.get_allocator());
+    }
+    if (other.positions_) {
+        positions_.emplace(*other.positions_, memory_.positions);
+    }
+    if (other.impacts_) {
+        impacts_.emplace(*other.impacts_, memory_.impacts);
+    }
+    if (other.statistics_) {
+        statistics_.emplace(*other.statistics_, memory_.statistics);
+    }
+}
+
+SearchServer& SearchServer::operator=(const SearchServer& other) {
+    if (this != &other) {
+        SearchServer copy(other);
+        MoveFrom(copy);
+    }
+    return *this;
+}
+
+SearchServer::SearchServer(SearchServer&& other) {
+    MoveFrom(other);
+}
+
+SearchServer& SearchServer::operator=(SearchServer&& other) {
+    if (this != &other) {
+        MoveFrom(other);
+    }
+    return *this;
+}
+
+void SearchServer::MoveFrom(SearchServer& other) {
+    memory_ = exchange(other.memory_, MemoryCounters());
+    // other's new empty containers report to its fresh counters
+    const MemoryCounters& fresh = other.memory_;
+    stop_words_ = exchange(other.stop_words_, StopWordSet(fresh.stop_words));
+    dictionary_ = exchange(other.dictionary_, TermDictionary(fresh.dictionary));
+    term_to_document_freqs_ = exchange(other.term_to_document_freqs_, MakeCounted<CountedVector<Postings>>(fresh.postings));
+    forward_index_ = exchange(other.forward_index_, MakeCounted<CountedVector<TermFrequency>>(fresh.forward_index));
+    forward_index_garbage_ = exchange(other.forward_index_garbage_, 0);
+    documents_ = exchange(other.documents_, MakeCounted<CountedMap<int, DocumentData>>(fresh.documents));
+    documents_order_ = exchange(other.documents_order_, MakeCounted<CountedSet<int>>(fresh.documents_order));
+    total_document_length_ = exchange(other.total_document_length_, 0);
+    slot_to_document_id_ = exchange(other.slot_to_document_id_, MakeCounted<CountedVector<int>>(fresh.slots));
+    free_slots_ = exchange(other.free_slots_, MakeCounted<CountedVector<int>>(fresh.slots));
+    positions_ = exchange(other.positions_, nullopt);
+    impacts_ = exchange(other.impacts_, nullopt);
+    statistics_ = exchange(other.statistics_, nullopt);
+    analyzer_ = exchange(other.analyzer_, nullopt);
+}
+
+void SearchServer::EnablePositionalIndex() {
+    if (!documents_.empty()) {
+        throw logic_error("     "s);
+    }
+    positions_.emplace(memory_.positions);
+}
+
+void SearchServer::EnableImpactOrder() {
+    if (!documents_.empty()) {
+        throw logic_error("      "s);
+    }
+    impacts_.emplace(memory_.impacts);
+}
+
+void SearchServer::EnableTextAnalysis(TextAnalysisOptions options) {
+    if (!documents_.empty()) {
+        throw logic_error("     "s);
+    }
+    // a second call would analyze the analyzed stop words again
+    if (analyzer_) {
+        throw logic_error("   "s);
+    }
+    // the server changes only once the stop words are analyzed and assigned
+    TextAnalyzer analyzer(move(options));
+    set<string, less<>> stop_words;
+    for (const string& word : stop_words_.GetWords()) {
+        const optional<string> analyzed = analyzer.NormalizeDocument(word);
+        for (const string_view part : SplitIntoWords(analyzed ? *analyzed : word)) {
+            stop_words.emplace(part);
+        }
+    }
+    stop_words_.Assign(vector<string_view>(stop_words.begin(), stop_words.end()));
+    analyzer_.emplace(move(analyzer));
+}
+
+void SearchServer::EnableStatisticsSnapshots(double max_drift) {
+    if (!(max_drift >= 0.0)) {
+        throw invalid_argument("     "s);
+    }
+    statistics_.emplace(max_drift, memory_.statistics);
+    for (int term_id = 0; term_id < static_cast<int>(term_to_document_freqs_.size()); ++term_id) {
+        if (!term_to_document_freqs_[term_id].empty()) {
+            statistics_->MarkChanged(term_id);
+        }
+    }
+    RefreshStatistics();
+}
+
+void SearchServer::RefreshStatistics() {
+    if (statistics_) {
+        statistics_->Refresh(GetDocumentCount(), total_document_length_, [this](int term_id) {
+            return static_cast<int>(term_to_document_freqs_[term_id].size());
+            });
+    }
+}
+
+uint64_t SearchServer::GetStatisticsGeneration() const {
+    return statistics_ ? statistics_->GetGeneration() : 0;
+}
+
 void SearchServer::AddDocument(int document_id, const string_view document, DocumentStatus status,
     const vector<int>& ratings) {
+    CheckNewDocumentId(document_id);
+    AddTokenizedDocument(document_id, TokenizeDocument(document), status, ratings);
+}
+
+void SearchServer::AddDocuments(const vector<DocumentRecord>& documents) {
+    CheckNewDocumentIds(documents);
+    for (const DocumentRecord& document : documents) {
+        CheckDocumentText(document.text);
+    }
+    for (const DocumentRecord& document : documents) {
+        AddTokenizedDocument(document.id, TokenizeDocument(document.text), document.status, document.ratings);
+    }
+}
+
+void SearchServer::AddDocuments(std::execution::parallel_policy policy, const vector<DocumentRecord>& documents) {
+    CheckNewDocuments(policy, documents);
+    // checked texts do not throw, so the words are split in parallel a batch at a time
+    vector<TokenizedDocument> tokenized;
+    vector<size_t> indexes;
+    for (size_t batch_begin = 0; batch_begin < documents.size(); batch_begin += TOKENIZE_BATCH_SIZE) {
+        const size_t batch_end = min(batch_begin + TOKENIZE_BATCH_SIZE, documents.size());
+        tokenized.assign(batch_end - batch_begin, {});
+        indexes.resize(batch_end - batch_begin);
+        iota(indexes.begin(), indexes.end(), batch_begin);
+        for_each(policy, indexes.begin(), indexes.end(), [this, &documents, &tokenized, batch_begin](size_t i) {
+            tokenized[i - batch_begin] = TokenizeDocument(documents[i].text);
+            });
+        for (size_t i = batch_begin; i < batch_end; ++i) {
+            AddTokenizedDocument(documents[i].id, tokenized[i - batch_begin], documents[i].status, documents[i].ratings);
+        }
+    }
+}
+
+void SearchServer::CheckNewDocuments(std::execution::parallel_policy policy, const vector<DocumentRecord>& documents) const {
+    CheckNewDocumentIds(documents);
+    // an exception must not leave a parallel algorithm, so the first invalid text is only found there
+    const auto invalid = find_if(policy, documents.begin(), documents.end(), [this](const DocumentRecord& document) {
+        try {
+            CheckDocumentText(document.text);
+            return false;
+        }
+        catch (const invalid_argument&) {
+            return true;
+        }
+        });
+    if (invalid != documents.end()) {
+        CheckDocumentText(invalid->text);
+    }
+}
+
+void SearchServer::CheckNewDocumentIds(const vector<DocumentRecord>& documents) const {
+    vector<int> new_ids;
+    new_ids.reserve(documents.size());
+    for (const DocumentRecord& document : documents) {
+        CheckNewDocumentId(document.id);
+        new_ids.push_back(document.id);
+    }
+    sort(new_ids.begin(), new_ids.end());
+    if (adjacent_find(new_ids.begin(), new_ids.end()) != new_ids.end()) {
+        throw invalid_argument("     "s);
+    }
+}
+
+void SearchServer::CheckNewDocumentId(int document_id) const {
     if (document_id <= -1) {
         throw invalid_argument("  "s);
     }
     else if (documents_.count(document_id) > 0) {
         throw invalid_argument("     "s);
     }
-    else if (!IsValidWord(document))
-    {
+}
+
+void SearchServer::CheckDocumentText(const string_view document) const {
+    if (!IsValidWord(document)) {
         throw invalid_argument("    - "s);
     }
-    else
-    {
-        const vector<string_view> words = SearchServer::SplitIntoWordsNoStop(document);
-        const double inv_word_count = 1.0 / words.size();
-        for (const string_view word : words) {
-            word_to_document_freqs_[string(word)][document_id] += inv_word_count;
-            document_words_freqs_[document_id][word] += static_cast<double>(count(words.begin(), words.end(), word)) / static_cast<int>(words.size());
+    if (analyzer_) {
+        analyzer_->CheckDocument(document);
+    }
+}
+
+SearchServer::TokenizedDocument SearchServer::TokenizeDocument(const string_view document) const {
+    if (!IsValidWord(document)) {
+        throw invalid_argument("    - "s);
+    }
+    TokenizedDocument result;
+    string_view text = document;
+    if (analyzer_) {
+        if (optional<string> analyzed = analyzer_->NormalizeDocument(document)) {
+            result.text = make_shared<const string>(move(*analyzed));
+            text = *result.text;
+        }
+    }
+    int position = 0;
+    for (const string_view word : SplitIntoWords(text)) {
+        if (!IsStopWord(word)) {
+            result.word_positions.push_back({ word, position });
         }
+        ++position;
+    }
+    return result;
+}
+
+void SearchServer::AddTokenizedDocument(int document_id, const TokenizedDocument& document, DocumentStatus status,
+    const vector<int>& ratings) {
+    // (term id, position) pairs
+    vector<pair<int, int>> term_positions;
+    term_positions.reserve(document.word_positions.size());
+    for (const auto& [word, position] : document.word_positions) {
+        term_positions.push_back({ dictionary_.AddWord(word), position });
+    }
+    sort(term_positions.begin(), term_positions.end());
+    if (term_to_document_freqs_.size() < dictionary_.size()) {
+        term_to_document_freqs_.resize(dictionary_.size(), Postings(term_to_document_freqs_.get_allocator()));
+    }
+
+    const int word_count = static_cast<int>(term_positions.size());
+    const size_t terms_begin = forward_index_.size();
+    for (auto it = term_positions.begin(); it != term_positions.end();) {
+        const int term_id = it->first;
+        const auto run_end = find_if(it, term_positions.end(), [term_id](const pair<int, int>& entry) {
+            return entry.first != term_id;
+            });
+        const double term_freq = static_cast<double>(run_end - it) / word_count;
+        forward_index_.push_back({ term_id, term_freq });
+        term_to_document_freqs_[term_id][document_id] = term_freq;
+        it = run_end;
+    }
+    if (positions_) {
+        positions_->AddDocument(document_id, term_positions);
+    }
+
+    int slot = static_cast<int>(slot_to_document_id_.size());
+    if (free_slots_.empty()) {
+        slot_to_document_id_.push_back(document_id);
+    }
+    else {
+        slot = free_slots_.back();
+        free_slots_.pop_back();
+        slot_to_document_id_[slot] = document_id;
+    }
 
-        documents_.emplace(document_id, DocumentData{ SearchServer::ComputeAverageRating(ratings), status });
-        documents_order_.insert(document_id);
+    const int rating = SearchServer::ComputeAverageRating(ratings);
+    documents_.emplace(document_id, DocumentData{ rating, status, word_count, terms_begin, forward_index_.size(), slot });
+    if (impacts_) {
+        for (size_t i = terms_begin; i < forward_index_.size(); ++i) {
+            impacts_->Add(forward_index_[i].term_id, { forward_index_[i].freq, document_id, slot, rating, status });
+        }
+    }
+    total_document_length_ += word_count;
+    documents_order_.insert(document_id);
+    if (statistics_) {
+        MarkStatisticsChanged(terms_begin, forward_index_.size());
     }
+    RefreshStatisticsIfDrifted();
 }
 
 vector<Document> SearchServer::FindTopDocuments(string_view query, DocumentStatus document_status) const {
@@ -56,15 +326,120 @@ vector<Document> SearchServer::FindTopDocuments(string_view query) const {
     return FindTopDocuments(query, DocumentStatus::ACTUAL);
 }
 
+vector<Document> SearchServer::FindTopDocuments(QueryMode mode, string_view query, DocumentStatus document_status) const {
+    return FindTopDocuments(mode, query, [document_status](int, DocumentStatus status, int) {
+        return status == document_status;
+        });
+}
+
+vector<Document> SearchServer::FindTopDocumentsByImpact(string_view query, DocumentStatus document_status,
+    chrono::nanoseconds budget) const {
+    return FindTopDocumentsByImpact(query, [document_status](int, DocumentStatus status, int) {
+        return status == document_status;
+        }, budget);
+}
+
+LimitedSearchResult SearchServer::FindTopDocumentsWithLimits(string_view raw_query, DocumentStatus document_status,
+    const QueryLimits& limits) const {
+    return FindTopDocumentsWithLimits(raw_query, [document_status](int, DocumentStatus status, int) {
+        return status == document_status;
+        }, limits);
+}
+
+CorpusStatistics SearchServer::GetCorpusStatistics(string_view raw_query) const {
+    // unsorted, so the words of every expansion stay together
+    const Query query = ParseQueryWithoutSort(raw_query);
+    CorpusStatistics statistics;
+    statistics.document_count = GetDocumentCount();
+    statistics.total_document_length = total_document_length_;
+    const auto add_word = [this, &statistics](string_view word) {
+        const auto term_id = dictionary_.FindWord(word);
+        if (term_id && !term_to_document_freqs_[*term_id].empty()) {
+            statistics.document_freqs.emplace(word, static_cast<int>(term_to_document_freqs_[*term_id].size()));
+        }
+    };
+    for (const string_view word : query.plus_words) {
+        add_word(word);
+    }
+    for (const auto& [word, _] : query.fuzzy_words) {
+        add_word(word);
+    }
+    for (const Query::Expansion& expansion : query.expansions) {
+        QueryExpansion& words = statistics.expansions.emplace_back();
+        words.is_fuzzy = expansion.is_fuzzy;
+        words.max_word_count = expansion.is_fuzzy ? MAX_FUZZY_EXPANSION_COUNT : MAX_PREFIX_EXPANSION_COUNT;
+        for (size_t i = expansion.plus_begin; i < expansion.plus_end; ++i) {
+            words.words.emplace_back(query.plus_words[i], 0);
+        }
+        for (size_t i = expansion.fuzzy_begin; i < expansion.fuzzy_end; ++i) {
+            words.words.emplace_back(query.fuzzy_words[i].first, query.fuzzy_words[i].second);
+        }
+    }
+    return statistics;
+}
+
+size_t SearchServer::EstimateQueryCost(string_view raw_query) const {
+    const Query query = ParseQuery(raw_query);
+    size_t cost = 0;
+    const auto add_word = [this, &cost](string_view word) {
+        if (const auto term_id = dictionary_.FindWord(word)) {
+            cost += term_to_document_freqs_[*term_id].size();
+        }
+    };
+    for (const string_view word : query.plus_words) {
+        add_word(word);
+    }
+    for (const auto& [word, _] : query.fuzzy_words) {
+        add_word(word);
+    }
+    for (const string_view word : query.minus_words) {
+        add_word(word);
+    }
+    return cost;
+}
+
+vector<Document> SearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status, const CorpusStatistics& corpus) const {
+    const Query query = ParseQuery(raw_query, chrono::steady_clock::time_point::max(), &corpus);
+    BoundedHeap<Document, bool (*)(const Document&, const Document&)> top_documents(MAX_RESULT_DOCUMENT_COUNT,
+        IsRankedBefore);
+    ForEachMatchedDocument(execution::seq, query, [status](int, DocumentStatus document_status, int) {
+        return document_status == status;
+        }, TfIdfRanking{}, [&top_documents](Document document) {
+            top_documents.Push(document);
+        }, &corpus);
+
+    METRICS_SCOPE(MetricStage::TOP_K);
+    return move(top_documents).TakeSorted();
+}
+
+vector<Document> SearchServer::FindPage(string_view query, DocumentStatus document_status, size_t page, size_t page_size) const {
+    return FindPage(query, [document_status](int, DocumentStatus status, int) {
+        return status == document_status;
+        }, page, page_size);
+}
+
+vector<Document> SearchServer::FindPage(string_view query, size_t page, size_t page_size) const {
+    return FindPage(query, DocumentStatus::ACTUAL, page, page_size);
+}
+
+bool SearchServer::IsRankedBefore(const Document& lhs, const Document& rhs) {
+    if (abs(lhs.relevance - rhs.relevance) < EPSILON) {
+        return lhs.rating > rhs.rating;
+    }
+    else {
+        return lhs.relevance > rhs.relevance;
+    }
+}
+
 int SearchServer::GetDocumentCount() const {
     return static_cast<int>(documents_.size());
 }
 
-set<int>::const_iterator SearchServer::begin() const {
+CountedSet<int>::const_iterator SearchServer::begin() const {
     return documents_order_.cbegin();
 }
 
-set<int>::const_iterator SearchServer::end() const {
+CountedSet<int>::const_iterator SearchServer::end() const {
     return documents_order_.cend();
 }
 
@@ -78,62 +453,103 @@ int SearchServer::ComputeAverageRating(const vector<int>& ratings) {
 }
 
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(
-    std::execution::sequenced_policy policy, const string_view raw_query, int document_id) const {
+    std::execution::sequenced_policy, const string_view raw_query, int document_id) const {
     return MatchDocument(raw_query, document_id);
 }
 
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(const string_view raw_query, int document_id) const {
-    if (document_id < 0 || document_words_freqs_.count(document_id) == 0) {
+    METRICS_SCOPE(MetricStage::MATCH);
+    const auto document_it = documents_.find(document_id);
+    if (document_id < 0 || document_it == documents_.end()) {
         throw out_of_range("   id  ");
     }
-    Query query = SearchServer::ParseQuery(raw_query);
+    const DocumentData& document_data = document_it->second;
+    const Query query = SearchServer::ParseQuery(raw_query);
 
-    vector<string_view> matched_words(query.plus_words.size());
-    if (any_of(query.minus_words.begin(), query.minus_words.end(), [this, &document_id](const string_view minus_word) {
-        return document_words_freqs_.at(document_id).count(minus_word); }))
-    {
-        return { {},documents_.at(document_id).status };
+    for (const string_view minus_word : query.minus_words) {
+        if (FindDocumentTerm(document_data, minus_word)) {
+            return { vector<string_view>{}, document_data.status };
+        }
+    }
+    if (!query.phrases.empty() && !ContainsPhrases(document_id, document_data, query.phrases)) {
+        return { vector<string_view>{}, document_data.status };
     }
 
-        vector<string_view>::iterator end_copy = copy_if(query.plus_words.begin(), query.plus_words.end(),
-            matched_words.begin(), [this, &document_id](const string_view plus_word) {
-                return document_words_freqs_.at(document_id).count(plus_word);
-            });
-
-        matched_words.resize(distance(matched_words.begin(), end_copy));
-
-        set<string_view> unique_words(matched_words.begin(), matched_words.end());
-
-        return { vector<string_view> { unique_words.begin(), unique_words.end() }, documents_.at(document_id).status };        
+    // plus words are already sorted and unique, matched words keep that order
+    vector<string_view> matched_words;
+    for (const string_view plus_word : query.plus_words) {
+        if (const auto term_id = FindDocumentTerm(document_data, plus_word)) {
+            matched_words.push_back(dictionary_.GetWord(*term_id));
+        }
+    }
+    if (!query.fuzzy_words.empty()) {
+        for (const auto& [fuzzy_word, _] : query.fuzzy_words) {
+            if (FindDocumentTerm(document_data, fuzzy_word)) {
+                matched_words.push_back(fuzzy_word);
+            }
+        }
+        sort(matched_words.begin(), matched_words.end());
+    }
+    return { matched_words, document_data.status };
 }
 
 tuple<vector<string_view>, DocumentStatus> SearchServer::MatchDocument(
     std::execution::parallel_policy policy, const string_view raw_query, int document_id) const {
-    if (document_id < 0 || document_words_freqs_.count(document_id) == 0) {
+    METRICS_SCOPE(MetricStage::MATCH);
+    const auto document_it = documents_.find(document_id);
+    if (document_id < 0 || document_it == documents_.end()) {
         throw out_of_range("   id  ");
     }
-    const Query query = SearchServer::ParseQueryWithoutSort(raw_query);
-    vector<string_view> matched_words(query.plus_words.size());
+    const DocumentData& document_data = document_it->second;
+    Query query;
+    {
+        METRICS_SCOPE(MetricStage::PARSE);
+        query = SearchServer::ParseQueryWithoutSort(raw_query);
+    }
 
-    if (any_of(policy, query.minus_words.begin(), query.minus_words.end(), [this, &document_id](const string_view minus_word) {
-        return document_words_freqs_.at(document_id).count(minus_word); }))
+    if (any_of(policy, query.minus_words.begin(), query.minus_words.end(), [this, &document_data](const string_view minus_word) {
+        return FindDocumentTerm(document_data, minus_word).has_value(); }))
     {
-        return { {},documents_.at(document_id).status };
+        return { vector<string_view>{}, document_data.status };
     }
+    if (!query.phrases.empty() && !ContainsPhrases(document_id, document_data, query.phrases)) {
+        return { vector<string_view>{}, document_data.status };
+    }
+
+    vector<string_view> plus_words = query.plus_words;
+    for (const auto& [fuzzy_word, _] : query.fuzzy_words) {
+        plus_words.push_back(fuzzy_word);
+    }
+    vector<int> term_ids(plus_words.size());
+    transform(policy, plus_words.begin(), plus_words.end(), term_ids.begin(),
+        [this, &document_data](const string_view plus_word) {
+            return FindDocumentTerm(document_data, plus_word).value_or(-1);
+        });
+    sort(policy, term_ids.begin(), term_ids.end());
+    term_ids.erase(unique(term_ids.begin(), term_ids.end()), term_ids.end());
 
-    vector<string_view>::iterator end_copy = copy_if(policy, query.plus_words.begin(), query.plus_words.end(),
-      matched_words.begin(), [this, &document_id](const string_view plus_word) {
-        return document_words_freqs_.at(document_id).count(plus_word);
-      });
+    vector<string_view> matched_words;
+    matched_words.reserve(term_ids.size());
+    for (const int term_id : term_ids) {
+        if (term_id >= 0) {
+            matched_words.push_back(dictionary_.GetWord(term_id));
+        }
+    }
+    sort(matched_words.begin(), matched_words.end());
 
-    matched_words.resize(distance(matched_words.begin(), end_copy));
-    set<string_view> unique_words(matched_words.begin(), matched_words.end());
+    return { matched_words, document_data.status };
+}
 
-    return { vector<string_view> { unique_words.begin(), unique_words.end() }, documents_.at(document_id).status };
+optional<int> SearchServer::FindDocumentTerm(const DocumentData& document_data, const string_view word) const {
+    const auto term_id = dictionary_.FindWord(word);
+    if (!term_id || GetDocumentWords(document_data).FindTerm(*term_id) == nullptr) {
+        return nullopt;
+    }
+    return term_id;
 }
 
 bool SearchServer::IsStopWord(const string_view word) const {
-    return stop_words_.count(word) > 0;
+    return stop_words_.Contains(word);
 }
 
 bool SearchServer::IsValidWord(const string_view word) {
@@ -177,25 +593,84 @@ SearchServer::QueryWord SearchServer::ParseQueryWord(const string_view text) con
     return { word, is_minus, IsStopWord(text) };
 }
 
-SearchServer::Query SearchServer::ParseQuery(const string_view raw_query) const {
-    SearchServer::Query query;
-    if (!IsValidWord(raw_query)) {
-        throw invalid_argument("    - "s);
+void SearchServer::AddPrefixExpansions(const string_view prefix, vector<string_view>& words, bool is_minus,
+    chrono::steady_clock::time_point deadline, Query& query) const {
+    if (prefix.empty()) {
+        throw invalid_argument("  \"*\"  "s);
     }
-    for (const string_view word : SplitIntoWords(raw_query)) {
-        if (word == "-"s) {
-            throw invalid_argument("  \" - \"  ");
+    int expansion_count = 0;
+    size_t visited_count = 0;
+    dictionary_.ForEachWithPrefix(prefix, [this, &words, &expansion_count, &visited_count, &query, is_minus, deadline](
+        int term_id, string_view word) {
+        if (deadline != chrono::steady_clock::time_point::max() && visited_count++ % QUERY_LIMITS_CHECK_INTERVAL == 0
+            && chrono::steady_clock::now() >= deadline) {
+            query.expansions_truncated = true;
+            return false;
         }
-        const SearchServer::QueryWord query_word = SearchServer::ParseQueryWord(word);
-        if (!query_word.is_stop) {
-            if (query_word.is_minus) {
-                query.minus_words.push_back(query_word.data);
-            }
-            else {
-                query.plus_words.push_back(query_word.data);
-            }
+        // words of removed documents stay in the dictionary without postings
+        if (!term_to_document_freqs_[term_id].empty()) {
+            words.push_back(word);
+            ++expansion_count;
+        }
+        // a minus prefix excludes every word it matches
+        return is_minus || expansion_count < MAX_PREFIX_EXPANSION_COUNT;
+        });
+}
+
+void SearchServer::AddFuzzyExpansions(const string_view word, int max_distance, Query& query, bool is_minus,
+    chrono::steady_clock::time_point deadline) const {
+    if (word.empty()) {
+        throw invalid_argument("  \"~\"  "s);
+    }
+    // the automaton walk is not interrupted, it is skipped once the deadline has passed
+    if (deadline != chrono::steady_clock::time_point::max() && chrono::steady_clock::now() >= deadline) {
+        query.expansions_truncated = true;
+        return;
+    }
+    // a minus word excludes every close word, a plus word keeps the closest ones. Equally close
+    // words are cut in lexicographic order, so parts of a corpus cut them the same way
+    const auto has_documents = [this](int term_id) {
+        return !term_to_document_freqs_[term_id].empty();
+    };
+    auto matches = is_minus ? dictionary_.FindWithinDistance(word, max_distance)
+        : dictionary_.FindClosest(word, max_distance, MAX_FUZZY_EXPANSION_COUNT, has_documents);
+    if (is_minus) {
+        matches.erase(remove_if(matches.begin(), matches.end(), [&has_documents](const pair<int, int>& match) {
+            return !has_documents(match.first);
+            }), matches.end());
+    }
+    for (const auto& [term_id, distance] : matches) {
+        if (is_minus) {
+            query.minus_words.push_back(dictionary_.GetWord(term_id));
+        }
+        else if (distance == 0) {
+            query.plus_words.push_back(dictionary_.GetWord(term_id));
+        }
+        else {
+            query.fuzzy_words.push_back({ dictionary_.GetWord(term_id), distance });
+        }
+    }
+}
+
+void SearchServer::AddCorpusExpansion(const CorpusStatistics& corpus, bool is_fuzzy, Query& query) {
+    const size_t index = query.expansions.size();
+    if (index >= corpus.expansions.size() || corpus.expansions[index].is_fuzzy != is_fuzzy) {
+        throw invalid_argument("    "s);
+    }
+    for (const auto& [word, distance] : corpus.expansions[index].words) {
+        if (distance == 0) {
+            query.plus_words.push_back(word);
+        }
+        else {
+            query.fuzzy_words.push_back({ word, distance });
         }
     }
+}
+
+SearchServer::Query SearchServer::ParseQuery(const string_view raw_query, chrono::steady_clock::time_point deadline,
+    const CorpusStatistics* corpus) const {
+    METRICS_SCOPE(MetricStage::PARSE);
+    SearchServer::Query query = ParseQueryWithoutSort(raw_query, deadline, corpus);
     sort(query.plus_words.begin(), query.plus_words.end());
     sort(query.minus_words.begin(), query.minus_words.end());
     auto last_minus = unique(query.minus_words.begin(), query.minus_words.end());
@@ -206,76 +681,369 @@ SearchServer::Query SearchServer::ParseQuery(const string_view raw_query) const
     query.minus_words.resize(newSize);
     newSize = last_plus - query.plus_words.begin();
     query.plus_words.resize(newSize);
+    sort(query.required_words.begin(), query.required_words.end());
+    query.required_words.erase(unique(query.required_words.begin(), query.required_words.end()),
+        query.required_words.end());
+
+    // a word found by several fuzzy words keeps the smallest distance, exact plus words win
+    sort(query.fuzzy_words.begin(), query.fuzzy_words.end());
+    query.fuzzy_words.erase(unique(query.fuzzy_words.begin(), query.fuzzy_words.end(),
+        [](const auto& lhs, const auto& rhs) { return lhs.first == rhs.first; }), query.fuzzy_words.end());
+    query.fuzzy_words.erase(remove_if(query.fuzzy_words.begin(), query.fuzzy_words.end(), [&query](const auto& fuzzy_word) {
+        return binary_search(query.plus_words.begin(), query.plus_words.end(), fuzzy_word.first);
+        }), query.fuzzy_words.end());
     return query;
 }
 
-SearchServer::Query SearchServer::ParseQueryWithoutSort(const string_view raw_query) const {
+SearchServer::Query SearchServer::ParseQueryWithoutSort(const string_view raw_query,
+    chrono::steady_clock::time_point deadline, const CorpusStatistics* corpus) const {
     SearchServer::Query query;
     if (!IsValidWord(raw_query)) {
         throw invalid_argument("    - "s);
     }
-    for (const string_view word : SplitIntoWords(raw_query)) {
+    string_view text = raw_query;
+    if (analyzer_) {
+        if (optional<string> analyzed = analyzer_->NormalizeQuery(raw_query)) {
+            query.text = make_shared<const string>(move(*analyzed));
+            text = *query.text;
+        }
+    }
+    bool in_phrase = false;
+    int phrase_offset = 0;
+    for (string_view word : SplitIntoWords(text)) {
+        if (!in_phrase && word[0] == '"') {
+            in_phrase = true;
+            phrase_offset = 0;
+            query.phrases.emplace_back();
+            word.remove_prefix(1);
+        }
+        if (in_phrase) {
+            // words inside quotes are taken as is, without minus parsing
+            const bool closes_phrase = !word.empty() && word.back() == '"';
+            if (closes_phrase) {
+                word.remove_suffix(1);
+            }
+            if (!word.empty()) {
+                if (!IsStopWord(word)) {
+                    query.plus_words.push_back(word);
+                    query.required_words.push_back(word);
+                    query.phrases.back().words.push_back(word);
+                    query.phrases.back().offsets.push_back(phrase_offset);
+                }
+                ++phrase_offset;
+            }
+            if (closes_phrase) {
+                in_phrase = false;
+                if (query.phrases.back().words.size() < 2) {
+                    query.phrases.pop_back();
+                }
+            }
+            continue;
+        }
         if (word == "-"s) {
             throw invalid_argument("  \" - \"  ");
         }
         const SearchServer::QueryWord query_word = SearchServer::ParseQueryWord(word);
         if (!query_word.is_stop) {
-            if (query_word.is_minus) {
-                query.minus_words.push_back(query_word.data);
+            auto& words = query_word.is_minus ? query.minus_words : query.plus_words;
+            // "word~" or "word~2", a tilde elsewhere is a part of the word, as in "a~b"
+            const size_t size = query_word.data.size();
+            const bool is_fuzzy = query_word.data.back() == '~'
+                || (size >= 2 && query_word.data[size - 2] == '~' && isdigit(static_cast<unsigned char>(query_word.data.back())));
+            const size_t tilde = query_word.data.rfind('~');
+            const bool is_prefix = query_word.data.back() == '*';
+            const size_t plus_begin = query.plus_words.size();
+            const size_t fuzzy_begin = query.fuzzy_words.size();
+            // minus words exclude every word they match in each part of a corpus, so they
+            // are always expanded here
+            const bool use_corpus = corpus && !query_word.is_minus;
+            if (is_prefix) {
+                const string_view prefix = query_word.data.substr(0, query_word.data.size() - 1);
+                if (use_corpus && !prefix.empty()) {
+                    AddCorpusExpansion(*corpus, false, query);
+                }
+                else {
+                    AddPrefixExpansions(prefix, words, query_word.is_minus, deadline, query);
+                }
+            }
+            else if (is_fuzzy) {
+                const string_view distance_text = query_word.data.substr(tilde + 1);
+                const int max_distance = distance_text.empty() ? 1 : distance_text[0] - '0';
+                if (max_distance < 1 || max_distance > MAX_FUZZY_DISTANCE) {
+                    throw invalid_argument("     \"~\""s);
+                }
+                if (use_corpus && tilde > 0) {
+                    AddCorpusExpansion(*corpus, true, query);
+                }
+                else {
+                    AddFuzzyExpansions(query_word.data.substr(0, tilde), max_distance, query, query_word.is_minus, deadline);
+                }
             }
             else {
-                query.plus_words.push_back(query_word.data);
+                words.push_back(query_word.data);
+                if (!query_word.is_minus) {
+                    query.required_words.push_back(query_word.data);
+                }
+            }
+            // the words of a plus expansion were appended together, GetCorpusStatistics reads them
+            if ((is_prefix || is_fuzzy) && !query_word.is_minus) {
+                query.expansions.push_back({ is_fuzzy, plus_begin, query.plus_words.size(), fuzzy_begin,
+                    query.fuzzy_words.size() });
             }
         }
     }
+    if (in_phrase) {
+        throw invalid_argument("    "s);
+    }
+    if (!query.phrases.empty() && !positions_) {
+        throw logic_error("     "s);
+    }
+    if (corpus && query.expansions.size() != corpus->expansions.size()) {
+        throw invalid_argument("    "s);
+    }
     return query;
 }
 
-const map<string_view, double>& SearchServer::GetWordFrequencies(int document_id) const {
-    static map<string_view, double> temp = {};
-    if (documents_order_.count(document_id) == 0) {
-        return temp;
-    }
-    else
-    {
-        return document_words_freqs_.at(document_id);
+WordFrequencies SearchServer::GetWordFrequencies(int document_id) const {
+    const auto document_it = documents_.find(document_id);
+    if (document_it == documents_.end()) {
+        return {};
     }
+    return GetDocumentWords(document_it->second);
+}
+
+WordFrequencies SearchServer::GetDocumentWords(const DocumentData& document_data) const {
+    return { forward_index_.data() + document_data.terms_begin, forward_index_.data() + document_data.terms_end, dictionary_ };
 }
 
 void SearchServer::RemoveDocument(int document_id) {
-    auto& docwords = SearchServer::GetWordFrequencies(document_id);
-    for (auto& docword : docwords)
-    {
-        word_to_document_freqs_.at(string(docword.first)).erase(document_id);
+    const auto document_it = documents_.find(document_id);
+    if (document_it == documents_.end()) {
+        return;
+    }
+    for (size_t i = document_it->second.terms_begin; i < document_it->second.terms_end; ++i) {
+        term_to_document_freqs_[forward_index_[i].term_id].erase(document_id);
+        if (impacts_) {
+            impacts_->Remove(forward_index_[i].term_id, document_id, forward_index_[i].freq);
+        }
+    }
+    if (statistics_) {
+        MarkStatisticsChanged(document_it->second.terms_begin, document_it->second.terms_end);
+    }
+    EraseForwardIndex(document_it->second);
+    total_document_length_ -= document_it->second.length;
+    free_slots_.push_back(document_it->second.slot);
+    if (positions_) {
+        positions_->RemoveDocument(document_id);
     }
-    document_words_freqs_.erase(document_id);
     documents_order_.erase(document_id);
-    documents_.erase(document_id);
+    documents_.erase(document_it);
+    RefreshStatisticsIfDrifted();
 }
 
-void SearchServer::RemoveDocument(std::execution::sequenced_policy policy, int document_id)
+void SearchServer::RemoveDocument(std::execution::sequenced_policy, int document_id)
 {
     RemoveDocument(document_id);
 }
 
 void SearchServer::RemoveDocument(std::execution::parallel_policy policy, int document_id)
 {
-    auto& docwords = SearchServer::GetWordFrequencies(document_id);
-    vector<const string_view*> temp(docwords.size());
+    const auto document_it = documents_.find(document_id);
+    if (document_it == documents_.end()) {
+        return;
+    }
+    // every entry names a distinct term, so the postings are erased without data races
+    for_each(policy, forward_index_.begin() + document_it->second.terms_begin, forward_index_.begin() + document_it->second.terms_end,
+        [this, document_id](const TermFrequency& entry) {
+            term_to_document_freqs_[entry.term_id].erase(document_id);
+            if (impacts_) {
+                impacts_->Remove(entry.term_id, document_id, entry.freq);
+            }
+        });
+    if (statistics_) {
+        MarkStatisticsChanged(document_it->second.terms_begin, document_it->second.terms_end);
+    }
+    EraseForwardIndex(document_it->second);
+    total_document_length_ -= document_it->second.length;
+    free_slots_.push_back(document_it->second.slot);
+    if (positions_) {
+        positions_->RemoveDocument(document_id);
+    }
+    documents_order_.erase(document_id);
+    documents_.erase(document_it);
+    RefreshStatisticsIfDrifted();
+}
+
+vector<vector<int>> SearchServer::GetWordsPositions(int document_id, const DocumentData& document_data,
+    const vector<string_view>& words) const {
+    vector<vector<int>> positions;
+    const WordFrequencies document_words = GetDocumentWords(document_data);
+    for (const string_view word : words) {
+        const auto term_id = dictionary_.FindWord(word);
+        const TermFrequency* entry = term_id ? document_words.FindTerm(*term_id) : nullptr;
+        if (entry != nullptr) {
+            const size_t entry_index = entry - (forward_index_.data() + document_data.terms_begin);
+            positions.push_back(positions_->GetPositions(document_id, entry_index));
+        }
+    }
+    return positions;
+}
+
+vector<int> SearchServer::CollectMinusDocuments(const Query& query) const {
+    vector<int> document_ids;
+    for (const string_view word : query.minus_words) {
+        const auto term_id = dictionary_.FindWord(word);
+        if (term_id) {
+            for (const auto& [document_id, _] : term_to_document_freqs_[*term_id]) {
+                document_ids.push_back(document_id);
+            }
+        }
+    }
+    sort(document_ids.begin(), document_ids.end());
+    document_ids.erase(unique(document_ids.begin(), document_ids.end()), document_ids.end());
+    return document_ids;
+}
+
+SearchServer::Postings::const_iterator SearchServer::SkipTo(const Postings& postings, Postings::const_iterator it,
+    int document_id) {
+    for (int step = 0; step < MAX_LINEAR_SKIP_STEPS; ++step) {
+        if (it == postings.end() || it->first >= document_id) {
+            return it;
+        }
+        ++it;
+    }
+    if (it == postings.end() || it->first >= document_id) {
+        return it;
+    }
+    return postings.lower_bound(document_id);
+}
 
-    transform(policy, docwords.begin(), docwords.end(), temp.begin(), [&](const auto& pointer) {
-        return (&pointer.first);
+bool SearchServer::IsImpactTopSettled(vector<ImpactCandidate>& candidates, double remaining) const {
+    const auto last_in_top = candidates.begin() + (MAX_RESULT_DOCUMENT_COUNT - 1);
+    nth_element(candidates.begin(), last_in_top, candidates.end(), [](const ImpactCandidate& lhs, const ImpactCandidate& rhs) {
+        return lhs.relevance > rhs.relevance;
         });
+    const double border = last_in_top->relevance;
+    if (remaining >= border - EPSILON) {
+        return false;
+    }
+    const auto get_rating = [this](const ImpactCandidate& candidate) {
+        return documents_.at(slot_to_document_id_[candidate.slot]).rating;
+    };
 
-    for_each(policy, temp.begin(), temp.end(), [&](const string_view* word) {
-        word_to_document_freqs_[string(*word)].erase(document_id);
+    // documents tied with the border are ordered by rating as in the final sort
+    const auto contenders_end = partition(candidates.begin(), candidates.end(), [border](const ImpactCandidate& candidate) {
+        return candidate.relevance > border - EPSILON;
+        });
+    // (relevance so far with the rating, bound)
+    vector<pair<Document, double>> contenders;
+    for (auto it = candidates.begin(); it != contenders_end; ++it) {
+        contenders.push_back({ Document{ slot_to_document_id_[it->slot], it->relevance, get_rating(*it) }, it->bound });
+    }
+    const auto top_end = contenders.begin() + MAX_RESULT_DOCUMENT_COUNT;
+    partial_sort(contenders.begin(), top_end, contenders.end(), [](const auto& lhs, const auto& rhs) {
+        return IsRankedBefore(lhs.first, rhs.first);
         });
+    double top_min = numeric_limits<double>::max();
+    for (auto it = contenders.begin(); it != top_end; ++it) {
+        top_min = min(top_min, it->first.relevance);
+    }
 
-    document_words_freqs_.erase(document_id);
-    documents_order_.erase(document_id);
-    documents_.erase(document_id);
+    // an outside document ranks after a top one when it cannot reach its relevance,
+    // or can only tie with it and has no higher rating
+    const auto stays_outside = [&contenders, top_end](double bound, int rating) {
+        return all_of(contenders.begin(), top_end, [bound, rating](const auto& top) {
+            return bound < top.first.relevance - EPSILON
+                || (rating <= top.first.rating && bound < top.first.relevance + EPSILON);
+            });
+    };
+    for (auto it = top_end; it != contenders.end(); ++it) {
+        if (!stays_outside(it->second, it->first.rating)) {
+            return false;
+        }
+    }
+    for (auto it = contenders_end; it != candidates.end(); ++it) {
+        if (it->bound >= top_min - EPSILON && !stays_outside(it->bound, get_rating(*it))) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool SearchServer::ContainsPhrases(int document_id, const DocumentData& document_data, const vector<Phrase>& phrases) const {
+    return all_of(phrases.begin(), phrases.end(), [&](const Phrase& phrase) {
+        const auto positions = GetWordsPositions(document_id, document_data, phrase.words);
+        return positions.size() == phrase.words.size() && ContainsPhrase(positions, phrase.offsets);
+        });
 }
 
-double SearchServer::ComputeWordInverseDocumentFreq(const string_view word) const {
-    return log(SearchServer::GetDocumentCount() * 1.0 / word_to_document_freqs_.at(string(word)).size());
+void SearchServer::EraseForwardIndex(const DocumentData& document_data) {
+    forward_index_garbage_ += document_data.terms_end - document_data.terms_begin;
+    // compact the arena once removed documents take more than half of it
+    if (forward_index_garbage_ * 2 <= forward_index_.size()) {
+        return;
+    }
+    CountedVector<TermFrequency> compacted(forward_index_.get_allocator());
+    compacted.reserve(forward_index_.size() - forward_index_garbage_);
+    for (auto& [id, data] : documents_) {
+        if (&data == &document_data) {
+            continue;
+        }
+        const size_t terms_begin = compacted.size();
+        compacted.insert(compacted.end(), forward_index_.begin() + data.terms_begin, forward_index_.begin() + data.terms_end);
+        data.terms_begin = terms_begin;
+        data.terms_end = compacted.size();
+    }
+    forward_index_ = move(compacted);
+    forward_index_garbage_ = 0;
+}
+
+MemoryStats SearchServer::GetMemoryStats() const {
+    MemoryStats stats;
+    stats.document_count = documents_.size();
+    stats.components = {
+        MakeComponentMemory("stop_words"s, *memory_.stop_words, stop_words_.size(), MemoryGrowth::CONSTANT),
+        MakeComponentMemory("dictionary"s, *memory_.dictionary, dictionary_.size(), MemoryGrowth::VOCABULARY),
+        MakeComponentMemory("postings"s, *memory_.postings, forward_index_.size() - forward_index_garbage_, MemoryGrowth::LINEAR),
+        MakeComponentMemory("forward_index"s, *memory_.forward_index, forward_index_.size(), MemoryGrowth::LINEAR),
+        MakeComponentMemory("documents"s, *memory_.documents, documents_.size(), MemoryGrowth::LINEAR),
+        MakeComponentMemory("documents_order"s, *memory_.documents_order, documents_order_.size(), MemoryGrowth::LINEAR),
+        MakeComponentMemory("slots"s, *memory_.slots, slot_to_document_id_.size(), MemoryGrowth::LINEAR),
+        MakeComponentMemory("positions"s, *memory_.positions, positions_ ? documents_.size() : 0, MemoryGrowth::LINEAR),
+        MakeComponentMemory("impacts"s, *memory_.impacts, impacts_ ? forward_index_.size() - forward_index_garbage_ : 0,
+            MemoryGrowth::LINEAR),
+        MakeComponentMemory("statistics"s, *memory_.statistics, statistics_ ? dictionary_.size() : 0, MemoryGrowth::VOCABULARY),
+    };
+    return stats;
+}
+
+RankingStats SearchServer::GetRankingStats() const {
+    if (statistics_) {
+        return statistics_->GetRankingStats();
+    }
+    const int document_count = SearchServer::GetDocumentCount();
+    return { document_count, document_count > 0 ? static_cast<double>(total_document_length_) / document_count : 0.0 };
+}
+
+int SearchServer::GetDocumentFreq(int term_id) const {
+    const int live_document_freq = static_cast<int>(term_to_document_freqs_[term_id].size());
+    if (statistics_) {
+        // words without documents at the last refresh have no snapshot value yet
+        const int document_freq = statistics_->GetDocumentFreq(term_id);
+        return document_freq > 0 ? document_freq : live_document_freq;
+    }
+    return live_document_freq;
+}
+
+void SearchServer::MarkStatisticsChanged(size_t terms_begin, size_t terms_end) {
+    for (size_t i = terms_begin; i < terms_end; ++i) {
+        statistics_->MarkChanged(forward_index_[i].term_id);
+    }
+    statistics_->CountDocumentChange();
+}
+
+void SearchServer::RefreshStatisticsIfDrifted() {
+    if (statistics_ && statistics_->NeedsRefresh()) {
+        RefreshStatistics();
+    }
 }
\ No newline at end of file
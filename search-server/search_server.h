@@ -1,23 +1,109 @@
 #pragma once
 
 #include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <limits>
 #include <string>
 #include <map>
+#include <memory>
+#include <numeric>
+#include <optional>
 #include <set>
 #include <vector>
 #include <stdexcept>
 #include <execution>
+#include <functional>
 #include <thread>
+#include "bounded_heap.h"
 #include "document.h"
+#include "impact_index.h"
 #include "string_processing.h"
-#include "concurrent_map.h"
+#include "corpus_statistics.h"
+#include "memory_stats.h"
+#include "metrics.h"
+#include "relevance_accumulator.h"
+#include "statistics_snapshot.h"
+#include "stop_word_set.h"
+#include "text_analyzer.h"
+#include "ranking.h"
+#include "positional_index.h"
+#include "query_executor.h"
+#include "term_dictionary.h"
+#include "word_frequencies.h"
 
 const int MAX_RESULT_DOCUMENT_COUNT = 5;
 
 const double EPSILON = 1e-6;
 
+// maximum number of dictionary words a plus "prefix*" query word expands to, "-prefix*" excludes them all
+const int MAX_PREFIX_EXPANSION_COUNT = 50;
+
+// "word~" matches words within 1 edit, "word~2" within 2 edits
+const int MAX_FUZZY_DISTANCE = 2;
+
+// maximum number of dictionary words a plus "word~" expands to, the closest are kept
+const int MAX_FUZZY_EXPANSION_COUNT = 50;
+
+// relevance of a fuzzy match is multiplied by this factor per edit
+const double FUZZY_DISTANCE_PENALTY = 0.5;
+
+// FindTopDocumentsAsync yields to its executor after reading this many postings, matched or not
+const size_t ASYNC_CHUNK_POSTING_COUNT = 1024;
+
+// FindTopDocumentsByImpact reads the clock once per this many postings
+const size_t IMPACT_BUDGET_CHECK_INTERVAL = 256;
+
+// FindTopDocumentsByImpact checks whether it can stop after at least this many postings
+const size_t MIN_IMPACT_STOP_CHECK_INTERVAL = 64;
+
+// FindTopDocumentsWithLimits reads the clock once per this many postings
+const size_t QUERY_LIMITS_CHECK_INTERVAL = 256;
+
 using namespace std::string_literals;
 
+enum class QueryMode {
+    // a document matches when it contains any plus word
+    ANY_WORD,
+    // a document must contain every plain and phrase word, "word*" and "word~" expansions
+    // only add relevance
+    ALL_WORDS,
+};
+
+enum class CursorOrder {
+    // ascending document id, every block continues from the last returned document
+    DOCUMENT_ID,
+    // the FindTopDocuments order with ties broken by id, every block rescans the matches and
+    // keeps only the max_count best of those ranked after the last returned document
+    RELEVANCE,
+};
+
+// the work one query of FindTopDocumentsWithLimits may do, unlimited by default
+struct QueryLimits {
+    // postings of plus and expanded words read while scoring
+    size_t max_postings = std::numeric_limits<size_t>::max();
+    // documents the relevance is summed for, the accumulator never holds more
+    size_t max_candidates = std::numeric_limits<size_t>::max();
+    std::chrono::nanoseconds time_budget = std::chrono::nanoseconds::max();
+};
+
+enum class QueryLimit {
+    NONE,
+    POSTINGS,
+    CANDIDATES,
+    TIME,
+};
+
+struct LimitedSearchResult {
+    std::vector<Document> documents;
+    // set when a limit was reached and documents may differ from FindTopDocuments
+    bool truncated = false;
+    // the first limit reached
+    QueryLimit reached_limit = QueryLimit::NONE;
+    size_t postings_scanned = 0;
+    size_t candidates = 0;
+};
+
 class SearchServer {
 public:
 
@@ -28,28 +114,165 @@ public:
 
     explicit SearchServer(std::string_view stop_words_text);
 
+    // the index structures report their memory to counters owned by this server, a copy
+    // gets counters of its own
+    SearchServer(const SearchServer& other);
+    SearchServer& operator=(const SearchServer& other);
+
+    // the counters move along with the index, the moved-from server is left empty, without
+    // stop words and optional indexes, and with fresh counters
+    SearchServer(SearchServer&& other);
+    SearchServer& operator=(SearchServer&& other);
+
+    // Starts keeping word positions for phrase queries and ProximityRanking.
+    // Must be called before the first document is added.
+    void EnablePositionalIndex();
+
+    // Starts keeping the postings also in the order of impact for FindTopDocumentsByImpact.
+    // Must be called before the first document is added.
+    void EnableImpactOrder();
+
+    // Documents and queries are analyzed before they are split into words: UTF-8 is checked,
+    // the case is folded, punctuation separates words and words may be stemmed, see
+    // TextAnalyzer. Stop words are analyzed the same way. Must be called once, before the
+    // first document is added, otherwise throws logic_error
+    void EnableTextAnalysis(TextAnalysisOptions options = {});
+
+    // Scores are computed with the document count, lengths and document frequencies of the
+    // last refresh instead of the live ones, so cached results and precomputed weights stay
+    // valid while documents change. The snapshot is refreshed once more than max_drift of its
+    // document count has been added or removed, a refresh rereads only the changed words.
+    //
+    // Between refreshes the IDF log(N / df) of a word with snapshot frequency df differs from
+    // the live one by at most -log(1 - max_drift) for N plus -log(1 - max_drift * N / df) for df
+    // while max_drift * N < df. For words with df > 10 * max_drift * N the drift is within
+    // 0.16 for max_drift = 0.05; rarer words may drift more. Words first seen after the
+    // refresh use their live frequency. May be called at any time
+    void EnableStatisticsSnapshots(double max_drift = 0.05);
+
+    // brings the snapshot up to date, does nothing without EnableStatisticsSnapshots
+    void RefreshStatistics();
+
+    // grows with every refresh, results of one generation are scored alike
+    uint64_t GetStatisticsGeneration() const;
+
     void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
 
-    template <typename DocumentPredicate>
-    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate) const;
+    // Adds the documents in their order as AddDocument would. Every document is checked before
+    // the first one is added, so on invalid_argument the index is not changed. The parallel
+    // version splits the texts into words on all cores, the index itself is filled by the
+    // calling thread. The words are kept for a batch of documents at a time, not for all of them
+    void AddDocuments(const std::vector<DocumentRecord>& documents);
+
+    void AddDocuments(std::execution::parallel_policy policy, const std::vector<DocumentRecord>& documents);
+
+    // throws invalid_argument when AddDocuments would reject the documents, the index is not changed
+    void CheckNewDocuments(std::execution::parallel_policy policy, const std::vector<DocumentRecord>& documents) const;
+
+    template <typename DocumentPredicate, typename Ranking = TfIdfRanking>
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentPredicate document_predicate,
+        const Ranking& ranking = {}) const;
 
     std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status) const;
 
     std::vector<Document> FindTopDocuments(std::string_view raw_query) const;
 
-    template <typename Policy, typename DocumentPredicate>
-    std::vector<Document> FindTopDocuments(Policy& policy, std::string_view raw_query, DocumentPredicate document_predicate) const;
+    // ranking selects the relevance function at compile time, see ranking.h
+    template <typename Policy, typename DocumentPredicate, typename Ranking = TfIdfRanking>
+    std::vector<Document> FindTopDocuments(Policy& policy, std::string_view raw_query, DocumentPredicate document_predicate,
+        const Ranking& ranking = {}) const;
 
-    template <typename Policy>
-    std::vector<Document> FindTopDocuments(Policy& policy, std::string_view raw_query, DocumentStatus status) const;
+    template <typename Policy, typename Ranking = TfIdfRanking>
+    std::vector<Document> FindTopDocuments(Policy& policy, std::string_view raw_query, DocumentStatus status,
+        const Ranking& ranking = {}) const;
 
     template <typename Policy>
     std::vector<Document> FindTopDocuments(Policy& policy, std::string_view raw_query) const;
 
+    // With ALL_WORDS only the documents found in the intersection of the posting lists are scored
+    template <typename DocumentPredicate, typename Ranking = TfIdfRanking>
+    std::vector<Document> FindTopDocuments(QueryMode mode, std::string_view raw_query,
+        DocumentPredicate document_predicate, const Ranking& ranking = {}) const;
+
+    std::vector<Document> FindTopDocuments(QueryMode mode, std::string_view raw_query,
+        DocumentStatus status = DocumentStatus::ACTUAL) const;
+
+    // Documents of the page with the given index (from 0) in the full relevance order.
+    // Only the best (page + 1) * page_size matches are kept while scoring.
+    template <typename DocumentPredicate, typename Ranking = TfIdfRanking>
+    std::vector<Document> FindPage(std::string_view raw_query, DocumentPredicate document_predicate, size_t page,
+        size_t page_size, const Ranking& ranking = {}) const;
+
+    std::vector<Document> FindPage(std::string_view raw_query, DocumentStatus status, size_t page, size_t page_size) const;
+
+    std::vector<Document> FindPage(std::string_view raw_query, size_t page, size_t page_size) const;
+
+    // Score-at-a-time TF-IDF search over the impact ordered postings: postings of all the query
+    // words are taken by descending tf-idf until the rest cannot change the top documents or
+    // budget runs out, then the best documents found so far are returned. The result matches
+    // FindTopDocuments unless the budget is exceeded. Without EnableImpactOrder and for phrase
+    // queries it is FindTopDocuments.
+    template <typename DocumentPredicate>
+    std::vector<Document> FindTopDocumentsByImpact(std::string_view raw_query, DocumentPredicate document_predicate,
+        std::chrono::nanoseconds budget = std::chrono::nanoseconds::max()) const;
+
+    std::vector<Document> FindTopDocumentsByImpact(std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL,
+        std::chrono::nanoseconds budget = std::chrono::nanoseconds::max()) const;
+
+    // FindTopDocuments that stops where limits say. The words are scored from the rarest, so a
+    // query cut short keeps the words that tell documents apart. Past max_candidates no new
+    // documents are taken, the ones taken still gain relevance; past max_postings or the time
+    // budget scoring stops. The time budget also covers parsing, where it cuts the "word*" and
+    // "word~" expansions short, and a budget spent before scoring leaves no documents. The best
+    // documents of the relevance summed so far are returned with truncated set. Minus words are
+    // looked up for every candidate instead of being scanned.
+    template <typename DocumentPredicate, typename Ranking = TfIdfRanking>
+    LimitedSearchResult FindTopDocumentsWithLimits(std::string_view raw_query, DocumentPredicate document_predicate,
+        const QueryLimits& limits, const Ranking& ranking = {}) const;
+
+    LimitedSearchResult FindTopDocumentsWithLimits(std::string_view raw_query, DocumentStatus status,
+        const QueryLimits& limits) const;
+
+    // Number of postings a search for the query reads: the documents of its plus, expanded
+    // and minus words. Cheap, the query is parsed but nothing is scored
+    size_t EstimateQueryCost(std::string_view raw_query) const;
+
+    // order of the search results: by relevance, equal relevance by rating
+    static bool IsRankedBefore(const Document& lhs, const Document& rhs);
+
+    // statistics of the query words in this server with the words of its plus "word*" and
+    // "word~" expansions, see CorpusStatistics
+    CorpusStatistics GetCorpusStatistics(std::string_view raw_query) const;
+
+    // TF-IDF search with the word statistics of a larger corpus this server is a part of, the
+    // plus "word*" and "word~" match the words of corpus.expansions. Throws invalid_argument
+    // when corpus was collected for another query
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status,
+        const CorpusStatistics& corpus) const;
+
+    class Cursor;
+
+    // Streams every match of the query with TF-IDF relevance in blocks. A cursor holds at most
+    // one block of documents in either order, its memory does not depend on the number of matches
+    Cursor OpenCursor(std::string_view raw_query, CursorOrder order = CursorOrder::DOCUMENT_ID,
+        DocumentStatus status = DocumentStatus::ACTUAL) const;
+
+    // Continues a cursor over the same query from Cursor::GetContinuationToken, throws
+    // invalid_argument for a malformed token or a token of another query
+    Cursor ResumeCursor(std::string_view raw_query, std::string_view token) const;
+
+#ifdef SEARCH_SERVER_HAS_COROUTINES
+    // FindTopDocuments(raw_query, status) as a coroutine that walks the matches with a cursor and
+    // yields to the executor after every ASYNC_CHUNK_POSTING_COUNT postings read, so a long query
+    // does not hold up the short ones even when few postings match. Changes between chunks are seen as by Cursor
+    QueryTask<std::vector<Document>> FindTopDocumentsAsync(QueryExecutor& executor, std::string raw_query,
+        DocumentStatus status = DocumentStatus::ACTUAL) const;
+#endif
+
     int GetDocumentCount() const;
 
-    std::set<int>::const_iterator begin() const;
-    std::set<int>::const_iterator end() const;
+    CountedSet<int>::const_iterator begin() const;
+    CountedSet<int>::const_iterator end() const;
 
     int ComputeAverageRating(const std::vector<int>& ratings);
 
@@ -61,7 +284,7 @@ public:
     std::tuple<std::vector<std::string_view>, DocumentStatus> MatchDocument(
         std::execution::parallel_policy policy, std::string_view raw_query, int document_id) const;
 
-    const std::map<std::string_view, double>& GetWordFrequencies(int document_id) const;
+    WordFrequencies GetWordFrequencies(int document_id) const;
 
     void RemoveDocument(int document_id);
 
@@ -69,39 +292,164 @@ public:
 
     void RemoveDocument(std::execution::parallel_policy policy, int document_id);
 
+    // heap memory of every index structure, see ProjectMemory for capacity planning
+    MemoryStats GetMemoryStats() const;
+
 private:
     struct DocumentData {
         int rating;
         DocumentStatus status;
+        // number of words without stop words
+        int length;
+        // the document's entries in forward_index_
+        size_t terms_begin;
+        size_t terms_end;
+        // dense index of the document in relevance accumulators
+        int slot;
+    };
+
+    // document id -> tf of one term
+    using Postings = CountedMap<int, double>;
+
+    struct MemoryCounters {
+        std::shared_ptr<MemoryCounter> stop_words = std::make_shared<MemoryCounter>();
+        std::shared_ptr<MemoryCounter> dictionary = std::make_shared<MemoryCounter>();
+        std::shared_ptr<MemoryCounter> postings = std::make_shared<MemoryCounter>();
+        std::shared_ptr<MemoryCounter> forward_index = std::make_shared<MemoryCounter>();
+        std::shared_ptr<MemoryCounter> documents = std::make_shared<MemoryCounter>();
+        std::shared_ptr<MemoryCounter> documents_order = std::make_shared<MemoryCounter>();
+        std::shared_ptr<MemoryCounter> slots = std::make_shared<MemoryCounter>();
+        std::shared_ptr<MemoryCounter> positions = std::make_shared<MemoryCounter>();
+        std::shared_ptr<MemoryCounter> impacts = std::make_shared<MemoryCounter>();
+        std::shared_ptr<MemoryCounter> statistics = std::make_shared<MemoryCounter>();
     };
 
-    const std::set<std::string, std::less<>> stop_words_;
+    // declared first, the allocators of the members below refer to it
+    MemoryCounters memory_;
+
+    StopWordSet stop_words_{ memory_.stop_words };
+
+    TermDictionary dictionary_{ memory_.dictionary };
+
+    // postings indexed by term id
+    CountedVector<Postings> term_to_document_freqs_ = MakeCounted<CountedVector<Postings>>(memory_.postings);
+
+    // per document sorted (term id, tf) runs, addressed by DocumentData offsets
+    CountedVector<TermFrequency> forward_index_ = MakeCounted<CountedVector<TermFrequency>>(memory_.forward_index);
+
+    size_t forward_index_garbage_ = 0;
+
+    CountedMap<int, DocumentData> documents_ = MakeCounted<CountedMap<int, DocumentData>>(memory_.documents);
+
+    CountedSet<int> documents_order_ = MakeCounted<CountedSet<int>>(memory_.documents_order);
+
+    long long total_document_length_ = 0;
+
+    CountedVector<int> slot_to_document_id_ = MakeCounted<CountedVector<int>>(memory_.slots);
 
-    std::map<std::string, std::map<int, double>> word_to_document_freqs_;
+    CountedVector<int> free_slots_ = MakeCounted<CountedVector<int>>(memory_.slots);
 
-    std::map<int, std::map<std::string_view, double>> document_words_freqs_;
+    // engaged only after EnablePositionalIndex
+    std::optional<PositionalIndex> positions_;
 
-    std::map<int, DocumentData> documents_;
+    // engaged only after EnableImpactOrder
+    std::optional<ImpactIndex> impacts_;
 
-    std::set<int> documents_order_;
+    // engaged only after EnableStatisticsSnapshots
+    std::optional<StatisticsSnapshot> statistics_;
+
+    // engaged only after EnableTextAnalysis
+    std::optional<TextAnalyzer> analyzer_;
+
+    struct Phrase {
+        std::vector<std::string_view> words;
+        // word offsets from the phrase start, stop words keep their place
+        std::vector<int> offsets;
+    };
 
     struct Query {
+        // the analyzed query the words refer to, null when they refer to the raw query
+        std::shared_ptr<const std::string> text;
         std::vector<std::string_view> plus_words;
         std::vector<std::string_view> minus_words;
+        // phrase words are also included into plus words
+        std::vector<Phrase> phrases;
+        // dictionary words found for "word~", exact matches stay in plus words
+        std::vector<std::pair<std::string_view, int>> fuzzy_words;
+        // plain and phrase plus words, without "word*" and "word~" expansions
+        std::vector<std::string_view> required_words;
+        // set when the deadline of ParseQuery cut "word*" or "word~" expansions short
+        bool expansions_truncated = false;
+
+        // a plus "word*" or "word~" and the words it expanded to, plus_words[plus_begin, plus_end)
+        // and fuzzy_words[fuzzy_begin, fuzzy_end) as ParseQueryWithoutSort leaves them
+        struct Expansion {
+            bool is_fuzzy = false;
+            size_t plus_begin = 0;
+            size_t plus_end = 0;
+            size_t fuzzy_begin = 0;
+            size_t fuzzy_end = 0;
+        };
+        // in query order
+        std::vector<Expansion> expansions;
     };
 
+    // words of a document split and checked without touching the index, so documents
+    // can be tokenized in parallel
+    struct TokenizedDocument {
+        // the analyzed text the words refer to, null when they refer to the document
+        std::shared_ptr<const std::string> text;
+        // (word, position) pairs, stop words are skipped but keep their positions
+        std::vector<std::pair<std::string_view, int>> word_positions;
+    };
+
+    TokenizedDocument TokenizeDocument(std::string_view document) const;
+
+    void CheckNewDocumentId(int document_id) const;
+
+    // throws invalid_argument when TokenizeDocument would
+    void CheckDocumentText(std::string_view document) const;
+
+    // also rejects an id repeated in documents
+    void CheckNewDocumentIds(const std::vector<DocumentRecord>& documents) const;
+
+    void AddTokenizedDocument(int document_id, const TokenizedDocument& document, DocumentStatus status,
+        const std::vector<int>& ratings);
+
     struct QueryWord {
         std::string_view data;
         bool is_minus;
         bool is_stop;
     };
 
-    Query ParseQuery(std::string_view text) const;
+    void MoveFrom(SearchServer& other);
+
+    // Past deadline the expansions that are left are skipped. With corpus the plus "word*" and
+    // "word~" take the words of corpus->expansions instead of the words of this server
+    Query ParseQuery(std::string_view text,
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max(),
+        const CorpusStatistics* corpus = nullptr) const;
 
-    Query ParseQueryWithoutSort(std::string_view raw_query) const;
+    Query ParseQueryWithoutSort(std::string_view raw_query,
+        std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max(),
+        const CorpusStatistics* corpus = nullptr) const;
 
     QueryWord ParseQueryWord(std::string_view text) const;
 
+    // Plus prefixes expand to at most MAX_PREFIX_EXPANSION_COUNT words, minus prefixes to all of
+    // them. Both expansions stop past deadline and set query.expansions_truncated
+    void AddPrefixExpansions(std::string_view prefix, std::vector<std::string_view>& words, bool is_minus,
+        std::chrono::steady_clock::time_point deadline, Query& query) const;
+
+    // Plus "word~" expands to the MAX_FUZZY_EXPANSION_COUNT closest words, equally close words
+    // in lexicographic order, minus "word~" to all of them
+    void AddFuzzyExpansions(std::string_view word, int max_distance, Query& query, bool is_minus,
+        std::chrono::steady_clock::time_point deadline) const;
+
+    // the next plus expansion of the query taken from corpus, throws invalid_argument when
+    // corpus has fewer expansions
+    static void AddCorpusExpansion(const CorpusStatistics& corpus, bool is_fuzzy, Query& query);
+
     std::vector<std::string_view> SplitIntoWordsNoStop(std::string_view text) const;
 
     bool IsStopWord(std::string_view word) const;
@@ -110,69 +458,377 @@ private:
 
     static bool IsValidWord(std::string_view word);
 
-    double ComputeWordInverseDocumentFreq(std::string_view word) const;
+    RankingStats GetRankingStats() const;
+
+    // document frequency scores are computed with, the snapshot value when there is one
+    int GetDocumentFreq(int term_id) const;
+
+    // the words of forward_index_[terms_begin, terms_end) of an added or removed document
+    void MarkStatisticsChanged(size_t terms_begin, size_t terms_end);
+
+    void RefreshStatisticsIfDrifted();
+
+    WordFrequencies GetDocumentWords(const DocumentData& document_data) const;
+
+    std::optional<int> FindDocumentTerm(const DocumentData& document_data, std::string_view word) const;
+
+    void EraseForwardIndex(const DocumentData& document_data);
+
+    // positions of the words present in the document, absent words are skipped
+    std::vector<std::vector<int>> GetWordsPositions(int document_id, const DocumentData& document_data,
+        const std::vector<std::string_view>& words) const;
+
+    // sorted ids of the documents containing minus words
+    std::vector<int> CollectMinusDocuments(const Query& query) const;
+
+    bool ContainsPhrases(int document_id, const DocumentData& document_data, const std::vector<Phrase>& phrases) const;
+
+    struct ImpactCandidate {
+        double relevance;
+        // the most the relevance can still reach
+        double bound;
+        int slot;
+    };
+
+    // Checks that no document outside the best found so far can get into the top, remaining is
+    // the bound of the documents not found yet. Ratings are read only near the border of the top.
+    bool IsImpactTopSettled(std::vector<ImpactCandidate>& candidates, double remaining) const;
+
+    // Calls consume(Document) for every matched document in no particular order. Words are
+    // weighted with the statistics of corpus when it is given, of this server otherwise.
+    template <typename Policy, typename DocumentPredicate, typename Ranking, typename Consumer>
+    void ForEachMatchedDocument(Policy& policy, const Query& query, DocumentPredicate document_predicate,
+        const Ranking& ranking, Consumer consume, const CorpusStatistics* corpus = nullptr) const;
+
+    // Calls consume(Document) in id order for the documents containing every required word.
+    // The shortest posting list leads and the others skip to its documents, any list running
+    // out ends the search. Without required words it is ForEachMatchedDocument.
+    template <typename DocumentPredicate, typename Ranking, typename Consumer>
+    void ForEachDocumentWithAllWords(const Query& query, DocumentPredicate document_predicate,
+        const Ranking& ranking, Consumer consume) const;
+
+    // the first posting from it on with an id not less than document_id
+    static Postings::const_iterator SkipTo(const Postings& postings, Postings::const_iterator it, int document_id);
+
+    // checks the phrases and applies the proximity boost of ranking before consume
+    template <typename Ranking, typename Consumer>
+    void ConsumeMatchedDocument(int document_id, const DocumentData& document_data, double relevance,
+        const Query& query, const Ranking& ranking, Consumer& consume) const;
 
-    template <typename Policy, typename DocumentPredicate>
-    std::vector<Document> FindAllDocuments(Policy& policy, const Query& query, DocumentPredicate document_predicate) const;
+    template <typename Policy, typename DocumentPredicate, typename Ranking>
+    std::vector<Document> FindAllDocuments(Policy& policy, const Query& query, DocumentPredicate document_predicate,
+        const Ranking& ranking) const;
+};
+
+// Keeps the parsed query, its term weights and the last returned document, never the
+// matches themselves. The term weights are fixed when the cursor is opened, so relevances
+// stay comparable between blocks. The server must outlive the cursor and must not change
+// during Next, changes between calls are seen by the following blocks.
+class SearchServer::Cursor {
+public:
+    // up to max_count following documents, fewer only when the matches are exhausted
+    std::vector<Document> Next(size_t max_count);
+
+    // In id order also stops after about max_postings postings are read, so fewer than
+    // max_count documents, even none, do not mean the end: check IsExhausted. In relevance
+    // order the limit is ignored, the first call ranks all matches
+    std::vector<Document> Next(size_t max_count, size_t max_postings);
+
+    bool IsExhausted() const {
+        return exhausted_;
+    }
+
+    // opaque string for SearchServer::ResumeCursor
+    std::string GetContinuationToken() const;
+
+private:
+    friend class SearchServer;
+
+    Cursor(const SearchServer& server, std::string_view raw_query, CursorOrder order, DocumentStatus status);
+
+    const SearchServer* server_;
+    // the parsed query refers to this text
+    std::shared_ptr<const std::string> text_;
+    Query query_;
+    CursorOrder order_;
+    DocumentStatus status_;
+    uint64_t fingerprint_;
+    // (term id, weight) of plus and fuzzy words
+    std::vector<std::pair<int, double>> terms_;
+    std::vector<int> minus_terms_;
+    // id -1 before the first block
+    Document last_ = { -1, 0.0, 0 };
+    // id order only, the last document read by a block that stopped on its postings limit,
+    // the token does not keep it and a resumed cursor reads these postings again
+    int last_read_id_ = -1;
+    bool exhausted_ = false;
+
+    // calls consume(Document) for the matches from first_id on in id order while it returns true
+    // and fewer than max_postings postings are read; returns the id of the last document read,
+    // nullopt when the postings are exhausted
+    template <typename Consumer>
+    std::optional<int> ScanFrom(int first_id, size_t max_postings, Consumer consume) const;
 };
 
 template <typename StringContainer>
-SearchServer::SearchServer(const StringContainer& stop_words)
-    : stop_words_(MakeUniqueNonEmptyStrings(stop_words)) {
-    for (const auto& wordFromStops : stop_words_) {
+SearchServer::SearchServer(const StringContainer& stop_words) {
+    const auto unique_stop_words = MakeUniqueNonEmptyStrings(stop_words);
+    for (const auto& wordFromStops : unique_stop_words) {
         if (!IsValidWord(wordFromStops)) {
             throw std::invalid_argument("    - "s);
         }
     }
+    stop_words_.Assign(std::vector<std::string_view>(unique_stop_words.begin(), unique_stop_words.end()));
 }
 
-template <typename Policy, typename DocumentPredicate>
-std::vector<Document> SearchServer::FindAllDocuments(Policy& policy, const Query& query, DocumentPredicate document_predicate) const {
-    ConcurrentMap<int, double> document_to_relevance(std::thread::hardware_concurrency());
-    
-    //for plus words
-    std::for_each(query.plus_words.begin(), query.plus_words.end(),
-        [&document_predicate, &document_to_relevance, this](auto word_view) {
-            if (word_to_document_freqs_.count(std::string(word_view)) != 0) {
-                const double inverse_document_freq = ComputeWordInverseDocumentFreq(word_view);
-                for (const auto& [document_id, term_freq] : word_to_document_freqs_.at(std::string(word_view))) {
-                    const auto& document_data = documents_.at(document_id);
-                    if (document_predicate(document_id, document_data.status, document_data.rating)) {
-                        document_to_relevance[document_id].ref_to_value += term_freq * inverse_document_freq;
-                    }
-                }
+template <typename Policy, typename DocumentPredicate, typename Ranking, typename Consumer>
+void SearchServer::ForEachMatchedDocument(Policy& policy, const Query& query, DocumentPredicate document_predicate,
+    const Ranking& ranking, Consumer consume, const CorpusStatistics* corpus) const {
+    if constexpr (RankingUsesPositions<Ranking>::value) {
+        if (!positions_) {
+            throw std::logic_error("       "s);
+        }
+    }
+    const RankingStats stats = corpus ? corpus->GetRankingStats() : GetRankingStats();
+
+    // postings and weights of the words contributing to relevance
+    std::vector<std::pair<const Postings*, double>> terms;
+    size_t posting_count = 0;
+    std::vector<int> excluded_documents;
+    const auto add_term = [&terms, &posting_count, &ranking, &stats, corpus, this](std::string_view word_view,
+        double penalty) {
+        const auto term_id = dictionary_.FindWord(word_view);
+        if (term_id && !term_to_document_freqs_[*term_id].empty()) {
+            const auto& postings = term_to_document_freqs_[*term_id];
+            const int document_freq = corpus ? std::max(corpus->GetDocumentFreq(word_view), static_cast<int>(postings.size()))
+                : GetDocumentFreq(*term_id);
+            terms.push_back({ &postings, ranking.TermWeight(stats, document_freq) * penalty });
+            posting_count += postings.size();
+        }
+    };
+    {
+        METRICS_SCOPE(MetricStage::POSTING_FETCH);
+        //for plus words
+        for (const std::string_view word_view : query.plus_words) {
+            add_term(word_view, 1.0);
+        }
+        //for words similar to fuzzy words
+        for (const auto& [word_view, distance] : query.fuzzy_words) {
+            add_term(word_view, std::pow(FUZZY_DISTANCE_PENALTY, distance));
+        }
+        //for minus words
+        excluded_documents = CollectMinusDocuments(query);
+    }
+    METRICS_COUNT(MetricCounter::POSTINGS_SCANNED, posting_count);
+
+    const auto score_term = [&document_predicate, &ranking, &stats, this](const auto& term, auto&& add_relevance) {
+        const auto& [postings, term_weight] = term;
+        for (const auto& [document_id, term_freq] : *postings) {
+            const auto& document_data = documents_.at(document_id);
+            if (document_predicate(document_id, document_data.status, document_data.rating)) {
+                add_relevance(document_data.slot, ranking(stats, term_weight, term_freq, document_data.length));
             }
-        });
+        }
+    };
 
-    //for minus words
-    std::for_each(query.minus_words.begin(), query.minus_words.end(),
-        [&document_predicate, &document_to_relevance, this](auto word_view) {
-            if (word_to_document_freqs_.count(std::string(word_view)) != 0) {                
-                for (const auto& [document_id, _] : word_to_document_freqs_.at(std::string(word_view))) {
-            document_to_relevance.Erase(document_id);
+    size_t scored_count = 0;
+    const auto add_document = [&consume, &scored_count, &excluded_documents, &query, &ranking, this](int slot,
+        double relevance) {
+        ++scored_count;
+        const int document_id = slot_to_document_id_[slot];
+        if (std::binary_search(excluded_documents.begin(), excluded_documents.end(), document_id)) {
+            return;
+        }
+        ConsumeMatchedDocument(document_id, documents_.at(document_id), relevance, query, ranking, consume);
+    };
+
+    METRICS_SCOPE(MetricStage::SCORING);
+    constexpr bool is_parallel = !std::is_same_v<std::decay_t<Policy>, std::execution::sequenced_policy>;
+    const size_t slot_count = slot_to_document_id_.size();
+    const size_t thread_count = std::thread::hardware_concurrency();
+    switch (ChooseAccumulationMode(is_parallel, terms.size(), posting_count, slot_count, thread_count)) {
+    case AccumulationMode::SEQUENTIAL: {
+        SequentialAccumulator accumulator(slot_count);
+        for (const auto& term : terms) {
+            score_term(term, [&accumulator](int slot, double value) { accumulator.Add(slot, value); });
+        }
+        accumulator.ForEach(add_document);
+        break;
+    }
+    case AccumulationMode::ATOMIC: {
+        AtomicAccumulator accumulator(slot_count);
+        std::for_each(policy, terms.begin(), terms.end(), [&accumulator, &score_term](const auto& term) {
+            score_term(term, [&accumulator](int slot, double value) { accumulator.Add(slot, value); });
+            });
+        accumulator.ForEach(add_document);
+        break;
+    }
+    case AccumulationMode::PRIVATE: {
+        PrivateAccumulators accumulators(slot_count, std::min(thread_count, terms.size()));
+        std::vector<size_t> parts(accumulators.GetPartCount());
+        std::iota(parts.begin(), parts.end(), 0);
+        std::for_each(policy, parts.begin(), parts.end(), [&accumulators, &terms, &score_term](size_t part) {
+            for (size_t i = part; i < terms.size(); i += accumulators.GetPartCount()) {
+                score_term(terms[i], [&accumulators, part](int slot, double value) { accumulators.Add(part, slot, value); });
+            }
+            });
+        accumulators.Reduce(policy);
+        accumulators.ForEach(add_document);
+        break;
+    }
+    }
+    METRICS_COUNT(MetricCounter::DOCUMENTS_SCORED, scored_count);
+}
+
+template <typename DocumentPredicate, typename Ranking, typename Consumer>
+void SearchServer::ForEachDocumentWithAllWords(const Query& query, DocumentPredicate document_predicate,
+    const Ranking& ranking, Consumer consume) const {
+    if (query.required_words.empty()) {
+        ForEachMatchedDocument(std::execution::seq, query, document_predicate, ranking, consume);
+        return;
+    }
+    if constexpr (RankingUsesPositions<Ranking>::value) {
+        if (!positions_) {
+            throw std::logic_error("       "s);
+        }
+    }
+    const RankingStats stats = GetRankingStats();
+
+    struct RequiredTerm {
+        const Postings* postings;
+        double weight;
+        Postings::const_iterator it;
+    };
+    std::vector<RequiredTerm> required_terms;
+    // expansions are looked up only in the documents containing every required word
+    std::vector<std::pair<const Postings*, double>> optional_terms;
+    std::vector<const Postings*> minus_terms;
+    {
+        METRICS_SCOPE(MetricStage::POSTING_FETCH);
+        for (const std::string_view word_view : query.required_words) {
+            const auto term_id = dictionary_.FindWord(word_view);
+            if (!term_id || term_to_document_freqs_[*term_id].empty()) {
+                return;
+            }
+            const auto& postings = term_to_document_freqs_[*term_id];
+            required_terms.push_back({ &postings, ranking.TermWeight(stats, GetDocumentFreq(*term_id)), postings.begin() });
+        }
+        const auto add_optional_term = [&optional_terms, &ranking, &stats, this](std::string_view word_view,
+            double penalty) {
+            const auto term_id = dictionary_.FindWord(word_view);
+            if (term_id && !term_to_document_freqs_[*term_id].empty()) {
+                const auto& postings = term_to_document_freqs_[*term_id];
+                optional_terms.push_back({ &postings, ranking.TermWeight(stats, GetDocumentFreq(*term_id)) * penalty });
+            }
+        };
+        for (const std::string_view word_view : query.plus_words) {
+            if (!std::binary_search(query.required_words.begin(), query.required_words.end(), word_view)) {
+                add_optional_term(word_view, 1.0);
+            }
+        }
+        for (const auto& [word_view, distance] : query.fuzzy_words) {
+            add_optional_term(word_view, std::pow(FUZZY_DISTANCE_PENALTY, distance));
+        }
+        for (const std::string_view word_view : query.minus_words) {
+            const auto term_id = dictionary_.FindWord(word_view);
+            if (term_id && !term_to_document_freqs_[*term_id].empty()) {
+                minus_terms.push_back(&term_to_document_freqs_[*term_id]);
+            }
+        }
+        std::sort(required_terms.begin(), required_terms.end(), [](const RequiredTerm& lhs, const RequiredTerm& rhs) {
+            return lhs.postings->size() < rhs.postings->size();
+            });
+    }
+
+    METRICS_SCOPE(MetricStage::SCORING);
+    size_t scanned_count = 0;
+    size_t scored_count = 0;
+    RequiredTerm& lead = required_terms.front();
+    while (lead.it != lead.postings->end()) {
+        const int document_id = lead.it->first;
+        // the smallest id all the lists can still share
+        int next_id = document_id;
+        for (size_t i = 1; i < required_terms.size() && next_id == document_id; ++i) {
+            RequiredTerm& term = required_terms[i];
+            term.it = SkipTo(*term.postings, term.it, document_id);
+            ++scanned_count;
+            if (term.it == term.postings->end()) {
+                next_id = std::numeric_limits<int>::max();
+                break;
+            }
+            next_id = term.it->first;
+        }
+        if (next_id != document_id) {
+            if (next_id == std::numeric_limits<int>::max()) {
+                break;
+            }
+            lead.it = SkipTo(*lead.postings, lead.it, next_id);
+            ++scanned_count;
+            continue;
+        }
+
+        const auto& document_data = documents_.at(document_id);
+        const bool has_minus_word = std::any_of(minus_terms.begin(), minus_terms.end(), [document_id](const Postings* postings) {
+            return postings->count(document_id) > 0;
+            });
+        if (!has_minus_word && document_predicate(document_id, document_data.status, document_data.rating)) {
+            ++scored_count;
+            double relevance = 0.0;
+            for (const RequiredTerm& term : required_terms) {
+                relevance += ranking(stats, term.weight, term.it->second, document_data.length);
+            }
+            for (const auto& [postings, term_weight] : optional_terms) {
+                const auto posting = postings->find(document_id);
+                if (posting != postings->end()) {
+                    relevance += ranking(stats, term_weight, posting->second, document_data.length);
                 }
             }
-        });
-    
-    auto result = document_to_relevance.BuildOrdinaryMap();
+            ConsumeMatchedDocument(document_id, document_data, relevance, query, ranking, consume);
+        }
+        ++lead.it;
+        ++scanned_count;
+    }
+    METRICS_COUNT(MetricCounter::POSTINGS_SCANNED, scanned_count);
+    METRICS_COUNT(MetricCounter::DOCUMENTS_SCORED, scored_count);
+}
 
-    std::vector<Document> matched_documents;
-    for (const auto& [document_id, relevance] : result) {
-        matched_documents.push_back({ document_id, relevance, documents_.at(document_id).rating });
+template <typename Ranking, typename Consumer>
+void SearchServer::ConsumeMatchedDocument(int document_id, const DocumentData& document_data, double relevance,
+    const Query& query, const Ranking& ranking, Consumer& consume) const {
+    if (!query.phrases.empty() && !ContainsPhrases(document_id, document_data, query.phrases)) {
+        return;
+    }
+    if constexpr (RankingUsesPositions<Ranking>::value) {
+        const auto positions = GetWordsPositions(document_id, document_data, query.plus_words);
+        const double boost = ranking.ProximityBoost(ComputeMinimalSpan(positions), static_cast<int>(positions.size()));
+        consume(Document{ document_id, relevance * boost, document_data.rating });
+    }
+    else {
+        consume(Document{ document_id, relevance, document_data.rating });
     }
-    return matched_documents;    
 }
 
-template <typename DocumentPredicate>
+template <typename Policy, typename DocumentPredicate, typename Ranking>
+std::vector<Document> SearchServer::FindAllDocuments(Policy& policy, const Query& query, DocumentPredicate document_predicate,
+    const Ranking& ranking) const {
+    std::vector<Document> matched_documents;
+    ForEachMatchedDocument(policy, query, document_predicate, ranking, [&matched_documents](Document document) {
+        matched_documents.push_back(document);
+        });
+    return matched_documents;
+}
+
+template <typename DocumentPredicate, typename Ranking>
 std::vector<Document> SearchServer::FindTopDocuments(const std::string_view raw_query,
-    DocumentPredicate document_predicate) const {
-    return FindTopDocuments(std::execution::seq, raw_query, document_predicate);
+    DocumentPredicate document_predicate, const Ranking& ranking) const {
+    return FindTopDocuments(std::execution::seq, raw_query, document_predicate, ranking);
 }
 
-template <typename Policy>
-std::vector<Document> SearchServer::FindTopDocuments(Policy& policy, const std::string_view raw_query, DocumentStatus status) const {
+template <typename Policy, typename Ranking>
+std::vector<Document> SearchServer::FindTopDocuments(Policy& policy, const std::string_view raw_query, DocumentStatus status,
+    const Ranking& ranking) const {
     return SearchServer::FindTopDocuments( policy, raw_query, [status](int document_id, DocumentStatus document_status, int rating) {
-        return document_status == status; });
+        return document_status == status; }, ranking);
 }
 
 template <typename Policy>
@@ -180,22 +836,318 @@ std::vector<Document> SearchServer::FindTopDocuments(Policy& policy, const std::
     return FindTopDocuments(policy, raw_query, DocumentStatus::ACTUAL);
 }
 
-template <typename Policy, typename DocumentPredicate>
-std::vector<Document> SearchServer::FindTopDocuments(Policy& policy, const std::string_view raw_query, DocumentPredicate document_predicate) const {
+template <typename Policy, typename DocumentPredicate, typename Ranking>
+std::vector<Document> SearchServer::FindTopDocuments(Policy& policy, const std::string_view raw_query, DocumentPredicate document_predicate,
+    const Ranking& ranking) const {
     const auto query = ParseQuery(raw_query);
 
-    auto matched_documents = FindAllDocuments(policy, query, document_predicate);
+    auto matched_documents = FindAllDocuments(policy, query, document_predicate, ranking);
 
-    std::sort(policy, matched_documents.begin(), matched_documents.end(), [](const Document& lhs, const Document& rhs) {
-        if (std::abs(lhs.relevance - rhs.relevance) < EPSILON) {
-            return lhs.rating > rhs.rating;
-        }
-        else {
-            return lhs.relevance > rhs.relevance;
-        }
-        });
+    METRICS_SCOPE(MetricStage::TOP_K);
+    std::sort(policy, matched_documents.begin(), matched_documents.end(), IsRankedBefore);
     if (matched_documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
         matched_documents.resize(MAX_RESULT_DOCUMENT_COUNT);
     }
     return matched_documents;
 }
+
+template <typename DocumentPredicate, typename Ranking>
+std::vector<Document> SearchServer::FindTopDocuments(QueryMode mode, const std::string_view raw_query,
+    DocumentPredicate document_predicate, const Ranking& ranking) const {
+    if (mode == QueryMode::ANY_WORD) {
+        return FindTopDocuments(std::execution::seq, raw_query, document_predicate, ranking);
+    }
+    const auto query = ParseQuery(raw_query);
+
+    BoundedHeap<Document, bool (*)(const Document&, const Document&)> top_documents(MAX_RESULT_DOCUMENT_COUNT,
+        IsRankedBefore);
+    ForEachDocumentWithAllWords(query, document_predicate, ranking, [&top_documents](Document document) {
+        top_documents.Push(document);
+        });
+
+    METRICS_SCOPE(MetricStage::TOP_K);
+    return std::move(top_documents).TakeSorted();
+}
+
+template <typename DocumentPredicate, typename Ranking>
+std::vector<Document> SearchServer::FindPage(const std::string_view raw_query, DocumentPredicate document_predicate,
+    size_t page, size_t page_size, const Ranking& ranking) const {
+    if (page_size == 0) {
+        throw std::invalid_argument("    "s);
+    }
+    const auto query = ParseQuery(raw_query);
+
+    // matches ranked before the end of the requested page
+    const size_t window = page < std::numeric_limits<size_t>::max() / page_size ? (page + 1) * page_size
+        : std::numeric_limits<size_t>::max();
+    BoundedHeap<Document, bool (*)(const Document&, const Document&)> top_documents(window, IsRankedBefore);
+    ForEachMatchedDocument(std::execution::seq, query, document_predicate, ranking, [&top_documents](Document document) {
+        top_documents.Push(document);
+        });
+
+    METRICS_SCOPE(MetricStage::TOP_K);
+    auto documents = std::move(top_documents).TakeSorted();
+    if (documents.size() <= window - page_size) {
+        return {};
+    }
+    documents.erase(documents.begin(), documents.begin() + (window - page_size));
+    return documents;
+}
+
+template <typename DocumentPredicate, typename Ranking>
+LimitedSearchResult SearchServer::FindTopDocumentsWithLimits(const std::string_view raw_query,
+    DocumentPredicate document_predicate, const QueryLimits& limits, const Ranking& ranking) const {
+    const auto start = std::chrono::steady_clock::now();
+    if constexpr (RankingUsesPositions<Ranking>::value) {
+        if (!positions_) {
+            throw std::logic_error("       "s);
+        }
+    }
+    const auto deadline = limits.time_budget >= std::chrono::steady_clock::time_point::max() - start
+        ? std::chrono::steady_clock::time_point::max() : start + limits.time_budget;
+    LimitedSearchResult result;
+    const auto reach_limit = [&result](QueryLimit limit) {
+        if (!result.truncated) {
+            result.truncated = true;
+            result.reached_limit = limit;
+        }
+    };
+
+    const auto query = ParseQuery(raw_query, deadline);
+    if (query.expansions_truncated) {
+        reach_limit(QueryLimit::TIME);
+    }
+    // parsing and expanding may take the whole budget
+    if (deadline != std::chrono::steady_clock::time_point::max() && std::chrono::steady_clock::now() >= deadline) {
+        reach_limit(QueryLimit::TIME);
+        return result;
+    }
+    const RankingStats stats = GetRankingStats();
+
+    std::vector<std::pair<const Postings*, double>> terms;
+    std::vector<const Postings*> minus_terms;
+    {
+        METRICS_SCOPE(MetricStage::POSTING_FETCH);
+        const auto add_term = [&terms, &ranking, &stats, this](std::string_view word_view, double penalty) {
+            const auto term_id = dictionary_.FindWord(word_view);
+            if (term_id && !term_to_document_freqs_[*term_id].empty()) {
+                terms.push_back({ &term_to_document_freqs_[*term_id],
+                    ranking.TermWeight(stats, GetDocumentFreq(*term_id)) * penalty });
+            }
+        };
+        for (const std::string_view word_view : query.plus_words) {
+            add_term(word_view, 1.0);
+        }
+        for (const auto& [word_view, distance] : query.fuzzy_words) {
+            add_term(word_view, std::pow(FUZZY_DISTANCE_PENALTY, distance));
+        }
+        for (const std::string_view word_view : query.minus_words) {
+            const auto term_id = dictionary_.FindWord(word_view);
+            if (term_id && !term_to_document_freqs_[*term_id].empty()) {
+                minus_terms.push_back(&term_to_document_freqs_[*term_id]);
+            }
+        }
+        std::stable_sort(terms.begin(), terms.end(), [](const auto& lhs, const auto& rhs) {
+            return lhs.first->size() < rhs.first->size();
+            });
+    }
+
+    SequentialAccumulator accumulator(slot_to_document_id_.size());
+    {
+        METRICS_SCOPE(MetricStage::SCORING);
+        bool is_stopped = false;
+        for (size_t i = 0; i < terms.size() && !is_stopped; ++i) {
+            const auto& [postings, term_weight] = terms[i];
+            for (const auto& [document_id, term_freq] : *postings) {
+                if (result.postings_scanned == limits.max_postings) {
+                    reach_limit(QueryLimit::POSTINGS);
+                    is_stopped = true;
+                    break;
+                }
+                // checked before the posting is counted, so every counted posting is read
+                if (result.postings_scanned > 0 && result.postings_scanned % QUERY_LIMITS_CHECK_INTERVAL == 0
+                    && std::chrono::steady_clock::now() >= deadline) {
+                    reach_limit(QueryLimit::TIME);
+                    is_stopped = true;
+                    break;
+                }
+                ++result.postings_scanned;
+                const auto& document_data = documents_.at(document_id);
+                if (!accumulator.Contains(document_data.slot)) {
+                    // a full accumulator takes no new documents, they are not even checked
+                    if (accumulator.GetCount() == limits.max_candidates) {
+                        reach_limit(QueryLimit::CANDIDATES);
+                        continue;
+                    }
+                    if (!document_predicate(document_id, document_data.status, document_data.rating)
+                        || std::any_of(minus_terms.begin(), minus_terms.end(), [document_id](const Postings* minus_postings) {
+                            return minus_postings->count(document_id) > 0;
+                            })) {
+                        continue;
+                    }
+                }
+                accumulator.Add(document_data.slot, ranking(stats, term_weight, term_freq, document_data.length));
+            }
+        }
+    }
+    result.candidates = accumulator.GetCount();
+    METRICS_COUNT(MetricCounter::POSTINGS_SCANNED, result.postings_scanned);
+    METRICS_COUNT(MetricCounter::DOCUMENTS_SCORED, result.candidates);
+
+    METRICS_SCOPE(MetricStage::TOP_K);
+    BoundedHeap<Document, bool (*)(const Document&, const Document&)> top_documents(MAX_RESULT_DOCUMENT_COUNT,
+        IsRankedBefore);
+    const auto push = [&top_documents](Document document) {
+        top_documents.Push(document);
+    };
+    accumulator.ForEach([&query, &ranking, &push, this](int slot, double relevance) {
+        const int document_id = slot_to_document_id_[slot];
+        ConsumeMatchedDocument(document_id, documents_.at(document_id), relevance, query, ranking, push);
+        });
+    result.documents = std::move(top_documents).TakeSorted();
+    return result;
+}
+
+template <typename DocumentPredicate>
+std::vector<Document> SearchServer::FindTopDocumentsByImpact(const std::string_view raw_query,
+    DocumentPredicate document_predicate, std::chrono::nanoseconds budget) const {
+    const auto start = std::chrono::steady_clock::now();
+    if (!impacts_) {
+        return FindTopDocuments(std::execution::seq, raw_query, document_predicate);
+    }
+    const auto query = ParseQuery(raw_query);
+    if (!query.phrases.empty()) {
+        return FindTopDocuments(std::execution::seq, raw_query, document_predicate);
+    }
+    const RankingStats stats = GetRankingStats();
+    const TfIdfRanking ranking;
+
+    struct ImpactCursor {
+        const Postings* postings;
+        ImpactIndex::ImpactList::const_iterator it;
+        ImpactIndex::ImpactList::const_iterator end;
+        double weight;
+
+        double GetNextImpact() const {
+            return it == end ? 0.0 : it->term_freq * weight;
+        }
+    };
+    std::vector<ImpactCursor> cursors;
+    std::vector<const Postings*> minus_terms;
+    {
+        METRICS_SCOPE(MetricStage::POSTING_FETCH);
+        const auto add_term = [&cursors, &ranking, &stats, this](std::string_view word_view, double penalty) {
+            const auto term_id = dictionary_.FindWord(word_view);
+            if (term_id && !term_to_document_freqs_[*term_id].empty()) {
+                const auto& postings = term_to_document_freqs_[*term_id];
+                const auto& impacts = impacts_->GetImpacts(*term_id);
+                cursors.push_back({ &postings, impacts.begin(), impacts.end(),
+                    ranking.TermWeight(stats, GetDocumentFreq(*term_id)) * penalty });
+            }
+        };
+        for (const std::string_view word_view : query.plus_words) {
+            add_term(word_view, 1.0);
+        }
+        for (const auto& [word_view, distance] : query.fuzzy_words) {
+            add_term(word_view, std::pow(FUZZY_DISTANCE_PENALTY, distance));
+        }
+        for (const std::string_view word_view : query.minus_words) {
+            const auto term_id = dictionary_.FindWord(word_view);
+            if (term_id && !term_to_document_freqs_[*term_id].empty()) {
+                minus_terms.push_back(&term_to_document_freqs_[*term_id]);
+            }
+        }
+    }
+
+    ImpactAccumulator accumulator(slot_to_document_id_.size());
+    size_t processed_count = 0;
+    {
+        METRICS_SCOPE(MetricStage::SCORING);
+        // cursors with postings left, the highest next impact on top
+        const auto lower_next_impact = [&cursors](size_t lhs, size_t rhs) {
+            return cursors[lhs].GetNextImpact() < cursors[rhs].GetNextImpact();
+        };
+        std::vector<size_t> queue(cursors.size());
+        std::iota(queue.begin(), queue.end(), 0);
+        std::make_heap(queue.begin(), queue.end(), lower_next_impact);
+
+        std::vector<double> next_impacts(cursors.size());
+        std::vector<ImpactCandidate> candidates;
+        size_t next_stop_check = MIN_IMPACT_STOP_CHECK_INTERVAL;
+        while (!queue.empty()) {
+            std::pop_heap(queue.begin(), queue.end(), lower_next_impact);
+            const size_t cursor_index = queue.back();
+            ImpactCursor& cursor = cursors[cursor_index];
+            const ImpactIndex::Impact& impact = *cursor.it;
+            const bool has_minus_word = std::any_of(minus_terms.begin(), minus_terms.end(), [&impact](const Postings* postings) {
+                return postings->count(impact.document_id) > 0;
+                });
+            if (!has_minus_word && document_predicate(impact.document_id, impact.status, impact.rating)) {
+                accumulator.Add(impact.slot, cursor_index, cursor.GetNextImpact());
+            }
+            if (++cursor.it == cursor.end) {
+                queue.pop_back();
+            }
+            else {
+                std::push_heap(queue.begin(), queue.end(), lower_next_impact);
+            }
+
+            ++processed_count;
+            if (processed_count % IMPACT_BUDGET_CHECK_INTERVAL == 0 && std::chrono::steady_clock::now() - start >= budget) {
+                break;
+            }
+            if (processed_count < next_stop_check) {
+                continue;
+            }
+            // a document gains at most the next impact of every term not counted for it yet,
+            // a document not found yet gains at most remaining
+            double remaining = 0.0;
+            for (size_t i = 0; i < cursors.size(); ++i) {
+                next_impacts[i] = cursors[i].GetNextImpact();
+                remaining += next_impacts[i];
+            }
+            candidates.clear();
+            accumulator.ForEach([&candidates, &next_impacts, remaining](int slot, double relevance, uint64_t seen_terms) {
+                double gain = remaining;
+                for (size_t i = 0; seen_terms != 0; ++i, seen_terms >>= 1) {
+                    if (seen_terms & 1) {
+                        gain -= next_impacts[i];
+                    }
+                }
+                candidates.push_back({ relevance, relevance + gain, slot });
+                });
+            if (candidates.size() >= MAX_RESULT_DOCUMENT_COUNT && IsImpactTopSettled(candidates, remaining)) {
+                break;
+            }
+            // checks cost as much as the postings taken between them
+            next_stop_check = processed_count + std::max(MIN_IMPACT_STOP_CHECK_INTERVAL, candidates.size());
+        }
+    }
+    METRICS_COUNT(MetricCounter::POSTINGS_SCANNED, processed_count);
+
+    METRICS_SCOPE(MetricStage::TOP_K);
+    size_t scored_count = 0;
+    BoundedHeap<Document, bool (*)(const Document&, const Document&)> top_documents(MAX_RESULT_DOCUMENT_COUNT,
+        IsRankedBefore);
+    accumulator.ForEach([&top_documents, &scored_count, this](int slot, double relevance, uint64_t) {
+        ++scored_count;
+        const int document_id = slot_to_document_id_[slot];
+        top_documents.Push(Document{ document_id, relevance, documents_.at(document_id).rating });
+        });
+    METRICS_COUNT(MetricCounter::DOCUMENTS_SCORED, scored_count);
+
+    // postings not taken yet are looked up, so the relevance of the found documents is exact
+    auto documents = std::move(top_documents).TakeSorted();
+    for (Document& document : documents) {
+        const auto& document_data = documents_.at(document.id);
+        document.relevance = 0.0;
+        for (const ImpactCursor& cursor : cursors) {
+            const auto posting = cursor.postings->find(document.id);
+            if (posting != cursor.postings->end()) {
+                document.relevance += ranking(stats, cursor.weight, posting->second, document_data.length);
+            }
+        }
+    }
+    std::sort(documents.begin(), documents.end(), IsRankedBefore);
+    return documents;
+}
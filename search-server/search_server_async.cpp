@@ -0,0 +1,24 @@
+#include "search_server.h"
+
+#ifdef SEARCH_SERVER_HAS_COROUTINES
+
+using namespace std;
+
+QueryTask<vector<Document>> SearchServer::FindTopDocumentsAsync(QueryExecutor& executor, string raw_query,
+    DocumentStatus status) const {
+    Cursor cursor = OpenCursor(raw_query, CursorOrder::DOCUMENT_ID, status);
+    BoundedHeap<Document, bool (*)(const Document&, const Document&)> top_documents(MAX_RESULT_DOCUMENT_COUNT,
+        IsRankedBefore);
+    while (true) {
+        for (const Document& document : cursor.Next(numeric_limits<size_t>::max(), ASYNC_CHUNK_POSTING_COUNT)) {
+            top_documents.Push(document);
+        }
+        if (cursor.IsExhausted()) {
+            break;
+        }
+        co_await executor.Yield();
+    }
+    co_return move(top_documents).TakeSorted();
+}
+
+#endif
@@ -0,0 +1,524 @@
+#include "search_server_benchmark.h"
+#include "document_loader.h"
+#include "metrics.h"
+#include "process_queries.h"
+#include "remove_duplicates.h"
+#include "search_client.h"
+#include "search_server.h"
+#include "stop_word_set.h"
+#include "string_processing.h"
+#include "text_analyzer.h"
+#include "write_ahead_log.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <execution>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <sstream>
+#include <string_view>
+#ifdef __linux__
+#include <unistd.h>
+#endif
+
+using namespace std;
+
+namespace {
+
+const int MIN_DOCUMENT_LENGTH = 20;
+const int MAX_DOCUMENT_LENGTH = 200;
+const int MAX_QUERY_LENGTH = 10;
+const double MINUS_WORD_PROBABILITY = 0.1;
+const int STOP_WORD_COUNT = 10;
+// a synced write per document takes milliseconds on a disk, so the log is measured on a prefix
+const int WAL_BENCHMARK_DOCUMENT_COUNT = 10'000;
+// indexing is measured twice, with and without analysis, on a prefix of the corpus
+const int TEXT_ANALYSIS_DOCUMENT_COUNT = 10'000;
+// the most common words after the stop words make a query that scores nearly the whole corpus
+const int HEAVY_QUERY_WORD_COUNT = 10;
+const int HEAVY_QUERY_REPEAT_COUNT = 20;
+
+using Clock = chrono::steady_clock;
+
+uint64_t GetNanoseconds(Clock::duration duration) {
+    return static_cast<uint64_t>(chrono::duration_cast<chrono::nanoseconds>(duration).count());
+}
+
+// resident set size of the process, 0 where it cannot be read
+uint64_t GetResidentMemory() {
+#ifdef __linux__
+    FILE* statm = fopen("/proc/self/statm", "r");
+    if (statm == nullptr) {
+        return 0;
+    }
+    unsigned long long size = 0;
+    unsigned long long resident = 0;
+    const int read = fscanf(statm, "%llu %llu", &size, &resident);
+    fclose(statm);
+    return read == 2 ? resident * static_cast<uint64_t>(sysconf(_SC_PAGESIZE)) : 0;
+#else
+    return 0;
+#endif
+}
+
+class ZipfDistribution {
+public:
+    ZipfDistribution(int count, double exponent)
+        : cumulative_(count) {
+        double total = 0;
+        for (int rank = 0; rank < count; ++rank) {
+            total += 1.0 / pow(rank + 1, exponent);
+            cumulative_[rank] = total;
+        }
+        for (double& value : cumulative_) {
+            value /= total;
+        }
+    }
+
+    // rank from 0, the most frequent first
+    int operator()(mt19937& generator) const {
+        const double value = uniform_real_distribution<double>(0, 1)(generator);
+        const auto it = lower_bound(cumulative_.begin(), cumulative_.end(), value);
+        return static_cast<int>(min<ptrdiff_t>(it - cumulative_.begin(), cumulative_.size() - 1));
+    }
+
+private:
+    vector<double> cumulative_;
+};
+
+vector<string> GenerateVocabulary(mt19937& generator, int word_count) {
+    vector<string> words;
+    words.reserve(word_count);
+    uniform_int_distribution<int> length_distribution(2, 12);
+    uniform_int_distribution<int> letter_distribution('a', 'z');
+    // the rank is appended, so words are unique without rejection
+    for (int i = 0; i < word_count; ++i) {
+        string word;
+        const int length = length_distribution(generator);
+        for (int j = 0; j < length; ++j) {
+            word.push_back(static_cast<char>(letter_distribution(generator)));
+        }
+        word += to_string(i);
+        words.push_back(move(word));
+    }
+    return words;
+}
+
+struct Corpus {
+    vector<string> vocabulary;
+    string stop_words;
+    vector<string> documents;
+    vector<string> queries;
+};
+
+Corpus GenerateCorpus(const BenchmarkScale& scale) {
+    mt19937 generator(scale.seed);
+    Corpus corpus;
+    corpus.vocabulary = GenerateVocabulary(generator, scale.vocabulary_size);
+    for (int i = 0; i < STOP_WORD_COUNT && i < scale.vocabulary_size; ++i) {
+        corpus.stop_words += corpus.vocabulary[i] + ' ';
+    }
+
+    const ZipfDistribution word_distribution(scale.vocabulary_size, scale.zipf_exponent);
+    uniform_int_distribution<int> document_length_distribution(MIN_DOCUMENT_LENGTH, MAX_DOCUMENT_LENGTH);
+    corpus.documents.reserve(scale.document_count);
+    for (int i = 0; i < scale.document_count; ++i) {
+        string document;
+        const int length = document_length_distribution(generator);
+        for (int j = 0; j < length; ++j) {
+            document += corpus.vocabulary[word_distribution(generator)];
+            document.push_back(' ');
+        }
+        corpus.documents.push_back(move(document));
+    }
+
+    const ZipfDistribution query_length_distribution(MAX_QUERY_LENGTH, scale.zipf_exponent);
+    bernoulli_distribution minus_distribution(MINUS_WORD_PROBABILITY);
+    corpus.queries.reserve(scale.query_count);
+    for (int i = 0; i < scale.query_count; ++i) {
+        string query;
+        const int length = query_length_distribution(generator) + 1;
+        for (int j = 0; j < length; ++j) {
+            if (!query.empty()) {
+                query.push_back(' ');
+            }
+            if (j > 0 && minus_distribution(generator)) {
+                query.push_back('-');
+            }
+            query += corpus.vocabulary[word_distribution(generator)];
+        }
+        corpus.queries.push_back(move(query));
+    }
+    return corpus;
+}
+
+// one JSON object per line, fields appended in order
+class BenchmarkRecord {
+public:
+    BenchmarkRecord(ostream& out, const BenchmarkScale& scale, string_view benchmark)
+        : out_(out) {
+        line_ << "{\"benchmark\":\""sv << benchmark << "\",\"scale\":\""sv << scale.name
+            << "\",\"documents\":"sv << scale.document_count << ",\"seed\":"sv << scale.seed;
+    }
+
+    template <typename Value>
+    BenchmarkRecord& Add(string_view key, const Value& value) {
+        line_ << ",\""sv << key << "\":"sv;
+        if constexpr (is_convertible_v<const Value&, string_view>) {
+            line_ << '"' << value << '"';
+        }
+        else {
+            line_ << value;
+        }
+        return *this;
+    }
+
+    BenchmarkRecord& AddLatency(const LatencyHistogram& histogram) {
+        return Add("count"sv, histogram.GetCount())
+            .Add("mean_ns"sv, histogram.GetMean())
+            .Add("p50_ns"sv, histogram.GetPercentile(50))
+            .Add("p90_ns"sv, histogram.GetPercentile(90))
+            .Add("p99_ns"sv, histogram.GetPercentile(99))
+            .Add("p999_ns"sv, histogram.GetPercentile(99.9))
+            .Add("max_ns"sv, histogram.GetMax());
+    }
+
+    ~BenchmarkRecord() {
+        out_ << line_.str() << '}' << endl;
+    }
+
+private:
+    ostream& out_;
+    ostringstream line_;
+};
+
+template <typename Policy>
+void BenchmarkQueries(const SearchServer& search_server, const Corpus& corpus, const BenchmarkScale& scale,
+    string_view policy_name, Policy& policy, ostream& out) {
+    LatencyHistogram latency;
+    double total_relevance = 0;
+    for (const string& query : corpus.queries) {
+        const auto start = Clock::now();
+        for (const Document& document : search_server.FindTopDocuments(policy, query)) {
+            total_relevance += document.relevance;
+        }
+        latency.Record(GetNanoseconds(Clock::now() - start));
+    }
+    BenchmarkRecord(out, scale, "query_latency"sv).Add("policy"sv, policy_name).AddLatency(latency)
+        .Add("total_relevance"sv, total_relevance);
+}
+
+// the heavy query with FindTopDocumentsWithLimits, unlimited and with a tenth of the corpus
+// allowed for postings and candidates
+void BenchmarkQueryLimits(const SearchServer& search_server, const Corpus& corpus, const BenchmarkScale& scale,
+    ostream& out) {
+    string heavy_query;
+    for (int i = STOP_WORD_COUNT; i < STOP_WORD_COUNT + HEAVY_QUERY_WORD_COUNT && i < scale.vocabulary_size; ++i) {
+        heavy_query += corpus.vocabulary[i] + ' ';
+    }
+    QueryLimits limits;
+    limits.max_postings = max(scale.document_count / 10, 1);
+    limits.max_candidates = max(scale.document_count / 10, 1);
+    for (const auto& [name, query_limits] : { pair{ "off"sv, QueryLimits{} }, pair{ "on"sv, limits } }) {
+        LatencyHistogram latency;
+        LimitedSearchResult result;
+        for (int i = 0; i < HEAVY_QUERY_REPEAT_COUNT; ++i) {
+            const auto start = Clock::now();
+            result = search_server.FindTopDocumentsWithLimits(heavy_query, DocumentStatus::ACTUAL, query_limits);
+            latency.Record(GetNanoseconds(Clock::now() - start));
+        }
+        BenchmarkRecord(out, scale, "heavy_query_latency"sv).Add("limits"sv, name).AddLatency(latency)
+            .Add("truncated"sv, result.truncated ? "yes"sv : "no"sv).Add("postings_scanned"sv, result.postings_scanned)
+            .Add("candidates"sv, result.candidates);
+    }
+}
+
+// the corpus written as TSV and indexed back with LoadDocuments, the file is read from the page cache.
+// A plain sequential read of the file is the bandwidth the loader is compared with
+void BenchmarkFileIngestion(const Corpus& corpus, const BenchmarkScale& scale, ostream& out) {
+    const filesystem::path path = filesystem::temp_directory_path() / ("search_server_benchmark_"s + scale.name + ".tsv"s);
+    {
+        ofstream file(path, ios::binary);
+        for (int i = 0; i < scale.document_count; ++i) {
+            file << i << "\tACTUAL\t"sv << i % 10 << '\t' << corpus.documents[i] << '\n';
+        }
+    }
+    const uintmax_t bytes = filesystem::file_size(path);
+    uint64_t read_duration = 0;
+    {
+        ifstream file(path, ios::binary);
+        vector<char> buffer(1 << 20);
+        const auto read_start = Clock::now();
+        while (file.read(buffer.data(), static_cast<streamsize>(buffer.size())) || file.gcount() > 0) {
+        }
+        read_duration = GetNanoseconds(Clock::now() - read_start);
+    }
+    SearchServer search_server(corpus.stop_words);
+    const auto start = Clock::now();
+    const size_t document_count = LoadDocuments(search_server, path.string());
+    const uint64_t duration = GetNanoseconds(Clock::now() - start);
+    filesystem::remove(path);
+    BenchmarkRecord(out, scale, "file_ingestion"sv).Add("duration_ns"sv, duration).Add("bytes"sv, bytes)
+        .Add("megabytes_per_second"sv, bytes * 1e3 / max<uint64_t>(duration, 1))
+        .Add("read_megabytes_per_second"sv, bytes * 1e3 / max<uint64_t>(read_duration, 1))
+        .Add("documents_per_second"sv, document_count * 1e9 / max<uint64_t>(duration, 1));
+}
+
+// StopWordSet against the std::set it replaced, on every word of the corpus
+void BenchmarkStopWords(const Corpus& corpus, const BenchmarkScale& scale, ostream& out) {
+    const set<string, less<>> stop_word_tree = MakeUniqueNonEmptyStrings(SplitIntoWords(corpus.stop_words));
+    StopWordSet stop_word_set;
+    stop_word_set.Assign(vector<string_view>(stop_word_tree.begin(), stop_word_tree.end()));
+    vector<string_view> words;
+    for (const string& document : corpus.documents) {
+        for (const string_view word : SplitIntoWords(document)) {
+            words.push_back(word);
+        }
+    }
+    const auto measure = [&words](const auto& is_stop_word) {
+        size_t stop_word_count = 0;
+        const auto start = Clock::now();
+        for (const string_view word : words) {
+            stop_word_count += is_stop_word(word);
+        }
+        return pair{ GetNanoseconds(Clock::now() - start), stop_word_count };
+    };
+    const auto [tree_duration, tree_stop_word_count] = measure([&stop_word_tree](string_view word) {
+        return stop_word_tree.count(word) > 0;
+        });
+    const auto [hash_duration, hash_count] = measure([&stop_word_set](string_view word) {
+        return stop_word_set.Contains(word);
+        });
+    BenchmarkRecord(out, scale, "stop_word_lookup"sv).Add("words"sv, words.size())
+        .Add("set_stop_words"sv, tree_stop_word_count).Add("perfect_hash_stop_words"sv, hash_count)
+        .Add("set_ns_per_word"sv, static_cast<double>(tree_duration) / max<size_t>(words.size(), 1))
+        .Add("perfect_hash_ns_per_word"sv, static_cast<double>(hash_duration) / max<size_t>(words.size(), 1));
+}
+
+// TextAnalyzer on the corpus as it is, which takes the scan that finds nothing to change, and
+// on the corpus with capitalized words and commas, then indexing with and without analysis
+void BenchmarkTextAnalysis(const Corpus& corpus, const BenchmarkScale& scale, ostream& out) {
+    vector<string> mixed_case_documents;
+    mixed_case_documents.reserve(corpus.documents.size());
+    for (const string& document : corpus.documents) {
+        string& mixed_case = mixed_case_documents.emplace_back();
+        for (const string_view word : SplitIntoWords(document)) {
+            mixed_case += static_cast<char>(toupper(static_cast<unsigned char>(word[0])));
+            mixed_case += word.substr(1);
+            mixed_case += ", "sv;
+        }
+    }
+    const TextAnalyzer analyzer;
+    const auto measure_normalization = [&](string_view input_name, const vector<string>& documents) {
+        size_t bytes = 0;
+        size_t changed_documents = 0;
+        const auto start = Clock::now();
+        for (const string& document : documents) {
+            bytes += document.size();
+            changed_documents += analyzer.NormalizeDocument(document).has_value();
+        }
+        const uint64_t duration = GetNanoseconds(Clock::now() - start);
+        BenchmarkRecord(out, scale, "text_normalization"sv).Add("input"sv, input_name).Add("bytes"sv, bytes)
+            .Add("changed_documents"sv, changed_documents)
+            .Add("megabytes_per_second"sv, bytes * 1e3 / max<uint64_t>(duration, 1));
+    };
+    measure_normalization("normalized"sv, corpus.documents);
+    measure_normalization("mixed_case"sv, mixed_case_documents);
+
+    const int document_count = min(scale.document_count, TEXT_ANALYSIS_DOCUMENT_COUNT);
+    for (const bool analyze : { false, true }) {
+        SearchServer search_server(corpus.stop_words);
+        if (analyze) {
+            search_server.EnableTextAnalysis();
+        }
+        const auto start = Clock::now();
+        for (int i = 0; i < document_count; ++i) {
+            search_server.AddDocument(i, corpus.documents[i], DocumentStatus::ACTUAL, { i % 10 });
+        }
+        const uint64_t duration = GetNanoseconds(Clock::now() - start);
+        BenchmarkRecord(out, scale, "text_analysis_indexing"sv).Add("analysis"sv, analyze ? "on"sv : "off"sv)
+            .Add("indexed_documents"sv, document_count)
+            .Add("documents_per_second"sv, document_count * 1e9 / max<uint64_t>(duration, 1));
+    }
+}
+
+// indexing through a WriteAheadLog in TMPDIR at every durability level, then the replay of the log
+void BenchmarkWriteAheadLog(const Corpus& corpus, const BenchmarkScale& scale, ostream& out) {
+    const filesystem::path path = filesystem::temp_directory_path() / ("search_server_benchmark_"s + scale.name + ".wal"s);
+    const int document_count = min(scale.document_count, WAL_BENCHMARK_DOCUMENT_COUNT);
+    const pair<WalDurability, string_view> levels[] = {
+        { WalDurability::WRITE, "write"sv },
+        { WalDurability::GROUP_COMMIT, "group_commit"sv },
+        { WalDurability::SYNC, "sync"sv },
+    };
+    for (const auto& [durability, name] : levels) {
+        filesystem::remove(path);
+        SearchServer search_server(corpus.stop_words);
+        WriteAheadLog::Stats stats;
+        const auto start = Clock::now();
+        {
+            WriteAheadLog log(path.string(), { durability });
+            for (int i = 0; i < document_count; ++i) {
+                log.AddDocument(search_server, i, corpus.documents[i], DocumentStatus::ACTUAL, { i % 10 });
+            }
+            log.Sync();
+            stats = log.GetStats();
+        }
+        const uint64_t duration = GetNanoseconds(Clock::now() - start);
+        BenchmarkRecord(out, scale, "wal_indexing"sv).Add("durability"sv, name).Add("logged_documents"sv, document_count)
+            .Add("duration_ns"sv, duration).Add("documents_per_second"sv, document_count * 1e9 / max<uint64_t>(duration, 1))
+            .Add("bytes"sv, stats.bytes).Add("syncs"sv, stats.syncs);
+    }
+    SearchServer search_server(corpus.stop_words);
+    const auto start = Clock::now();
+    const WalReplayResult replay = ReplayWriteAheadLog(search_server, path.string());
+    const uint64_t duration = GetNanoseconds(Clock::now() - start);
+    filesystem::remove(path);
+    BenchmarkRecord(out, scale, "wal_replay"sv).Add("records"sv, replay.records).Add("duration_ns"sv, duration)
+        .Add("records_per_second"sv, replay.records * 1e9 / max<uint64_t>(duration, 1));
+}
+
+}
+
+vector<BenchmarkScale> GetDefaultBenchmarkScales() {
+    return {
+        { "small"s, 10'000, 10'000, 1'000 },
+        { "medium"s, 100'000, 50'000, 1'000 },
+        { "large"s, 1'000'000, 200'000, 1'000 },
+    };
+}
+
+void BenchmarkSearchServer(const BenchmarkScale& scale, ostream& out) {
+    const Corpus corpus = GenerateCorpus(scale);
+
+    const uint64_t memory_before = GetResidentMemory();
+    SearchServer search_server(corpus.stop_words);
+    {
+        const auto start = Clock::now();
+        for (int i = 0; i < scale.document_count; ++i) {
+            search_server.AddDocument(i, corpus.documents[i], DocumentStatus::ACTUAL, { i % 10 });
+        }
+        const uint64_t duration = GetNanoseconds(Clock::now() - start);
+        BenchmarkRecord(out, scale, "indexing"sv).Add("duration_ns"sv, duration)
+            .Add("documents_per_second"sv, scale.document_count * 1e9 / max<uint64_t>(duration, 1));
+    }
+    const uint64_t memory_after = GetResidentMemory();
+    {
+        const MemoryStats memory = search_server.GetMemoryStats();
+        BenchmarkRecord record(out, scale, "memory"sv);
+        record.Add("resident_bytes"sv, memory_after - min(memory_before, memory_after))
+            .Add("index_bytes"sv, memory.GetTotalBytes());
+        for (const ComponentMemory& component : memory.components) {
+            record.Add(component.name + "_bytes"s, component.bytes);
+        }
+    }
+
+    BenchmarkQueries(search_server, corpus, scale, "seq"sv, execution::seq, out);
+    BenchmarkQueries(search_server, corpus, scale, "par"sv, execution::par, out);
+
+    {
+        LatencyHistogram latency;
+        size_t document_count = 0;
+        for (const string& query : corpus.queries) {
+            const auto start = Clock::now();
+            document_count += search_server.FindTopDocuments(QueryMode::ALL_WORDS, query).size();
+            latency.Record(GetNanoseconds(Clock::now() - start));
+        }
+        BenchmarkRecord(out, scale, "all_words_query_latency"sv).AddLatency(latency)
+            .Add("documents"sv, document_count);
+    }
+    BenchmarkQueryLimits(search_server, corpus, scale, out);
+
+    {
+        const MetricsSnapshot metrics_before = GetMetricsSnapshot();
+        const auto start = Clock::now();
+        const auto results = ProcessQueries(search_server, corpus.queries);
+        const uint64_t duration = GetNanoseconds(Clock::now() - start);
+        MetricsSnapshot metrics = GetMetricsSnapshot();
+        metrics -= metrics_before;
+        BenchmarkRecord(out, scale, "process_queries"sv).Add("duration_ns"sv, duration)
+            .Add("queries_per_second"sv, corpus.queries.size() * 1e9 / max<uint64_t>(duration, 1))
+            .Add("postings_scanned"sv, metrics.GetCounter(MetricCounter::POSTINGS_SCANNED))
+            .Add("documents_scored"sv, metrics.GetCounter(MetricCounter::DOCUMENTS_SCORED));
+    }
+
+    {
+        mt19937 generator(scale.seed);
+        uniform_int_distribution<int> document_distribution(0, scale.document_count - 1);
+        LatencyHistogram latency;
+        size_t matched_words = 0;
+        for (const string& query : corpus.queries) {
+            const int document_id = document_distribution(generator);
+            const auto start = Clock::now();
+            matched_words += get<0>(search_server.MatchDocument(query, document_id)).size();
+            latency.Record(GetNanoseconds(Clock::now() - start));
+        }
+        BenchmarkRecord(out, scale, "match_document"sv).AddLatency(latency).Add("matched_words"sv, matched_words);
+    }
+
+    {
+        // every tenth document goes, spread over the whole id range
+        LatencyHistogram latency;
+        for (int document_id = 0; document_id < scale.document_count; document_id += 10) {
+            const auto start = Clock::now();
+            search_server.RemoveDocument(document_id);
+            latency.Record(GetNanoseconds(Clock::now() - start));
+        }
+        BenchmarkRecord(out, scale, "remove_document"sv).AddLatency(latency);
+    }
+
+    {
+        // duplicates of every tenth remaining document
+        const int duplicate_base = scale.document_count;
+        int duplicate_count = 0;
+        for (int document_id = 1; document_id < scale.document_count; document_id += 10) {
+            search_server.AddDocument(duplicate_base + document_id, corpus.documents[document_id], DocumentStatus::ACTUAL, { 1 });
+            ++duplicate_count;
+        }
+        // RemoveDuplicates reports every removed id to cout, that would pollute the output
+        ostringstream discarded;
+        auto* const cout_buffer = cout.rdbuf(discarded.rdbuf());
+        const auto start = Clock::now();
+        RemoveDuplicates(search_server);
+        const uint64_t duration = GetNanoseconds(Clock::now() - start);
+        cout.rdbuf(cout_buffer);
+        BenchmarkRecord(out, scale, "remove_duplicates"sv).Add("duration_ns"sv, duration)
+            .Add("duplicates"sv, duplicate_count).Add("documents_after"sv, search_server.GetDocumentCount());
+    }
+
+    BenchmarkStopWords(corpus, scale, out);
+    BenchmarkTextAnalysis(corpus, scale, out);
+    BenchmarkFileIngestion(corpus, scale, out);
+    BenchmarkWriteAheadLog(corpus, scale, out);
+}
+
+void ProjectSearchServerMemory(const BenchmarkScale& scale, size_t document_count, ostream& out) {
+    const SearchServer search_server = BuildBenchmarkSearchServer(scale);
+    const MemoryStats memory = search_server.GetMemoryStats();
+    out << "Measured:"sv << '\n';
+    PrintMemoryStats(out, memory);
+    out << "Projected:"sv << '\n';
+    PrintMemoryStats(out, ProjectMemory(memory, document_count));
+}
+
+SearchServer BuildBenchmarkSearchServer(const BenchmarkScale& scale) {
+    const Corpus corpus = GenerateCorpus(scale);
+    SearchServer search_server(corpus.stop_words);
+    for (int i = 0; i < scale.document_count; ++i) {
+        search_server.AddDocument(i, corpus.documents[i], DocumentStatus::ACTUAL, { i % 10 });
+    }
+    return search_server;
+}
+
+void BenchmarkSearchDaemon(const BenchmarkScale& scale, const string& socket_path, const LoadOptions& options,
+    ostream& out) {
+    const Corpus corpus = GenerateCorpus(scale);
+    const LoadReport report = RunLoad(socket_path, corpus.queries, options);
+    BenchmarkRecord(out, scale, "daemon_load"sv).Add("connections"sv, options.connections)
+        .Add("pipeline_depth"sv, options.pipeline_depth).Add("duration_ns"sv, report.duration.count())
+        .Add("requests_per_second"sv, report.GetThroughput()).Add("invalid_queries"sv, report.invalid_queries)
+        .AddLatency(report.latencies);
+}
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <string>
+#include <vector>
+
+class SearchServer;
+struct LoadOptions;
+
+struct BenchmarkScale {
+    std::string name;
+    int document_count = 0;
+    int vocabulary_size = 0;
+    int query_count = 0;
+    // words and query lengths are drawn with probability proportional to 1 / rank^zipf_exponent
+    double zipf_exponent = 1.0;
+    uint32_t seed = 42;
+};
+
+// small (10K documents), medium (100K) and large (1M)
+std::vector<BenchmarkScale> GetDefaultBenchmarkScales();
+
+// Indexing throughput, query latency percentiles (seq, par and ALL_WORDS), batch ProcessQueries throughput,
+// MatchDocument, RemoveDocument and RemoveDuplicates timings, resident memory of the index, stop word
+// lookup, the throughput of LoadDocuments from a TSV file and of indexing through a WriteAheadLog at
+// every durability level.
+// Every measurement is written to out as one JSON object per line.
+void BenchmarkSearchServer(const BenchmarkScale& scale, std::ostream& out = std::cout);
+
+// Indexes the corpus of scale and prints its memory by component together with
+// the projection to document_count documents
+void ProjectSearchServerMemory(const BenchmarkScale& scale, size_t document_count, std::ostream& out = std::cout);
+
+// The corpus of scale indexed the way BenchmarkSearchServer indexes it, to be served by a SearchDaemon
+SearchServer BuildBenchmarkSearchServer(const BenchmarkScale& scale);
+
+// Sends the queries of scale to a SearchDaemon serving BuildBenchmarkSearchServer(scale) and prints
+// the throughput and the latency percentiles seen by the clients as one JSON line
+void BenchmarkSearchDaemon(const BenchmarkScale& scale, const std::string& socket_path, const LoadOptions& options,
+    std::ostream& out = std::cout);
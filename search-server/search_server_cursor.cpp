@@ -0,0 +1,220 @@
+#include "search_server.h"
+#include <charconv>
+#include <cstring>
+#include <limits>
+#include <sstream>
+
+using namespace std;
+
+namespace {
+
+const int CURSOR_TOKEN_VERSION = 1;
+
+// FNV-1a, stable between runs unlike std::hash, so tokens survive restarts
+uint64_t ComputeQueryFingerprint(const string_view raw_query) {
+    uint64_t hash = 14695981039346656037ULL;
+    for (const char c : raw_query) {
+        hash ^= static_cast<unsigned char>(c);
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+// strict version of the result order, equal relevance and rating are ordered by id
+bool IsStrictlyRankedBefore(const Document& lhs, const Document& rhs) {
+    if (lhs.relevance != rhs.relevance) {
+        return lhs.relevance > rhs.relevance;
+    }
+    if (lhs.rating != rhs.rating) {
+        return lhs.rating > rhs.rating;
+    }
+    return lhs.id < rhs.id;
+}
+
+// the whole field must be the number, without spaces or trailing characters
+template <typename Number>
+Number ParseTokenField(const string_view field, int base = 10) {
+    Number value{};
+    const char* const end = field.data() + field.size();
+    const auto [parsed_end, error] = from_chars(field.data(), end, value, base);
+    if (field.empty() || error != errc() || parsed_end != end) {
+        throw invalid_argument("Некорректный токен продолжения"s);
+    }
+    return value;
+}
+
+}
+
+SearchServer::Cursor SearchServer::OpenCursor(const string_view raw_query, CursorOrder order, DocumentStatus status) const {
+    return Cursor(*this, raw_query, order, status);
+}
+
+SearchServer::Cursor SearchServer::ResumeCursor(const string_view raw_query, const string_view token) const {
+    vector<string_view> fields;
+    for (size_t begin = 0;;) {
+        const size_t end = token.find('.', begin);
+        fields.push_back(token.substr(begin, end == string_view::npos ? string_view::npos : end - begin));
+        if (end == string_view::npos) {
+            break;
+        }
+        begin = end + 1;
+    }
+    if (fields.size() != 8 || ParseTokenField<int>(fields[0]) != CURSOR_TOKEN_VERSION) {
+        throw invalid_argument("Некорректный токен продолжения"s);
+    }
+    const int order = ParseTokenField<int>(fields[1]);
+    const int status = ParseTokenField<int>(fields[2]);
+    const int exhausted = ParseTokenField<int>(fields[7]);
+    if (order < 0 || order > static_cast<int>(CursorOrder::RELEVANCE)
+        || status < 0 || status > static_cast<int>(DocumentStatus::REMOVED)
+        || exhausted < 0 || exhausted > 1) {
+        throw invalid_argument("Некорректный токен продолжения"s);
+    }
+    if (ParseTokenField<uint64_t>(fields[3], 16) != ComputeQueryFingerprint(raw_query)) {
+        throw invalid_argument("Токен продолжения выдан для другого запроса"s);
+    }
+    Cursor cursor(*this, raw_query, static_cast<CursorOrder>(order), static_cast<DocumentStatus>(status));
+    const uint64_t relevance_bits = ParseTokenField<uint64_t>(fields[4], 16);
+    memcpy(&cursor.last_.relevance, &relevance_bits, sizeof(relevance_bits));
+    cursor.last_.id = ParseTokenField<int>(fields[5]);
+    cursor.last_.rating = ParseTokenField<int>(fields[6]);
+    cursor.exhausted_ = exhausted == 1;
+    return cursor;
+}
+
+SearchServer::Cursor::Cursor(const SearchServer& server, const string_view raw_query, CursorOrder order,
+    DocumentStatus status)
+    : server_(&server)
+    , text_(make_shared<const string>(raw_query))
+    , query_(server.ParseQuery(*text_))
+    , order_(order)
+    , status_(status)
+    , fingerprint_(ComputeQueryFingerprint(raw_query)) {
+    const RankingStats stats = server.GetRankingStats();
+    const TfIdfRanking ranking;
+    const auto add_term = [this, &server, &stats, &ranking](string_view word, double penalty) {
+        const auto term_id = server.dictionary_.FindWord(word);
+        if (term_id && !server.term_to_document_freqs_[*term_id].empty()) {
+            terms_.push_back({ *term_id, ranking.TermWeight(stats, server.GetDocumentFreq(*term_id)) * penalty });
+        }
+    };
+    for (const string_view word : query_.plus_words) {
+        add_term(word, 1.0);
+    }
+    for (const auto& [word, distance] : query_.fuzzy_words) {
+        add_term(word, pow(FUZZY_DISTANCE_PENALTY, distance));
+    }
+    for (const string_view word : query_.minus_words) {
+        if (const auto term_id = server.dictionary_.FindWord(word)) {
+            minus_terms_.push_back(*term_id);
+        }
+    }
+}
+
+template <typename Consumer>
+optional<int> SearchServer::Cursor::ScanFrom(int first_id, size_t max_postings, Consumer consume) const {
+    const auto& postings = server_->term_to_document_freqs_;
+    struct TermPosition {
+        Postings::const_iterator it;
+        Postings::const_iterator end;
+        double weight;
+    };
+    // positions are looked up again on every call, so changes between blocks are safe
+    vector<TermPosition> positions;
+    positions.reserve(terms_.size());
+    for (const auto& [term_id, weight] : terms_) {
+        positions.push_back({ postings[term_id].lower_bound(first_id), postings[term_id].end(), weight });
+    }
+
+    size_t postings_read = 0;
+    while (true) {
+        // at least one document is read, so a block always moves on
+        if (postings_read > 0 && postings_read >= max_postings) {
+            return first_id - 1;
+        }
+        int document_id = numeric_limits<int>::max();
+        for (const TermPosition& position : positions) {
+            if (position.it != position.end) {
+                document_id = min(document_id, position.it->first);
+            }
+        }
+        if (document_id == numeric_limits<int>::max()) {
+            return nullopt;
+        }
+        first_id = document_id + 1;
+        double relevance = 0.0;
+        for (TermPosition& position : positions) {
+            if (position.it != position.end && position.it->first == document_id) {
+                relevance += position.it->second * position.weight;
+                ++position.it;
+                ++postings_read;
+            }
+        }
+
+        const DocumentData& document_data = server_->documents_.at(document_id);
+        if (document_data.status != status_) {
+            continue;
+        }
+        const bool has_minus_word = any_of(minus_terms_.begin(), minus_terms_.end(), [&postings, document_id](int term_id) {
+            return postings[term_id].count(document_id) > 0;
+            });
+        if (has_minus_word) {
+            continue;
+        }
+        if (!query_.phrases.empty() && !server_->ContainsPhrases(document_id, document_data, query_.phrases)) {
+            continue;
+        }
+        if (!consume(Document{ document_id, relevance, document_data.rating })) {
+            return document_id;
+        }
+    }
+}
+
+vector<Document> SearchServer::Cursor::Next(size_t max_count) {
+    return Next(max_count, numeric_limits<size_t>::max());
+}
+
+vector<Document> SearchServer::Cursor::Next(size_t max_count, size_t max_postings) {
+    vector<Document> documents;
+    if (exhausted_ || max_count == 0) {
+        return documents;
+    }
+    if (order_ == CursorOrder::DOCUMENT_ID) {
+        const optional<int> last_read = ScanFrom(max(last_.id, last_read_id_) + 1, max_postings,
+            [&documents, max_count](const Document& document) {
+                documents.push_back(document);
+                return documents.size() < max_count;
+            });
+        exhausted_ = !last_read;
+        if (last_read) {
+            last_read_id_ = *last_read;
+        }
+    }
+    else {
+        // the best max_count documents ranked after the last returned one
+        BoundedHeap<Document, bool (*)(const Document&, const Document&)> block(max_count, IsStrictlyRankedBefore);
+        const bool started = last_.id >= 0;
+        ScanFrom(0, numeric_limits<size_t>::max(), [this, &block, started](const Document& document) {
+            if (!started || IsStrictlyRankedBefore(last_, document)) {
+                block.Push(document);
+            }
+            return true;
+            });
+        documents = move(block).TakeSorted();
+        exhausted_ = documents.size() < max_count;
+    }
+    if (!documents.empty()) {
+        last_ = documents.back();
+    }
+    return documents;
+}
+
+string SearchServer::Cursor::GetContinuationToken() const {
+    uint64_t relevance_bits = 0;
+    memcpy(&relevance_bits, &last_.relevance, sizeof(relevance_bits));
+    ostringstream token;
+    token << CURSOR_TOKEN_VERSION << '.' << static_cast<int>(order_) << '.' << static_cast<int>(status_) << '.'
+        << hex << fingerprint_ << '.' << relevance_bits << dec << '.' << last_.id << '.' << last_.rating << '.'
+        << (exhausted_ ? 1 : 0);
+    return token.str();
+}
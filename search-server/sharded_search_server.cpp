@@ -0,0 +1,160 @@
+#include "sharded_search_server.h"
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+LocalSearchShard::LocalSearchShard(SearchServer server)
+    : server_(move(server))
+    , worker_([this] { Work(); }) {
+}
+
+LocalSearchShard::~LocalSearchShard() {
+    {
+        lock_guard guard(mutex_);
+        stopping_ = true;
+    }
+    task_added_.notify_one();
+    worker_.join();
+}
+
+template <typename Task>
+auto LocalSearchShard::Submit(Task task) -> future<decltype(task(server_))> {
+    // packaged_task is move-only and std::function needs a copyable target
+    auto packaged = make_shared<packaged_task<decltype(task(server_))()>>([this, task = move(task)]() mutable {
+        return task(server_);
+        });
+    auto result = packaged->get_future();
+    {
+        lock_guard guard(mutex_);
+        tasks_.push_back([packaged] { (*packaged)(); });
+    }
+    task_added_.notify_one();
+    return result;
+}
+
+void LocalSearchShard::Work() {
+    while (true) {
+        function<void()> task;
+        {
+            unique_lock lock(mutex_);
+            task_added_.wait(lock, [this] { return stopping_ || !tasks_.empty(); });
+            if (tasks_.empty()) {
+                return;
+            }
+            task = move(tasks_.front());
+            tasks_.pop_front();
+        }
+        task();
+    }
+}
+
+future<void> LocalSearchShard::AddDocument(int document_id, string_view document, DocumentStatus status,
+    const vector<int>& ratings) {
+    return Submit([document_id, document = string(document), status, ratings](SearchServer& server) {
+        server.AddDocument(document_id, document, status, ratings);
+        });
+}
+
+future<void> LocalSearchShard::RemoveDocument(int document_id) {
+    return Submit([document_id](SearchServer& server) {
+        server.RemoveDocument(document_id);
+        });
+}
+
+future<int> LocalSearchShard::GetDocumentCount() {
+    return Submit([](SearchServer& server) {
+        return server.GetDocumentCount();
+        });
+}
+
+future<CorpusStatistics> LocalSearchShard::GetCorpusStatistics(string_view raw_query) {
+    return Submit([raw_query = string(raw_query)](SearchServer& server) {
+        return server.GetCorpusStatistics(raw_query);
+        });
+}
+
+future<vector<Document>> LocalSearchShard::FindTopDocuments(string_view raw_query, DocumentStatus status,
+    const CorpusStatistics& corpus) {
+    return Submit([raw_query = string(raw_query), status, corpus](SearchServer& server) {
+        return server.FindTopDocuments(raw_query, status, corpus);
+        });
+}
+
+ShardedSearchServer::ShardedSearchServer(const string& stop_words_text, size_t shard_count) {
+    if (shard_count == 0) {
+        throw invalid_argument("Нужен хотя бы один шард"s);
+    }
+    for (size_t i = 0; i < shard_count; ++i) {
+        shards_.push_back(make_unique<LocalSearchShard>(SearchServer(stop_words_text)));
+    }
+}
+
+ShardedSearchServer::ShardedSearchServer(vector<unique_ptr<SearchShard>> shards)
+    : shards_(move(shards)) {
+    if (shards_.empty()) {
+        throw invalid_argument("Нужен хотя бы один шард"s);
+    }
+}
+
+void ShardedSearchServer::AddDocument(int document_id, string_view document, DocumentStatus status,
+    const vector<int>& ratings) {
+    if (document_id < 0) {
+        throw invalid_argument("номер документа отрицательный"s);
+    }
+    shards_[GetShardIndex(document_id)]->AddDocument(document_id, document, status, ratings).get();
+}
+
+void ShardedSearchServer::RemoveDocument(int document_id) {
+    if (document_id >= 0) {
+        shards_[GetShardIndex(document_id)]->RemoveDocument(document_id).get();
+    }
+}
+
+vector<Document> ShardedSearchServer::FindTopDocuments(string_view raw_query, DocumentStatus status) const {
+    // both phases are sent to all the shards before waiting for any of them
+    vector<future<CorpusStatistics>> statistics;
+    for (const auto& shard : shards_) {
+        statistics.push_back(shard->GetCorpusStatistics(raw_query));
+    }
+    CorpusStatistics corpus;
+    for (auto& shard_statistics : statistics) {
+        corpus += shard_statistics.get();
+    }
+
+    vector<future<vector<Document>>> replies;
+    for (const auto& shard : shards_) {
+        replies.push_back(shard->FindTopDocuments(raw_query, status, corpus));
+    }
+    vector<Document> documents;
+    for (auto& reply : replies) {
+        for (const Document& document : reply.get()) {
+            documents.push_back(document);
+        }
+    }
+    sort(documents.begin(), documents.end(), SearchServer::IsRankedBefore);
+    if (documents.size() > MAX_RESULT_DOCUMENT_COUNT) {
+        documents.resize(MAX_RESULT_DOCUMENT_COUNT);
+    }
+    return documents;
+}
+
+int ShardedSearchServer::GetDocumentCount() const {
+    vector<future<int>> counts;
+    for (const auto& shard : shards_) {
+        counts.push_back(shard->GetDocumentCount());
+    }
+    int document_count = 0;
+    for (auto& count : counts) {
+        document_count += count.get();
+    }
+    return document_count;
+}
+
+size_t ShardedSearchServer::GetShardCount() const {
+    return shards_.size();
+}
+
+size_t ShardedSearchServer::GetShardIndex(int document_id) const {
+    return static_cast<size_t>(document_id) % shards_.size();
+}
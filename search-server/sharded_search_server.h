@@ -0,0 +1,105 @@
+#pragma once
+
+#include "corpus_statistics.h"
+#include "document.h"
+#include "search_server.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+// A part of the documents of a ShardedSearchServer. Requests and replies are plain values and
+// every call returns a future, so a shard may live in another thread, process or machine.
+// Errors of a request are delivered as exceptions from the future.
+class SearchShard {
+public:
+    virtual ~SearchShard() = default;
+
+    virtual std::future<void> AddDocument(int document_id, std::string_view document, DocumentStatus status,
+        const std::vector<int>& ratings) = 0;
+
+    virtual std::future<void> RemoveDocument(int document_id) = 0;
+
+    virtual std::future<int> GetDocumentCount() = 0;
+
+    // first phase of a search, see SearchServer::GetCorpusStatistics
+    virtual std::future<CorpusStatistics> GetCorpusStatistics(std::string_view raw_query) = 0;
+
+    // second phase of a search with the statistics summed over all the shards
+    virtual std::future<std::vector<Document>> FindTopDocuments(std::string_view raw_query, DocumentStatus status,
+        const CorpusStatistics& corpus) = 0;
+};
+
+// A SearchServer served by its own thread, requests are executed one by one in arrival order
+class LocalSearchShard : public SearchShard {
+public:
+    explicit LocalSearchShard(SearchServer server);
+
+    LocalSearchShard(const LocalSearchShard&) = delete;
+    LocalSearchShard& operator=(const LocalSearchShard&) = delete;
+
+    // finishes the queued requests
+    ~LocalSearchShard() override;
+
+    std::future<void> AddDocument(int document_id, std::string_view document, DocumentStatus status,
+        const std::vector<int>& ratings) override;
+
+    std::future<void> RemoveDocument(int document_id) override;
+
+    std::future<int> GetDocumentCount() override;
+
+    std::future<CorpusStatistics> GetCorpusStatistics(std::string_view raw_query) override;
+
+    std::future<std::vector<Document>> FindTopDocuments(std::string_view raw_query, DocumentStatus status,
+        const CorpusStatistics& corpus) override;
+
+private:
+    SearchServer server_;
+    std::mutex mutex_;
+    std::condition_variable task_added_;
+    std::deque<std::function<void()>> tasks_;
+    bool stopping_ = false;
+    // started last, after everything it uses
+    std::thread worker_;
+
+    // runs task(server_) on the worker thread
+    template <typename Task>
+    auto Submit(Task task) -> std::future<decltype(task(server_))>;
+
+    void Work();
+};
+
+// Documents are partitioned by id between the shards. A search collects the word statistics
+// of every shard first, so every shard ranks with the IDF of the whole corpus. The "word*" and
+// "word~" expansions of the shards are merged too, every shard then matches the words the
+// whole corpus expands to, and the merged result is the one of a single SearchServer with all
+// the documents.
+class ShardedSearchServer {
+public:
+    // shard_count LocalSearchShard with the same stop words
+    ShardedSearchServer(const std::string& stop_words_text, size_t shard_count);
+
+    explicit ShardedSearchServer(std::vector<std::unique_ptr<SearchShard>> shards);
+
+    void AddDocument(int document_id, std::string_view document, DocumentStatus status, const std::vector<int>& ratings);
+
+    void RemoveDocument(int document_id);
+
+    std::vector<Document> FindTopDocuments(std::string_view raw_query, DocumentStatus status = DocumentStatus::ACTUAL) const;
+
+    int GetDocumentCount() const;
+
+    size_t GetShardCount() const;
+
+    // the shard owning the document
+    size_t GetShardIndex(int document_id) const;
+
+private:
+    std::vector<std::unique_ptr<SearchShard>> shards_;
+};
@@ -0,0 +1,35 @@
+#include "statistics_snapshot.h"
+
+using namespace std;
+
+StatisticsSnapshot::StatisticsSnapshot(double max_drift, shared_ptr<MemoryCounter> counter)
+    : max_drift_(max_drift)
+    , document_freqs_(MakeCounted<CountedVector<int>>(counter))
+    , changed_terms_(MakeCounted<CountedVector<int>>(counter))
+    , is_changed_(MakeCounted<CountedVector<bool>>(counter)) {
+}
+
+StatisticsSnapshot::StatisticsSnapshot(const StatisticsSnapshot& other, const shared_ptr<MemoryCounter>& counter)
+    : max_drift_(other.max_drift_)
+    , generation_(other.generation_)
+    , document_count_(other.document_count_)
+    , total_document_length_(other.total_document_length_)
+    , document_freqs_(other.document_freqs_, CountingAllocator<int>(counter))
+    , changed_terms_(other.changed_terms_, CountingAllocator<int>(counter))
+    , is_changed_(other.is_changed_, CountingAllocator<bool>(counter))
+    , changed_document_count_(other.changed_document_count_) {
+}
+
+void StatisticsSnapshot::MarkChanged(int term_id) {
+    if (static_cast<size_t>(term_id) >= is_changed_.size()) {
+        is_changed_.resize(term_id + 1, false);
+    }
+    if (!is_changed_[term_id]) {
+        is_changed_[term_id] = true;
+        changed_terms_.push_back(term_id);
+    }
+}
+
+RankingStats StatisticsSnapshot::GetRankingStats() const {
+    return { document_count_, document_count_ > 0 ? static_cast<double>(total_document_length_) / document_count_ : 0.0 };
+}
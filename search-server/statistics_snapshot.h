@@ -0,0 +1,76 @@
+#pragma once
+
+#include "memory_stats.h"
+#include "ranking.h"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+
+// Document count, total length and document frequencies of an index frozen at the last
+// refresh. The index reports every change as it happens, Refresh rereads only the words
+// changed since the previous refresh.
+class StatisticsSnapshot {
+public:
+    // the tables report their heap memory to counter
+    StatisticsSnapshot(double max_drift, std::shared_ptr<MemoryCounter> counter);
+
+    // copy of other reporting to counter instead of other's counter
+    StatisticsSnapshot(const StatisticsSnapshot& other, const std::shared_ptr<MemoryCounter>& counter);
+
+    // called for every word of an added or removed document
+    void MarkChanged(int term_id);
+
+    // called once for every added or removed document
+    void CountDocumentChange() {
+        ++changed_document_count_;
+    }
+
+    // more documents changed since the refresh than max_drift of the snapshot's count
+    bool NeedsRefresh() const {
+        return changed_document_count_ > max_drift_ * std::max(document_count_, 1);
+    }
+
+    // live_document_freq(term_id) is the current document frequency of a changed word
+    template <typename DocumentFreq>
+    void Refresh(int document_count, long long total_document_length, DocumentFreq live_document_freq);
+
+    RankingStats GetRankingStats() const;
+
+    // document frequency at the last refresh, 0 for words without documents then
+    int GetDocumentFreq(int term_id) const {
+        return static_cast<size_t>(term_id) < document_freqs_.size() ? document_freqs_[term_id] : 0;
+    }
+
+    // number of refreshes, scores of one generation are comparable with each other
+    uint64_t GetGeneration() const {
+        return generation_;
+    }
+
+private:
+    double max_drift_;
+    uint64_t generation_ = 0;
+    int document_count_ = 0;
+    long long total_document_length_ = 0;
+    CountedVector<int> document_freqs_;
+    CountedVector<int> changed_terms_;
+    // indexed by term id, keeps changed_terms_ free of duplicates
+    CountedVector<bool> is_changed_;
+    int changed_document_count_ = 0;
+};
+
+template <typename DocumentFreq>
+void StatisticsSnapshot::Refresh(int document_count, long long total_document_length, DocumentFreq live_document_freq) {
+    for (const int term_id : changed_terms_) {
+        if (static_cast<size_t>(term_id) >= document_freqs_.size()) {
+            document_freqs_.resize(term_id + 1, 0);
+        }
+        document_freqs_[term_id] = live_document_freq(term_id);
+        is_changed_[term_id] = false;
+    }
+    changed_terms_.clear();
+    document_count_ = document_count;
+    total_document_length_ = total_document_length;
+    changed_document_count_ = 0;
+    ++generation_;
+}
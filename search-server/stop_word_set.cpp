@@ -0,0 +1,145 @@
+#include "stop_word_set.h"
+#include <algorithm>
+#include <numeric>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+const size_t WORDS_PER_BUCKET = 4;
+const uint32_t MAX_DISPLACEMENT = 1 << 16;
+const uint64_t MAX_SEED_ATTEMPTS = 8;
+// the table grows until every bucket finds a displacement, distinct words do long before
+const size_t MAX_SLOTS_PER_WORD = 64;
+
+size_t RoundUpToPowerOfTwo(size_t value) {
+    size_t result = 1;
+    while (result < value) {
+        result <<= 1;
+    }
+    return result;
+}
+
+}
+
+StopWordSet::StopWordSet(const shared_ptr<MemoryCounter>& counter)
+    : chars_(MakeCounted<CountedString>(counter))
+    , offsets_(MakeCounted<CountedVector<uint32_t>>(counter))
+    , displacements_(MakeCounted<CountedVector<uint32_t>>(counter))
+    , slots_(MakeCounted<CountedVector<int32_t>>(counter)) {
+}
+
+StopWordSet::StopWordSet(const StopWordSet& other, const shared_ptr<MemoryCounter>& counter)
+    : chars_(other.chars_, CountingAllocator<char>(counter))
+    , offsets_(other.offsets_, CountingAllocator<uint32_t>(counter))
+    , displacements_(other.displacements_, CountingAllocator<uint32_t>(counter))
+    , slots_(other.slots_, CountingAllocator<int32_t>(counter))
+    , seed_(other.seed_)
+    , bucket_mask_(other.bucket_mask_)
+    , slot_mask_(other.slot_mask_)
+    , length_mask_(other.length_mask_)
+    , first_bytes_(other.first_bytes_) {
+}
+
+void StopWordSet::Assign(const vector<string_view>& words) {
+    if (any_of(words.begin(), words.end(), [](string_view word) {
+        return word.empty();
+        })) {
+        throw invalid_argument("Пустое стоп-слово"s);
+    }
+    vector<string_view> sorted_words = words;
+    sort(sorted_words.begin(), sorted_words.end());
+    if (adjacent_find(sorted_words.begin(), sorted_words.end()) != sorted_words.end()) {
+        throw invalid_argument("Стоп-слова повторяются"s);
+    }
+
+    // built aside with the same counter and moved in, so a throw leaves the words as they were
+    StopWordSet compiled;
+    compiled.chars_ = CountedString(chars_.get_allocator());
+    compiled.offsets_ = CountedVector<uint32_t>(offsets_.get_allocator());
+    compiled.displacements_ = CountedVector<uint32_t>(displacements_.get_allocator());
+    compiled.slots_ = CountedVector<int32_t>(slots_.get_allocator());
+    if (words.empty()) {
+        *this = move(compiled);
+        return;
+    }
+    compiled.offsets_.push_back(0);
+    for (const string_view word : words) {
+        compiled.chars_.append(word.data(), word.size());
+        compiled.offsets_.push_back(static_cast<uint32_t>(compiled.chars_.size()));
+        compiled.length_mask_ |= GetLengthBit(word.size());
+        const auto first_byte = static_cast<unsigned char>(word[0]);
+        compiled.first_bytes_[first_byte / 64] |= uint64_t{ 1 } << (first_byte % 64);
+    }
+
+    const size_t bucket_count = RoundUpToPowerOfTwo((words.size() + WORDS_PER_BUCKET - 1) / WORDS_PER_BUCKET);
+    for (size_t slot_count = RoundUpToPowerOfTwo(words.size() + words.size() / 4);
+        slot_count <= words.size() * MAX_SLOTS_PER_WORD; slot_count *= 2) {
+        for (compiled.seed_ = 0; compiled.seed_ < MAX_SEED_ATTEMPTS; ++compiled.seed_) {
+            if (compiled.TryPlace(words, bucket_count, slot_count)) {
+                *this = move(compiled);
+                return;
+            }
+        }
+    }
+    throw runtime_error("Не удалось построить таблицу стоп-слов"s);
+}
+
+vector<string> StopWordSet::GetWords() const {
+    vector<string> words;
+    words.reserve(size());
+    for (size_t i = 0; i < size(); ++i) {
+        words.emplace_back(GetWord(static_cast<int32_t>(i)));
+    }
+    return words;
+}
+
+bool StopWordSet::TryPlace(const vector<string_view>& words, size_t bucket_count, size_t slot_count) {
+    vector<uint64_t> hashes(words.size());
+    vector<vector<int32_t>> buckets(bucket_count);
+    for (size_t i = 0; i < words.size(); ++i) {
+        hashes[i] = HashWord(words[i], seed_);
+        buckets[GetBucket(hashes[i]) & (bucket_count - 1)].push_back(static_cast<int32_t>(i));
+    }
+    // the largest buckets are placed first, while most slots are free
+    vector<size_t> order(bucket_count);
+    iota(order.begin(), order.end(), 0);
+    stable_sort(order.begin(), order.end(), [&buckets](size_t lhs, size_t rhs) {
+        return buckets[lhs].size() > buckets[rhs].size();
+        });
+
+    displacements_.assign(bucket_count, 0);
+    slots_.assign(slot_count, -1);
+    vector<size_t> bucket_slots;
+    for (const size_t bucket : order) {
+        if (buckets[bucket].empty()) {
+            break;
+        }
+        bool is_placed = false;
+        for (uint32_t displacement = 0; displacement < MAX_DISPLACEMENT && !is_placed; ++displacement) {
+            bucket_slots.clear();
+            is_placed = true;
+            for (const int32_t index : buckets[bucket]) {
+                const size_t slot = GetSlot(hashes[index], displacement) & (slot_count - 1);
+                if (slots_[slot] >= 0 || find(bucket_slots.begin(), bucket_slots.end(), slot) != bucket_slots.end()) {
+                    is_placed = false;
+                    break;
+                }
+                bucket_slots.push_back(slot);
+            }
+            if (is_placed) {
+                displacements_[bucket] = displacement;
+                for (size_t i = 0; i < bucket_slots.size(); ++i) {
+                    slots_[bucket_slots[i]] = buckets[bucket][i];
+                }
+            }
+        }
+        if (!is_placed) {
+            return false;
+        }
+    }
+    bucket_mask_ = bucket_count - 1;
+    slot_mask_ = slot_count - 1;
+    return true;
+}
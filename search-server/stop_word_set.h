@@ -0,0 +1,95 @@
+#pragma once
+
+#include "memory_stats.h"
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <vector>
+
+// Stop words compiled into a perfect hash: every word has its own slot, found with one hash
+// of the word and one displacement per bucket, so a lookup compares at most one word. Most
+// words that are not stop words are rejected by their length and first byte before hashing.
+class StopWordSet {
+public:
+    StopWordSet() = default;
+
+    // the words and the tables report their heap memory to counter
+    explicit StopWordSet(const std::shared_ptr<MemoryCounter>& counter);
+
+    // copy of other reporting to counter instead of other's counter
+    StopWordSet(const StopWordSet& other, const std::shared_ptr<MemoryCounter>& counter);
+
+    // replaces the words, they must be distinct and not empty, otherwise throws
+    // invalid_argument and keeps the old ones
+    void Assign(const std::vector<std::string_view>& words);
+
+    bool Contains(std::string_view word) const {
+        if (word.empty() || (length_mask_ & GetLengthBit(word.size())) == 0) {
+            return false;
+        }
+        const auto first_byte = static_cast<unsigned char>(word[0]);
+        if ((first_bytes_[first_byte / 64] & (uint64_t{ 1 } << (first_byte % 64))) == 0) {
+            return false;
+        }
+        const uint64_t hash = HashWord(word, seed_);
+        const uint32_t displacement = displacements_[GetBucket(hash) & bucket_mask_];
+        const int32_t index = slots_[GetSlot(hash, displacement) & slot_mask_];
+        return index >= 0 && GetWord(index) == word;
+    }
+
+    size_t size() const {
+        return offsets_.empty() ? 0 : offsets_.size() - 1;
+    }
+
+    // in the order they were assigned
+    std::vector<std::string> GetWords() const;
+
+    // FNV-1a started from seed
+    static uint64_t HashWord(std::string_view word, uint64_t seed) {
+        uint64_t hash = 0xCBF29CE484222325ull ^ seed;
+        for (const char c : word) {
+            hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001B3ull;
+        }
+        return hash;
+    }
+
+private:
+    // words packed one after another, word i is chars_[offsets_[i], offsets_[i + 1])
+    CountedString chars_;
+    CountedVector<uint32_t> offsets_;
+    // displacement of every bucket, chosen so that the words of the bucket land in free slots
+    CountedVector<uint32_t> displacements_;
+    // word index of every slot, -1 for a free one
+    CountedVector<int32_t> slots_;
+    uint64_t seed_ = 0;
+    size_t bucket_mask_ = 0;
+    size_t slot_mask_ = 0;
+    // bit min(length, 63) is set for every word length
+    uint64_t length_mask_ = 0;
+    std::array<uint64_t, 4> first_bytes_{};
+
+    static uint64_t GetLengthBit(size_t length) {
+        return uint64_t{ 1 } << (length < 63 ? length : 63);
+    }
+
+    static size_t GetBucket(uint64_t hash) {
+        return static_cast<size_t>(hash >> 32);
+    }
+
+    static size_t GetSlot(uint64_t hash, uint32_t displacement) {
+        uint64_t value = hash + displacement * 0x9E3779B97F4A7C15ull;
+        value ^= value >> 32;
+        value *= 0xD6E8FEB86659FD93ull;
+        return static_cast<size_t>(value ^ (value >> 32));
+    }
+
+    std::string_view GetWord(int32_t index) const {
+        return std::string_view(chars_).substr(offsets_[index], offsets_[index + 1] - offsets_[index]);
+    }
+
+    // false when some bucket found no displacement
+    bool TryPlace(const std::vector<std::string_view>& words, size_t bucket_count, size_t slot_count);
+};
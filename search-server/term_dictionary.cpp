@@ -0,0 +1,303 @@
+#include "term_dictionary.h"
+#include "levenshtein_automaton.h"
+#include <algorithm>
+#include <iterator>
+#include <limits>
+
+using namespace std;
+
+namespace {
+
+// the trie is rebuilt on a fuzzy search once more words than this have been added since it was built
+const size_t MIN_UNSORTED_WORD_LIMIT = 1024;
+// or more than this share of the words in the trie, so rebuilding costs O(1) per added word
+const size_t UNSORTED_WORD_LIMIT_DIVISOR = 64;
+
+}
+
+TermDictionary::TermDictionary(shared_ptr<MemoryCounter> counter)
+    : word_to_id_(MakeCounted<decltype(word_to_id_)>(counter))
+    , id_to_word_(MakeCounted<decltype(id_to_word_)>(counter)) {
+}
+
+TermDictionary::TermDictionary(const TermDictionary& other)
+    : word_to_id_(other.word_to_id_)
+    , id_to_word_(other.id_to_word_.size(), other.id_to_word_.get_allocator()) {
+    for (const auto& [word, term_id] : word_to_id_) {
+        id_to_word_[term_id] = word;
+    }
+    // the copy has the same term ids, so a trie other has already built serves it too
+    lock_guard guard(other.sorted_words_mutex_);
+    sorted_words_ = other.sorted_words_;
+}
+
+TermDictionary::TermDictionary(const TermDictionary& other, shared_ptr<MemoryCounter> counter)
+    : TermDictionary(move(counter)) {
+    // the keys are copied one by one, a map copy would keep their allocators
+    for (const auto& [word, term_id] : other.word_to_id_) {
+        word_to_id_.emplace_hint(word_to_id_.end(), CountedString(word, word_to_id_.get_allocator()), term_id);
+    }
+    id_to_word_.resize(word_to_id_.size());
+    for (const auto& [word, term_id] : word_to_id_) {
+        id_to_word_[term_id] = word;
+    }
+}
+
+TermDictionary::TermDictionary(TermDictionary&& other)
+    : word_to_id_(move(other.word_to_id_))
+    , id_to_word_(move(other.id_to_word_))
+    , sorted_words_(move(other.sorted_words_)) {
+}
+
+TermDictionary& TermDictionary::operator=(const TermDictionary& other) {
+    if (this != &other) {
+        TermDictionary copy(other);
+        *this = move(copy);
+    }
+    return *this;
+}
+
+TermDictionary& TermDictionary::operator=(TermDictionary&& other) {
+    // map nodes are moved along with their keys, so the views stay valid
+    word_to_id_ = move(other.word_to_id_);
+    id_to_word_ = move(other.id_to_word_);
+    sorted_words_ = move(other.sorted_words_);
+    return *this;
+}
+
+int TermDictionary::AddWord(const string_view word) {
+    auto it = word_to_id_.find(word);
+    if (it != word_to_id_.end()) {
+        return it->second;
+    }
+    const int term_id = static_cast<int>(id_to_word_.size());
+    it = word_to_id_.emplace(CountedString(word, word_to_id_.get_allocator()), term_id).first;
+    id_to_word_.push_back(it->first);
+    return term_id;
+}
+
+optional<int> TermDictionary::FindWord(const string_view word) const {
+    const auto it = word_to_id_.find(word);
+    if (it == word_to_id_.end()) {
+        return nullopt;
+    }
+    return it->second;
+}
+
+string_view TermDictionary::GetWord(int term_id) const {
+    return id_to_word_[term_id];
+}
+
+namespace {
+
+size_t GetWordLength(const TermDictionary::SortedWords& words, size_t index) {
+    return words.offsets[index + 1] - words.offsets[index];
+}
+
+unsigned char GetWordByte(const TermDictionary::SortedWords& words, size_t index, size_t depth) {
+    return static_cast<unsigned char>(words.chars[words.offsets[index] + depth]);
+}
+
+// Breadth-first, so the children of every node are appended next to each other
+void BuildTrie(TermDictionary::SortedWords& words) {
+    const size_t word_count = words.term_ids.size();
+    // the end of the word range and the depth of every node, needed only while building
+    vector<uint32_t> last_words = { static_cast<uint32_t>(word_count) };
+    vector<uint32_t> depths = { 0 };
+    words.nodes.push_back({ 0, 0, '\0' });
+    for (size_t node = 0; node < last_words.size(); ++node) {
+        words.nodes[node].first_child = static_cast<uint32_t>(words.nodes.size());
+        size_t first = words.nodes[node].first_word;
+        const size_t last = last_words[node];
+        const size_t depth = depths[node];
+        if (last - first < 2) {
+            continue;
+        }
+        // the word equal to the node prefix sorts first and belongs to the node itself
+        if (GetWordLength(words, first) == depth) {
+            ++first;
+        }
+        while (first < last) {
+            const unsigned char c = GetWordByte(words, first, depth);
+            size_t child_last = first + 1;
+            while (child_last < last && GetWordByte(words, child_last, depth) == c) {
+                ++child_last;
+            }
+            words.nodes.push_back({ 0, static_cast<uint32_t>(first), static_cast<char>(c) });
+            last_words.push_back(static_cast<uint32_t>(child_last));
+            depths.push_back(static_cast<uint32_t>(depth + 1));
+            first = child_last;
+        }
+    }
+    words.nodes.push_back({ static_cast<uint32_t>(words.nodes.size()), 0, '\0' });
+}
+
+// Depth-first walk of the trie that enters only the nodes the automaton can still accept from.
+// Words closer than min_distance and words accept rejects are skipped, the walk stops at the
+// limit-th match
+class FuzzyWalker {
+public:
+    FuzzyWalker(const TermDictionary::SortedWords& words, string_view word, int max_distance, int min_distance,
+        size_t limit, const function<bool(int)>* accept)
+        : words_(words)
+        , automaton_(word, max_distance)
+        , min_distance_(min_distance)
+        , limit_(limit)
+        , accept_(accept) {
+    }
+
+    // the matches in lexicographic order of the words
+    vector<pair<int, int>> Run() {
+        if (!words_.term_ids.empty() && limit_ > 0) {
+            Walk(0, 0, automaton_.Start());
+        }
+        return move(result_);
+    }
+
+    // distance to a word outside the trie, nullopt when it is too far
+    optional<int> Match(string_view word) {
+        State state = automaton_.Start();
+        for (const char c : word) {
+            state = automaton_.Step(state, c);
+            if (!automaton_.CanMatch(state)) {
+                return nullopt;
+            }
+        }
+        if (!automaton_.IsMatch(state) || automaton_.GetDistance(state) < min_distance_) {
+            return nullopt;
+        }
+        return automaton_.GetDistance(state);
+    }
+
+    bool IsAccepted(int term_id) const {
+        return !accept_ || (*accept_)(term_id);
+    }
+
+private:
+    using State = LevenshteinAutomaton::State;
+
+    const TermDictionary::SortedWords& words_;
+    LevenshteinAutomaton automaton_;
+    int min_distance_;
+    size_t limit_;
+    const function<bool(int)>* accept_;
+    vector<pair<int, int>> result_;
+
+    bool IsDone() const {
+        return result_.size() >= limit_;
+    }
+
+    void AddIfMatch(size_t word_index, State state) {
+        if (automaton_.IsMatch(state) && automaton_.GetDistance(state) >= min_distance_
+            && IsAccepted(words_.term_ids[word_index])) {
+            result_.push_back({ words_.term_ids[word_index], automaton_.GetDistance(state) });
+        }
+    }
+
+    void Walk(size_t node, size_t depth, State state) {
+        const size_t first_word = words_.nodes[node].first_word;
+        const size_t first_child = words_.nodes[node].first_child;
+        const size_t last_child = words_.nodes[node + 1].first_child;
+        if (first_child == last_child) {
+            WalkTail(first_word, depth, state);
+            return;
+        }
+        if (GetWordLength(words_, first_word) == depth) {
+            AddIfMatch(first_word, state);
+        }
+        for (size_t child = first_child; child < last_child; ++child) {
+            if (IsDone()) {
+                return;
+            }
+            const State next = automaton_.Step(state, words_.nodes[child].label);
+            if (automaton_.CanMatch(next)) {
+                Walk(child, depth + 1, next);
+            }
+        }
+    }
+
+    // a node with a single word below it: the rest of the word is stepped through directly
+    void WalkTail(size_t word_index, size_t depth, State state) {
+        for (size_t i = depth; i < GetWordLength(words_, word_index); ++i) {
+            state = automaton_.Step(state, static_cast<char>(GetWordByte(words_, word_index, i)));
+            if (!automaton_.CanMatch(state)) {
+                return;
+            }
+        }
+        AddIfMatch(word_index, state);
+    }
+};
+
+}
+
+shared_ptr<const TermDictionary::SortedWords> TermDictionary::GetSortedWords() const {
+    lock_guard guard(sorted_words_mutex_);
+    if (!sorted_words_ || id_to_word_.size() - sorted_words_->term_ids.size()
+        > max(MIN_UNSORTED_WORD_LIMIT, sorted_words_->term_ids.size() / UNSORTED_WORD_LIMIT_DIVISOR)) {
+        auto sorted_words = make_shared<SortedWords>(word_to_id_.get_allocator());
+        sorted_words->offsets.reserve(word_to_id_.size() + 1);
+        sorted_words->term_ids.reserve(word_to_id_.size());
+        sorted_words->offsets.push_back(0);
+        for (const auto& [word, term_id] : word_to_id_) {
+            sorted_words->chars += word;
+            sorted_words->offsets.push_back(static_cast<uint32_t>(sorted_words->chars.size()));
+            sorted_words->term_ids.push_back(term_id);
+        }
+        BuildTrie(*sorted_words);
+        sorted_words_ = move(sorted_words);
+    }
+    return sorted_words_;
+}
+
+vector<pair<int, int>> TermDictionary::FindWithinDistance(const string_view word, int max_distance) const {
+    return FindInDistanceRange(word, 0, max_distance, numeric_limits<size_t>::max(), nullptr);
+}
+
+vector<pair<int, int>> TermDictionary::FindClosest(const string_view word, int max_distance, size_t limit,
+    const function<bool(int)>& accept) const {
+    vector<pair<int, int>> result;
+    if (const auto term_id = FindWord(word); term_id && limit > 0 && accept(*term_id)) {
+        result.push_back({ *term_id, 0 });
+    }
+    // a walk for one more edit is started only while the closer words are too few, and stops
+    // at the last word it needs
+    for (int distance = 1; distance <= max_distance && result.size() < limit; ++distance) {
+        const auto matches = FindInDistanceRange(word, distance, distance, limit - result.size(), &accept);
+        result.insert(result.end(), matches.begin(), matches.end());
+    }
+    return result;
+}
+
+vector<pair<int, int>> TermDictionary::FindInDistanceRange(const string_view word, int min_distance, int max_distance,
+    size_t limit, const function<bool(int)>* accept) const {
+    const auto sorted_words = GetSortedWords();
+    FuzzyWalker walker(*sorted_words, word, max_distance, min_distance, limit, accept);
+    // the words added after the trie was built have the highest ids and are matched one by one
+    vector<pair<int, int>> unsorted_matches;
+    for (size_t term_id = sorted_words->term_ids.size(); term_id < id_to_word_.size(); ++term_id) {
+        const optional<int> distance = walker.Match(id_to_word_[term_id]);
+        if (distance && walker.IsAccepted(static_cast<int>(term_id))) {
+            unsorted_matches.push_back({ static_cast<int>(term_id), *distance });
+        }
+    }
+    // the first limit words of the trie and the matched words outside it hold the first limit of all
+    vector<pair<int, int>> matches = walker.Run();
+    if (unsorted_matches.empty()) {
+        return matches;
+    }
+    const auto word_less = [this](const pair<int, int>& lhs, const pair<int, int>& rhs) {
+        return id_to_word_[lhs.first] < id_to_word_[rhs.first];
+    };
+    sort(unsorted_matches.begin(), unsorted_matches.end(), word_less);
+    vector<pair<int, int>> result;
+    result.reserve(matches.size() + unsorted_matches.size());
+    merge(matches.begin(), matches.end(), unsorted_matches.begin(), unsorted_matches.end(), back_inserter(result), word_less);
+    if (result.size() > limit) {
+        result.resize(limit);
+    }
+    return result;
+}
+
+size_t TermDictionary::size() const {
+    return id_to_word_.size();
+}
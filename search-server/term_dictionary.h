@@ -0,0 +1,119 @@
+#pragma once
+
+#include "memory_stats.h"
+#include <cstdint>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+// Assigns dense integer ids to distinct words. Ids are never reused, so term ids
+// stored in the indexes stay valid for the whole lifetime of the dictionary.
+class TermDictionary {
+public:
+    TermDictionary() = default;
+    // the words and the lookup structures report their heap memory to counter
+    explicit TermDictionary(std::shared_ptr<MemoryCounter> counter);
+    TermDictionary(const TermDictionary& other);
+
+    // copy of other reporting to counter instead of other's counter
+    TermDictionary(const TermDictionary& other, std::shared_ptr<MemoryCounter> counter);
+
+    TermDictionary(TermDictionary&& other);
+    TermDictionary& operator=(const TermDictionary& other);
+    TermDictionary& operator=(TermDictionary&& other);
+
+    int AddWord(std::string_view word);
+
+    std::optional<int> FindWord(std::string_view word) const;
+
+    std::string_view GetWord(int term_id) const;
+
+    // Calls action(term_id, word) for the words starting with prefix in lexicographic
+    // order until action returns false
+    template <typename Action>
+    void ForEachWithPrefix(std::string_view prefix, Action action) const;
+
+    // (term id, edit distance) of the words within max_distance edits of word, in lexicographic
+    // order of the words. The trie is walked with a lazily compiled Levenshtein automaton, only
+    // the nodes it can still accept from are entered. Known limitation: on a dense dictionary two
+    // edits keep many nodes alive, a million random words take about 1 ms per query word against
+    // 0.07 ms for one edit.
+    // Words added after the trie was built are matched one by one. The trie is rebuilt from all
+    // the words once they are more than 1024 and more than 1/64 of the words in it, so a search
+    // after every added word does not rebuild it every time
+    std::vector<std::pair<int, int>> FindWithinDistance(std::string_view word, int max_distance) const;
+
+    // The limit closest words within max_distance edits of word that accept(term id) takes, as
+    // (term id, edit distance) by distance, equally close words in lexicographic order. The walk
+    // for two edits runs only when one edit finds fewer than limit words, and stops as soon as
+    // it has the rest: on a million random words a three letter word with a limit of 50 takes
+    // 0.03 ms instead of 0.9 ms, a word of six letters and more has fewer close words and
+    // still takes about 1 ms
+    std::vector<std::pair<int, int>> FindClosest(std::string_view word, int max_distance, size_t limit,
+        const std::function<bool(int)>& accept) const;
+
+    size_t size() const;
+
+    // All words in lexicographic order packed into one buffer, with a trie over them
+    // for the fuzzy search
+    struct SortedWords {
+        explicit SortedWords(const CountingAllocator<char>& allocator)
+            : chars(allocator)
+            , offsets(allocator)
+            , term_ids(allocator)
+            , nodes(allocator) {
+        }
+
+        CountedString chars;
+        // word i is chars[offsets[i], offsets[i + 1])
+        CountedVector<uint32_t> offsets;
+        CountedVector<int> term_ids;
+
+        // A node of the trie over the words, entered by the byte label. Its children are the
+        // nodes [first_child, next node's first_child) and its words start at word first_word.
+        // A node with a single word has no children, the rest of the word is read from chars.
+        struct TrieNode {
+            uint32_t first_child;
+            uint32_t first_word;
+            char label;
+        };
+
+        // breadth-first, so siblings are stored together, node 0 is the root, the last node
+        // only ends the children of the one before it
+        CountedVector<TrieNode> nodes;
+    };
+
+private:
+    CountedMap<CountedString, int, std::less<>> word_to_id_;
+    // views into the keys of word_to_id_, indexed by term id
+    CountedVector<std::string_view> id_to_word_;
+
+    // built on the first fuzzy search and rebuilt when too many words are added after it, the
+    // words with ids from sorted_words_->term_ids.size() on are not in it
+    mutable std::shared_ptr<const SortedWords> sorted_words_;
+    mutable std::mutex sorted_words_mutex_;
+
+    std::shared_ptr<const SortedWords> GetSortedWords() const;
+
+    // the first limit words in lexicographic order with min_distance to max_distance edits
+    // that accept takes, every word without accept
+    std::vector<std::pair<int, int>> FindInDistanceRange(std::string_view word, int min_distance, int max_distance,
+        size_t limit, const std::function<bool(int)>* accept) const;
+};
+
+template <typename Action>
+void TermDictionary::ForEachWithPrefix(std::string_view prefix, Action action) const {
+    // the words are kept sorted, so all words with the prefix form one contiguous range
+    for (auto it = word_to_id_.lower_bound(prefix); it != word_to_id_.end(); ++it) {
+        const std::string_view word = it->first;
+        if (word.substr(0, prefix.size()) != prefix || !action(it->second, word)) {
+            break;
+        }
+    }
+}
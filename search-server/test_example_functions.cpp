@@ -2,8 +2,24 @@
 #include "test_example_functions.h"
 #include "remove_duplicates.h"
 #include "request_queue.h"
+#include "metrics.h"
+#include "paginator.h"
+#include "concurrent_map.h"
+#include "sharded_search_server.h"
+#include "search_client.h"
+#include "search_daemon.h"
+#include "query_scheduler.h"
+#include "document_loader.h"
+#include "write_ahead_log.h"
+#include "stop_word_set.h"
+#include "text_analyzer.h"
+#include <filesystem>
+#include <fstream>
 #include <set>
+#include <limits>
 #include <numeric>
+#include <random>
+#include <sstream>
 
 using namespace std;
 using namespace std::string_literals;
@@ -224,9 +240,1634 @@ void TestCountingRelevansIsCorrect() {
     }
 }
 
+void TestRankingFunctions() {
+    SearchServer server(" "s);
+    server.AddDocument(1, "cat"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "cat dog bird fish mouse horse cow goat"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(3, "dog"s, DocumentStatus::ACTUAL, { 1 });
+
+    const auto tf_idf = server.FindTopDocuments(execution::seq, "cat"s, DocumentStatus::ACTUAL);
+    const auto default_ranking = server.FindTopDocuments("cat"s);
+    ASSERT_EQUAL(tf_idf.size(), default_ranking.size());
+    ASSERT(abs(tf_idf[0].relevance - log(3.0 / 2.0)) < EPSILON);
+
+    const auto bm25 = server.FindTopDocuments(execution::par, "cat"s, DocumentStatus::ACTUAL, Bm25Ranking{});
+    ASSERT_EQUAL(bm25.size(), 2u);
+    ASSERT_EQUAL(bm25[0].id, 1);
+    ASSERT_HINT(bm25[0].relevance > bm25[1].relevance, "BM25 must prefer the shorter document"s);
+
+    const auto by_length = server.FindTopDocuments("cat dog"s, [](int, DocumentStatus, int) { return true; },
+        MakeRanking([](double, double, int document_length) { return static_cast<double>(document_length); }));
+    ASSERT_EQUAL(by_length[0].id, 2);
+    ASSERT(abs(by_length[0].relevance - 16.0) < EPSILON);
+}
+
+void TestPhraseAndProximity() {
+    {
+        SearchServer server("in the"s);
+        ASSERT_EQUAL(server.FindTopDocuments("cat city"s).size(), 0u);
+        ASSERT_THROWS_HINT(server.FindTopDocuments("\"cat city\""s), logic_error, "Phrase queries need the positional index"s);
+    }
+
+    SearchServer server("in the"s);
+    server.EnablePositionalIndex();
+    server.AddDocument(1, "cat in the city"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "city cat"s, DocumentStatus::ACTUAL, { 2 });
+    server.AddDocument(3, "cat lives far away from big city"s, DocumentStatus::ACTUAL, { 3 });
+
+    const auto phrase = server.FindTopDocuments("\"cat in the city\""s);
+    ASSERT_EQUAL(phrase.size(), 1u);
+    ASSERT_EQUAL(phrase[0].id, 1);
+    ASSERT(server.FindTopDocuments("\"cat city\""s).empty());
+    ASSERT_EQUAL(server.FindTopDocuments("\"city cat\" -dog"s).size(), 1u);
+
+    const auto [words, status] = server.MatchDocument("\"big city\""s, 1);
+    ASSERT(words.empty());
+    const auto [words1, status1] = server.MatchDocument("\"big city\" lives"s, 3);
+    ASSERT_EQUAL(words1.size(), 3u);
+
+    const auto near = server.FindTopDocuments(execution::seq, "cat city"s, DocumentStatus::ACTUAL, ProximityRanking<Bm25Ranking>{});
+    ASSERT_EQUAL(near.size(), 3u);
+    ASSERT_EQUAL(near[2].id, 3);
+    server.RemoveDocument(2);
+    ASSERT(server.FindTopDocuments("\"city cat\""s).empty());
+}
+
+void TestPrefixQuery() {
+    SearchServer server("and"s);
+    server.AddDocument(1, "curly cat"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "cute dog"s, DocumentStatus::ACTUAL, { 2 });
+    server.AddDocument(3, "cucumber and carrot"s, DocumentStatus::ACTUAL, { 3 });
+    server.AddDocument(4, "big dog"s, DocumentStatus::ACTUAL, { 4 });
+
+    ASSERT_EQUAL(server.FindTopDocuments("cu*"s).size(), 3u);
+    ASSERT_EQUAL(server.FindTopDocuments("cu* -cuc*"s).size(), 2u);
+    ASSERT(server.FindTopDocuments("cux*"s).empty());
+    ASSERT_EQUAL(server.FindTopDocuments("c*"s).size(), 3u);
+
+    const auto [words, status] = server.MatchDocument("c* dog"s, 3);
+    ASSERT_EQUAL(words.size(), 2u);
+    ASSERT_EQUAL(words[0], "carrot"s);
+    ASSERT_EQUAL(words[1], "cucumber"s);
+
+    server.RemoveDocument(3);
+    ASSERT_EQUAL(server.FindTopDocuments("cu*"s).size(), 2u);
+
+    for (int id = 10; id < 10 + MAX_PREFIX_EXPANSION_COUNT * 2; ++id) {
+        server.AddDocument(id, "word"s + to_string(id), DocumentStatus::ACTUAL, { 1 });
+    }
+    ASSERT_EQUAL(server.FindTopDocuments(execution::par, "word*"s, [](int, DocumentStatus, int) { return true; }).size(),
+        static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+    ASSERT_EQUAL(get<0>(server.MatchDocument("word*"s, 10)).size(), 1u);
+    // the expansion keeps the lexicographically first words, "word99" is the last one
+    ASSERT(get<0>(server.MatchDocument("word*"s, 99)).empty());
+    // a minus prefix excludes all the words, not only the first ones
+    ASSERT(server.FindTopDocuments("word99 word10 -word*"s).empty());
+    ASSERT(get<0>(server.MatchDocument("word99 -word*"s, 99)).empty());
+}
+
+void TestFuzzyQuery() {
+    SearchServer server("and"s);
+    server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "black cart"s, DocumentStatus::ACTUAL, { 2 });
+    server.AddDocument(3, "grey coat"s, DocumentStatus::ACTUAL, { 3 });
+    server.AddDocument(4, "brown dog"s, DocumentStatus::ACTUAL, { 4 });
+
+    ASSERT(server.FindTopDocuments("cta"s).empty());
+    ASSERT(server.FindTopDocuments("cta~"s).empty());
+    ASSERT(!server.FindTopDocuments("cta~2"s).empty());
+
+    const auto one_edit = server.FindTopDocuments("cat~"s);
+    ASSERT_EQUAL(one_edit.size(), 3u);
+    ASSERT_HINT(one_edit[0].id == 1, "Exact match must rank above fuzzy matches"s);
+    ASSERT(abs(one_edit[1].relevance - one_edit[0].relevance * FUZZY_DISTANCE_PENALTY) < EPSILON);
+
+    ASSERT_EQUAL(server.FindTopDocuments("cat~ -caart~"s).size(), 2u);
+
+    // two edits find every word one edit finds, also with another first letter
+    ASSERT_EQUAL(server.FindTopDocuments("kat~"s).size(), 1u);
+    for (const string& word : { "kat"s, "cta"s, "blak"s, "dgo"s, "coet"s }) {
+        const auto one_edit_documents = server.FindTopDocuments(word + "~"s);
+        const auto two_edit_documents = server.FindTopDocuments(word + "~2"s);
+        for (const Document& document : one_edit_documents) {
+            ASSERT_HINT(any_of(two_edit_documents.begin(), two_edit_documents.end(), [&document](const Document& found) {
+                return found.id == document.id;
+                }), word);
+        }
+    }
+    ASSERT(server.FindTopDocuments("white -kat~2"s).empty());
+
+    //          -  
+    server.AddDocument(5, "a~b ok~2x"s, DocumentStatus::ACTUAL, { 5 });
+    ASSERT_EQUAL(server.FindTopDocuments("a~b"s).size(), 1u);
+    ASSERT_EQUAL(server.FindTopDocuments("ok~2x"s).size(), 1u);
+    ASSERT_EQUAL(server.FindTopDocuments("a~b~"s).size(), 1u);
+    ASSERT_EQUAL(server.FindTopDocuments(execution::par, "dgo~2"s, DocumentStatus::ACTUAL).size(), 1u);
+
+    // a minus word excludes every close word, beyond MAX_FUZZY_EXPANSION_COUNT
+    for (int id = 10; id < 10 + MAX_FUZZY_EXPANSION_COUNT * 2; ++id) {
+        server.AddDocument(id, "pet"s + to_string(id), DocumentStatus::ACTUAL, { 1 });
+    }
+    ASSERT_EQUAL(server.FindTopDocuments("pet1~2"s).size(), static_cast<size_t>(MAX_RESULT_DOCUMENT_COUNT));
+    ASSERT(server.FindTopDocuments("pet10 pet99 pet55 -pet1~2"s).empty());
+
+    const auto [words, status] = server.MatchDocument(execution::par, "cat~ white"s, 1);
+    ASSERT_EQUAL(words.size(), 2u);
+    const auto [words1, status1] = server.MatchDocument("caat~"s, 2);
+    ASSERT_EQUAL(words1.size(), 1u);
+    ASSERT_EQUAL(words1[0], "cart"s);
+
+    //      ,    
+    TermDictionary dictionary;
+    TestRandom next_random(42);
+    vector<string> dictionary_words;
+    const auto add_random_words = [&dictionary, &dictionary_words, &next_random](int count) {
+        for (int i = 0; i < count; ++i) {
+            string word;
+            const unsigned length = 1 + next_random(7);
+            for (unsigned j = 0; j < length; ++j) {
+                word += static_cast<char>('a' + next_random(4));
+            }
+            dictionary.AddWord(word);
+            dictionary_words.push_back(move(word));
+        }
+    };
+    add_random_words(3000);
+    const auto edit_distance = [](const string& lhs, const string& rhs) {
+        vector<size_t> row(rhs.size() + 1);
+        iota(row.begin(), row.end(), 0);
+        for (size_t i = 1; i <= lhs.size(); ++i) {
+            size_t diagonal = row[0];
+            row[0] = i;
+            for (size_t j = 1; j <= rhs.size(); ++j) {
+                const size_t substitution = diagonal + (lhs[i - 1] == rhs[j - 1] ? 0 : 1);
+                diagonal = row[j];
+                row[j] = min({ substitution, row[j] + 1, row[j - 1] + 1 });
+            }
+        }
+        return static_cast<int>(row.back());
+    };
+    const auto check_fuzzy_search = [&dictionary_words, &edit_distance](const TermDictionary& searched) {
+        for (const string& query : { "abc"s, "a"s, "dddd"s, "abcdabc"s, "bad"s, "ce"s }) {
+            for (int max_distance = 1; max_distance <= MAX_FUZZY_DISTANCE; ++max_distance) {
+                set<pair<string, int>> expected;
+                for (const string& word : dictionary_words) {
+                    const int distance = edit_distance(query, word);
+                    if (distance <= max_distance) {
+                        expected.insert({ word, distance });
+                    }
+                }
+                vector<pair<string, int>> found;
+                for (const auto& [term_id, distance] : searched.FindWithinDistance(query, max_distance)) {
+                    found.push_back({ string(searched.GetWord(term_id)), distance });
+                }
+                // in lexicographic order, so also without repeats
+                const vector<pair<string, int>> expected_in_order(expected.begin(), expected.end());
+                ASSERT_HINT(found == expected_in_order, query);
+
+                // the closest words with an even term id, by distance and then lexicographically
+                vector<pair<int, string>> closest_expected;
+                for (const auto& [word, distance] : expected) {
+                    if (*searched.FindWord(word) % 2 == 0) {
+                        closest_expected.push_back({ distance, word });
+                    }
+                }
+                sort(closest_expected.begin(), closest_expected.end());
+                for (const size_t limit : { 1u, 5u, 50u, 100000u }) {
+                    vector<pair<int, string>> closest_found;
+                    const auto is_even = [](int term_id) {
+                        return term_id % 2 == 0;
+                    };
+                    for (const auto& [term_id, distance] : searched.FindClosest(query, max_distance, limit, is_even)) {
+                        closest_found.push_back({ distance, string(searched.GetWord(term_id)) });
+                    }
+                    const vector<pair<int, string>> closest_prefix(closest_expected.begin(),
+                        closest_expected.begin() + min(limit, closest_expected.size()));
+                    ASSERT_HINT(closest_found == closest_prefix, query);
+                }
+            }
+        }
+    };
+    check_fuzzy_search(dictionary);
+    // words added after the trie was built are found before it is rebuilt, and after
+    add_random_words(300);
+    check_fuzzy_search(dictionary);
+    check_fuzzy_search(TermDictionary(dictionary));
+    add_random_words(3000);
+    check_fuzzy_search(dictionary);
+
+    ASSERT_THROWS(server.FindTopDocuments("cat~3"s), invalid_argument);
+}
+
+void TestParallelScoring() {
+    ASSERT(ChooseAccumulationMode(false, 10, 1000000, 1000, 8) == AccumulationMode::SEQUENTIAL);
+    ASSERT(ChooseAccumulationMode(true, 1, 1000000, 1000, 8) == AccumulationMode::SEQUENTIAL);
+    ASSERT(ChooseAccumulationMode(true, 10, 100, 1000, 8) == AccumulationMode::SEQUENTIAL);
+    ASSERT(ChooseAccumulationMode(true, 10, 1000000, 10000000, 8) == AccumulationMode::SEQUENTIAL);
+    ASSERT(ChooseAccumulationMode(true, 10, 1000000, 10000, 8) == AccumulationMode::PRIVATE);
+    ASSERT(ChooseAccumulationMode(true, 10, 1000000, 500000, 8) == AccumulationMode::ATOMIC);
+
+    AtomicAccumulator atomic(100);
+    PrivateAccumulators parts(100, 3);
+    vector<int> indexes(300);
+    iota(indexes.begin(), indexes.end(), 0);
+    for_each(execution::par, indexes.begin(), indexes.end(), [&atomic](int i) {
+        atomic.Add(i % 50, 0.5);
+        });
+    for (int i = 0; i < 300; ++i) {
+        parts.Add(i % 3, i % 50, 0.5);
+    }
+    parts.Reduce(execution::par);
+    int atomic_count = 0;
+    atomic.ForEach([&atomic_count](int slot, double relevance) {
+        ASSERT(slot < 50);
+        ASSERT(abs(relevance - 3.0) < EPSILON);
+        ++atomic_count;
+        });
+    ASSERT_EQUAL(atomic_count, 50);
+    int private_count = 0;
+    parts.ForEach([&private_count](int, double relevance) {
+        ASSERT(abs(relevance - 3.0) < EPSILON);
+        ++private_count;
+        });
+    ASSERT_EQUAL(private_count, 50);
+
+    SearchServer server("and"s);
+    const vector<string> words = { "cat"s, "dog"s, "bird"s, "fish"s, "mouse"s, "horse"s, "cow"s };
+    for (int id = 0; id < 3000; ++id) {
+        string text;
+        for (int i = 0; i < 1 + id % 5; ++i) {
+            text += words[(id * 7 + i * 3) % words.size()] + " "s;
+        }
+        server.AddDocument(id, text, DocumentStatus::ACTUAL, { id % 10 });
+    }
+    // removed slots are reused by new documents
+    for (int id = 0; id < 3000; id += 3) {
+        server.RemoveDocument(id);
+    }
+    server.AddDocument(5000, "cat dog bird"s, DocumentStatus::ACTUAL, { 1 });
+
+    const string query = "cat dog bird fish -cow"s;
+    const auto seq = server.FindTopDocuments(execution::seq, query);
+    const auto par = server.FindTopDocuments(execution::par, query);
+    ASSERT_EQUAL(seq.size(), par.size());
+    for (size_t i = 0; i < seq.size(); ++i) {
+        // documents with equal relevance and rating may come in any order
+        ASSERT_EQUAL(seq[i].rating, par[i].rating);
+        ASSERT(abs(seq[i].relevance - par[i].relevance) < EPSILON);
+        ASSERT(par[i].id % 3 != 0 || par[i].id == 5000);
+    }
+}
+
+void TestConcurrentMap() {
+    //    16 :    32 ,   
+    //    ,       
+    {
+        ConcurrentMap<int, int> concurrent(1);
+        map<int, int> expected;
+        mt19937 generator(7);
+        for (int i = 0; i < 20'000; ++i) {
+            const int key = uniform_int_distribution<int>(0, 15)(generator);
+            if (uniform_int_distribution<int>(0, 2)(generator) == 0) {
+                concurrent.Erase(key);
+                expected.erase(key);
+            }
+            else {
+                concurrent[key].ref_to_value += i;
+                expected[key] += i;
+            }
+            ASSERT_EQUAL(concurrent.Size(), expected.size());
+            map<int, int> actual;
+            concurrent.ForEach([&actual](int entry_key, int value) {
+                actual[entry_key] = value;
+                });
+            ASSERT_HINT(actual == expected, to_string(i));
+        }
+    }
+
+    {
+        ConcurrentMap<int, vector<int>> concurrent(4);
+        for (int key = 0; key < 100; ++key) {
+            concurrent[key].ref_to_value.assign(3, key);
+        }
+        map<int, vector<int>> drained;
+        concurrent.Drain([&drained](int key, vector<int>&& value) {
+            drained[key] = move(value);
+            });
+        ASSERT_EQUAL(drained.size(), 100u);
+        ASSERT(drained.at(42) == vector<int>(3, 42));
+        ASSERT_EQUAL(concurrent.Size(), 0u);
+        concurrent.ForEach([](int, vector<int>&) {
+            ASSERT(false);
+            });
+        concurrent[5].ref_to_value.push_back(1);
+        ASSERT_EQUAL(concurrent.Size(), 1u);
+    }
+
+    {
+        const int thread_count = 8;
+        const int key_count = 1000;
+        ConcurrentMap<int, int> concurrent(3);
+        vector<thread> threads;
+        for (int t = 0; t < thread_count; ++t) {
+            threads.emplace_back([&concurrent, t]() {
+                for (int key = 0; key < key_count; ++key) {
+                    concurrent[key].ref_to_value += 1;
+                    concurrent[key_count * (t + 1) + key].ref_to_value = t;
+                }
+                });
+        }
+        for (thread& worker : threads) {
+            worker.join();
+        }
+        ASSERT_EQUAL(concurrent.Size(), static_cast<size_t>(key_count * (thread_count + 1)));
+        concurrent.ForEach([thread_count](int key, int value) {
+            if (key < key_count) {
+                ASSERT_EQUAL_HINT(value, thread_count, to_string(key));
+            }
+            else {
+                ASSERT_EQUAL_HINT(value, key / key_count - 1, to_string(key));
+            }
+            });
+    }
+}
+
+void TestMetrics() {
+    LatencyHistogram histogram;
+    for (uint64_t value = 1; value <= 1000; ++value) {
+        histogram.Record(value);
+    }
+    ASSERT_EQUAL(histogram.GetCount(), 1000u);
+    ASSERT_EQUAL(histogram.GetMax(), 1000u);
+    ASSERT(abs(histogram.GetMean() - 500.5) < EPSILON);
+    //      1/16
+    ASSERT(histogram.GetPercentile(50) >= 500 && histogram.GetPercentile(50) <= 500 + 500 / 16);
+    ASSERT(histogram.GetPercentile(99) >= 990 && histogram.GetPercentile(99) <= 1000);
+    ASSERT_EQUAL(histogram.GetPercentile(100), 1000u);
+    for (size_t index = 1; index < LatencyHistogram::BUCKET_COUNT; ++index) {
+        const uint64_t lower = LatencyHistogram::GetBucketLowerBound(index);
+        ASSERT_EQUAL(LatencyHistogram::GetBucketIndex(lower), index);
+        ASSERT_EQUAL(LatencyHistogram::GetBucketIndex(lower - 1), index - 1);
+    }
+
+    SearchServer server("and"s);
+    server.AddDocument(1, "white cat"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(2, "black cat"s, DocumentStatus::ACTUAL, { 2 });
+    const MetricsSnapshot before = GetMetricsSnapshot();
+    server.FindTopDocuments("cat -dog"s);
+    server.FindTopDocuments(execution::par, "white cat"s);
+    server.MatchDocument("cat"s, 1);
+    MetricsSnapshot metrics = GetMetricsSnapshot();
+    metrics -= before;
+    if constexpr (METRICS_ENABLED) {
+        ASSERT_EQUAL(metrics.GetStage(MetricStage::PARSE).GetCount(), 3u);
+        ASSERT_EQUAL(metrics.GetStage(MetricStage::SCORING).GetCount(), 2u);
+        ASSERT_EQUAL(metrics.GetStage(MetricStage::TOP_K).GetCount(), 2u);
+        ASSERT_EQUAL(metrics.GetStage(MetricStage::MATCH).GetCount(), 1u);
+        ASSERT_EQUAL(metrics.GetCounter(MetricCounter::POSTINGS_SCANNED), 5u);
+        ASSERT_EQUAL(metrics.GetCounter(MetricCounter::DOCUMENTS_SCORED), 4u);
+    }
+    else {
+        ASSERT_EQUAL(metrics.GetStage(MetricStage::PARSE).GetCount(), 0u);
+    }
+
+    ostringstream json;
+    PrintMetricsJson(json, metrics);
+    ASSERT(json.str().find("\"postings_scanned\":"s) != string::npos);
+    ASSERT_EQUAL(json.str().front(), '{');
+    ASSERT_EQUAL(json.str().back(), '}');
+}
+
+void TestMemoryStats() {
+    SearchServer server("and in"s);
+    const auto find_component = [](const MemoryStats& stats, const string& name) {
+        return *find_if(stats.components.begin(), stats.components.end(), [&name](const ComponentMemory& component) {
+            return component.name == name;
+            });
+    };
+    const MemoryStats empty = server.GetMemoryStats();
+    ASSERT_EQUAL(empty.document_count, 0u);
+    ASSERT(find_component(empty, "stop_words"s).bytes > 0);
+    ASSERT_EQUAL(find_component(empty, "forward_index"s).bytes, 0u);
+
+    for (int id = 0; id < 100; ++id) {
+        server.AddDocument(id, "cat and dog in the city number "s + to_string(id), DocumentStatus::ACTUAL, { 1 });
+    }
+    const MemoryStats full = server.GetMemoryStats();
+    ASSERT_EQUAL(full.document_count, 100u);
+    ASSERT_EQUAL(find_component(full, "dictionary"s).elements, 105u);
+    ASSERT_EQUAL(find_component(full, "postings"s).elements, 600u);
+    ASSERT(find_component(full, "postings"s).bytes >= 600 * sizeof(pair<const int, double>));
+    ASSERT(find_component(full, "documents"s).bytes > 0);
+    ASSERT_EQUAL(find_component(full, "positions"s).bytes, 0u);
+    ASSERT(full.GetTotalBytes() > empty.GetTotalBytes());
+
+    for (int id = 0; id < 50; ++id) {
+        server.RemoveDocument(id);
+    }
+    const MemoryStats half = server.GetMemoryStats();
+    ASSERT(find_component(half, "postings"s).bytes < find_component(full, "postings"s).bytes);
+    ASSERT(find_component(half, "documents"s).bytes < find_component(full, "documents"s).bytes);
+
+    // the counters move with the server
+    SearchServer moved(move(server));
+    ASSERT_EQUAL(moved.GetMemoryStats().GetTotalBytes(), half.GetTotalBytes());
+
+    // the moved-from server is empty, usable and counts its own memory
+    const MemoryStats moved_from = server.GetMemoryStats();
+    ASSERT_EQUAL(moved_from.document_count, 0u);
+    ASSERT_EQUAL(moved_from.GetTotalBytes(), 0u);
+    server.AddDocument(1, "cat and dog"s, DocumentStatus::ACTUAL, { 1 });
+    ASSERT_EQUAL(server.FindTopDocuments("cat"s).size(), 1u);
+    ASSERT(server.GetMemoryStats().GetTotalBytes() > 0);
+
+    // a copy counts its memory apart from the source
+    {
+        const SearchServer copy(moved);
+        ASSERT_EQUAL(copy.GetMemoryStats().document_count, 50u);
+        ASSERT(find_component(copy.GetMemoryStats(), "postings"s).bytes > 0);
+        const auto found = copy.FindTopDocuments("77"s);
+        ASSERT_EQUAL(found.size(), 1u);
+        ASSERT_EQUAL(found[0].id, 77);
+    }
+    ASSERT_EQUAL(moved.GetMemoryStats().GetTotalBytes(), half.GetTotalBytes());
+    server = moved;
+    ASSERT_EQUAL(server.GetDocumentCount(), 50);
+    ASSERT_EQUAL(server.FindTopDocuments("77"s).size(), 1u);
+    ASSERT_EQUAL(moved.GetMemoryStats().GetTotalBytes(), half.GetTotalBytes());
+
+    const MemoryStats projection = ProjectMemory(full, 400);
+    ASSERT_EQUAL(projection.document_count, 400u);
+    ASSERT_EQUAL(find_component(projection, "stop_words"s).bytes, find_component(full, "stop_words"s).bytes);
+    ASSERT_EQUAL(find_component(projection, "dictionary"s).elements, 210u);
+    ASSERT_EQUAL(find_component(projection, "documents"s).bytes, find_component(full, "documents"s).bytes * 4);
+
+    ASSERT_THROWS(ProjectMemory(empty, 1000), invalid_argument);
+}
+
+void TestFindPage() {
+    SearchServer server("and"s);
+    for (int id = 0; id < 30; ++id) {
+        string text = "cat"s;
+        for (int i = 0; i < id % 7; ++i) {
+            text += " dog"s;
+        }
+        server.AddDocument(id, text, DocumentStatus::ACTUAL, { id });
+    }
+    server.AddDocument(100, "bird"s, DocumentStatus::ACTUAL, { 1 });
+
+    //        
+    vector<Document> all;
+    for (size_t page = 0; ; ++page) {
+        const auto documents = server.FindPage("cat bird -fish"s, page, 1);
+        if (documents.empty()) {
+            break;
+        }
+        ASSERT_EQUAL(documents.size(), 1u);
+        all.push_back(documents[0]);
+    }
+    ASSERT_EQUAL(all.size(), 31u);
+    for (size_t i = 1; i < all.size(); ++i) {
+        ASSERT(all[i - 1].relevance > all[i].relevance - EPSILON);
+    }
+
+    const auto top = server.FindTopDocuments("cat bird -fish"s);
+    const auto first_page = server.FindPage("cat bird -fish"s, 0, 5);
+    ASSERT_EQUAL(first_page.size(), top.size());
+    for (size_t i = 0; i < top.size(); ++i) {
+        ASSERT_EQUAL(first_page[i].id, top[i].id);
+    }
+    const auto third_page = server.FindPage("cat bird -fish"s, 2, 7);
+    ASSERT_EQUAL(third_page.size(), 7u);
+    for (size_t i = 0; i < third_page.size(); ++i) {
+        ASSERT_EQUAL(third_page[i].id, all[14 + i].id);
+    }
+    ASSERT_EQUAL(server.FindPage("cat bird"s, 4, 7).size(), 3u);
+    ASSERT(server.FindPage("cat bird"s, 5, 7).empty());
+    ASSERT(server.FindPage("cat"s, numeric_limits<size_t>::max(), 2).empty());
+    ASSERT_EQUAL(server.FindPage("cat"s, DocumentStatus::BANNED, 0, 10).size(), 0u);
+    ASSERT_EQUAL(server.FindPage("cat"s, [](int id, DocumentStatus, int) { return id % 2 == 0; }, 1, 10).size(), 5u);
+
+    ASSERT_THROWS(server.FindPage("cat"s, 0, 0), invalid_argument);
+
+    const vector<int> numbers = { 1, 2, 3, 4, 5, 6, 7, 8, 9, 10 };
+    const auto pages = Paginate(numbers, 3);
+    ASSERT_EQUAL(pages.size(), 4u);
+    vector<size_t> page_sizes;
+    for (const auto& page : pages) {
+        page_sizes.push_back(page.size());
+    }
+    ASSERT(page_sizes == vector<size_t>({ 3, 3, 3, 1 }));
+    ASSERT_EQUAL(*pages[2].begin(), 7);
+    ASSERT_EQUAL(pages[3].size(), 1u);
+    ASSERT_EQUAL(pages[4].size(), 0u);
+    const set<int> ordered(numbers.begin(), numbers.end());
+    const auto set_pages = Paginate(ordered, 4);
+    ASSERT_EQUAL(set_pages.size(), 3u);
+    ASSERT_EQUAL(*set_pages[1].begin(), 5);
+    ASSERT_EQUAL(set_pages[2].size(), 2u);
+}
+
+void TestCursor() {
+    SearchServer server("and"s);
+    for (int id = 0; id < 30; ++id) {
+        string text = "cat"s;
+        for (int i = 0; i < id % 7; ++i) {
+            text += " dog"s;
+        }
+        server.AddDocument(id, text, DocumentStatus::ACTUAL, { id });
+    }
+    server.AddDocument(100, "bird"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(101, "cat fish"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(102, "cat"s, DocumentStatus::BANNED, { 1 });
+
+    //  ,    FindAllDocuments
+    const auto expected = server.FindPage("cat bird -fish"s, 0, 100);
+    auto cursor = server.OpenCursor("cat bird -fish"s);
+    vector<Document> by_id;
+    while (!cursor.IsExhausted()) {
+        const auto block = cursor.Next(4);
+        ASSERT(block.size() <= 4u);
+        by_id.insert(by_id.end(), block.begin(), block.end());
+    }
+    ASSERT_EQUAL(by_id.size(), 31u);
+    ASSERT(cursor.Next(4).empty());
+    for (size_t i = 0; i < by_id.size(); ++i) {
+        ASSERT(i == 0 || by_id[i - 1].id < by_id[i].id);
+        const auto it = find_if(expected.begin(), expected.end(), [&](const Document& document) {
+            return document.id == by_id[i].id;
+            });
+        ASSERT(it != expected.end());
+        ASSERT(abs(it->relevance - by_id[i].relevance) < EPSILON);
+    }
+    ASSERT_EQUAL(by_id.back().id, 100);
+    ASSERT_EQUAL(server.OpenCursor("cat"s, CursorOrder::DOCUMENT_ID, DocumentStatus::BANNED).Next(10).size(), 1u);
+    ASSERT(server.OpenCursor("cat"s).Next(0).empty());
+
+    //          ,   
+    auto limited = server.OpenCursor("cat"s, CursorOrder::DOCUMENT_ID, DocumentStatus::BANNED);
+    vector<Document> banned;
+    size_t block_count = 0;
+    while (!limited.IsExhausted()) {
+        const auto block = limited.Next(10, 4);
+        banned.insert(banned.end(), block.begin(), block.end());
+        ++block_count;
+    }
+    ASSERT_EQUAL(banned.size(), 1u);
+    ASSERT_EQUAL(banned[0].id, 102);
+    ASSERT(block_count >= 8u);
+
+    //     FindPage
+    auto ranked = server.OpenCursor("cat bird -fish"s, CursorOrder::RELEVANCE);
+    for (size_t page = 0; page < 5; ++page) {
+        const auto block = ranked.Next(7);
+        const auto expected_page = server.FindPage("cat bird -fish"s, page, 7);
+        ASSERT_EQUAL(block.size(), expected_page.size());
+        for (size_t i = 0; i < block.size(); ++i) {
+            ASSERT_EQUAL(block[i].id, expected_page[i].id);
+        }
+    }
+    ASSERT(ranked.IsExhausted());
+
+    //   
+    for (const CursorOrder order : { CursorOrder::DOCUMENT_ID, CursorOrder::RELEVANCE }) {
+        auto first = server.OpenCursor("cat bird -fish"s, order);
+        first.Next(10);
+        const auto rest = first.Next(10);
+        auto second = server.OpenCursor("cat bird -fish"s, order);
+        second.Next(10);
+        auto resumed = server.ResumeCursor("cat bird -fish"s, second.GetContinuationToken());
+        const auto resumed_rest = resumed.Next(10);
+        ASSERT_EQUAL(resumed_rest.size(), rest.size());
+        for (size_t i = 0; i < rest.size(); ++i) {
+            ASSERT_EQUAL(resumed_rest[i].id, rest[i].id);
+        }
+    }
+
+    const string valid_token = server.OpenCursor("cat bird -fish"s).GetContinuationToken();
+    for (const string& token : { "1.0.0.1.0.-1.0.0"s, "garbage"s, ""s,
+        server.OpenCursor("cat"s).GetContinuationToken(), valid_token + "x"s, " "s + valid_token, valid_token + "."s }) {
+        ASSERT_THROWS_HINT(server.ResumeCursor("cat bird -fish"s, token), invalid_argument, token);
+    }
+    ASSERT_EQUAL(server.ResumeCursor("cat bird -fish"s, valid_token).Next(100).size(), 31u);
+
+    //     ,          
+    const auto all = server.FindPage("cat bird -fish"s, 0, 100);
+    auto snapshot = server.OpenCursor("cat bird -fish"s, CursorOrder::RELEVANCE);
+    snapshot.Next(5);
+    server.RemoveDocument(all[5].id);
+    const auto block = snapshot.Next(5);
+    ASSERT_EQUAL(block.size(), 5u);
+    for (size_t i = 0; i < block.size(); ++i) {
+        ASSERT_EQUAL(block[i].id, all[6 + i].id);
+    }
+}
+
+void TestAllWordsQuery() {
+    SearchServer server("and with"s);
+    const vector<string> words = { "cat"s, "dog"s, "bird"s, "fish"s, "tail"s, "collar"s };
+    for (int id = 0; id < 200; ++id) {
+        string text;
+        for (size_t i = 0; i < words.size(); ++i) {
+            //  i   ,     i + 1
+            if (id % (i + 1) == 0) {
+                for (int repeat = 0; repeat <= id % 3; ++repeat) {
+                    text += words[i] + " and "s;
+                }
+            }
+        }
+        text += "word"s + to_string(id);
+        server.AddDocument(id, text, id % 5 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, { id });
+    }
+
+    //     ,   MatchDocument
+    for (const string& query : { "cat dog"s, "dog bird fish"s, "bird tail -collar"s, "tail collar"s }) {
+        const auto required_count = SplitIntoWords(query).size() - count(query.begin(), query.end(), '-');
+        vector<Document> expected;
+        for (const Document& document : server.FindPage(query, 0, 1000)) {
+            if (get<0>(server.MatchDocument(query, document.id)).size() == required_count) {
+                expected.push_back(document);
+            }
+        }
+        if (expected.size() > MAX_RESULT_DOCUMENT_COUNT) {
+            expected.resize(MAX_RESULT_DOCUMENT_COUNT);
+        }
+        const auto found = server.FindTopDocuments(QueryMode::ALL_WORDS, query);
+        ASSERT_EQUAL_HINT(found.size(), expected.size(), query);
+        for (size_t i = 0; i < found.size(); ++i) {
+            ASSERT_EQUAL_HINT(found[i].id, expected[i].id, query);
+            ASSERT_HINT(abs(found[i].relevance - expected[i].relevance) < EPSILON, query);
+        }
+    }
+
+    ASSERT(server.FindTopDocuments(QueryMode::ALL_WORDS, "cat unknown"s).empty());
+    ASSERT_EQUAL(server.FindTopDocuments(QueryMode::ANY_WORD, "cat unknown"s).size(), MAX_RESULT_DOCUMENT_COUNT);
+    ASSERT(server.FindTopDocuments(QueryMode::ALL_WORDS, "cat dog -dog"s).empty());
+
+    //        
+    const auto with_prefix = server.FindTopDocuments(QueryMode::ALL_WORDS, "collar word6*"s);
+    ASSERT_EQUAL(with_prefix.size(), MAX_RESULT_DOCUMENT_COUNT);
+    //   6  66  ,    66
+    ASSERT_EQUAL(with_prefix[0].id, 66);
+    ASSERT_EQUAL(with_prefix[1].id, 6);
+    ASSERT_EQUAL(server.FindTopDocuments(QueryMode::ALL_WORDS, "word1*"s).size(), MAX_RESULT_DOCUMENT_COUNT);
+
+    const auto banned = server.FindTopDocuments(QueryMode::ALL_WORDS, "collar fish"s, DocumentStatus::BANNED);
+    ASSERT_EQUAL(banned.size(), 4u);
+    for (const Document& document : banned) {
+        ASSERT_EQUAL(document.id % 60, 0);
+    }
+    ASSERT(server.FindTopDocuments(QueryMode::ALL_WORDS, "cat tail"s, [](int id, DocumentStatus, int) {
+        return id % 5 != 0;
+        }).empty());
+}
+
+void TestImpactOrder() {
+    SearchServer server("and"s);
+    server.EnableImpactOrder();
+    SearchServer plain_server("and"s);
+    TestRandom next_random(12345);
+    for (int id = 0; id < 400; ++id) {
+        string text;
+        const unsigned length = 1 + next_random(12);
+        for (unsigned i = 0; i < length; ++i) {
+            //     ,    
+            text += "w"s + to_string(next_random(1 + next_random(40))) + " "s;
+        }
+        const DocumentStatus status = id % 7 == 0 ? DocumentStatus::IRRELEVANT : DocumentStatus::ACTUAL;
+        server.AddDocument(id, text, status, { id });
+        plain_server.AddDocument(id, text, status, { id });
+    }
+
+    const vector<string> queries = { "w0"s, "w1 w2 w3"s, "w5 w17 w30 -w2"s, "w3*"s, "w10 w11 w12 w13 w14"s, "w39 w0"s,
+        "unknown"s };
+    const auto check_queries = [&](const string& hint) {
+        for (const string& query : queries) {
+            const auto expected = server.FindTopDocuments(query);
+            const auto found = server.FindTopDocumentsByImpact(query);
+            ASSERT_EQUAL_HINT(found.size(), expected.size(), hint + query);
+            for (size_t i = 0; i < found.size(); ++i) {
+                ASSERT_EQUAL_HINT(found[i].id, expected[i].id, hint + query);
+                ASSERT_HINT(abs(found[i].relevance - expected[i].relevance) < EPSILON, hint + query);
+            }
+            const auto irrelevant = server.FindTopDocumentsByImpact(query, DocumentStatus::IRRELEVANT);
+            ASSERT_EQUAL_HINT(irrelevant.size(), server.FindTopDocuments(query, DocumentStatus::IRRELEVANT).size(), query);
+            ASSERT_EQUAL_HINT(plain_server.FindTopDocumentsByImpact(query).size(), expected.size(), query);
+        }
+    };
+    check_queries(""s);
+    for (int id = 0; id < 400; id += 3) {
+        server.RemoveDocument(id);
+    }
+    server.RemoveDocument(execution::par, 1);
+    check_queries("  "s);
+
+    //         
+    const auto truncated = server.FindTopDocumentsByImpact("w0 w1 w2"s, DocumentStatus::ACTUAL, chrono::nanoseconds(0));
+    ASSERT(!truncated.empty() && truncated.size() <= MAX_RESULT_DOCUMENT_COUNT);
+    for (size_t i = 1; i < truncated.size(); ++i) {
+        ASSERT(truncated[i - 1].relevance > truncated[i].relevance - EPSILON);
+    }
+
+    const MemoryStats memory = server.GetMemoryStats();
+    const auto impacts = find_if(memory.components.begin(), memory.components.end(), [](const ComponentMemory& component) {
+        return component.name == "impacts"s;
+        });
+    ASSERT(impacts != memory.components.end() && impacts->bytes > 0);
+
+    ASSERT_THROWS(server.EnableImpactOrder(), logic_error);
+}
+
+void TestQueryLimits() {
+    SearchServer server("and"s);
+    for (int id = 0; id < 600; ++id) {
+        string text = "common w"s + to_string(id % 10) + " w"s + to_string(id % 13);
+        if (id % 100 == 0) {
+            text += " rare"s;
+        }
+        if (id % 50 == 1) {
+            text += " blocked"s;
+        }
+        server.AddDocument(id, text, id % 7 == 0 ? DocumentStatus::IRRELEVANT : DocumentStatus::ACTUAL, { id });
+    }
+
+    //      FindTopDocuments
+    for (const string& query : { "w1 w2"s, "common rare -w3"s, "w1* w12~"s, "rare"s, "unknown"s }) {
+        const auto expected = server.FindTopDocuments(query);
+        const auto found = server.FindTopDocumentsWithLimits(query, DocumentStatus::ACTUAL, {});
+        ASSERT_HINT(!found.truncated && found.reached_limit == QueryLimit::NONE, query);
+        ASSERT_EQUAL_HINT(found.documents.size(), expected.size(), query);
+        for (size_t i = 0; i < expected.size(); ++i) {
+            ASSERT_EQUAL_HINT(found.documents[i].id, expected[i].id, query);
+            ASSERT_HINT(abs(found.documents[i].relevance - expected[i].relevance) < EPSILON, query);
+        }
+    }
+
+    //    
+    QueryLimits limits;
+    limits.max_postings = 6;
+    auto result = server.FindTopDocumentsWithLimits("common rare"s, DocumentStatus::ACTUAL, limits);
+    ASSERT(result.truncated && result.reached_limit == QueryLimit::POSTINGS);
+    ASSERT_EQUAL(result.postings_scanned, 6u);
+    ASSERT_EQUAL(result.candidates, 5u);
+    ASSERT_EQUAL(result.documents.size(), 5u);
+    for (const Document& document : result.documents) {
+        ASSERT_EQUAL(document.id % 100, 0);
+    }
+
+    limits = {};
+    limits.max_candidates = 3;
+    result = server.FindTopDocumentsWithLimits("common -blocked"s, [](int, DocumentStatus, int rating) {
+        return rating % 5 != 0;
+        }, limits);
+    ASSERT(result.truncated && result.reached_limit == QueryLimit::CANDIDATES);
+    ASSERT_EQUAL(result.postings_scanned, 600u);
+    ASSERT_EQUAL(result.candidates, 3u);
+    ASSERT_EQUAL(result.documents.size(), 3u);
+    for (const Document& document : result.documents) {
+        ASSERT(document.id % 50 != 1 && document.rating % 5 != 0);
+    }
+    //       
+    size_t predicate_calls = 0;
+    result = server.FindTopDocumentsWithLimits("common"s, [&predicate_calls](int, DocumentStatus, int) {
+        ++predicate_calls;
+        return true;
+        }, limits);
+    ASSERT_EQUAL(result.candidates, 3u);
+    ASSERT_EQUAL(predicate_calls, 3u);
+
+    //         word*  word~
+    limits = {};
+    limits.time_budget = chrono::nanoseconds(0);
+    for (const string& query : { "common"s, "w1* w12~"s, "-w1* common"s }) {
+        result = server.FindTopDocumentsWithLimits(query, DocumentStatus::ACTUAL, limits);
+        ASSERT_HINT(result.truncated && result.reached_limit == QueryLimit::TIME, query);
+        ASSERT_EQUAL_HINT(result.postings_scanned, 0u, query);
+        ASSERT_HINT(result.documents.empty(), query);
+    }
+
+    limits.time_budget = chrono::hours(1);
+    result = server.FindTopDocumentsWithLimits("common"s, DocumentStatus::ACTUAL, limits);
+    ASSERT(!result.truncated && result.reached_limit == QueryLimit::NONE);
+    ASSERT_EQUAL(result.postings_scanned, 600u);
+}
+
+void TestShardedSearchServer() {
+    SearchServer server("and"s);
+    ShardedSearchServer sharded("and"s, 3);
+    TestRandom next_random(777);
+    for (int id = 0; id < 300; ++id) {
+        string text;
+        const unsigned length = 1 + next_random(10);
+        for (unsigned i = 0; i < length; ++i) {
+            text += "w"s + to_string(next_random(1 + next_random(30))) + " and "s;
+        }
+        const DocumentStatus status = id % 11 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL;
+        server.AddDocument(id, text, status, { id });
+        sharded.AddDocument(id, text, status, { id });
+    }
+    ASSERT_EQUAL(sharded.GetShardCount(), 3u);
+    ASSERT_EQUAL(sharded.GetShardIndex(301), 1u);
+
+    //  IDF    ,    
+    const auto check_queries = [&](const string& hint) {
+        ASSERT_EQUAL_HINT(sharded.GetDocumentCount(), server.GetDocumentCount(), hint);
+        for (const string& query : { "w0"s, "w1 w2 w3"s, "w4 w20 -w1"s, "w2*"s, "w13~"s, "w29 w0"s, "unknown"s }) {
+            for (const DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::BANNED }) {
+                const auto expected = server.FindTopDocuments(query, status);
+                const auto found = sharded.FindTopDocuments(query, status);
+                ASSERT_EQUAL_HINT(found.size(), expected.size(), hint + query);
+                for (size_t i = 0; i < found.size(); ++i) {
+                    ASSERT_EQUAL_HINT(found[i].id, expected[i].id, hint + query);
+                    ASSERT_HINT(abs(found[i].relevance - expected[i].relevance) < EPSILON, hint + query);
+                }
+            }
+        }
+    };
+    check_queries(""s);
+    for (int id = 0; id < 300; id += 4) {
+        server.RemoveDocument(id);
+        sharded.RemoveDocument(id);
+    }
+    sharded.RemoveDocument(1000);
+    check_queries("  "s);
+
+    //  "word*"  "word~"    ,     
+    {
+        SearchServer single("and"s);
+        ShardedSearchServer two_shards("and"s, 2);
+        for (int id = 0; id < 100; ++id) {
+            const string word = (id < 10 ? "p00"s : "p0"s) + to_string(id);
+            single.AddDocument(id, word, DocumentStatus::ACTUAL, { id });
+            two_shards.AddDocument(id, word, DocumentStatus::ACTUAL, { id });
+        }
+        for (const string& query : { "p*"s, "p0~2"s, "p0~2 p*"s }) {
+            const auto expected = single.FindTopDocuments(query);
+            const auto found = two_shards.FindTopDocuments(query);
+            ASSERT_EQUAL_HINT(found.size(), expected.size(), query);
+            for (size_t i = 0; i < found.size(); ++i) {
+                ASSERT_EQUAL_HINT(found[i].id, expected[i].id, query);
+                ASSERT_HINT(abs(found[i].relevance - expected[i].relevance) < EPSILON, query);
+            }
+        }
+        ASSERT_EQUAL(two_shards.FindTopDocuments("p*"s)[0].id, MAX_PREFIX_EXPANSION_COUNT - 1);
+
+        CorpusStatistics statistics = single.GetCorpusStatistics("p*"s);
+        ASSERT_THROWS(statistics += single.GetCorpusStatistics("p* q*"s), invalid_argument);
+        ASSERT_THROWS(single.FindTopDocuments("p~"s, DocumentStatus::ACTUAL, statistics), invalid_argument);
+    }
+
+    //     
+    for (const auto& action : vector<function<void()>>{
+        [&sharded] { sharded.AddDocument(5, "w1"s, DocumentStatus::ACTUAL, { 1 }); },
+        [&sharded] { sharded.AddDocument(-1, "w1"s, DocumentStatus::ACTUAL, { 1 }); },
+        [&sharded] { sharded.FindTopDocuments("--w1"s); },
+        [] { ShardedSearchServer("and"s, 0); } }) {
+        ASSERT_THROWS(action(), invalid_argument);
+    }
+}
+
+//     ,       
+static string MakeTemporaryPath(const string& name) {
+    static unsigned counter = 0;
+    const string unique_name = name + "_"s + to_string(random_device{}()) + "_"s + to_string(counter++);
+    return (filesystem::temp_directory_path() / unique_name).string();
+}
+
+void TestSearchDaemon() {
+    //      
+    {
+        string frames;
+        AppendFrame(frames, SearchRequest{ 7, DocumentStatus::BANNED, " -"s });
+        AppendFrame(frames, SearchReply{ 8, ReplyCode::OK, { { 3, 0.25, -2 }, { 1, 0.125, 4 } }, {} });
+        const size_t request_size = GetFrameSize(frames);
+        ASSERT_EQUAL(GetFrameSize(string_view(frames).substr(0, request_size - 1)), 0u);
+        const SearchRequest request = ParseRequest(string_view(frames).substr(FRAME_HEADER_SIZE, request_size - FRAME_HEADER_SIZE));
+        ASSERT_EQUAL(request.request_id, 7u);
+        ASSERT(request.status == DocumentStatus::BANNED);
+        ASSERT_EQUAL(request.raw_query, " -"s);
+        const string_view reply_frame = string_view(frames).substr(request_size);
+        ASSERT_EQUAL(GetFrameSize(reply_frame), reply_frame.size());
+        const SearchReply reply = ParseReply(reply_frame.substr(FRAME_HEADER_SIZE));
+        ASSERT_EQUAL(reply.request_id, 8u);
+        ASSERT_EQUAL(reply.documents.size(), 2u);
+        ASSERT_EQUAL(reply.documents[1].id, 1);
+        ASSERT_EQUAL(reply.documents[1].relevance, 0.125);
+        ASSERT_EQUAL(reply.documents[0].rating, -2);
+
+        ASSERT_THROWS(ParseReply(reply_frame.substr(FRAME_HEADER_SIZE, 10)), invalid_argument);
+    }
+
+    SearchServer server("and"s);
+    for (int id = 0; id < 100; ++id) {
+        server.AddDocument(id, "w"s + to_string(id % 7) + " and w"s + to_string(id % 13), id % 9 == 0
+            ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, { id });
+    }
+    const string socket_path = MakeTemporaryPath("search_daemon_test.sock"s);
+    SearchDaemon daemon(server, socket_path, { 16, chrono::microseconds(500) });
+
+    //      
+    SearchClient client(socket_path);
+    for (const string& query : { "w1"s, "w2 w3"s, "w4 -w5"s, "w1*"s, "unknown"s }) {
+        for (const DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::BANNED }) {
+            const auto expected = server.FindTopDocuments(query, status);
+            const auto found = client.FindTopDocuments(query, status);
+            ASSERT_EQUAL_HINT(found.size(), expected.size(), query);
+            for (size_t i = 0; i < found.size(); ++i) {
+                ASSERT_EQUAL_HINT(found[i].id, expected[i].id, query);
+                ASSERT_EQUAL_HINT(found[i].relevance, expected[i].relevance, query);
+                ASSERT_EQUAL_HINT(found[i].rating, expected[i].rating, query);
+            }
+        }
+    }
+    ASSERT_THROWS(client.FindTopDocuments("--w1"s), invalid_argument);
+    //       ,    
+    ASSERT_THROWS(client.FindTopDocuments("\"w1 w2\""s), runtime_error);
+    ASSERT_EQUAL(client.FindTopDocuments("w2"s).size(), server.FindTopDocuments("w2"s).size());
+
+    //      
+    const LoadReport report = RunLoad(socket_path, { "w1"s, "w2 w3"s, "--w1"s }, { 4, 60, 8 });
+    ASSERT_EQUAL(report.requests, 240u);
+    ASSERT_EQUAL(report.invalid_queries, 80u);
+    const SearchDaemon::Stats stats = daemon.GetStats();
+    ASSERT_EQUAL(stats.connections, 5u);
+    ASSERT_EQUAL(stats.requests, 240u + 13u);
+    ASSERT(stats.batches < stats.requests);
+
+    //     
+    ASSERT_THROWS(SearchDaemon(server, socket_path), runtime_error);
+
+    // ,   ,    
+    {
+        SearchClient silent(socket_path);
+        for (uint32_t request_id = 0; request_id < 20'000; ++request_id) {
+            silent.Send({ request_id, DocumentStatus::ACTUAL, "w1 w2"s });
+        }
+        ASSERT_EQUAL(client.FindTopDocuments("w3"s).size(), server.FindTopDocuments("w3"s).size());
+    }
+    ASSERT_EQUAL(client.FindTopDocuments("w4"s).size(), server.FindTopDocuments("w4"s).size());
+
+    //   max_pending_requests     ,     
+    {
+        const string limited_path = socket_path + ".limited"s;
+        SearchDaemon limited(server, limited_path, { 16, chrono::microseconds(500), 1 });
+        SearchClient pipelined(limited_path);
+        const uint32_t request_count = 500;
+        for (uint32_t request_id = 0; request_id < request_count; ++request_id) {
+            pipelined.Send({ request_id, DocumentStatus::ACTUAL, "w1 w2"s });
+        }
+        for (uint32_t request_id = 0; request_id < request_count; ++request_id) {
+            ASSERT_EQUAL(pipelined.Receive().request_id, request_id);
+        }
+        // so every batch has the one request the connection may have in flight
+        const SearchDaemon::Stats limited_stats = limited.GetStats();
+        ASSERT_EQUAL(limited_stats.requests, request_count);
+        ASSERT_EQUAL(limited_stats.batches, request_count);
+    }
+
+    daemon.Stop();
+    ASSERT_THROWS(SearchClient(socket_path), runtime_error);
+}
+
+#ifdef SEARCH_SERVER_HAS_COROUTINES
+QueryTask<void> SearchAsync(const SearchServer& server, QueryExecutor& executor, string query, DocumentStatus status,
+    vector<Document>& found, vector<string>& finished) {
+    found = co_await server.FindTopDocumentsAsync(executor, query, status);
+    finished.push_back(query);
+}
+
+QueryTask<void> SearchInvalidAsync(const SearchServer& server, QueryExecutor& executor, bool& thrown) {
+    try {
+        co_await server.FindTopDocumentsAsync(executor, "--w1"s);
+    }
+    catch (const invalid_argument&) {
+        thrown = true;
+    }
+}
+
+QueryTask<void> SearchUncaughtAsync(const SearchServer& server, QueryExecutor& executor) {
+    co_await server.FindTopDocumentsAsync(executor, "w1 -"s);
+}
+#endif
+
+void TestFindTopDocumentsAsync() {
+#ifdef SEARCH_SERVER_HAS_COROUTINES
+    SearchServer server("and"s);
+    for (int id = 0; id < 3000; ++id) {
+        server.AddDocument(id, "common and w"s + to_string(id % 7) + (id == 2999 ? " rare"s : ""s),
+            id % 5 == 0 ? DocumentStatus::BANNED : DocumentStatus::ACTUAL, { id % 17 });
+    }
+    const vector<pair<string, DocumentStatus>> queries = { { "common"s, DocumentStatus::ACTUAL },
+        { "rare"s, DocumentStatus::ACTUAL }, { "w1 w2 -w3"s, DocumentStatus::BANNED }, { "w4 -common"s, DocumentStatus::ACTUAL },
+        { "w1*"s, DocumentStatus::ACTUAL }, { "unknown"s, DocumentStatus::ACTUAL } };
+
+    //    FindTopDocuments,     
+    QueryExecutor executor;
+    vector<vector<Document>> found(queries.size());
+    vector<string> finished;
+    for (size_t i = 0; i < queries.size(); ++i) {
+        executor.Spawn(SearchAsync(server, executor, queries[i].first, queries[i].second, found[i], finished));
+    }
+    ASSERT_EQUAL(executor.GetTaskCount(), queries.size());
+    ASSERT(executor.Run() > queries.size());
+    ASSERT_EQUAL(executor.GetTaskCount(), 0u);
+    ASSERT_EQUAL(finished.size(), queries.size());
+    ASSERT_EQUAL(finished[0], "rare"s);
+    ASSERT_EQUAL(finished.back(), "common"s);
+    for (size_t i = 0; i < queries.size(); ++i) {
+        const auto expected = server.FindTopDocuments(queries[i].first, queries[i].second);
+        ASSERT_EQUAL_HINT(found[i].size(), expected.size(), queries[i].first);
+        //         
+        for (size_t j = 0; j < expected.size(); ++j) {
+            ASSERT_EQUAL_HINT(found[i][j].rating, expected[j].rating, queries[i].first);
+            ASSERT_HINT(abs(found[i][j].relevance - expected[j].relevance) < EPSILON, queries[i].first);
+        }
+    }
+
+    // ,        ,   
+    vector<Document> removed;
+    executor.Spawn(SearchAsync(server, executor, "common"s, DocumentStatus::REMOVED, removed, finished));
+    ASSERT(executor.Run() > 3000 / ASYNC_CHUNK_POSTING_COUNT);
+    ASSERT(removed.empty());
+
+    //     co_await,  -  Run
+    bool thrown = false;
+    executor.Spawn(SearchInvalidAsync(server, executor, thrown));
+    executor.Run();
+    ASSERT(thrown);
+    executor.Spawn(SearchUncaughtAsync(server, executor));
+    ASSERT_THROWS(executor.Run(), invalid_argument);
+    ASSERT_EQUAL(executor.GetTaskCount(), 0u);
+
+    //      
+    {
+        QueryExecutor unfinished_executor;
+        unfinished_executor.Spawn(SearchAsync(server, unfinished_executor, "common"s, DocumentStatus::ACTUAL, found[0], finished));
+        ASSERT_EQUAL(unfinished_executor.GetTaskCount(), 1u);
+    }
+#endif
+}
+
+void TestQueryScheduler() {
+    SearchServer server("and"s);
+    for (int id = 0; id < 400; ++id) {
+        server.AddDocument(id, "common and w"s + to_string(id % 20) + (id % 100 == 0 ? " rare"s : ""s),
+            DocumentStatus::ACTUAL, { id % 13 });
+    }
+    //   -   ,   
+    ASSERT_EQUAL(server.EstimateQueryCost("rare"s), 4u);
+    ASSERT_EQUAL(server.EstimateQueryCost("w1 -rare"s), 24u);
+    ASSERT_EQUAL(server.EstimateQueryCost("common w1"s), 420u);
+    ASSERT_EQUAL(server.EstimateQueryCost("unknown and"s), 0u);
+
+    using Result = future<vector<Document>>;
+    const auto is_ready = [](const Result& result) {
+        return result.wait_for(chrono::seconds(0)) == future_status::ready;
+    };
+    const auto get_rejection = [](Result& result) -> optional<RejectionReason> {
+        try {
+            result.get();
+        }
+        catch (const QueryRejectedError& error) {
+            return error.GetReason();
+        }
+        return nullopt;
+    };
+
+    //           
+    {
+        QuerySchedulerOptions options;
+        options.worker_count = 0;
+        options.max_queue_depth = 4;
+        options.max_queued_cost = 10'000;
+        options.interactive_cost_limit = 100;
+        QueryScheduler scheduler(server, options);
+        vector<Result> expensive;
+        for (const string& query : { "common"s, "common w1"s, "common w2"s }) {
+            expensive.push_back(scheduler.Submit(query));
+        }
+        Result rare = scheduler.Submit("rare"s);
+        Result short_query = scheduler.Submit("w3"s);
+        ASSERT(get_rejection(expensive[2]) == RejectionReason::SHED);
+        ASSERT_EQUAL(scheduler.GetStats().queue_depth, 4u);
+        ASSERT_EQUAL(scheduler.GetStats().queued_cost, 400u + 420u + 4u + 20u);
+
+        ASSERT(scheduler.RunNext());
+        ASSERT(is_ready(rare) && !is_ready(short_query) && !is_ready(expensive[0]));
+        ASSERT(scheduler.RunNext());
+        ASSERT(is_ready(short_query) && !is_ready(expensive[0]));
+        ASSERT(scheduler.RunNext());
+        ASSERT(scheduler.RunNext());
+        ASSERT(!scheduler.RunNext());
+        const auto expected = server.FindTopDocuments("common w1"s);
+        const auto found = expensive[1].get();
+        ASSERT_EQUAL(found.size(), expected.size());
+        for (size_t i = 0; i < found.size(); ++i) {
+            ASSERT_EQUAL(found[i].id, expected[i].id);
+        }
+        ASSERT_EQUAL(rare.get().size(), 4u);
+
+        const QueryScheduler::Stats stats = scheduler.GetStats();
+        ASSERT_EQUAL(stats.submitted, 5u);
+        ASSERT_EQUAL(stats.completed, 4u);
+        ASSERT_EQUAL(stats.shed, 1u);
+        ASSERT_EQUAL(stats.peak_queue_depth, 4u);
+        ASSERT_EQUAL(stats.queue_depth, 0u);
+        ASSERT_EQUAL(stats.queue_wait[static_cast<size_t>(QueryPriority::INTERACTIVE)].GetCount(), 2u);
+    }
+
+    // ,   ,  ;      
+    {
+        QuerySchedulerOptions options;
+        options.worker_count = 0;
+        options.max_queue_depth = 2;
+        options.max_queued_cost = 500;
+        options.interactive_cost_limit = 100;
+        QueryScheduler scheduler(server, options);
+        Result first = scheduler.Submit("rare"s);
+        Result second = scheduler.Submit("w1"s);
+        Result third = scheduler.Submit("w2"s);
+        ASSERT(get_rejection(third) == RejectionReason::QUEUE_FULL);
+        ASSERT(scheduler.RunNext());
+        ASSERT(scheduler.RunNext());
+        Result expensive = scheduler.Submit("common w1"s);
+        Result too_expensive = scheduler.Submit("common w2"s);
+        ASSERT(get_rejection(too_expensive) == RejectionReason::QUEUE_FULL);
+        ASSERT_EQUAL(scheduler.GetStats().rejected, 2u);
+    }
+
+    //    ,    
+    Result abandoned;
+    {
+        QuerySchedulerOptions options;
+        options.worker_count = 0;
+        QueryScheduler scheduler(server, options);
+        Result expired = scheduler.Submit("w1"s, DocumentStatus::ACTUAL, QueryPriority::INTERACTIVE,
+            QueryScheduler::Clock::now() - chrono::milliseconds(1));
+        Result fresh = scheduler.Submit("w2"s, DocumentStatus::ACTUAL, QueryPriority::BATCH,
+            QueryScheduler::Clock::now() + chrono::hours(1));
+        ASSERT(scheduler.RunNext());
+        ASSERT(get_rejection(expired) == RejectionReason::DEADLINE_EXPIRED);
+        ASSERT(is_ready(fresh));
+        ASSERT_EQUAL(scheduler.GetStats().expired, 1u);
+
+        ASSERT_THROWS(scheduler.Submit("w1 --w2"s), invalid_argument);
+        abandoned = scheduler.Submit("w3"s);
+    }
+    ASSERT(get_rejection(abandoned) == RejectionReason::SHED);
+
+    //  :       ,  
+    {
+        QuerySchedulerOptions options;
+        options.worker_count = 2;
+        options.max_queue_depth = 16;
+        options.max_queued_cost = 1'000'000;
+        options.interactive_cost_limit = 100;
+        QueryScheduler scheduler(server, options);
+        vector<Result> results;
+        for (int i = 0; i < 300; ++i) {
+            results.push_back(scheduler.Submit(i % 10 == 0 ? "common w"s + to_string(i % 20) : "w"s + to_string(i % 20)));
+        }
+        size_t answered = 0;
+        size_t rejected = 0;
+        for (Result& result : results) {
+            get_rejection(result) ? ++rejected : ++answered;
+        }
+        ASSERT_EQUAL(answered + rejected, 300u);
+        const QueryScheduler::Stats stats = scheduler.GetStats();
+        ASSERT_EQUAL(stats.submitted, 300u);
+        ASSERT_EQUAL(stats.completed, answered);
+        ASSERT_EQUAL(stats.rejected + stats.shed + stats.expired, rejected);
+        ASSERT(stats.peak_queue_depth <= 16u);
+    }
+}
+
+void TestStatisticsSnapshots() {
+    SearchServer live("and"s);
+    SearchServer server("and"s);
+    server.EnableStatisticsSnapshots(0.1);
+    ASSERT_EQUAL(server.GetStatisticsGeneration(), 1u);
+    for (int id = 0; id < 100; ++id) {
+        const string text = "cat and w"s + to_string(id % 10) + (id % 3 == 0 ? " dog"s : ""s);
+        live.AddDocument(id, text, DocumentStatus::ACTUAL, { id });
+        server.AddDocument(id, text, DocumentStatus::ACTUAL, { id });
+    }
+    ASSERT(server.GetStatisticsGeneration() > 1u);
+    server.RefreshStatistics();
+
+    const auto get_relevances = [](const SearchServer& search_server, const string& query) {
+        map<int, double> relevances;
+        for (const Document& document : search_server.FindPage(query, 0, 1000)) {
+            relevances[document.id] = document.relevance;
+        }
+        return relevances;
+    };
+    const auto assert_equal_relevances = [](const map<int, double>& lhs, const map<int, double>& rhs, const string& hint) {
+        for (const auto& [id, relevance] : lhs) {
+            ASSERT_HINT(rhs.count(id) > 0 && abs(rhs.at(id) - relevance) < EPSILON, hint);
+        }
+    };
+    //        
+    const auto before = get_relevances(server, "dog w1"s);
+    assert_equal_relevances(before, get_relevances(live, "dog w1"s), " "s);
+
+    //     10% ,     
+    const uint64_t generation = server.GetStatisticsGeneration();
+    for (int id = 100; id < 110; ++id) {
+        live.AddDocument(id, "dog w1 w5"s, DocumentStatus::ACTUAL, { 1 });
+        server.AddDocument(id, "dog w1 w5"s, DocumentStatus::ACTUAL, { 1 });
+    }
+    ASSERT_EQUAL(server.GetStatisticsGeneration(), generation);
+    assert_equal_relevances(before, get_relevances(server, "dog w1"s), " "s);
+    ASSERT(abs(get_relevances(live, "dog w1"s).at(3) - before.at(3)) > EPSILON);
+
+    //    ,   
+    live.RemoveDocument(0);
+    server.RemoveDocument(0);
+    ASSERT_EQUAL(server.GetStatisticsGeneration(), generation + 1);
+    assert_equal_relevances(get_relevances(live, "dog w1 cat"s), get_relevances(server, "dog w1 cat"s), " "s);
+
+    //          
+    live.AddDocument(200, "zebra cat"s, DocumentStatus::ACTUAL, { 1 });
+    server.AddDocument(200, "zebra cat"s, DocumentStatus::ACTUAL, { 1 });
+    ASSERT(abs(server.FindTopDocuments("zebra"s)[0].relevance - 0.5 * log(109.0)) < EPSILON);
+    ASSERT(abs(live.FindTopDocuments("zebra"s)[0].relevance - 0.5 * log(110.0)) < EPSILON);
+
+    const auto statistics_bytes = [](const SearchServer& search_server) {
+        const MemoryStats memory = search_server.GetMemoryStats();
+        const auto statistics = find_if(memory.components.begin(), memory.components.end(), [](const ComponentMemory& component) {
+            return component.name == "statistics"s;
+            });
+        ASSERT(statistics != memory.components.end());
+        return statistics->bytes;
+    };
+    ASSERT(statistics_bytes(server) > 0u);
+    ASSERT_EQUAL(statistics_bytes(live), 0u);
+}
+
+void TestDocumentLoader() {
+    {
+        const string data = "1\tACTUAL\t1 2 3\tcat and dog\n\n7\tBANNED\t\tdog\r\n"s;
+        const vector<DocumentRecord> records = ParseDocuments(data, DocumentFormat::TSV);
+        ASSERT_EQUAL(records.size(), 2u);
+        ASSERT_EQUAL(records[0].id, 1);
+        ASSERT(records[0].status == DocumentStatus::ACTUAL);
+        ASSERT(records[0].ratings == vector<int>({ 1, 2, 3 }));
+        ASSERT_EQUAL(records[0].text, "cat and dog"sv);
+        //     
+        ASSERT(records[0].text.data() == data.data() + data.find("cat"s));
+        ASSERT_EQUAL(records[1].id, 7);
+        ASSERT(records[1].status == DocumentStatus::BANNED);
+        ASSERT(records[1].ratings.empty());
+        ASSERT_EQUAL(records[1].text, "dog"sv);
+    }
+    for (const string& data : { "1\tACTUAL\t1\tcat\nx\tACTUAL\t\tdog\n"s, "1\tACTUAL\t1\tcat\n2\tNEW\t\tdog\n"s,
+        "1\tACTUAL\t1\tcat\n2\tACTUAL\t1 b\tdog\n"s, "1\tACTUAL\t1\tcat\n2 ACTUAL dog\n"s }) {
+        try {
+            ParseDocuments(data, DocumentFormat::TSV);
+            ASSERT_HINT(false, data);
+        }
+        catch (const invalid_argument& error) {
+            //     ,     
+            ASSERT_HINT(string(error.what()).find(" 2: "s) != string::npos, error.what());
+        }
+    }
+    {
+        //  ,      
+        string data;
+        for (int line = 0; line < 50'000; ++line) {
+            if (line % 100 != 99) {
+                data += "word"s + to_string(line) + " common\n"s;
+            }
+            else {
+                data += "\n"s;
+            }
+        }
+        const vector<DocumentRecord> records = ParseDocuments(data, DocumentFormat::LINES);
+        ASSERT_EQUAL(records.size(), 49'500u);
+        for (const DocumentRecord& record : records) {
+            ASSERT_EQUAL(record.text, "word"s + to_string(record.id) + " common"s);
+        }
+        ASSERT_EQUAL(records.back().id, 49'998);
+    }
+
+    const string path = MakeTemporaryPath("search_server_test_documents.tsv"s);
+    {
+        ofstream file(path, ios::binary);
+        file << "3\tACTUAL\t5\tcurly cat and dog\n1\tACTUAL\t1 3\tcurly dog\n2\tBANNED\t9\tcat\n"s;
+    }
+    SearchServer loaded("and"s);
+    ASSERT_EQUAL(LoadDocuments(loaded, path), 3u);
+    SearchServer added("and"s);
+    added.AddDocument(3, "curly cat and dog"s, DocumentStatus::ACTUAL, { 5 });
+    added.AddDocument(1, "curly dog"s, DocumentStatus::ACTUAL, { 1, 3 });
+    added.AddDocument(2, "cat"s, DocumentStatus::BANNED, { 9 });
+    for (const DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::BANNED }) {
+        const auto expected = added.FindTopDocuments("curly cat"s, status);
+        const auto found = loaded.FindTopDocuments("curly cat"s, status);
+        ASSERT_EQUAL(found.size(), expected.size());
+        for (size_t i = 0; i < found.size(); ++i) {
+            ASSERT_EQUAL(found[i].id, expected[i].id);
+            ASSERT_EQUAL(found[i].rating, expected[i].rating);
+            ASSERT(abs(found[i].relevance - expected[i].relevance) < EPSILON);
+        }
+    }
+
+    //         
+    {
+        ofstream file(path, ios::binary);
+        file << "10\tACTUAL\t1\tparrot\n3\tACTUAL\t1\tparrot\n"s;
+    }
+    ASSERT_THROWS(LoadDocuments(loaded, path), invalid_argument);
+    ASSERT_EQUAL(loaded.GetDocumentCount(), 3);
+    ASSERT(loaded.FindTopDocuments("parrot"s).empty());
+    filesystem::remove(path);
+
+    const string bad_text = "bad\x01text"s;
+    ASSERT_THROWS(loaded.AddDocuments(execution::par, { { 10, DocumentStatus::ACTUAL, {}, "parrot"sv }, { 11, DocumentStatus::ACTUAL, {}, bad_text } }), invalid_argument);
+    ASSERT_EQUAL(loaded.GetDocumentCount(), 3);
+    loaded.AddDocuments({ { 10, DocumentStatus::ACTUAL, { 4 }, "parrot"sv } });
+    ASSERT_EQUAL(loaded.FindTopDocuments("parrot"s)[0].rating, 4);
+
+    ASSERT_THROWS(MappedFile(path), runtime_error);
+}
+
+void TestWriteAheadLog() {
+    const string path = MakeTemporaryPath("search_server_test.wal"s);
+    SearchServer server("and"s);
+    ASSERT_EQUAL(ReplayWriteAheadLog(server, path).records, 0u);
+    {
+        WriteAheadLog log(path, { WalDurability::SYNC });
+        log.AddDocument(server, 1, "curly cat and dog"s, DocumentStatus::ACTUAL, { 1, 2 });
+        log.AddDocument(server, 2, "curly dog"s, DocumentStatus::BANNED, { -3 });
+        log.AddDocument(server, 3, "parrot"s, DocumentStatus::ACTUAL, {});
+        log.RemoveDocument(server, 3);
+        //      
+        ASSERT_THROWS(log.AddDocument(server, 1, "cat"s, DocumentStatus::ACTUAL, {}), invalid_argument);
+        ASSERT_EQUAL(log.GetStats().records, 4u);
+        ASSERT_EQUAL(log.GetStats().syncs, 4u);
+    }
+    const auto assert_replayed = [&server](const SearchServer& replayed) {
+        ASSERT_EQUAL(replayed.GetDocumentCount(), server.GetDocumentCount());
+        for (const DocumentStatus status : { DocumentStatus::ACTUAL, DocumentStatus::BANNED }) {
+            const auto expected = server.FindTopDocuments("curly cat parrot"s, status);
+            const auto found = replayed.FindTopDocuments("curly cat parrot"s, status);
+            ASSERT_EQUAL(found.size(), expected.size());
+            for (size_t i = 0; i < found.size(); ++i) {
+                ASSERT_EQUAL(found[i].id, expected[i].id);
+                ASSERT_EQUAL(found[i].rating, expected[i].rating);
+                ASSERT(abs(found[i].relevance - expected[i].relevance) < EPSILON);
+            }
+        }
+    };
+    {
+        SearchServer replayed("and"s);
+        const WalReplayResult result = ReplayWriteAheadLog(replayed, path);
+        ASSERT_EQUAL(result.records, 4u);
+        ASSERT_EQUAL(result.discarded_bytes, 0u);
+        assert_replayed(replayed);
+        //    ,      
+        ASSERT_THROWS(ReplayWriteAheadLog(replayed, path), invalid_argument);
+    }
+
+    //     ,     
+    const uintmax_t log_size = filesystem::file_size(path);
+    {
+        ofstream file(path, ios::binary | ios::app);
+        file << "\x10\x00\x00"s;
+    }
+    {
+        SearchServer replayed("and"s);
+        const WalReplayResult result = ReplayWriteAheadLog(replayed, path);
+        ASSERT_EQUAL(result.records, 4u);
+        ASSERT_EQUAL(result.discarded_bytes, 3u);
+        ASSERT_EQUAL(filesystem::file_size(path), log_size);
+        assert_replayed(replayed);
+    }
+    {
+        WriteAheadLog log(path, { WalDurability::WRITE });
+        log.AddDocument(server, 4, "white cat"s, DocumentStatus::ACTUAL, { 7 });
+        ASSERT_EQUAL(log.GetStats().syncs, 0u);
+    }
+    {
+        SearchServer replayed("and"s);
+        ASSERT_EQUAL(ReplayWriteAheadLog(replayed, path).records, 5u);
+        assert_replayed(replayed);
+    }
+
+    //          
+    {
+        fstream file(path, ios::binary | ios::in | ios::out);
+        file.seekp(-1, ios::end);
+        file.put('X');
+    }
+    {
+        SearchServer replayed("and"s);
+        const WalReplayResult result = ReplayWriteAheadLog(replayed, path);
+        ASSERT_EQUAL(result.records, 4u);
+        ASSERT_EQUAL(filesystem::file_size(path), log_size);
+        ASSERT(replayed.FindTopDocuments("white"s).empty());
+    }
+
+    //     ,    , - ,   
+    {
+        ofstream file(path, ios::binary | ios::app);
+        file << "\x05\x00\x00\x00\x68\x4c\xbe\xcc\x07\x01\x00\x00\x00"s;
+    }
+    {
+        SearchServer replayed("and"s);
+        ASSERT_THROWS(ReplayWriteAheadLog(replayed, path), invalid_argument);
+    }
+    ASSERT_EQUAL(filesystem::file_size(path), log_size + 13);
+
+    //  :    
+    {
+        WriteAheadLog log(path, { WalDurability::GROUP_COMMIT, 2, chrono::hours(1) });
+        log.Reset();
+        ASSERT_EQUAL(filesystem::file_size(path), 0u);
+        SearchServer group_server("and"s);
+        log.AddDocument(group_server, 1, "cat"s, DocumentStatus::ACTUAL, {});
+        ASSERT_EQUAL(log.GetStats().syncs, 0u);
+        ASSERT_EQUAL(filesystem::file_size(path), 0u);
+        log.AddDocument(group_server, 2, "dog"s, DocumentStatus::ACTUAL, {});
+        ASSERT_EQUAL(log.GetStats().syncs, 1u);
+        log.RemoveDocument(group_server, 1);
+        log.Sync();
+        ASSERT_EQUAL(log.GetStats().syncs, 2u);
+        SearchServer replayed("and"s);
+        ASSERT_EQUAL(ReplayWriteAheadLog(replayed, path).records, 3u);
+        ASSERT_EQUAL(replayed.GetDocumentCount(), 1);
+    }
+    // ...    
+    {
+        WriteAheadLog log(path, { WalDurability::GROUP_COMMIT, 1000, chrono::milliseconds(1) });
+        SearchServer group_server("and"s);
+        log.AddDocument(group_server, 5, "cat"s, DocumentStatus::ACTUAL, {});
+        log.WaitForSyncs(1);
+        ASSERT_EQUAL(log.GetStats().syncs, 1u);
+    }
+    filesystem::remove(path);
+
+    //  :  ,    ,    
+    if (filesystem::exists("/dev/full"s)) {
+        SearchServer full_server("and"s);
+        full_server.AddDocument(1, "cat"s, DocumentStatus::ACTUAL, {});
+        {
+            WriteAheadLog log("/dev/full"s, { WalDurability::SYNC });
+            ASSERT_THROWS(log.AddDocument(full_server, 2, "dog"s, DocumentStatus::ACTUAL, {}), runtime_error);
+            ASSERT_THROWS(log.RemoveDocument(full_server, 1), runtime_error);
+            ASSERT_EQUAL(full_server.GetDocumentCount(), 1);
+            ASSERT_EQUAL(full_server.FindTopDocuments("cat"s).size(), 1u);
+            ASSERT_EQUAL(log.GetStats().records, 0u);
+        }
+        {
+            WriteAheadLog log("/dev/full"s, { WalDurability::GROUP_COMMIT, 1, chrono::hours(1) });
+            log.AddDocument(full_server, 3, "bird"s, DocumentStatus::ACTUAL, {});
+            ASSERT_EQUAL(full_server.GetDocumentCount(), 2);
+            ASSERT_THROWS(log.AddDocument(full_server, 4, "fish"s, DocumentStatus::ACTUAL, {}), runtime_error);
+            ASSERT_EQUAL(full_server.GetDocumentCount(), 2);
+            ASSERT_THROWS(log.Sync(), runtime_error);
+            ASSERT_EQUAL(log.GetStats().records, 1u);
+            ASSERT_EQUAL(log.GetStats().syncs, 0u);
+        }
+    }
+}
+
+void TestStopWordSet() {
+    StopWordSet empty;
+    empty.Assign({});
+    ASSERT_EQUAL(empty.size(), 0u);
+    ASSERT(!empty.Contains("in"s));
+    ASSERT(!empty.Contains(""s));
+
+    const auto counter = make_shared<MemoryCounter>();
+    StopWordSet stop_words(counter);
+    vector<string> words;
+    for (int i = 0; i < 1000; ++i) {
+        words.push_back("w"s + to_string(i * 7));
+    }
+    words.push_back(string(100, 'x'));
+    const vector<string_view> views(words.begin(), words.end());
+    stop_words.Assign(views);
+    ASSERT_EQUAL(stop_words.size(), words.size());
+    ASSERT(counter->bytes > 0);
+    for (const string& word : words) {
+        ASSERT_HINT(stop_words.Contains(word), word);
+    }
+    //      ,   
+    for (int i = 0; i < 1000; ++i) {
+        const string word = "w"s + to_string(i * 7 + 1);
+        ASSERT_HINT(stop_words.Contains(word) == (find(words.begin(), words.end(), word) != words.end()), word);
+    }
+    ASSERT(!stop_words.Contains(""s));
+    ASSERT(!stop_words.Contains("v1"s));
+    ASSERT(!stop_words.Contains(string(99, 'x')));
+    ASSERT(!stop_words.Contains(string(101, 'x')));
+    ASSERT(!stop_words.Contains(string(99, 'x') + 'y'));
+
+    //     ,  - 
+    const int64_t bytes = counter->bytes.load();
+    for (const vector<string_view>& invalid : { vector<string_view>{ "in"sv, "on"sv, "in"sv }, vector<string_view>{ "in"sv, ""sv } }) {
+        ASSERT_THROWS(stop_words.Assign(invalid), invalid_argument);
+        ASSERT_EQUAL(stop_words.size(), words.size());
+        ASSERT(stop_words.Contains(words.front()) && !stop_words.Contains("in"s));
+        ASSERT_EQUAL(counter->bytes.load(), bytes);
+    }
+
+    //   -   ,   
+    SearchServer server(vector<string>{ "in"s, "the"s, "a"s });
+    server.AddDocument(1, "cat in the city"s, DocumentStatus::ACTUAL, { 1 });
+    ASSERT(server.FindTopDocuments("in the"s).empty());
+    ASSERT_EQUAL(server.FindTopDocuments("a city"s).size(), 1u);
+    ASSERT_EQUAL(server.GetWordFrequencies(1).size(), 2u);
+}
+
+void TestTextAnalysis() {
+    // UTF-8   ,       
+    const TextAnalyzer analyzer;
+    ASSERT(!analyzer.NormalizeDocument("curly dog 42"s));
+    ASSERT_EQUAL(*analyzer.NormalizeDocument("Curly, DOG!  42"s), "curly dog 42"s);
+    ASSERT_EQUAL(*analyzer.NormalizeDocument("\xD0\x9F\xD1\x83\xD1\x88\xD0\xB8\xD1\x81\xD1\x82\xD1\x8B\xD0\xB9 \xD0\x9A\xD0\x9E\xD0\xA2, \xD0\x81\xD0\xB6\xD0\xB8\xD0\xBA!"s), "\xD0\xBF\xD1\x83\xD1\x88\xD0\xB8\xD1\x81\xD1\x82\xD1\x8B\xD0\xB9 \xD0\xBA\xD0\xBE\xD1\x82 \xD1\x91\xD0\xB6\xD0\xB8\xD0\xBA"s);
+    ASSERT_EQUAL(*analyzer.NormalizeDocument("\xCE\xA3\xCE\x9F\xCE\xA6\xCE\x8A\xCE\x91 \xC3\x84\xC3\x96\xC3\x9C \xC5\x92uvre \xD4\xB1"s), "\xCF\x83\xCE\xBF\xCF\x86\xCE\xAF\xCE\xB1 \xC3\xA4\xC3\xB6\xC3\xBC \xC5\x93uvre \xD5\xA1"s);
+    ASSERT_EQUAL(*analyzer.NormalizeDocument("na\xC3\xAFve\xE2\x80\x94word \xC2\xAB\xD0\xBA\xD0\xBE\xD1\x82\xC2\xBB \xE2\x80\xA6 ,"s), "na\xC3\xAFve word \xD0\xBA\xD0\xBE\xD1\x82"s);
+    ASSERT_EQUAL(*analyzer.NormalizeQuery("-\xD0\x9A\xD0\xBE\xD1\x82 \"Big Dog\" Prefix* Fuzzy~2 a,b -x.y --z"s),
+        "-\xD0\xBA\xD0\xBE\xD1\x82 \"big dog\" prefix* fuzzy~2 a b -x -y --z"s);
+    //      ,  -  ,    -  
+    ASSERT_EQUAL(*analyzer.NormalizeQuery("-X.Y.Z \"A.B c\" -p.q~1"s), "-x -y -z \"a b c\" -p -q~1"s);
+    for (const string& invalid : { "cat \xFF"s, "\xD0"s, "\xC0\xAF"s, "\xED\xA0\x80"s }) {
+        ASSERT_THROWS(analyzer.NormalizeDocument(invalid), invalid_argument);
+    }
+    TextAnalysisOptions raw_bytes;
+    raw_bytes.validate_utf8 = false;
+    ASSERT_EQUAL(*TextAnalyzer(raw_bytes).NormalizeDocument("Cat \xFF!"s), "cat \xFF"s);
+
+    const SuffixStemmer stemmer({ "s"s, "ing"s, "\xD0\xB0\xD0\xBC\xD0\xB8"s }, 3);
+    ASSERT_EQUAL(stemmer("walking"s), 4u);
+    ASSERT_EQUAL(stemmer("cats"s), 3u);
+    ASSERT_EQUAL(stemmer("is"s), 2u);
+    ASSERT_EQUAL(stemmer("\xD0\xBA\xD0\xBE\xD1\x82\xD0\xB0\xD0\xBC\xD0\xB8"s), string("\xD0\xBA\xD0\xBE\xD1\x82").size());
+
+    //     
+    {
+        SearchServer server("and"s);
+        server.AddDocument(1, "Cat cat CAT cat."s, DocumentStatus::ACTUAL, {});
+        ASSERT_EQUAL(server.GetWordFrequencies(1).size(), 4u);
+        ASSERT_EQUAL(server.FindTopDocuments("cat"s).size(), 1u);
+    }
+    {
+        SearchServer server("\xD0\x98 and"s);
+        server.EnableTextAnalysis();
+        server.EnablePositionalIndex();
+        server.AddDocument(1, "Cat cat CAT cat."s, DocumentStatus::ACTUAL, {});
+        ASSERT_EQUAL(server.GetWordFrequencies(1).size(), 1u);
+        server.AddDocument(2, "\xD0\x9A\xD0\xBE\xD1\x82 \xD0\xB8 \xD0\x9F\xD1\x91\xD1\x81. AND Curly-Dog!"s, DocumentStatus::ACTUAL, {});
+        ASSERT_EQUAL(server.GetWordFrequencies(2).size(), 4u);
+        ASSERT_EQUAL(server.FindTopDocuments("\xD0\x9A\xD0\x9E\xD0\xA2,"s).size(), 1u);
+        ASSERT_EQUAL(server.FindTopDocuments("\xD0\xB8 AND"s).size(), 0u);
+        ASSERT_EQUAL(server.FindTopDocuments("\"curly dog\""s).size(), 1u);
+        ASSERT_EQUAL(server.FindTopDocuments("CURLY -Dog."s).size(), 0u);
+        ASSERT_EQUAL(server.FindTopDocuments("cat curly -x.Dog"s).size(), 1u);
+        ASSERT_EQUAL(server.FindTopDocuments("CU*"s).size(), 1u);
+        const auto [words, status] = server.MatchDocument("\xD0\x9A\xD0\xBE\xD1\x82 \xD0\x9F\xD0\x81\xD0\xA1"s, 2);
+        ASSERT(words == vector<string_view>({ "\xD0\xBA\xD0\xBE\xD1\x82"sv, "\xD0\xBF\xD1\x91\xD1\x81"sv }));
+        auto cursor = server.OpenCursor("CAT DOG"s);
+        ASSERT_EQUAL(cursor.Next(10).size(), 2u);
+
+        ASSERT_THROWS(server.AddDocument(3, "bad \xFF"s, DocumentStatus::ACTUAL, {}), invalid_argument);
+        const string bad_text = "bad \xFF"s;
+        ASSERT_THROWS(server.AddDocuments(execution::par, { { 3, DocumentStatus::ACTUAL, {}, "parrot"sv }, { 4, DocumentStatus::ACTUAL, {}, bad_text } }), invalid_argument);
+        ASSERT_EQUAL(server.GetDocumentCount(), 2);
+        ASSERT_THROWS(server.EnableTextAnalysis(), logic_error);
+    }
+    {
+        TextAnalysisOptions options;
+        options.stemmer = SuffixStemmer({ "s"s, "ing"s }, 3);
+        SearchServer server("things"s);
+        server.EnableTextAnalysis(move(options));
+        ASSERT_THROWS(server.EnableTextAnalysis(), logic_error);
+        server.AddDocument(1, "Cats walking THINGS"s, DocumentStatus::ACTUAL, {});
+        ASSERT_EQUAL(server.GetWordFrequencies(1).size(), 2u);
+        ASSERT_EQUAL(server.FindTopDocuments("cat"s).size(), 1u);
+        ASSERT_EQUAL(server.FindTopDocuments("walks"s).size(), 1u);
+        ASSERT_EQUAL(server.FindTopDocuments("thing"s).size(), 0u);
+        ASSERT_EQUAL(server.FindTopDocuments("walki*"s).size(), 0u);
+        ASSERT_EQUAL(server.FindTopDocuments("wal*"s).size(), 1u);
+        ASSERT_EQUAL(server.FindTopDocuments("cots~"s).size(), 1u);
+    }
+    //     ,      
+    {
+        SearchServer server("bad\xFF AND"s);
+        ASSERT_THROWS(server.EnableTextAnalysis(), invalid_argument);
+        server.EnableTextAnalysis(raw_bytes);
+        server.AddDocument(1, "Cat and"s, DocumentStatus::ACTUAL, {});
+        ASSERT_EQUAL(server.GetWordFrequencies(1).size(), 1u);
+    }
+}
+
 void TestRequests() {
     SearchServer search_server("and in at"s);
-    RequestQueue request_queue(search_server);
+    auto now = RequestQueue::Clock::now();
+    RequestQueue request_queue(search_server, [&now] { return now; });
 
     search_server.AddDocument(1, "curly cat curly tail"s, DocumentStatus::ACTUAL, { 7, 2, 7 });
     search_server.AddDocument(2, "curly dog and fancy collar"s, DocumentStatus::ACTUAL, { 1, 2, 3 });
@@ -234,18 +1875,61 @@ void TestRequests() {
     search_server.AddDocument(4, "big dog sparrow Eugene"s, DocumentStatus::ACTUAL, { 1, 3, 2 });
     search_server.AddDocument(5, "big dog sparrow Vasiliy"s, DocumentStatus::ACTUAL, { 1, 1, 1 });
 
-    // 1439    
+    // 1439    ,    
     for (int i = 0; i < 1439; ++i) {
         request_queue.AddFindRequest("empty request"s);
+        now += 1min;
     }
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(), 1439);
+    ASSERT_EQUAL(request_queue.GetStats(RequestQueue::Window::HOUR).requests, 59u);
+    ASSERT_EQUAL(request_queue.GetStats(RequestQueue::Window::MINUTE).requests, 0u);
     //   1439    
     request_queue.AddFindRequest("curly dog"s);
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(), 1439);
+    ASSERT_EQUAL(request_queue.GetStats(RequestQueue::Window::MINUTE).requests, 1u);
     //  ,   , 1438    
-    request_queue.AddFindRequest("big collar"s);
-    //   , 1437    
-    request_queue.AddFindRequest("sparrow"s);
-    cout << endl;
-    cout << "Total empty requests: "s << request_queue.GetNoResultRequests() << endl;
+    now += 1min;
+    request_queue.AddFindRequest(execution::par, "big collar"s);
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(), 1438);
+    //   ,     : - 1438
+    now += 1min;
+    request_queue.AddProcessQueries({ "sparrow"s, "empty request"s });
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(), 1438);
+    ASSERT_EQUAL(request_queue.GetStats(RequestQueue::Window::DAY).requests, 1441u);
+
+    //    
+    vector<int> threads(1000);
+    for_each(execution::par, threads.begin(), threads.end(), [&request_queue](int) {
+        request_queue.AddRequest(0);
+        });
+    ASSERT_EQUAL(request_queue.GetStats(RequestQueue::Window::MINUTE).no_result_requests, 1001u);
+
+    //      
+    now += 24h;
+    ASSERT_EQUAL(request_queue.GetNoResultRequests(), 0);
+
+    // ,   ,       
+    RequestQueue seconds_queue(search_server, [&now] { return now; });
+    vector<int> request_seconds;
+    for (int second = 0; second < 3 * 3600; second += 7) {
+        request_seconds.push_back(second);
+    }
+    int elapsed = 0;
+    for (const int second : request_seconds) {
+        now += chrono::seconds(second - elapsed);
+        elapsed = second;
+        seconds_queue.AddRequest(second % 3);
+        if (second % 1001 == 0) {
+            const auto in_window = [&request_seconds, second](int length) {
+                return static_cast<uint64_t>(count_if(request_seconds.begin(), request_seconds.end(), [second, length](int request_second) {
+                    return request_second <= second && request_second > second - length;
+                    }));
+            };
+            ASSERT_EQUAL(seconds_queue.GetStats(RequestQueue::Window::MINUTE).requests, in_window(60));
+            ASSERT_EQUAL(seconds_queue.GetStats(RequestQueue::Window::HOUR).requests, in_window(3600));
+            ASSERT_EQUAL(seconds_queue.GetStats(RequestQueue::Window::DAY).requests, in_window(86400));
+        }
+    }
 }
 
 void TestBeginEndSearchServer() {
@@ -289,7 +1973,7 @@ void TestGetWordFrequencies() {
 
     server.AddDocument(doc_id, content, DocumentStatus::ACTUAL, ratings);
 
-    auto& test1 = server.GetWordFrequencies(42);
+    const auto test1 = server.GetWordFrequencies(42);
     ASSERT_EQUAL(test1.at("cat"s), static_cast<double>(0.5));
     ASSERT_EQUAL(test1.at("city"s), static_cast<double>(0.5));
 }
@@ -308,6 +1992,27 @@ void TestRemoveDocument() {
     ASSERT_EQUAL(test1, 1u);
 }
 
+void TestRemoveDocumentKeepsWordFrequencies() {
+    SearchServer server("and"s);
+
+    for (int id = 0; id < 10; ++id) {
+        server.AddDocument(id, "cat and dog number "s + to_string(id), DocumentStatus::ACTUAL, { 1 });
+    }
+    for (int id = 0; id < 8; ++id) {
+        server.RemoveDocument(id);
+    }
+
+    const auto words = server.GetWordFrequencies(9);
+    ASSERT_EQUAL(words.size(), 4u);
+    ASSERT_EQUAL(words.at("9"s), 0.25);
+    ASSERT_EQUAL(words.count("8"s), 0u);
+    ASSERT(server.GetWordFrequencies(3).empty());
+
+    const auto [matched_words, status] = server.MatchDocument("dog 9 -7"s, 9);
+    ASSERT_EQUAL(matched_words.size(), 2u);
+    ASSERT_EQUAL(server.FindTopDocuments("number"s).size(), 2u);
+}
+
 void TestRemoveDuplicates() {    
 
     SearchServer search_server("and with"s);
@@ -353,10 +2058,33 @@ void TestSearchServer() {
     RUN_TEST(TestPredicate);
     RUN_TEST(TestStatus);
     RUN_TEST(TestCountingRelevansIsCorrect);
+    RUN_TEST(TestRankingFunctions);
+    RUN_TEST(TestPhraseAndProximity);
+    RUN_TEST(TestPrefixQuery);
+    RUN_TEST(TestFuzzyQuery);
+    RUN_TEST(TestParallelScoring);
+    RUN_TEST(TestConcurrentMap);
+    RUN_TEST(TestMetrics);
+    RUN_TEST(TestMemoryStats);
+    RUN_TEST(TestFindPage);
+    RUN_TEST(TestCursor);
+    RUN_TEST(TestAllWordsQuery);
+    RUN_TEST(TestImpactOrder);
+    RUN_TEST(TestShardedSearchServer);
+    RUN_TEST(TestSearchDaemon);
+    RUN_TEST(TestFindTopDocumentsAsync);
+    RUN_TEST(TestQueryScheduler);
+    RUN_TEST(TestStatisticsSnapshots);
+    RUN_TEST(TestDocumentLoader);
+    RUN_TEST(TestWriteAheadLog);
+    RUN_TEST(TestStopWordSet);
+    RUN_TEST(TestTextAnalysis);
+    RUN_TEST(TestQueryLimits);
     RUN_TEST(TestRequests);
     RUN_TEST(TestBeginEndSearchServer);
     RUN_TEST(TestGetWordFrequencies);
     RUN_TEST(TestRemoveDocument);
+    RUN_TEST(TestRemoveDocumentKeepsWordFrequencies);
     RUN_TEST(TestRemoveDuplicates);
 }
 
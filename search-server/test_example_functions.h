@@ -7,6 +7,8 @@
 #include <cstdlib>
 #include <algorithm>
 #include <iostream>
+#include <type_traits>
+#include <utility>
 #include "search_server.h"
 
 #define ASSERT(expr) AssertEqualImpl(expr, #expr, __FILE__, __FUNCTION__, __LINE__, ""s)
@@ -17,14 +19,34 @@
 
 #define ASSERT_EQUAL_HINT(a, b, hint) AssertEqualImpl((a), (b), #a, #b, __FILE__, __FUNCTION__, __LINE__, (hint))
 
+#define ASSERT_THROWS(expr, type) AssertThrowsImpl<type>([&] { (void)(expr); }, #expr, #type, __FILE__, __FUNCTION__, __LINE__, ""s)
+
+#define ASSERT_THROWS_HINT(expr, type, hint) AssertThrowsImpl<type>([&] { (void)(expr); }, #expr, #type, __FILE__, __FUNCTION__, __LINE__, (hint))
+
 #define RUN_TEST(func) RunTestImpl((func), #func) 
 
+// integer types std::cmp_equal accepts: no bool and no character types
+template <typename T>
+inline constexpr bool IS_PLAIN_INTEGER = std::is_integral_v<T> && !std::is_same_v<T, bool> && !std::is_same_v<T, char>
+    && !std::is_same_v<T, wchar_t> && !std::is_same_v<T, char8_t> && !std::is_same_v<T, char16_t> && !std::is_same_v<T, char32_t>;
+
+// integers of any signedness compare by value, so ASSERT_EQUAL(size, 3) needs no 3u
+template <typename T, typename U>
+bool AreEqualForAssert(const T& t, const U& u) {
+    if constexpr (IS_PLAIN_INTEGER<T> && IS_PLAIN_INTEGER<U>) {
+        return std::cmp_equal(t, u);
+    }
+    else {
+        return t == u;
+    }
+}
+
 template <typename T, typename U>
 void AssertEqualImpl(const T& t, const U& u, const std::string& t_str, const std::string& u_str, const std::string& file,
     const std::string& func, unsigned line, const std::string& hint) {
     using namespace std;
     using namespace std::string_literals;
-    if (t != u) {
+    if (!AreEqualForAssert(t, u)) {
         cout << std::boolalpha;
         cout << file << "("s << line << "): "s << func << ": "s;
         cout << "ASSERT_EQUAL("s << t_str << ", "s << u_str << ") failed: "s;
@@ -54,6 +76,44 @@ void AssertEqualImpl(const T& t, const std::string& t_str, const std::string& fi
     }
 }
 
+// passes when action throws Exception or an exception derived from it, other exceptions fly through
+template <typename Exception, typename Action>
+void AssertThrowsImpl(Action action, const std::string& expr_str, const std::string& type_str, const std::string& file,
+    const std::string& func, unsigned line, const std::string& hint) {
+    using namespace std;
+    using namespace std::string_literals;
+    try {
+        action();
+    }
+    catch (const Exception&) {
+        return;
+    }
+    cout << file << "("s << line << "): "s << func << ": "s;
+    cout << "ASSERT_THROWS("s << expr_str << ", "s << type_str << ") failed: nothing thrown."s;
+    if (!hint.empty()) {
+        cout << " Hint: "s << hint;
+    }
+    cout << endl;
+    abort();
+}
+
+// Linear congruential generator, so the random test data does not depend on the <random> implementation
+class TestRandom {
+public:
+    explicit TestRandom(unsigned seed)
+        : state_(seed) {
+    }
+
+    // a number in [0, limit)
+    unsigned operator()(unsigned limit) {
+        state_ = state_ * 1103515245u + 12345u;
+        return (state_ >> 16) % limit;
+    }
+
+private:
+    unsigned state_;
+};
+
 template <typename TestFunc>
 void RunTestImpl(TestFunc t_func, const std::string& func) {
     using namespace std;
@@ -93,7 +153,30 @@ void TestCalcRating();
 void TestPredicate();
 void TestStatus();
 void TestCountingRelevansIsCorrect();
+void TestRankingFunctions();
+void TestPhraseAndProximity();
+void TestPrefixQuery();
+void TestFuzzyQuery();
+void TestParallelScoring();
+void TestConcurrentMap();
+void TestMetrics();
+void TestMemoryStats();
+void TestFindPage();
+void TestCursor();
+void TestAllWordsQuery();
+void TestImpactOrder();
+void TestShardedSearchServer();
+void TestSearchDaemon();
+void TestFindTopDocumentsAsync();
+void TestQueryScheduler();
+void TestStatisticsSnapshots();
+void TestDocumentLoader();
+void TestWriteAheadLog();
+void TestStopWordSet();
+void TestTextAnalysis();
+void TestQueryLimits();
 void TestRequests();
 void TestBeginEndSearchServer();
 void TestGetWordFrequencies();
-void TestRemoveDocument();
\ No newline at end of file
+void TestRemoveDocument();
+void TestRemoveDocumentKeepsWordFrequencies();
\ No newline at end of file
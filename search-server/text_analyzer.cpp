@@ -0,0 +1,340 @@
+#include "text_analyzer.h"
+#include "string_processing.h"
+#include <algorithm>
+#include <array>
+#include <cctype>
+#include <cstdint>
+#include <stdexcept>
+
+using namespace std;
+
+namespace {
+
+const char32_t INVALID_CODE_POINT = 0xFFFFFFFF;
+
+struct CodePointRange {
+    char32_t first;
+    char32_t last;
+};
+
+// characters that are neither letters nor digits above ASCII, sorted
+const CodePointRange SEPARATOR_RANGES[] = {
+    { 0x0080, 0x00A9 }, { 0x00AB, 0x00B4 }, { 0x00B6, 0x00B9 }, { 0x00BB, 0x00BF }, { 0x00D7, 0x00D7 },
+    { 0x00F7, 0x00F7 }, { 0x037E, 0x037E }, { 0x0387, 0x0387 }, { 0x055A, 0x055F }, { 0x0589, 0x058A },
+    { 0x05BE, 0x05BE }, { 0x05C0, 0x05C0 }, { 0x05C3, 0x05C3 }, { 0x05C6, 0x05C6 }, { 0x05F3, 0x05F4 },
+    { 0x060C, 0x060D }, { 0x061B, 0x061B }, { 0x061F, 0x061F }, { 0x066A, 0x066D }, { 0x06D4, 0x06D4 },
+    { 0x0964, 0x0965 }, { 0x0970, 0x0970 }, { 0x0E4F, 0x0E4F }, { 0x0E5A, 0x0E5B }, { 0x10FB, 0x10FB },
+    { 0x1360, 0x1368 }, { 0x166D, 0x166E }, { 0x1680, 0x1680 }, { 0x2000, 0x206F }, { 0x20A0, 0x20CF },
+    { 0x2190, 0x23FF }, { 0x2500, 0x27BF }, { 0x27C0, 0x2BFF }, { 0x2E00, 0x2E7F }, { 0x3000, 0x3003 },
+    { 0x3008, 0x3011 }, { 0x3014, 0x301F }, { 0xFD3E, 0xFD3F }, { 0xFE10, 0xFE19 }, { 0xFE30, 0xFE6B },
+    { 0xFEFF, 0xFEFF }, { 0xFF01, 0xFF0F }, { 0xFF1A, 0xFF20 }, { 0xFF3B, 0xFF40 }, { 0xFF5B, 0xFF65 },
+    { 0x1F000, 0x1FAFF },
+};
+
+enum class FoldKind {
+    // every code point of the range moves by delta
+    ALL,
+    // upper case letters at even code points, the lower case ones follow them
+    EVEN,
+    ODD,
+};
+
+struct FoldRange {
+    char32_t first;
+    char32_t last;
+    int32_t delta;
+    FoldKind kind;
+};
+
+// simple case folding above ASCII, sorted
+const FoldRange FOLD_RANGES[] = {
+    { 0x00C0, 0x00D6, 32, FoldKind::ALL }, { 0x00D8, 0x00DE, 32, FoldKind::ALL },
+    { 0x0100, 0x012F, 1, FoldKind::EVEN }, { 0x0132, 0x0137, 1, FoldKind::EVEN }, { 0x0139, 0x0148, 1, FoldKind::ODD },
+    { 0x014A, 0x0177, 1, FoldKind::EVEN }, { 0x0178, 0x0178, -121, FoldKind::ALL }, { 0x0179, 0x017E, 1, FoldKind::ODD },
+    { 0x0386, 0x0386, 38, FoldKind::ALL }, { 0x0388, 0x038A, 37, FoldKind::ALL }, { 0x038C, 0x038C, 64, FoldKind::ALL },
+    { 0x038E, 0x038F, 63, FoldKind::ALL }, { 0x0391, 0x03A1, 32, FoldKind::ALL }, { 0x03A3, 0x03AB, 32, FoldKind::ALL },
+    { 0x03C2, 0x03C2, 1, FoldKind::ALL }, { 0x03D8, 0x03EF, 1, FoldKind::EVEN },
+    { 0x0400, 0x040F, 80, FoldKind::ALL }, { 0x0410, 0x042F, 32, FoldKind::ALL }, { 0x0460, 0x0481, 1, FoldKind::EVEN },
+    { 0x048A, 0x04BF, 1, FoldKind::EVEN }, { 0x04C0, 0x04C0, 15, FoldKind::ALL }, { 0x04C1, 0x04CE, 1, FoldKind::ODD },
+    { 0x04D0, 0x052F, 1, FoldKind::EVEN }, { 0x0531, 0x0556, 48, FoldKind::ALL }, { 0x10A0, 0x10C5, 7264, FoldKind::ALL },
+    { 0x1E00, 0x1E95, 1, FoldKind::EVEN }, { 0x1EA0, 0x1EFF, 1, FoldKind::EVEN }, { 0x2160, 0x216F, 16, FoldKind::ALL },
+    { 0x24B6, 0x24CF, 26, FoldKind::ALL }, { 0xFF21, 0xFF3A, 32, FoldKind::ALL }, { 0x10400, 0x10427, 40, FoldKind::ALL },
+};
+
+// for every ASCII character: 0 when it separates words, otherwise the character after folding
+const array<char, 128> ASCII_FOLDED = [] {
+    array<char, 128> table{};
+    for (int c = '0'; c <= '9'; ++c) {
+        table[c] = static_cast<char>(c);
+    }
+    for (int c = 'a'; c <= 'z'; ++c) {
+        table[c] = static_cast<char>(c);
+        table[c - 'a' + 'A'] = static_cast<char>(c);
+    }
+    return table;
+}();
+
+bool IsWordCodePoint(char32_t code_point) {
+    if (code_point < 0x80) {
+        return ASCII_FOLDED[code_point] != 0;
+    }
+    const auto it = upper_bound(begin(SEPARATOR_RANGES), end(SEPARATOR_RANGES), code_point,
+        [](char32_t value, const CodePointRange& range) {
+            return value < range.first;
+        });
+    return it == begin(SEPARATOR_RANGES) || prev(it)->last < code_point;
+}
+
+char32_t FoldCodePoint(char32_t code_point) {
+    const auto it = upper_bound(begin(FOLD_RANGES), end(FOLD_RANGES), code_point,
+        [](char32_t value, const FoldRange& range) {
+            return value < range.first;
+        });
+    if (it == begin(FOLD_RANGES) || prev(it)->last < code_point) {
+        return code_point;
+    }
+    const FoldRange& range = *prev(it);
+    if ((range.kind == FoldKind::EVEN && code_point % 2 != 0) || (range.kind == FoldKind::ODD && code_point % 2 == 0)) {
+        return code_point;
+    }
+    return static_cast<char32_t>(static_cast<int32_t>(code_point) + range.delta);
+}
+
+// the code point starting at text[pos] and its length in bytes, INVALID_CODE_POINT with length 1
+// for a malformed sequence
+pair<char32_t, size_t> DecodeUtf8(string_view text, size_t pos) {
+    const auto lead = static_cast<unsigned char>(text[pos]);
+    size_t length = 0;
+    char32_t code_point = 0;
+    char32_t min_code_point = 0;
+    if (lead < 0x80) {
+        return { lead, 1 };
+    }
+    else if ((lead & 0xE0) == 0xC0) {
+        length = 2;
+        code_point = lead & 0x1F;
+        min_code_point = 0x80;
+    }
+    else if ((lead & 0xF0) == 0xE0) {
+        length = 3;
+        code_point = lead & 0x0F;
+        min_code_point = 0x800;
+    }
+    else if ((lead & 0xF8) == 0xF0) {
+        length = 4;
+        code_point = lead & 0x07;
+        min_code_point = 0x10000;
+    }
+    else {
+        return { INVALID_CODE_POINT, 1 };
+    }
+    if (pos + length > text.size()) {
+        return { INVALID_CODE_POINT, 1 };
+    }
+    for (size_t i = 1; i < length; ++i) {
+        const auto byte = static_cast<unsigned char>(text[pos + i]);
+        if ((byte & 0xC0) != 0x80) {
+            return { INVALID_CODE_POINT, 1 };
+        }
+        code_point = (code_point << 6) | (byte & 0x3F);
+    }
+    // overlong forms, surrogates and code points past Unicode
+    if (code_point < min_code_point || (code_point >= 0xD800 && code_point <= 0xDFFF) || code_point > 0x10FFFF) {
+        return { INVALID_CODE_POINT, 1 };
+    }
+    return { code_point, length };
+}
+
+void AppendUtf8(char32_t code_point, string& out) {
+    if (code_point < 0x80) {
+        out.push_back(static_cast<char>(code_point));
+    }
+    else if (code_point < 0x800) {
+        out.push_back(static_cast<char>(0xC0 | (code_point >> 6)));
+        out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    }
+    else if (code_point < 0x10000) {
+        out.push_back(static_cast<char>(0xE0 | (code_point >> 12)));
+        out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    }
+    else {
+        out.push_back(static_cast<char>(0xF0 | (code_point >> 18)));
+        out.push_back(static_cast<char>(0x80 | ((code_point >> 12) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | ((code_point >> 6) & 0x3F)));
+        out.push_back(static_cast<char>(0x80 | (code_point & 0x3F)));
+    }
+}
+
+size_t CountCodePoints(string_view text) {
+    return static_cast<size_t>(count_if(text.begin(), text.end(), [](char c) {
+        return (static_cast<unsigned char>(c) & 0xC0) != 0x80;
+        }));
+}
+
+}
+
+SuffixStemmer::SuffixStemmer(vector<string> suffixes, size_t min_stem_length)
+    : suffixes_(move(suffixes))
+    , min_stem_length_(min_stem_length) {
+    stable_sort(suffixes_.begin(), suffixes_.end(), [](const string& lhs, const string& rhs) {
+        return lhs.size() > rhs.size();
+        });
+}
+
+size_t SuffixStemmer::operator()(string_view word) const {
+    for (const string& suffix : suffixes_) {
+        if (word.size() > suffix.size() && word.substr(word.size() - suffix.size()) == suffix
+            && CountCodePoints(word.substr(0, word.size() - suffix.size())) >= min_stem_length_) {
+            return word.size() - suffix.size();
+        }
+    }
+    return word.size();
+}
+
+TextAnalyzer::TextAnalyzer(TextAnalysisOptions options)
+    : options_(move(options)) {
+}
+
+optional<string> TextAnalyzer::NormalizeDocument(string_view text) const {
+    if (IsNormalized(text)) {
+        return nullopt;
+    }
+    string result;
+    result.reserve(text.size());
+    for (const string_view word : SplitIntoWords(text)) {
+        if (!result.empty()) {
+            result.push_back(' ');
+        }
+        if (!AppendWord(word, true, result) && !result.empty()) {
+            result.pop_back();
+        }
+    }
+    return result;
+}
+
+void TextAnalyzer::CheckDocument(string_view text) const {
+    if (!options_.validate_utf8 || IsNormalized(text)) {
+        return;
+    }
+    // word by word, as AppendWord decodes them
+    for (const string_view word : SplitIntoWords(text)) {
+        for (size_t pos = 0; pos < word.size();) {
+            const auto [code_point, length] = DecodeUtf8(word, pos);
+            if (code_point == INVALID_CODE_POINT) {
+                throw invalid_argument("Текст не в кодировке UTF-8"s);
+            }
+            pos += length;
+        }
+    }
+}
+
+optional<string> TextAnalyzer::NormalizeQuery(string_view raw_query) const {
+    if (IsNormalized(raw_query)) {
+        return nullopt;
+    }
+    string result;
+    result.reserve(raw_query.size());
+    for (string_view word : SplitIntoWords(raw_query)) {
+        // -word, "word, -"word
+        size_t lead_size = 0;
+        while (lead_size < min<size_t>(word.size(), 2) && (word[lead_size] == '-' || word[lead_size] == '"')) {
+            ++lead_size;
+        }
+        const string_view lead = word.substr(0, lead_size);
+        word.remove_prefix(lead_size);
+        // word", word*, word~, word~2
+        size_t trail_size = 0;
+        if (trail_size < word.size() && word[word.size() - 1 - trail_size] == '"') {
+            ++trail_size;
+        }
+        if (trail_size < word.size() && word[word.size() - 1 - trail_size] == '*') {
+            ++trail_size;
+        }
+        else if (trail_size < word.size() && word[word.size() - 1 - trail_size] == '~') {
+            ++trail_size;
+        }
+        else if (trail_size + 1 < word.size() && word[word.size() - 2 - trail_size] == '~'
+            && isdigit(static_cast<unsigned char>(word[word.size() - 1 - trail_size]))) {
+            trail_size += 2;
+        }
+        const string_view trail = word.substr(word.size() - trail_size);
+        word.remove_suffix(trail_size);
+
+        const size_t word_begin = result.size();
+        if (!result.empty()) {
+            result.push_back(' ');
+        }
+        result += lead;
+        // -x.y excludes both parts as the document x.y holds both
+        const string_view minus = lead.substr(0, lead.find_first_not_of('-'));
+        const bool has_parts = AppendWord(word, trail.find('*') == string_view::npos, result, minus);
+        result += trail;
+        if (!has_parts && lead.empty() && trail.empty()) {
+            result.resize(word_begin);
+        }
+    }
+    return result;
+}
+
+bool TextAnalyzer::IsNormalized(string_view text) const {
+    if (options_.stemmer) {
+        return false;
+    }
+    return all_of(text.begin(), text.end(), [this](char c) {
+        const auto byte = static_cast<unsigned char>(c);
+        if (byte >= 0x80) {
+            return false;
+        }
+        if (byte == ' ') {
+            return true;
+        }
+        const char folded = ASCII_FOLDED[byte];
+        return (folded != 0 || !options_.split_punctuation) && (folded == c || folded == 0 || !options_.fold_case);
+        });
+}
+
+bool TextAnalyzer::AppendWord(string_view word, bool stem, string& out, string_view part_prefix) const {
+    bool has_parts = false;
+    bool in_part = false;
+    size_t part_begin = out.size();
+    const auto end_part = [&] {
+        if (in_part && stem && options_.stemmer) {
+            const string_view part = string_view(out).substr(part_begin);
+            out.resize(part_begin + clamp<size_t>(options_.stemmer(part), 1, part.size()));
+        }
+        in_part = false;
+    };
+    for (size_t pos = 0; pos < word.size();) {
+        const auto [code_point, length] = DecodeUtf8(word, pos);
+        if (code_point == INVALID_CODE_POINT && options_.validate_utf8) {
+            throw invalid_argument("Текст не в кодировке UTF-8"s);
+        }
+        if (code_point == INVALID_CODE_POINT || !options_.split_punctuation || IsWordCodePoint(code_point)) {
+            if (!in_part) {
+                if (has_parts) {
+                    out.push_back(' ');
+                    out += part_prefix;
+                }
+                part_begin = out.size();
+                in_part = true;
+                has_parts = true;
+            }
+            if (code_point == INVALID_CODE_POINT || !options_.fold_case) {
+                out.append(word.substr(pos, length));
+            }
+            else if (code_point < 0x80) {
+                out.push_back(ASCII_FOLDED[code_point] != 0 ? ASCII_FOLDED[code_point] : static_cast<char>(code_point));
+            }
+            else {
+                AppendUtf8(FoldCodePoint(code_point), out);
+            }
+        }
+        else {
+            end_part();
+        }
+        pos += length;
+    }
+    end_part();
+    return has_parts;
+}
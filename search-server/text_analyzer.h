@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstddef>
+#include <functional>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+struct TextAnalysisOptions {
+    // invalid UTF-8 throws invalid_argument, otherwise its bytes are kept as they are
+    bool validate_utf8 = true;
+    // simple case folding of Latin, Greek, Cyrillic, Armenian and Georgian letters
+    bool fold_case = true;
+    // punctuation, symbols and other characters that are neither letters nor digits separate words
+    bool split_punctuation = true;
+    // length in bytes of the stem of a folded word, no stemming when empty. Called from several
+    // threads at once
+    std::function<size_t(std::string_view)> stemmer;
+};
+
+// Strips the longest suffix from the list that leaves at least min_stem_length characters
+class SuffixStemmer {
+public:
+    SuffixStemmer(std::vector<std::string> suffixes, size_t min_stem_length);
+
+    size_t operator()(std::string_view word) const;
+
+private:
+    // the longest first
+    std::vector<std::string> suffixes_;
+    size_t min_stem_length_;
+};
+
+/**
+ * Turns the text of a document or a query into the words the index stores: checks UTF-8,
+ * folds the case, splits words at punctuation and stems them. The same analysis applied to
+ * documents and queries makes "Кот," and "кот" one term.
+ *
+ * Text made only of lower case ASCII letters, digits and spaces needs no work and is recognised
+ * by a scan without decoding, other ASCII characters are handled by tables and only the rest
+ * is decoded.
+ */
+class TextAnalyzer {
+public:
+    explicit TextAnalyzer(TextAnalysisOptions options = {});
+
+    // the words of text separated by single spaces, nullopt when text is already analyzed
+    std::optional<std::string> NormalizeDocument(std::string_view text) const;
+
+    // throws invalid_argument exactly when NormalizeDocument would, without building the words
+    void CheckDocument(std::string_view text) const;
+
+    // NormalizeDocument that keeps the query operators -word, "phrase", word* and word~N.
+    // When punctuation splits a word, its trailing operators go to the last part, a minus
+    // goes to every part and an opening quote to the first. Prefixes of word* are folded
+    // but not stemmed
+    std::optional<std::string> NormalizeQuery(std::string_view raw_query) const;
+
+private:
+    TextAnalysisOptions options_;
+
+    bool IsNormalized(std::string_view text) const;
+
+    // appends the parts of a word without spaces, separated by spaces and each but the first
+    // preceded by part_prefix; false when it has none
+    bool AppendWord(std::string_view word, bool stem, std::string& out, std::string_view part_prefix = {}) const;
+};
@@ -0,0 +1,32 @@
+#include "word_frequencies.h"
+#include <algorithm>
+#include <stdexcept>
+
+using namespace std;
+
+const TermFrequency* WordFrequencies::FindTerm(int term_id) const {
+    const TermFrequency* it = lower_bound(first_, last_, term_id, [](const TermFrequency& entry, int id) {
+        return entry.term_id < id;
+        });
+    if (it == last_ || it->term_id != term_id) {
+        return nullptr;
+    }
+    return it;
+}
+
+size_t WordFrequencies::count(const string_view word) const {
+    if (empty()) {
+        return 0;
+    }
+    const auto term_id = dictionary_->FindWord(word);
+    return term_id && FindTerm(*term_id) ? 1 : 0;
+}
+
+double WordFrequencies::at(const string_view word) const {
+    const auto term_id = empty() ? nullopt : dictionary_->FindWord(word);
+    const TermFrequency* entry = term_id ? FindTerm(*term_id) : nullptr;
+    if (entry == nullptr) {
+        throw out_of_range("word is not in the document"s);
+    }
+    return entry->freq;
+}
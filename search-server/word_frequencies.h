@@ -0,0 +1,93 @@
+#pragma once
+
+#include <cstddef>
+#include <iterator>
+#include <string_view>
+#include <utility>
+#include "term_dictionary.h"
+
+struct TermFrequency {
+    int term_id = 0;
+    double freq = 0.0;
+};
+
+// Lightweight read-only view over the forward index entries of one document.
+// Entries are sorted by term id. The view is invalidated by AddDocument and RemoveDocument.
+class WordFrequencies {
+public:
+    class Iterator {
+    public:
+        using iterator_category = std::forward_iterator_tag;
+        using value_type = std::pair<std::string_view, double>;
+        using difference_type = std::ptrdiff_t;
+        using pointer = void;
+        using reference = value_type;
+
+        Iterator(const TermFrequency* entry, const TermDictionary* dictionary)
+            : entry_(entry)
+            , dictionary_(dictionary) {
+        }
+
+        value_type operator*() const {
+            return { dictionary_->GetWord(entry_->term_id), entry_->freq };
+        }
+
+        Iterator& operator++() {
+            ++entry_;
+            return *this;
+        }
+
+        Iterator operator++(int) {
+            Iterator old = *this;
+            ++entry_;
+            return old;
+        }
+
+        bool operator==(const Iterator& other) const {
+            return entry_ == other.entry_;
+        }
+
+        bool operator!=(const Iterator& other) const {
+            return entry_ != other.entry_;
+        }
+
+    private:
+        const TermFrequency* entry_;
+        const TermDictionary* dictionary_;
+    };
+
+    WordFrequencies() = default;
+
+    WordFrequencies(const TermFrequency* first, const TermFrequency* last, const TermDictionary& dictionary)
+        : first_(first)
+        , last_(last)
+        , dictionary_(&dictionary) {
+    }
+
+    Iterator begin() const {
+        return { first_, dictionary_ };
+    }
+
+    Iterator end() const {
+        return { last_, dictionary_ };
+    }
+
+    size_t size() const {
+        return static_cast<size_t>(last_ - first_);
+    }
+
+    bool empty() const {
+        return first_ == last_;
+    }
+
+    const TermFrequency* FindTerm(int term_id) const;
+
+    size_t count(std::string_view word) const;
+
+    double at(std::string_view word) const;
+
+private:
+    const TermFrequency* first_ = nullptr;
+    const TermFrequency* last_ = nullptr;
+    const TermDictionary* dictionary_ = nullptr;
+};
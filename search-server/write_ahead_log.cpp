@@ -0,0 +1,379 @@
+#include "write_ahead_log.h"
+#include "document_loader.h"
+#include "little_endian.h"
+#include <array>
+#include <cerrno>
+#include <cstring>
+#include <fcntl.h>
+#include <filesystem>
+#include <optional>
+#include <stdexcept>
+#include <unistd.h>
+#include <utility>
+
+using namespace std;
+
+namespace {
+
+// payload size and checksum
+const size_t RECORD_HEADER_SIZE = 8;
+
+enum class RecordType : uint8_t {
+    ADD_DOCUMENT = 1,
+    REMOVE_DOCUMENT = 2,
+};
+
+using Clock = chrono::steady_clock;
+
+// CRC-32 with the polynomial of zlib and Ethernet
+uint32_t ComputeCrc32(string_view data) {
+    static const array<uint32_t, 256> table = [] {
+        array<uint32_t, 256> result{};
+        for (uint32_t i = 0; i < result.size(); ++i) {
+            uint32_t value = i;
+            for (int bit = 0; bit < 8; ++bit) {
+                value = (value & 1) ? (value >> 1) ^ 0xEDB88320u : value >> 1;
+            }
+            result[i] = value;
+        }
+        return result;
+    }();
+    uint32_t crc = 0xFFFFFFFFu;
+    for (const char c : data) {
+        crc = table[(crc ^ static_cast<unsigned char>(c)) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+// nullopt when data is too short
+template <typename Integer>
+optional<Integer> ReadInteger(string_view& data) {
+    if (data.size() < sizeof(Integer)) {
+        return nullopt;
+    }
+    const auto value = ParseLittleEndian<Integer>(data);
+    data.remove_prefix(sizeof(Integer));
+    return value;
+}
+
+string MakeRecord(const string& payload) {
+    string record;
+    record.reserve(RECORD_HEADER_SIZE + payload.size());
+    AppendLittleEndian(record, static_cast<uint32_t>(payload.size()));
+    AppendLittleEndian(record, ComputeCrc32(payload));
+    record += payload;
+    return record;
+}
+
+// false for a payload that does not decode, the checksum matched so it was written so
+bool ApplyRecord(SearchServer& search_server, string_view payload) {
+    const auto type = ReadInteger<uint8_t>(payload);
+    const auto document_id = ReadInteger<int32_t>(payload);
+    if (!type || !document_id) {
+        return false;
+    }
+    if (*type == static_cast<uint8_t>(RecordType::REMOVE_DOCUMENT)) {
+        if (!payload.empty()) {
+            return false;
+        }
+        search_server.RemoveDocument(*document_id);
+        return true;
+    }
+    if (*type != static_cast<uint8_t>(RecordType::ADD_DOCUMENT)) {
+        return false;
+    }
+    const auto status = ReadInteger<uint8_t>(payload);
+    const auto rating_count = ReadInteger<uint32_t>(payload);
+    if (!status || *status > static_cast<uint8_t>(DocumentStatus::REMOVED) || !rating_count
+        || *rating_count > payload.size() / sizeof(int32_t)) {
+        return false;
+    }
+    vector<int> ratings;
+    ratings.reserve(*rating_count);
+    for (uint32_t i = 0; i < *rating_count; ++i) {
+        ratings.push_back(*ReadInteger<int32_t>(payload));
+    }
+    search_server.AddDocument(*document_id, payload, static_cast<DocumentStatus>(*status), ratings);
+    return true;
+}
+
+void WriteAll(int fd, string_view data) {
+    while (!data.empty()) {
+        const ssize_t written = write(fd, data.data(), data.size());
+        if (written < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            throw runtime_error("Не удалось записать журнал: "s + strerror(errno));
+        }
+        data.remove_prefix(static_cast<size_t>(written));
+    }
+}
+
+}
+
+WriteAheadLog::WriteAheadLog(const string& path, WalOptions options)
+    : options_(options) {
+    fd_ = open(path.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (fd_ < 0) {
+        throw runtime_error("Не удалось открыть журнал "s + path + ": "s + strerror(errno));
+    }
+    // a created file survives a crash of the machine only once its directory entry is synced too.
+    // The directory is synced on every open, so a log created by a run that crashed is covered as well
+    if (options_.durability != WalDurability::WRITE) {
+        const filesystem::path directory = filesystem::path(path).parent_path();
+        const int directory_fd = open(directory.empty() ? "." : directory.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        const bool synced = directory_fd >= 0 && fsync(directory_fd) == 0;
+        const string reason = strerror(errno);
+        if (directory_fd >= 0) {
+            close(directory_fd);
+        }
+        if (!synced) {
+            close(fd_);
+            throw runtime_error("Не удалось сохранить на диск каталог журнала "s + path + ": "s + reason);
+        }
+    }
+    if (options_.durability == WalDurability::GROUP_COMMIT) {
+        flusher_ = thread(&WriteAheadLog::FlushPeriodically, this);
+    }
+}
+
+WriteAheadLog::~WriteAheadLog() {
+    {
+        lock_guard lock(mutex_);
+        stopping_ = true;
+    }
+    records_pending_.notify_one();
+    if (flusher_.joinable()) {
+        flusher_.join();
+    }
+    try {
+        Flush(true);
+    }
+    catch (const runtime_error&) {
+        // nothing to report the error to
+    }
+    close(fd_);
+}
+
+void WriteAheadLog::AddDocument(SearchServer& search_server, int document_id, string_view document, DocumentStatus status,
+    const vector<int>& ratings) {
+    search_server.AddDocument(document_id, document, status, ratings);
+    string payload;
+    AppendLittleEndian(payload, static_cast<uint8_t>(RecordType::ADD_DOCUMENT));
+    AppendLittleEndian(payload, static_cast<int32_t>(document_id));
+    AppendLittleEndian(payload, static_cast<uint8_t>(status));
+    AppendLittleEndian(payload, static_cast<uint32_t>(ratings.size()));
+    for (const int rating : ratings) {
+        AppendLittleEndian(payload, static_cast<int32_t>(rating));
+    }
+    payload += document;
+    try {
+        Append(MakeRecord(payload));
+    }
+    catch (...) {
+        search_server.RemoveDocument(document_id);
+        throw;
+    }
+}
+
+void WriteAheadLog::RemoveDocument(SearchServer& search_server, int document_id) {
+    string payload;
+    AppendLittleEndian(payload, static_cast<uint8_t>(RecordType::REMOVE_DOCUMENT));
+    AppendLittleEndian(payload, static_cast<int32_t>(document_id));
+    Append(MakeRecord(payload));
+    search_server.RemoveDocument(document_id);
+}
+
+void WriteAheadLog::Sync() {
+    {
+        lock_guard lock(mutex_);
+        if (error_) {
+            rethrow_exception(exchange(error_, nullptr));
+        }
+    }
+    Flush(true);
+}
+
+void WriteAheadLog::WaitForSyncs(uint64_t syncs) const {
+    unique_lock lock(mutex_);
+    synced_.wait(lock, [this, syncs] {
+        return stats_.syncs >= syncs || error_;
+        });
+}
+
+void WriteAheadLog::Reset() {
+    lock_guard file_lock(file_mutex_);
+    {
+        lock_guard lock(mutex_);
+        pending_.clear();
+        pending_records_ = 0;
+        // the error belongs to the discarded records
+        error_ = nullptr;
+    }
+    if (ftruncate(fd_, 0) != 0 || fdatasync(fd_) != 0) {
+        throw runtime_error("Не удалось очистить журнал: "s + strerror(errno));
+    }
+}
+
+WriteAheadLog::Stats WriteAheadLog::GetStats() const {
+    lock_guard lock(mutex_);
+    return stats_;
+}
+
+void WriteAheadLog::Append(const string& record) {
+    if (options_.durability != WalDurability::GROUP_COMMIT) {
+        const bool sync = options_.durability == WalDurability::SYNC;
+        lock_guard file_lock(file_mutex_);
+        Write(record, sync);
+        lock_guard lock(mutex_);
+        ++stats_.records;
+        stats_.bytes += record.size();
+        if (sync) {
+            ++stats_.syncs;
+            synced_.notify_all();
+        }
+        return;
+    }
+    bool flush = false;
+    {
+        lock_guard lock(mutex_);
+        if (error_) {
+            rethrow_exception(exchange(error_, nullptr));
+        }
+        if (pending_.empty()) {
+            first_pending_ = Clock::now();
+            records_pending_.notify_one();
+        }
+        pending_ += record;
+        ++pending_records_;
+        ++stats_.records;
+        stats_.bytes += record.size();
+        flush = pending_records_ >= options_.group_commit_size;
+    }
+    if (flush) {
+        // the record is logged once queued, a failed group stays queued for the next flush
+        try {
+            Flush(true);
+        }
+        catch (const runtime_error&) {
+            lock_guard lock(mutex_);
+            error_ = current_exception();
+        }
+    }
+}
+
+void WriteAheadLog::Flush(bool sync) {
+    // the file lock keeps the groups in order, appending goes on while a group is synced
+    lock_guard file_lock(file_mutex_);
+    string group;
+    size_t group_records = 0;
+    {
+        lock_guard lock(mutex_);
+        group.swap(pending_);
+        group_records = exchange(pending_records_, 0);
+    }
+    if (group.empty()) {
+        return;
+    }
+    try {
+        Write(group, sync);
+    }
+    catch (const runtime_error&) {
+        lock_guard lock(mutex_);
+        group += pending_;
+        pending_.swap(group);
+        pending_records_ += group_records;
+        // the flushing thread tries again after an interval, not at once
+        first_pending_ = Clock::now();
+        throw;
+    }
+    if (sync) {
+        lock_guard lock(mutex_);
+        ++stats_.syncs;
+        synced_.notify_all();
+    }
+}
+
+void WriteAheadLog::Write(string_view data, bool sync) {
+    const off_t start = lseek(fd_, 0, SEEK_END);
+    if (start < 0) {
+        throw runtime_error("Не удалось записать журнал: "s + strerror(errno));
+    }
+    try {
+        WriteAll(fd_, data);
+        if (sync && fdatasync(fd_) != 0) {
+            throw runtime_error("Не удалось сохранить журнал на диск: "s + strerror(errno));
+        }
+    }
+    catch (const runtime_error&) {
+        // the data is written again whole or not at all, a part left behind would end the replay
+        // when the cut fails too, the replay stops at the torn record
+        [[maybe_unused]] const int truncated = ftruncate(fd_, start);
+        throw;
+    }
+}
+
+void WriteAheadLog::FlushPeriodically() {
+    unique_lock lock(mutex_);
+    while (!stopping_) {
+        if (pending_.empty()) {
+            records_pending_.wait(lock);
+            continue;
+        }
+        const auto deadline = first_pending_ + options_.group_commit_interval;
+        if (Clock::now() < deadline) {
+            records_pending_.wait_until(lock, deadline);
+            continue;
+        }
+        lock.unlock();
+        try {
+            Flush(true);
+        }
+        catch (const runtime_error&) {
+            lock.lock();
+            error_ = current_exception();
+            synced_.notify_all();
+            continue;
+        }
+        lock.lock();
+    }
+}
+
+WalReplayResult ReplayWriteAheadLog(SearchServer& search_server, const string& path) {
+    if (access(path.c_str(), F_OK) != 0) {
+        return {};
+    }
+    WalReplayResult result;
+    size_t valid_size = 0;
+    size_t total_size = 0;
+    {
+        const MappedFile file(path);
+        string_view data = file.GetData();
+        total_size = data.size();
+        while (!data.empty()) {
+            string_view header = data;
+            const auto payload_size = ReadInteger<uint32_t>(header);
+            const auto checksum = ReadInteger<uint32_t>(header);
+            if (!payload_size || !checksum || header.size() < *payload_size) {
+                break;
+            }
+            const string_view payload = header.substr(0, *payload_size);
+            if (ComputeCrc32(payload) != *checksum) {
+                break;
+            }
+            if (!ApplyRecord(search_server, payload)) {
+                throw invalid_argument("Не удалось разобрать запись журнала "s + path + " по смещению "s
+                    + to_string(valid_size));
+            }
+            ++result.records;
+            data.remove_prefix(RECORD_HEADER_SIZE + *payload_size);
+            valid_size += RECORD_HEADER_SIZE + *payload_size;
+        }
+    }
+    result.discarded_bytes = total_size - valid_size;
+    if (result.discarded_bytes > 0 && truncate(path.c_str(), static_cast<off_t>(valid_size)) != 0) {
+        throw runtime_error("Не удалось обрезать журнал "s + path + ": "s + strerror(errno));
+    }
+    return result;
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include "document.h"
+#include "search_server.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <exception>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+enum class WalDurability {
+    // every record is written to the file at once but never synced: survives a crash of
+    // the process, not of the machine
+    WRITE,
+    // records are written and synced in groups, a crash of the machine loses at most the
+    // last group_commit_size records or group_commit_interval of them
+    GROUP_COMMIT,
+    // every record is synced before the call returns
+    SYNC,
+};
+
+struct WalOptions {
+    WalDurability durability = WalDurability::GROUP_COMMIT;
+    size_t group_commit_size = 256;
+    std::chrono::milliseconds group_commit_interval{ 10 };
+};
+
+/**
+ * Append-only log of the changes of a SearchServer, so a server rebuilt after a restart
+ * can be brought back to its last state. The log is replayed on top of the state the
+ * server was built from, such as a LoadDocuments file, and is cleared with Reset once
+ * that base is rewritten with the logged changes.
+ *
+ * The log and the server never disagree on a change. A removal, which the server never
+ * rejects, is logged before it is applied. An addition is applied first, so a document the
+ * server rejects is never logged, and is removed again when its record cannot be logged.
+ * A record that fails to be written leaves nothing in the file: the file is cut back to
+ * where the record started. With group commit a record is logged once it is queued; a group
+ * that fails to be written stays queued for the next flush and its error is thrown by the
+ * next call. Every record carries its length and a CRC-32 of its contents, a torn write at
+ * the end of the log is detected and cut off on replay.
+ *
+ * Пример использования:
+ *
+ *  SearchServer search_server("и в на"s);
+ *  LoadDocuments(search_server, "documents.tsv"s);
+ *  ReplayWriteAheadLog(search_server, "documents.wal"s);
+ *  WriteAheadLog log("documents.wal"s);
+ *  log.AddDocument(search_server, 100, "пушистый кот"s, DocumentStatus::ACTUAL, { 5 });
+ */
+class WriteAheadLog {
+public:
+    struct Stats {
+        uint64_t records = 0;
+        uint64_t bytes = 0;
+        uint64_t syncs = 0;
+    };
+
+    // opens the log for appending, throws runtime_error when it cannot be opened
+    explicit WriteAheadLog(const std::string& path, WalOptions options = {});
+
+    WriteAheadLog(const WriteAheadLog&) = delete;
+    WriteAheadLog& operator=(const WriteAheadLog&) = delete;
+
+    // writes and syncs the pending records
+    ~WriteAheadLog();
+
+    // search_server.AddDocument, then the record. A write error of the log throws runtime_error
+    // and the document is removed from the server again
+    void AddDocument(SearchServer& search_server, int document_id, std::string_view document, DocumentStatus status,
+        const std::vector<int>& ratings);
+
+    // the record, then search_server.RemoveDocument. A write error of the log throws
+    // runtime_error and the document stays
+    void RemoveDocument(SearchServer& search_server, int document_id);
+
+    // every record appended so far is on disk when Sync returns
+    void Sync();
+
+    // waits until syncs groups in total are synced, by the flushing thread or by callers,
+    // or until a write of the flushing thread fails
+    void WaitForSyncs(uint64_t syncs) const;
+
+    // empties the log once its changes are part of the base the server is rebuilt from,
+    // together with the error of a failed group flush
+    void Reset();
+
+    Stats GetStats() const;
+
+private:
+    const WalOptions options_;
+    int fd_ = -1;
+
+    // guards pending_, error_, stopping_ and stats_
+    mutable std::mutex mutex_;
+    std::condition_variable records_pending_;
+    mutable std::condition_variable synced_;
+    std::string pending_;
+    size_t pending_records_ = 0;
+    std::chrono::steady_clock::time_point first_pending_;
+    // a write error of the flushing thread, rethrown to the next caller
+    std::exception_ptr error_;
+    bool stopping_ = false;
+    Stats stats_;
+
+    // serializes writes to the file, taken before mutex_
+    std::mutex file_mutex_;
+
+    // writes the group commit interval, started last
+    std::thread flusher_;
+
+    // throws when the record is not logged
+    void Append(const std::string& record);
+
+    // writes the pending records and syncs them when sync is set, a group that fails to
+    // be written is queued again in front of the later records
+    void Flush(bool sync);
+
+    // writes data at the end of the file, cuts the file back and throws on an error;
+    // takes file_mutex_ held
+    void Write(std::string_view data, bool sync);
+
+    void FlushPeriodically();
+};
+
+struct WalReplayResult {
+    size_t records = 0;
+    // bytes of a torn or corrupt record at the end that were cut off
+    size_t discarded_bytes = 0;
+};
+
+// Applies the records of the log to search_server in order. The first record with a wrong
+// length or checksum ends the replay and the log is truncated before it, so appending may
+// go on. A record with a right checksum that does not decode or that the server rejects
+// throws invalid_argument and the log is left as is: it was written so, it does not belong
+// to this version or the log does not match the base of the server. A missing log is an
+// empty one
+WalReplayResult ReplayWriteAheadLog(SearchServer& search_server, const std::string& path);